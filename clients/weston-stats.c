@@ -0,0 +1,303 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wayland-client.h>
+
+#include "shared/helpers.h"
+#include "shared/zalloc.h"
+#include "weston-stats-client-protocol.h"
+
+struct output {
+	struct wl_list link;
+	struct wl_output *wl_output;
+	struct weston_output_stats *stats;
+	char *make;
+	char *model;
+	bool done;
+};
+
+struct stats_client {
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct weston_stats *stats;
+	uint32_t stats_version;
+	struct wl_list output_list;
+	bool clients_done;
+};
+
+static void
+output_handle_geometry(void *data, struct wl_output *wl_output,
+		       int32_t x, int32_t y,
+		       int32_t physical_width, int32_t physical_height,
+		       int32_t subpixel,
+		       const char *make, const char *model,
+		       int32_t output_transform)
+{
+	struct output *output = data;
+
+	free(output->make);
+	free(output->model);
+	output->make = strdup(make);
+	output->model = strdup(model);
+}
+
+static void
+output_handle_mode(void *data, struct wl_output *wl_output,
+		   uint32_t flags, int32_t width, int32_t height,
+		   int32_t refresh)
+{
+}
+
+static const struct wl_output_listener output_listener = {
+	output_handle_geometry,
+	output_handle_mode,
+};
+
+static void
+stats_handle_histogram(void *data, struct weston_output_stats *stats,
+		       const char *name, uint32_t count, uint32_t min,
+		       uint32_t avg, uint32_t p50, uint32_t p99, uint32_t max)
+{
+	printf("  %-18s %8u %8u %8u %8u %8u %8u\n",
+	       name, count, min, avg, p50, p99, max);
+}
+
+static void
+stats_handle_frames(void *data, struct weston_output_stats *stats,
+		    uint32_t presented, uint32_t missed)
+{
+	printf("  frames presented: %u, missed: %u\n", presented, missed);
+}
+
+static void
+stats_handle_repicks(void *data, struct weston_output_stats *stats,
+		     uint32_t repicked, uint32_t skipped)
+{
+	printf("  pointer repicks: %u, skipped: %u\n", repicked, skipped);
+}
+
+static void
+stats_handle_done(void *data, struct weston_output_stats *stats)
+{
+	struct output *output = data;
+
+	output->done = true;
+}
+
+static const struct weston_output_stats_listener stats_listener = {
+	stats_handle_histogram,
+	stats_handle_frames,
+	stats_handle_done,
+	stats_handle_repicks,
+};
+
+static void
+weston_stats_handle_client(void *data, struct weston_stats *stats,
+			   int32_t pid, const char *name, uint32_t commits,
+			   uint32_t request_usec, uint32_t render_usec,
+			   uint32_t bytes_uploaded, uint32_t pixels_composited)
+{
+	printf("  %8d %-16s %8u %10u %10u %10u %12u\n",
+	       pid, name, commits, request_usec, render_usec,
+	       bytes_uploaded / 1024, pixels_composited);
+}
+
+static void
+weston_stats_handle_clients_done(void *data, struct weston_stats *stats)
+{
+	struct stats_client *client = data;
+
+	client->clients_done = true;
+}
+
+static const struct weston_stats_listener weston_stats_listener = {
+	weston_stats_handle_client,
+	weston_stats_handle_clients_done,
+};
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry,
+		       uint32_t id, const char *interface, uint32_t version)
+{
+	struct stats_client *client = data;
+	struct output *output;
+
+	if (strcmp(interface, "weston_stats") == 0) {
+		client->stats_version = MIN(version, 3);
+		client->stats = wl_registry_bind(registry, id,
+						 &weston_stats_interface,
+						 client->stats_version);
+		weston_stats_add_listener(client->stats,
+					  &weston_stats_listener, client);
+	} else if (strcmp(interface, "wl_output") == 0) {
+		output = zalloc(sizeof *output);
+		if (!output)
+			return;
+
+		output->wl_output = wl_registry_bind(registry, id,
+						     &wl_output_interface, 1);
+		wl_output_add_listener(output->wl_output, &output_listener,
+				       output);
+		wl_list_insert(client->output_list.prev, &output->link);
+	}
+}
+
+static void
+registry_handle_global_remove(void *data, struct wl_registry *registry,
+			      uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_handle_global,
+	registry_handle_global_remove
+};
+
+static void
+print_output_stats(struct stats_client *client, struct output *output,
+		   int index)
+{
+	printf("output %d: %s %s\n", index,
+	       output->make ? output->make : "unknown",
+	       output->model ? output->model : "unknown");
+	printf("  %-18s %8s %8s %8s %8s %8s %8s\n",
+	       "usec", "count", "min", "avg", "p50", "p99", "max");
+
+	output->stats = weston_stats_get_output_stats(client->stats,
+						      output->wl_output);
+	weston_output_stats_add_listener(output->stats, &stats_listener,
+					 output);
+
+	while (!output->done)
+		if (wl_display_dispatch(client->display) < 0)
+			break;
+}
+
+static void
+print_client_stats(struct stats_client *client)
+{
+	printf("clients, per second, most expensive first:\n");
+	printf("  %8s %-16s %8s %10s %10s %10s %12s\n",
+	       "pid", "name", "commits", "req usec", "render usec",
+	       "upload KiB", "pixels");
+
+	weston_stats_list_clients(client->stats);
+
+	while (!client->clients_done)
+		if (wl_display_dispatch(client->display) < 0)
+			break;
+}
+
+static void
+usage(const char *prog, int exit_code)
+{
+	fprintf(stderr, "Usage: %s [options]\n"
+		"Print the repaint statistics of every output, in "
+		"microseconds,\nand the cost of every client.\n"
+		"Weston must run with --debug.\n\n"
+		"  -r, --reset\tclear the statistics after printing them\n"
+		"  -h, --help\tthis help message\n",
+		prog);
+
+	exit(exit_code);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct stats_client client = { 0 };
+	struct output *output, *tmp;
+	bool reset = false;
+	int i, index = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-r") == 0 ||
+		    strcmp(argv[i], "--reset") == 0)
+			reset = true;
+		else if (strcmp(argv[i], "-h") == 0 ||
+			 strcmp(argv[i], "--help") == 0)
+			usage(argv[0], EXIT_SUCCESS);
+		else
+			usage(argv[0], EXIT_FAILURE);
+	}
+
+	client.display = wl_display_connect(NULL);
+	if (!client.display) {
+		fprintf(stderr, "failed to create display: %m\n");
+		return -1;
+	}
+
+	wl_list_init(&client.output_list);
+	client.registry = wl_display_get_registry(client.display);
+	wl_registry_add_listener(client.registry, &registry_listener, &client);
+
+	/* One roundtrip for the globals, one for the output geometry. */
+	wl_display_roundtrip(client.display);
+	wl_display_roundtrip(client.display);
+
+	if (!client.stats) {
+		fprintf(stderr, "weston_stats is not advertised, "
+			"is weston running with --debug?\n");
+		return -1;
+	}
+
+	wl_list_for_each(output, &client.output_list, link) {
+		if (index > 0)
+			printf("\n");
+		print_output_stats(&client, output, index++);
+		if (reset)
+			weston_output_stats_reset(output->stats);
+	}
+
+	if (client.stats_version >= 2) {
+		printf("\n");
+		print_client_stats(&client);
+	}
+
+	wl_display_roundtrip(client.display);
+
+	wl_list_for_each_safe(output, tmp, &client.output_list, link) {
+		if (output->stats)
+			weston_output_stats_destroy(output->stats);
+		wl_output_destroy(output->wl_output);
+		free(output->make);
+		free(output->model);
+		free(output);
+	}
+
+	weston_stats_destroy(client.stats);
+	wl_registry_destroy(client.registry);
+	wl_display_disconnect(client.display);
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "histogram.h"
+
+static unsigned
+bucket_index(uint32_t value)
+{
+	unsigned e;
+
+	if (value < 16)
+		return value;
+
+	/* e is the position of the highest bit set, at least 4 */
+	e = 31 - __builtin_clz(value);
+
+	return 16 + (e - 4) * 8 + ((value >> (e - 3)) & 7);
+}
+
+static uint32_t
+bucket_upper_bound(unsigned index)
+{
+	unsigned e, sub;
+
+	if (index < 16)
+		return index;
+
+	e = 4 + (index - 16) / 8;
+	sub = (index - 16) % 8;
+
+	return ((8 + sub) << (e - 3)) + (1u << (e - 3)) - 1;
+}
+
+void
+weston_histogram_init(struct weston_histogram *h)
+{
+	memset(h, 0, sizeof *h);
+	h->min = UINT32_MAX;
+}
+
+void
+weston_histogram_add(struct weston_histogram *h, uint32_t value)
+{
+	h->buckets[bucket_index(value)]++;
+	h->count++;
+	h->sum += value;
+
+	if (value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+}
+
+/** Average of the values added, 0 if there are none */
+uint32_t
+weston_histogram_mean(const struct weston_histogram *h)
+{
+	if (h->count == 0)
+		return 0;
+
+	return h->sum / h->count;
+}
+
+/** Estimate a percentile
+ *
+ * \param h The histogram.
+ * \param percent The percentile, from 0 to 100.
+ * \return The upper bound of the bucket holding the percentile,
+ * clamped to the exact minimum and maximum, or 0 if the histogram is
+ * empty.
+ */
+uint32_t
+weston_histogram_percentile(const struct weston_histogram *h,
+			    unsigned percent)
+{
+	uint64_t rank, seen = 0;
+	uint32_t value;
+	unsigned i;
+
+	if (h->count == 0)
+		return 0;
+
+	if (percent > 100)
+		percent = 100;
+
+	/* The rank of the percentile, rounded up and at least 1 */
+	rank = (h->count * percent + 99) / 100;
+	if (rank == 0)
+		rank = 1;
+
+	for (i = 0; i < WESTON_HISTOGRAM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+
+	value = bucket_upper_bound(i);
+	if (value < h->min)
+		value = h->min;
+	if (value > h->max)
+		value = h->max;
+
+	return value;
+}
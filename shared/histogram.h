@@ -0,0 +1,69 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_HISTOGRAM_H
+#define WESTON_HISTOGRAM_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Fixed-size histogram of unsigned 32-bit values, typically durations
+ * in microseconds. Values below 16 get a bucket each; larger ones are
+ * split in 8 buckets per power of two, so percentiles are accurate to
+ * 12.5%. Count, sum, min and max are exact.
+ */
+
+#define WESTON_HISTOGRAM_BUCKETS (16 + 28 * 8)
+
+struct weston_histogram {
+	uint32_t buckets[WESTON_HISTOGRAM_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint32_t min;
+	uint32_t max;
+};
+
+void
+weston_histogram_init(struct weston_histogram *h);
+
+void
+weston_histogram_add(struct weston_histogram *h, uint32_t value);
+
+uint32_t
+weston_histogram_mean(const struct weston_histogram *h);
+
+uint32_t
+weston_histogram_percentile(const struct weston_histogram *h,
+			    unsigned percent);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* WESTON_HISTOGRAM_H */
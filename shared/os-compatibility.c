@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -195,6 +196,67 @@ os_create_anonymous_file(off_t size)
 	return fd;
 }
 
+static int
+write_all(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+	ssize_t len;
+
+	while (size > 0) {
+		len = write(fd, p, size);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += len;
+		size -= len;
+	}
+
+	return 0;
+}
+
+/*
+ * Create an anonymous file holding a copy of the given data, that
+ * nobody can modify anymore, and return the file descriptor for it.
+ * The file descriptor is set CLOEXEC.
+ *
+ * Where memfd_create() and file sealing are available, the file is
+ * sealed against writes and size changes, so it can be handed to any
+ * number of untrusted clients, which can only map it for reading.
+ * Otherwise, and whenever creating or sealing the memfd fails for any
+ * reason, this falls back to os_create_anonymous_file(), and clients
+ * that get the file descriptor can still write to it.
+ */
+int
+os_create_sealed_anonymous_file(const void *data, size_t size)
+{
+	int fd;
+
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+	fd = memfd_create("weston-shared", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd >= 0) {
+		if (write_all(fd, data, size) == 0 &&
+		    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+			  F_SEAL_WRITE | F_SEAL_SEAL) == 0)
+			return fd;
+
+		close(fd);
+	}
+#endif
+
+	fd = os_create_anonymous_file(size);
+	if (fd < 0)
+		return -1;
+
+	if (write_all(fd, data, size) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c)
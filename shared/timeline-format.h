@@ -0,0 +1,85 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_TIMELINE_FORMAT_H
+#define WESTON_TIMELINE_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * Binary timeline log format
+ *
+ * A log starts with a struct weston_timeline_header, followed by a
+ * stream of fixed-size struct weston_timeline_record. Point names and
+ * objects are interned: they are described once by a definition record
+ * before the first point referring to them. The text of a definition is
+ * stored, without terminating NUL, in the raw bytes of the
+ * DIV_ROUNDUP(aux, sizeof(struct weston_timeline_record)) records
+ * directly following it. All values are in host byte order.
+ */
+
+#define WESTON_TIMELINE_MAGIC 0x4c545357	/* "WSTL" */
+#define WESTON_TIMELINE_VERSION 1
+
+struct weston_timeline_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t clock_id;
+};
+
+enum weston_timeline_record_type {
+	WESTON_TIMELINE_RECORD_POINT = 1,
+	/* defines a point name */
+	WESTON_TIMELINE_RECORD_NAME,
+	/* defines a weston_output, the text is the output name */
+	WESTON_TIMELINE_RECORD_OUTPUT,
+	/* defines a weston_surface, the text is its label */
+	WESTON_TIMELINE_RECORD_SURFACE,
+};
+
+/* point flags */
+#define WESTON_TIMELINE_POINT_VBLANK (1 << 0)
+/* the vblank is a PRESENTATION_FEEDBACK_INVALID stamp, e.g. when the
+ * repaint loop restarts, and not a real presentation */
+#define WESTON_TIMELINE_POINT_VBLANK_INVALID (1 << 1)
+
+struct weston_timeline_record {
+	uint16_t type;
+	/* point: flags, definition: length of the text */
+	uint16_t aux;
+	/* point: name id, definition: the id being defined */
+	uint32_t id;
+	/* point: time in nanoseconds on the header clock */
+	uint64_t time;
+	/* point: output id, surface definition: main surface id */
+	uint32_t output;
+	/* point: surface id */
+	uint32_t surface;
+	/* point: vblank time in nanoseconds */
+	uint64_t vblank;
+};
+
+#endif /* WESTON_TIMELINE_FORMAT_H */
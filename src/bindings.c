@@ -39,8 +39,39 @@ struct weston_binding {
 	void *handler;
 	void *data;
 	struct wl_list link;
+	struct wl_list hash_link;	/* in a weston_binding_table bucket */
 };
 
+void
+weston_binding_table_init(struct weston_binding_table *table)
+{
+	int i;
+
+	for (i = 0; i < WESTON_BINDING_TABLE_SIZE; i++)
+		wl_list_init(&table->buckets[i]);
+}
+
+static struct wl_list *
+binding_table_bucket(struct weston_binding_table *table,
+		     uint32_t code, uint32_t modifier)
+{
+	uint32_t hash = code * 0x9e3779b1 ^ modifier * 0x85ebca6b;
+
+	hash ^= hash >> 16;
+
+	return &table->buckets[hash & (WESTON_BINDING_TABLE_SIZE - 1)];
+}
+
+static void
+binding_table_insert(struct weston_binding_table *table,
+		     struct weston_binding *binding, uint32_t code)
+{
+	struct wl_list *bucket =
+		binding_table_bucket(table, code, binding->modifier);
+
+	wl_list_insert(bucket->prev, &binding->hash_link);
+}
+
 static struct weston_binding *
 weston_compositor_add_binding(struct weston_compositor *compositor,
 			      uint32_t key, uint32_t button, uint32_t axis,
@@ -58,6 +89,7 @@ weston_compositor_add_binding(struct weston_compositor *compositor,
 	binding->modifier = modifier;
 	binding->handler = handler;
 	binding->data = data;
+	wl_list_init(&binding->hash_link);
 
 	return binding;
 }
@@ -76,6 +108,7 @@ weston_compositor_add_key_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->key_binding_list.prev, &binding->link);
+	binding_table_insert(&compositor->key_binding_table, binding, key);
 
 	return binding;
 }
@@ -112,6 +145,8 @@ weston_compositor_add_button_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->button_binding_list.prev, &binding->link);
+	binding_table_insert(&compositor->button_binding_table, binding,
+			     button);
 
 	return binding;
 }
@@ -148,6 +183,7 @@ weston_compositor_add_axis_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->axis_binding_list.prev, &binding->link);
+	binding_table_insert(&compositor->axis_binding_table, binding, axis);
 
 	return binding;
 }
@@ -164,6 +200,7 @@ weston_compositor_add_debug_binding(struct weston_compositor *compositor,
 						handler, data);
 
 	wl_list_insert(compositor->debug_binding_list.prev, &binding->link);
+	binding_table_insert(&compositor->debug_binding_table, binding, key);
 
 	return binding;
 }
@@ -172,6 +209,7 @@ WL_EXPORT void
 weston_binding_destroy(struct weston_binding *binding)
 {
 	wl_list_remove(&binding->link);
+	wl_list_remove(&binding->hash_link);
 	free(binding);
 }
 
@@ -287,6 +325,7 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 	struct weston_binding *b, *tmp;
 	struct weston_surface *focus;
 	struct weston_seat *seat = keyboard->seat;
+	struct wl_list *bucket;
 
 	if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
 		return;
@@ -295,7 +334,9 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 	wl_list_for_each(b, &compositor->modifier_binding_list, link)
 		b->key = key;
 
-	wl_list_for_each_safe(b, tmp, &compositor->key_binding_list, link) {
+	bucket = binding_table_bucket(&compositor->key_binding_table,
+				      key, seat->modifier_state);
+	wl_list_for_each_safe(b, tmp, bucket, hash_link) {
 		if (b->key == key && b->modifier == seat->modifier_state) {
 			weston_key_binding_handler_t handler = b->handler;
 			focus = keyboard->focus;
@@ -352,6 +393,7 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 				     enum wl_pointer_button_state state)
 {
 	struct weston_binding *b, *tmp;
+	struct wl_list *bucket;
 
 	if (state == WL_POINTER_BUTTON_STATE_RELEASED)
 		return;
@@ -360,7 +402,9 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 	wl_list_for_each(b, &compositor->modifier_binding_list, link)
 		b->key = button;
 
-	wl_list_for_each_safe(b, tmp, &compositor->button_binding_list, link) {
+	bucket = binding_table_bucket(&compositor->button_binding_table,
+				      button, pointer->seat->modifier_state);
+	wl_list_for_each_safe(b, tmp, bucket, hash_link) {
 		if (b->button == button &&
 		    b->modifier == pointer->seat->modifier_state) {
 			weston_button_binding_handler_t handler = b->handler;
@@ -394,12 +438,15 @@ weston_compositor_run_axis_binding(struct weston_compositor *compositor,
 				   wl_fixed_t value)
 {
 	struct weston_binding *b, *tmp;
+	struct wl_list *bucket;
 
 	/* Invalidate all active modifier bindings. */
 	wl_list_for_each(b, &compositor->modifier_binding_list, link)
 		b->key = axis;
 
-	wl_list_for_each_safe(b, tmp, &compositor->axis_binding_list, link) {
+	bucket = binding_table_bucket(&compositor->axis_binding_table,
+				      axis, pointer->seat->modifier_state);
+	wl_list_for_each_safe(b, tmp, bucket, hash_link) {
 		if (b->axis == axis &&
 		    b->modifier == pointer->seat->modifier_state) {
 			weston_axis_binding_handler_t handler = b->handler;
@@ -419,9 +466,13 @@ weston_compositor_run_debug_binding(struct weston_compositor *compositor,
 {
 	weston_key_binding_handler_t handler;
 	struct weston_binding *binding, *tmp;
+	struct wl_list *bucket;
 	int count = 0;
 
-	wl_list_for_each_safe(binding, tmp, &compositor->debug_binding_list, link) {
+	/* Debug bindings have no modifier. */
+	bucket = binding_table_bucket(&compositor->debug_binding_table,
+				      key, 0);
+	wl_list_for_each_safe(binding, tmp, bucket, hash_link) {
 		if (key != binding->key)
 			continue;
 
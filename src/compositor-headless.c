@@ -28,10 +28,13 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
+#include <sys/eventfd.h>
 #include <stdbool.h>
 
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 #include "compositor.h"
 #include "pixman-renderer.h"
 #include "presentation_timing-server-protocol.h"
@@ -41,12 +44,19 @@ struct headless_backend {
 	struct weston_compositor *compositor;
 	struct weston_seat fake_seat;
 	bool use_pixman;
+	bool unthrottled;
+	bool virtual_clock;
 };
 
 struct headless_output {
 	struct weston_output base;
 	struct weston_mode mode;
 	struct wl_event_source *finish_frame_timer;
+	/* In unthrottled mode, frames complete through an eventfd rather
+	 * than a timer, so that clients still get dispatched in between */
+	int finish_frame_fd;
+	struct wl_event_source *finish_frame_source;
+	int frame_msec;
 	uint32_t *image_buf;
 	pixman_image_t *image;
 };
@@ -54,7 +64,10 @@ struct headless_output {
 struct headless_parameters {
 	int width;
 	int height;
+	int refresh;
 	int use_pixman;
+	int unthrottled;
+	int virtual_clock;
 	uint32_t transform;
 };
 
@@ -67,14 +80,48 @@ headless_output_start_repaint_loop(struct weston_output *output)
 	weston_output_finish_frame(output, &ts, PRESENTATION_FEEDBACK_INVALID);
 }
 
+static void
+headless_output_finish_frame(struct headless_output *output)
+{
+	struct weston_compositor *ec = output->base.compositor;
+	struct headless_backend *b = (struct headless_backend *) ec->backend;
+	struct timespec ts;
+	int64_t now, period;
+
+	/* The virtual clock moves to the next vblank of the mode, so that
+	 * presentation times are exact multiples of the refresh period. */
+	if (b->virtual_clock) {
+		weston_compositor_read_presentation_clock(ec, &ts);
+		now = timespec_to_nsec(&ts);
+		period = millihz_to_nsec(output->mode.refresh);
+		weston_compositor_advance_presentation_clock(ec,
+				(now / period + 1) * period - now);
+	}
+
+	weston_compositor_read_presentation_clock(ec, &ts);
+	weston_output_finish_frame(&output->base, &ts, 0);
+}
+
 static int
 finish_frame_handler(void *data)
 {
 	struct headless_output *output = data;
-	struct timespec ts;
 
-	weston_compositor_read_presentation_clock(output->base.compositor, &ts);
-	weston_output_finish_frame(&output->base, &ts, 0);
+	headless_output_finish_frame(output);
+
+	return 1;
+}
+
+static int
+finish_frame_fd_handler(int fd, uint32_t mask, void *data)
+{
+	struct headless_output *output = data;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof count) != sizeof count)
+		return 0;
+
+	headless_output_finish_frame(output);
 
 	return 1;
 }
@@ -91,7 +138,15 @@ headless_output_repaint(struct weston_output *output_base,
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
-	wl_event_source_timer_update(output->finish_frame_timer, 16);
+	if (output->finish_frame_source) {
+		uint64_t one = 1;
+
+		if (write(output->finish_frame_fd, &one, sizeof one) != sizeof one)
+			weston_log("failed to complete headless frame: %m\n");
+	} else {
+		wl_event_source_timer_update(output->finish_frame_timer,
+					     output->frame_msec);
+	}
 
 	return 0;
 }
@@ -104,6 +159,10 @@ headless_output_destroy(struct weston_output *output_base)
 			(struct headless_backend *) output->base.compositor->backend;
 
 	wl_event_source_remove(output->finish_frame_timer);
+	if (output->finish_frame_source) {
+		wl_event_source_remove(output->finish_frame_source);
+		close(output->finish_frame_fd);
+	}
 
 	if (b->use_pixman) {
 		pixman_renderer_output_destroy(&output->base);
@@ -134,7 +193,7 @@ headless_backend_create_output(struct headless_backend *b,
 		WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED;
 	output->mode.width = param->width;
 	output->mode.height = param->height;
-	output->mode.refresh = 60000;
+	output->mode.refresh = param->refresh;
 	wl_list_init(&output->base.mode_list);
 	wl_list_insert(&output->base.mode_list, &output->mode.link);
 
@@ -149,6 +208,22 @@ headless_backend_create_output(struct headless_backend *b,
 	output->finish_frame_timer =
 		wl_event_loop_add_timer(loop, finish_frame_handler, output);
 
+	output->frame_msec = millihz_to_nsec(param->refresh) / 1000000;
+	if (output->frame_msec < 1)
+		output->frame_msec = 1;
+
+	if (b->unthrottled) {
+		output->finish_frame_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (output->finish_frame_fd < 0)
+			return -1;
+
+		output->finish_frame_source =
+			wl_event_loop_add_fd(loop, output->finish_frame_fd,
+					     WL_EVENT_READABLE,
+					     finish_frame_fd_handler, output);
+		output->base.unthrottled = true;
+	}
+
 	output->base.start_repaint_loop = headless_output_start_repaint_loop;
 	output->base.repaint = headless_output_repaint;
 	output->base.destroy = headless_output_destroy;
@@ -227,8 +302,19 @@ headless_backend_create(struct weston_compositor *compositor,
 		return NULL;
 
 	b->compositor = compositor;
-	if (weston_compositor_set_presentation_clock_software(compositor) < 0)
+	b->unthrottled = param->unthrottled;
+	b->virtual_clock = param->virtual_clock;
+
+	if (b->virtual_clock) {
+		/* Not zero, which the statistics take for no time at all */
+		struct timespec start = { 1, 0 };
+
+		if (weston_compositor_set_presentation_clock_virtual(compositor,
+								     &start) < 0)
+			goto err_free;
+	} else if (weston_compositor_set_presentation_clock_software(compositor) < 0) {
 		goto err_free;
+	}
 
 	if (headless_input_create(b) < 0)
 		goto err_free;
@@ -262,7 +348,7 @@ backend_init(struct weston_compositor *compositor,
 	     int *argc, char *argv[],
 	     struct weston_config *config)
 {
-	int width = 1024, height = 640;
+	int width = 1024, height = 640, refresh = 60000;
 	char *display_name = NULL;
 	struct headless_parameters param = { 0, };
 	const char *transform = "normal";
@@ -273,6 +359,9 @@ backend_init(struct weston_compositor *compositor,
 		{ WESTON_OPTION_INTEGER, "height", 0, &height },
 		{ WESTON_OPTION_BOOLEAN, "use-pixman", 0, &param.use_pixman },
 		{ WESTON_OPTION_STRING, "transform", 0, &transform },
+		{ WESTON_OPTION_INTEGER, "refresh-rate", 0, &refresh },
+		{ WESTON_OPTION_BOOLEAN, "unthrottled", 0, &param.unthrottled },
+		{ WESTON_OPTION_BOOLEAN, "virtual-clock", 0, &param.virtual_clock },
 	};
 
 	parse_options(headless_options,
@@ -281,6 +370,12 @@ backend_init(struct weston_compositor *compositor,
 	param.width = width;
 	param.height = height;
 
+	if (refresh <= 0) {
+		weston_log("Invalid refresh rate %d, using 60000 mHz\n", refresh);
+		refresh = 60000;
+	}
+	param.refresh = refresh;
+
 	if (weston_parse_transform(transform, &param.transform) < 0)
 		weston_log("Invalid transform \"%s\"\n", transform);
 
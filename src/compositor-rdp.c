@@ -28,6 +28,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <linux/input.h>
 
 #if HAVE_FREERDP_VERSION_H
@@ -72,6 +74,9 @@
 #define MAX_FREERDP_FDS 32
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int(10)
 #define RDP_MODE_FREQ 60 * 1000
+#define RDP_ENCODER_MAX_THREADS 16
+#define RDP_ENCODER_MAX_JOBS (2 * RDP_ENCODER_MAX_THREADS)
+#define RDP_TILE_SIZE 64
 
 struct rdp_backend_config {
 	int width;
@@ -83,10 +88,65 @@ struct rdp_backend_config {
 	char *server_key;
 	int env_socket;
 	int no_clients_resize;
+	int encoder_threads;
 };
 
 struct rdp_output;
 
+enum rdp_codec {
+	RDP_CODEC_RFX,
+	RDP_CODEC_NSC,
+	RDP_CODEC_RAW,
+};
+
+struct rdp_encoder;
+
+/* Codec state owned by one encoding thread; slot 0 belongs to the
+ * compositor thread.
+ *
+ * Each band of a frame is a complete RemoteFX message of its own, sent
+ * as its own surface bits command, so the bands of one frame carry the
+ * frame index and header state of whichever slot encoded them. The
+ * FreeRDP decoder, rfx_process_message(), copes with that: it does not
+ * check the frame index sequence, which MS-RDPRFX only defines for
+ * diagnostics, and it takes the codec header blocks in any message, so
+ * a slot repeating them in its first message after a reset is harmless.
+ * Every slot is reset when a peer is activated, so the first band that
+ * peer gets carries the headers. */
+struct rdp_encoder_slot {
+	struct rdp_encoder *encoder;
+	pthread_t thread;
+
+	RFX_CONTEXT *rfx_context;
+	RFX_RECT *rfx_rects;
+	NSC_CONTEXT *nsc_context;
+};
+
+/* One horizontal band of the damage, encoded as its own surface bits
+ * command. */
+struct rdp_encoder_job {
+	pixman_region32_t region;
+	wStream *stream;
+};
+
+struct rdp_encoder {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	int destroying;
+
+	int nslots;
+	struct rdp_encoder_slot slots[RDP_ENCODER_MAX_THREADS];
+
+	/* The batch being encoded, protected by the mutex */
+	enum rdp_codec codec;
+	pixman_image_t *image;
+	int njobs;
+	int next_job;
+	int pending_jobs;
+	struct rdp_encoder_job jobs[RDP_ENCODER_MAX_JOBS];
+};
+
 struct rdp_backend {
 	struct weston_backend base;
 	struct weston_compositor *compositor;
@@ -94,6 +154,7 @@ struct rdp_backend {
 	freerdp_listener *listener;
 	struct wl_event_source *listener_events[MAX_FREERDP_FDS];
 	struct rdp_output *output;
+	struct rdp_encoder *encoder;
 
 	char *server_cert;
 	char *server_key;
@@ -128,10 +189,6 @@ struct rdp_peer_context {
 
 	struct rdp_backend *rdpBackend;
 	struct wl_event_source *events[MAX_FREERDP_FDS];
-	RFX_CONTEXT *rfx_context;
-	wStream *encode_stream;
-	RFX_RECT *rfx_rects;
-	NSC_CONTEXT *nsc_context;
 
 	struct rdp_peers_item item;
 };
@@ -149,105 +206,362 @@ rdp_backend_config_init(struct rdp_backend_config *config)
 	config->server_key = NULL;
 	config->env_socket = 0;
 	config->no_clients_resize = 0;
+	config->encoder_threads = 0;
 }
 
 static void
-rdp_peer_refresh_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+rdp_encoder_encode_rfx(struct rdp_encoder_slot *slot,
+		       struct rdp_encoder_job *job, pixman_image_t *image)
 {
+	pixman_box32_t *extents = &job->region.extents;
+	pixman_box32_t *rects;
 	int width, height, nrects, i;
-	pixman_box32_t *region, *rects;
 	uint32_t *ptr;
 	RFX_RECT *rfxRect;
-	rdpUpdate *update = peer->update;
-	SURFACE_BITS_COMMAND *cmd = &update->surface_bits_command;
-	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 
-	Stream_Clear(context->encode_stream);
-	Stream_SetPosition(context->encode_stream, 0);
+	width = extents->x2 - extents->x1;
+	height = extents->y2 - extents->y1;
 
-	width = (damage->extents.x2 - damage->extents.x1);
-	height = (damage->extents.y2 - damage->extents.y1);
+	ptr = pixman_image_get_data(image) + extents->x1 +
+		extents->y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
 
-#ifdef HAVE_SKIP_COMPRESSION
-	cmd->skipCompression = TRUE;
-#else
-	memset(cmd, 0, sizeof(*cmd));
+	rects = pixman_region32_rectangles(&job->region, &nrects);
+	slot->rfx_rects = realloc(slot->rfx_rects, nrects * sizeof *rfxRect);
+
+	for (i = 0; i < nrects; i++) {
+		rfxRect = &slot->rfx_rects[i];
+
+		rfxRect->x = rects[i].x1 - extents->x1;
+		rfxRect->y = rects[i].y1 - extents->y1;
+		rfxRect->width = rects[i].x2 - rects[i].x1;
+		rfxRect->height = rects[i].y2 - rects[i].y1;
+	}
+
+	rfx_compose_message(slot->rfx_context, job->stream, slot->rfx_rects,
+			    nrects, (BYTE *)ptr, width, height,
+			    pixman_image_get_stride(image));
+}
+
+static void
+rdp_encoder_encode_nsc(struct rdp_encoder_slot *slot,
+		       struct rdp_encoder_job *job, pixman_image_t *image)
+{
+	pixman_box32_t *extents = &job->region.extents;
+	uint32_t *ptr;
+
+	ptr = pixman_image_get_data(image) + extents->x1 +
+		extents->y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
+
+	nsc_compose_message(slot->nsc_context, job->stream, (BYTE *)ptr,
+			    extents->x2 - extents->x1,
+			    extents->y2 - extents->y1,
+			    pixman_image_get_stride(image));
+}
+
+/* Called with the encoder mutex held, which is dropped while encoding */
+static void
+rdp_encoder_run_jobs(struct rdp_encoder_slot *slot)
+{
+	struct rdp_encoder *encoder = slot->encoder;
+	struct rdp_encoder_job *job;
+
+	while (encoder->next_job < encoder->njobs) {
+		job = &encoder->jobs[encoder->next_job++];
+		pthread_mutex_unlock(&encoder->mutex);
+
+		Stream_Clear(job->stream);
+		Stream_SetPosition(job->stream, 0);
+
+		if (encoder->codec == RDP_CODEC_RFX)
+			rdp_encoder_encode_rfx(slot, job, encoder->image);
+		else
+			rdp_encoder_encode_nsc(slot, job, encoder->image);
+
+		pthread_mutex_lock(&encoder->mutex);
+		if (--encoder->pending_jobs == 0)
+			pthread_cond_signal(&encoder->done_cond);
+	}
+}
+
+static void *
+rdp_encoder_thread(void *data)
+{
+	struct rdp_encoder_slot *slot = data;
+	struct rdp_encoder *encoder = slot->encoder;
+
+	pthread_mutex_lock(&encoder->mutex);
+
+	while (!encoder->destroying) {
+		if (encoder->next_job >= encoder->njobs) {
+			pthread_cond_wait(&encoder->work_cond, &encoder->mutex);
+			continue;
+		}
+
+		rdp_encoder_run_jobs(slot);
+	}
+
+	pthread_mutex_unlock(&encoder->mutex);
+
+	return NULL;
+}
+
+/* Splits the damage in bands of whole tile rows, one job per band, so
+ * the bands can be encoded concurrently. Called with the encoder mutex
+ * held. */
+static void
+rdp_encoder_split_damage(struct rdp_encoder *encoder, pixman_region32_t *damage)
+{
+	pixman_box32_t *extents = &damage->extents;
+	struct rdp_encoder_job *job;
+	int tile_rows, band_rows, y;
+
+	tile_rows = (extents->y2 - extents->y1 + RDP_TILE_SIZE - 1) /
+		RDP_TILE_SIZE;
+	band_rows = (tile_rows + encoder->nslots - 1) / encoder->nslots;
+	if (band_rows < 1)
+		band_rows = 1;
+
+	encoder->njobs = 0;
+	for (y = extents->y1; y < extents->y2;
+	     y += band_rows * RDP_TILE_SIZE) {
+		job = &encoder->jobs[encoder->njobs];
+
+		pixman_region32_fini(&job->region);
+		pixman_region32_init_rect(&job->region, extents->x1, y,
+					  extents->x2 - extents->x1,
+					  band_rows * RDP_TILE_SIZE);
+		pixman_region32_intersect(&job->region, &job->region, damage);
+
+		if (pixman_region32_not_empty(&job->region))
+			encoder->njobs++;
+	}
+}
+
+/** Encode damage of an image with the given codec
+ *
+ * \param encoder The encoder pool
+ * \param codec RDP_CODEC_RFX or RDP_CODEC_NSC
+ * \param damage The region to encode, in image coordinates
+ * \param image The image to encode from
+ *
+ * The damage is split in bands encoded in parallel by the pool
+ * threads and the calling thread; this returns once all of them are
+ * done. The result stays in the encoder jobs until the next call, so
+ * it can be sent to every peer using the same codec with
+ * rdp_peer_send_encoded().
+ *
+ * Waiting here keeps the compositor thread from painting the next frame
+ * into the image while it is still being read, without copying it. The
+ * compositor thread takes jobs itself meanwhile, so the wait is only as
+ * long as the slowest band.
+ */
+static void
+rdp_encoder_encode(struct rdp_encoder *encoder, enum rdp_codec codec,
+		   pixman_region32_t *damage, pixman_image_t *image)
+{
+	/* The pool threads look at next_job and njobs under the lock, also
+	 * when woken up spuriously, so the jobs are set up with it held. */
+	pthread_mutex_lock(&encoder->mutex);
+
+	rdp_encoder_split_damage(encoder, damage);
+	encoder->codec = codec;
+	encoder->image = image;
+	encoder->next_job = 0;
+	encoder->pending_jobs = encoder->njobs;
+	pthread_cond_broadcast(&encoder->work_cond);
+
+	rdp_encoder_run_jobs(&encoder->slots[0]);
+
+	while (encoder->pending_jobs > 0)
+		pthread_cond_wait(&encoder->done_cond, &encoder->mutex);
+
+	pthread_mutex_unlock(&encoder->mutex);
+}
+
+/* Makes the next RemoteFX messages start with the codec headers again,
+ * as needed by a newly activated peer. */
+static void
+rdp_encoder_reset(struct rdp_encoder *encoder, int width, int height)
+{
+	struct rdp_encoder_slot *slot;
+	int i;
+
+	for (i = 0; i < encoder->nslots; i++) {
+		slot = &encoder->slots[i];
+
+		slot->rfx_context->width = width;
+		slot->rfx_context->height = height;
+		rfx_context_reset(slot->rfx_context);
+#ifdef HAVE_NSC_RESET
+		nsc_context_reset(slot->nsc_context);
 #endif
-	cmd->destLeft = damage->extents.x1;
-	cmd->destTop = damage->extents.y1;
-	cmd->destRight = damage->extents.x2;
-	cmd->destBottom = damage->extents.y2;
-	cmd->bpp = 32;
-	cmd->codecID = peer->settings->RemoteFxCodecId;
-	cmd->width = width;
-	cmd->height = height;
+	}
+}
 
-	ptr = pixman_image_get_data(image) + damage->extents.x1 +
-				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
+static void
+rdp_encoder_destroy(struct rdp_encoder *encoder)
+{
+	struct rdp_encoder_slot *slot;
+	int i;
 
-	rects = pixman_region32_rectangles(damage, &nrects);
-	context->rfx_rects = realloc(context->rfx_rects, nrects * sizeof *rfxRect);
+	pthread_mutex_lock(&encoder->mutex);
+	encoder->destroying = 1;
+	pthread_cond_broadcast(&encoder->work_cond);
+	pthread_mutex_unlock(&encoder->mutex);
 
-	for (i = 0; i < nrects; i++) {
-		region = &rects[i];
-		rfxRect = &context->rfx_rects[i];
+	for (i = 1; i < encoder->nslots; i++)
+		pthread_join(encoder->slots[i].thread, NULL);
 
-		rfxRect->x = (region->x1 - damage->extents.x1);
-		rfxRect->y = (region->y1 - damage->extents.y1);
-		rfxRect->width = (region->x2 - region->x1);
-		rfxRect->height = (region->y2 - region->y1);
+	for (i = 0; i < encoder->nslots; i++) {
+		slot = &encoder->slots[i];
+		nsc_context_free(slot->nsc_context);
+		rfx_context_free(slot->rfx_context);
+		free(slot->rfx_rects);
 	}
 
-	rfx_compose_message(context->rfx_context, context->encode_stream, context->rfx_rects, nrects,
-			(BYTE *)ptr, width, height,
-			pixman_image_get_stride(image)
-	);
+	for (i = 0; i < RDP_ENCODER_MAX_JOBS; i++) {
+		pixman_region32_fini(&encoder->jobs[i].region);
+		Stream_Free(encoder->jobs[i].stream, TRUE);
+	}
+
+	pthread_mutex_destroy(&encoder->mutex);
+	pthread_cond_destroy(&encoder->work_cond);
+	pthread_cond_destroy(&encoder->done_cond);
+	free(encoder);
+}
+
+static struct rdp_encoder *
+rdp_encoder_create(int nthreads, int width, int height)
+{
+	struct rdp_encoder *encoder;
+	struct rdp_encoder_slot *slot;
+	int i;
+
+	encoder = zalloc(sizeof *encoder);
+	if (encoder == NULL)
+		return NULL;
 
-	cmd->bitmapDataLength = Stream_GetPosition(context->encode_stream);
-	cmd->bitmapData = Stream_Buffer(context->encode_stream);
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > RDP_ENCODER_MAX_THREADS)
+		nthreads = RDP_ENCODER_MAX_THREADS;
 
-	update->SurfaceBits(update->context, cmd);
+	pthread_mutex_init(&encoder->mutex, NULL);
+	pthread_cond_init(&encoder->work_cond, NULL);
+	pthread_cond_init(&encoder->done_cond, NULL);
+
+	for (i = 0; i < RDP_ENCODER_MAX_JOBS; i++) {
+		pixman_region32_init(&encoder->jobs[i].region);
+		encoder->jobs[i].stream = Stream_New(NULL, 65536);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		slot = &encoder->slots[i];
+		slot->encoder = encoder;
+
+#if FREERDP_VERSION_MAJOR == 1 && FREERDP_VERSION_MINOR == 1
+		slot->rfx_context = rfx_context_new();
+#else
+		slot->rfx_context = rfx_context_new(TRUE);
+#endif
+		slot->rfx_context->mode = RLGR3;
+		slot->rfx_context->width = width;
+		slot->rfx_context->height = height;
+		rfx_context_set_pixel_format(slot->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+		slot->nsc_context = nsc_context_new();
+		nsc_context_set_pixel_format(slot->nsc_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+		if (i > 0 && pthread_create(&slot->thread, NULL,
+					    rdp_encoder_thread, slot) != 0) {
+			weston_log("failed to create RDP encoder thread\n");
+			nsc_context_free(slot->nsc_context);
+			rfx_context_free(slot->rfx_context);
+			break;
+		}
+
+		encoder->nslots++;
+	}
+
+	weston_log("RDP encoding on %d thread(s)\n", encoder->nslots);
+
+	return encoder;
 }
 
+static enum rdp_codec
+rdp_peer_get_codec(freerdp_peer *peer)
+{
+	rdpSettings *settings = peer->settings;
 
+	if (settings->RemoteFxCodec)
+		return RDP_CODEC_RFX;
+	else if (settings->NSCodec)
+		return RDP_CODEC_NSC;
+	else
+		return RDP_CODEC_RAW;
+}
+
+/* Surface frame markers are only sent to clients that announced support
+ * for them in their surface commands capability set, which overrides
+ * the server's advertisement in the peer settings. */
 static void
-rdp_peer_refresh_nsc(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+rdp_peer_send_frame_marker(freerdp_peer *peer, UINT16 action)
+{
+	SURFACE_FRAME_MARKER *marker = &peer->update->surface_frame_marker;
+
+	if (!peer->settings->SurfaceFrameMarkerEnabled)
+		return;
+
+	marker->frameAction = action;
+	peer->update->SurfaceFrameMarker(peer->context, marker);
+}
+
+static void
+rdp_peer_send_encoded(struct rdp_encoder *encoder, freerdp_peer *peer)
 {
-	int width, height;
-	uint32_t *ptr;
 	rdpUpdate *update = peer->update;
 	SURFACE_BITS_COMMAND *cmd = &update->surface_bits_command;
-	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	SURFACE_FRAME_MARKER *marker = &update->surface_frame_marker;
+	struct rdp_encoder_job *job;
+	pixman_box32_t *extents;
+	int i;
 
-	Stream_Clear(context->encode_stream);
-	Stream_SetPosition(context->encode_stream, 0);
+	if (encoder->njobs == 0)
+		return;
+
+	marker->frameId++;
+	rdp_peer_send_frame_marker(peer, SURFACECMD_FRAMEACTION_BEGIN);
 
-	width = (damage->extents.x2 - damage->extents.x1);
-	height = (damage->extents.y2 - damage->extents.y1);
+	for (i = 0; i < encoder->njobs; i++) {
+		job = &encoder->jobs[i];
+		extents = &job->region.extents;
 
 #ifdef HAVE_SKIP_COMPRESSION
-	cmd->skipCompression = TRUE;
+		cmd->skipCompression = TRUE;
 #else
-	memset(cmd, 0, sizeof(*cmd));
+		memset(cmd, 0, sizeof(*cmd));
 #endif
-	cmd->destLeft = damage->extents.x1;
-	cmd->destTop = damage->extents.y1;
-	cmd->destRight = damage->extents.x2;
-	cmd->destBottom = damage->extents.y2;
-	cmd->bpp = 32;
-	cmd->codecID = peer->settings->NSCodecId;
-	cmd->width = width;
-	cmd->height = height;
-
-	ptr = pixman_image_get_data(image) + damage->extents.x1 +
-				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
-
-	nsc_compose_message(context->nsc_context, context->encode_stream, (BYTE *)ptr,
-			cmd->width,	cmd->height,
-			pixman_image_get_stride(image));
-	cmd->bitmapDataLength = Stream_GetPosition(context->encode_stream);
-	cmd->bitmapData = Stream_Buffer(context->encode_stream);
-	update->SurfaceBits(update->context, cmd);
+		cmd->destLeft = extents->x1;
+		cmd->destTop = extents->y1;
+		cmd->destRight = extents->x2;
+		cmd->destBottom = extents->y2;
+		cmd->bpp = 32;
+		if (encoder->codec == RDP_CODEC_RFX)
+			cmd->codecID = peer->settings->RemoteFxCodecId;
+		else
+			cmd->codecID = peer->settings->NSCodecId;
+		cmd->width = extents->x2 - extents->x1;
+		cmd->height = extents->y2 - extents->y1;
+
+		cmd->bitmapDataLength = Stream_GetPosition(job->stream);
+		cmd->bitmapData = Stream_Buffer(job->stream);
+
+		update->SurfaceBits(update->context, cmd);
+	}
+
+	rdp_peer_send_frame_marker(peer, SURFACECMD_FRAMEACTION_END);
 }
 
 static void
@@ -279,8 +593,7 @@ rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_p
 		return;
 
 	marker->frameId++;
-	marker->frameAction = SURFACECMD_FRAMEACTION_BEGIN;
-	update->SurfaceFrameMarker(peer->context, marker);
+	rdp_peer_send_frame_marker(peer, SURFACECMD_FRAMEACTION_BEGIN);
 
 	memset(cmd, 0, sizeof(*cmd));
 	cmd->bpp = 32;
@@ -318,23 +631,24 @@ rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_p
 		}
 	}
 
-	marker->frameAction = SURFACECMD_FRAMEACTION_END;
-	update->SurfaceFrameMarker(peer->context, marker);
+	rdp_peer_send_frame_marker(peer, SURFACECMD_FRAMEACTION_END);
 }
 
 static void
 rdp_peer_refresh_region(pixman_region32_t *region, freerdp_peer *peer)
 {
 	RdpPeerContext *context = (RdpPeerContext *)peer->context;
-	struct rdp_output *output = context->rdpBackend->output;
-	rdpSettings *settings = peer->settings;
+	struct rdp_backend *b = context->rdpBackend;
+	struct rdp_output *output = b->output;
+	enum rdp_codec codec = rdp_peer_get_codec(peer);
 
-	if (settings->RemoteFxCodec)
-		rdp_peer_refresh_rfx(region, output->shadow_surface, peer);
-	else if (settings->NSCodec)
-		rdp_peer_refresh_nsc(region, output->shadow_surface, peer);
-	else
+	if (codec == RDP_CODEC_RAW) {
 		rdp_peer_refresh_raw(region, output->shadow_surface, peer);
+		return;
+	}
+
+	rdp_encoder_encode(b->encoder, codec, region, output->shadow_surface);
+	rdp_peer_send_encoded(b->encoder, peer);
 }
 
 static void
@@ -351,17 +665,38 @@ rdp_output_repaint(struct weston_output *output_base, pixman_region32_t *damage)
 {
 	struct rdp_output *output = container_of(output_base, struct rdp_output, base);
 	struct weston_compositor *ec = output->base.compositor;
+	struct rdp_backend *b = (struct rdp_backend *) ec->backend;
 	struct rdp_peers_item *outputPeer;
+	enum rdp_codec codec;
+	int encoded;
 
 	pixman_renderer_output_set_buffer(output_base, output->shadow_surface);
 	ec->renderer->repaint_output(&output->base, damage);
 
+	/* Encode once per codec and share the result between all the
+	 * peers which negotiated it. */
 	if (pixman_region32_not_empty(damage)) {
-		wl_list_for_each(outputPeer, &output->peers, link) {
-			if ((outputPeer->flags & RDP_PEER_ACTIVATED) &&
-					(outputPeer->flags & RDP_PEER_OUTPUT_ENABLED))
-			{
-				rdp_peer_refresh_region(damage, outputPeer->peer);
+		for (codec = RDP_CODEC_RFX; codec <= RDP_CODEC_RAW; codec++) {
+			encoded = 0;
+			wl_list_for_each(outputPeer, &output->peers, link) {
+				if (!(outputPeer->flags & RDP_PEER_ACTIVATED) ||
+				    !(outputPeer->flags & RDP_PEER_OUTPUT_ENABLED) ||
+				    rdp_peer_get_codec(outputPeer->peer) != codec)
+					continue;
+
+				if (codec == RDP_CODEC_RAW) {
+					rdp_peer_refresh_raw(damage,
+							     output->shadow_surface,
+							     outputPeer->peer);
+					continue;
+				}
+
+				if (!encoded) {
+					rdp_encoder_encode(b->encoder, codec, damage,
+							   output->shadow_surface);
+					encoded = 1;
+				}
+				rdp_peer_send_encoded(b->encoder, outputPeer->peer);
 			}
 		}
 	}
@@ -556,6 +891,9 @@ rdp_destroy(struct weston_compositor *ec)
 
 	freerdp_listener_free(b->listener);
 
+	if (b->encoder)
+		rdp_encoder_destroy(b->encoder);
+
 	free(b->server_cert);
 	free(b->server_key);
 	free(b->rdp_key);
@@ -607,21 +945,6 @@ rdp_peer_context_new(freerdp_peer* client, RdpPeerContext* context)
 {
 	context->item.peer = client;
 	context->item.flags = RDP_PEER_OUTPUT_ENABLED;
-
-#if FREERDP_VERSION_MAJOR == 1 && FREERDP_VERSION_MINOR == 1
-	context->rfx_context = rfx_context_new();
-#else
-	context->rfx_context = rfx_context_new(TRUE);
-#endif
-	context->rfx_context->mode = RLGR3;
-	context->rfx_context->width = client->settings->DesktopWidth;
-	context->rfx_context->height = client->settings->DesktopHeight;
-	rfx_context_set_pixel_format(context->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
-
-	context->nsc_context = nsc_context_new();
-	nsc_context_set_pixel_format(context->nsc_context, RDP_PIXEL_FORMAT_B8G8R8A8);
-
-	context->encode_stream = Stream_New(NULL, 65536);
 }
 
 static void
@@ -642,11 +965,6 @@ rdp_peer_context_free(freerdp_peer* client, RdpPeerContext* context)
 		weston_seat_release_pointer(&context->item.seat);
 		weston_seat_release(&context->item.seat);
 	}
-
-	Stream_Free(context->encode_stream, TRUE);
-	nsc_context_free(context->nsc_context);
-	rfx_context_free(context->rfx_context);
-	free(context->rfx_rects);
 }
 
 
@@ -868,10 +1186,7 @@ xf_peer_activate(freerdp_peer* client)
 		}
 	}
 
-	rfx_context_reset(peerCtx->rfx_context);
-#ifdef HAVE_NSC_RESET
-	nsc_context_reset(peerCtx->nsc_context);
-#endif
+	rdp_encoder_reset(b->encoder, output->base.width, output->base.height);
 
 	if (peersItem->flags & RDP_PEER_ACTIVATED)
 		return TRUE;
@@ -1134,7 +1449,7 @@ rdp_peer_init(freerdp_peer *client, struct rdp_backend *b)
 	settings->RefreshRect = TRUE;
 	settings->RemoteFxCodec = TRUE;
 	settings->NSCodec = TRUE;
-	settings->FrameMarkerCommandEnabled = TRUE;
+	/* Advertised only; the client's capabilities decide */
 	settings->SurfaceFrameMarkerEnabled = TRUE;
 
 	client->Capabilities = xf_peer_capabilities;
@@ -1221,9 +1536,14 @@ rdp_backend_create(struct weston_compositor *compositor,
 	if (pixman_renderer_init(compositor) < 0)
 		goto err_compositor;
 
-	if (rdp_backend_create_output(b, config->width, config->height) < 0)
+	b->encoder = rdp_encoder_create(config->encoder_threads,
+					config->width, config->height);
+	if (b->encoder == NULL)
 		goto err_compositor;
 
+	if (rdp_backend_create_output(b, config->width, config->height) < 0)
+		goto err_encoder;
+
 	compositor->capabilities |= WESTON_CAP_ARBITRARY_MODES;
 
 	if (!config->env_socket) {
@@ -1257,6 +1577,8 @@ err_listener:
 	freerdp_listener_free(b->listener);
 err_output:
 	weston_output_destroy(&b->output->base);
+err_encoder:
+	rdp_encoder_destroy(b->encoder);
 err_compositor:
 	weston_compositor_shutdown(compositor);
 err_free_strings:
@@ -1286,6 +1608,7 @@ backend_init(struct weston_compositor *compositor, int *argc, char *argv[],
 		{ WESTON_OPTION_STRING,  "address", 0, &config.bind_address },
 		{ WESTON_OPTION_INTEGER, "port", 0, &config.port },
 		{ WESTON_OPTION_BOOLEAN, "no-clients-resize", 0, &config.no_clients_resize },
+		{ WESTON_OPTION_INTEGER, "encoder-threads", 0, &config.encoder_threads },
 		{ WESTON_OPTION_STRING,  "rdp4-key", 0, &config.rdp_key },
 		{ WESTON_OPTION_STRING,  "rdp-tls-cert", 0, &config.server_cert },
 		{ WESTON_OPTION_STRING,  "rdp-tls-key", 0, &config.server_key }
@@ -52,6 +52,7 @@
 #include <errno.h>
 
 #include "timeline.h"
+#include "probes.h"
 
 #include "compositor.h"
 #include "scaler-server-protocol.h"
@@ -63,6 +64,7 @@
 #include "version.h"
 
 #define DEFAULT_REPAINT_WINDOW 7 /* milliseconds */
+#define DEFAULT_REPAINT_MARGIN 2000 /* microseconds */
 
 static void
 weston_output_transform_scale_init(struct weston_output *output,
@@ -89,6 +91,7 @@ static void weston_mode_switch_finish(struct weston_output *output,
 	pixman_region32_init(&output->previous_damage);
 	pixman_region32_init_rect(&output->region, output->x, output->y,
 				  output->width, output->height);
+	output->cursor_view = NULL;
 
 	weston_output_update_matrix(output);
 
@@ -584,6 +587,7 @@ weston_surface_create(struct weston_compositor *compositor)
 		return NULL;
 
 	wl_signal_init(&surface->destroy_signal);
+	wl_signal_init(&surface->commit_signal);
 
 	surface->compositor = compositor;
 	surface->ref_count = 1;
@@ -1246,6 +1250,34 @@ get_view_layer(struct weston_view *view)
 	return view->layer_link.layer;
 }
 
+/* Record that the pickable area of the view may change, so that the
+ * pointers over it are repicked after the next repaint. */
+static void
+weston_view_damage_pick(struct weston_view *view)
+{
+	struct weston_compositor *compositor = view->surface->compositor;
+
+	pixman_region32_union(&compositor->pick_damage,
+			      &compositor->pick_damage,
+			      &view->transform.boundingbox);
+}
+
+/* Moving the cursor_view of an output is what its cursor-only repaints
+ * are for, any other view may have moved onto or off an output without
+ * leaving damage there. */
+static void
+weston_view_bump_geometry_serial(struct weston_view *view)
+{
+	struct weston_compositor *compositor = view->surface->compositor;
+	struct weston_output *output;
+
+	wl_list_for_each(output, &compositor->output_list, link)
+		if (output->cursor_view == view)
+			return;
+
+	compositor->view_geometry_serial++;
+}
+
 WL_EXPORT void
 weston_view_update_transform(struct weston_view *view)
 {
@@ -1260,8 +1292,10 @@ weston_view_update_transform(struct weston_view *view)
 		weston_view_update_transform(parent);
 
 	view->transform.dirty = 0;
+	weston_view_bump_geometry_serial(view);
 
 	weston_view_damage_below(view);
+	weston_view_damage_pick(view);
 
 	pixman_region32_fini(&view->transform.boundingbox);
 	pixman_region32_fini(&view->transform.opaque);
@@ -1299,6 +1333,7 @@ weston_view_update_transform(struct weston_view *view)
 	}
 
 	weston_view_damage_below(view);
+	weston_view_damage_pick(view);
 
 	weston_view_assign_output(view);
 
@@ -1721,16 +1756,55 @@ weston_compositor_pick_view(struct weston_compositor *compositor,
 	return NULL;
 }
 
+static bool
+weston_pointer_needs_repick(struct weston_pointer *pointer)
+{
+	struct weston_compositor *compositor = pointer->seat->compositor;
+
+	if (compositor->pick_damage_all)
+		return true;
+
+	if (pointer->focus != pointer->pick_focus ||
+	    pointer->grab != pointer->pick_grab ||
+	    pointer->x != pointer->pick_x ||
+	    pointer->y != pointer->pick_y)
+		return true;
+
+	return pixman_region32_contains_point(&compositor->pick_damage,
+					      wl_fixed_to_int(pointer->x),
+					      wl_fixed_to_int(pointer->y),
+					      NULL);
+}
+
+/* Repick the seats whose pointer may now be over a different view.
+ * Seats whose pointer did not move, and under which no view changed
+ * since the last repick, keep their focus without picking again. */
 static void
-weston_compositor_repick(struct weston_compositor *compositor)
+weston_compositor_repick(struct weston_compositor *compositor,
+			 struct weston_output *output)
 {
 	struct weston_seat *seat;
+	struct weston_pointer *pointer;
 
 	if (!compositor->session_active)
 		return;
 
-	wl_list_for_each(seat, &compositor->seat_list, link)
-		weston_seat_repick(seat);
+	wl_list_for_each(seat, &compositor->seat_list, link) {
+		pointer = weston_seat_get_pointer(seat);
+		if (!pointer)
+			continue;
+
+		if (weston_pointer_needs_repick(pointer)) {
+			weston_seat_repick(seat);
+			output->stats.repicks++;
+		} else {
+			output->stats.repicks_skipped++;
+		}
+	}
+
+	pixman_region32_fini(&compositor->pick_damage);
+	pixman_region32_init(&compositor->pick_damage);
+	compositor->pick_damage_all = false;
 }
 
 WL_EXPORT void
@@ -1791,6 +1865,8 @@ weston_surface_reset_pending_buffer(struct weston_surface *surface)
 WL_EXPORT void
 weston_view_destroy(struct weston_view *view)
 {
+	struct weston_output *output;
+
 	wl_signal_emit(&view->destroy_signal, view);
 
 	assert(wl_list_empty(&view->geometry.child_list));
@@ -1812,6 +1888,10 @@ weston_view_destroy(struct weston_view *view)
 
 	wl_list_remove(&view->surface_link);
 
+	wl_list_for_each(output, &view->surface->compositor->output_list, link)
+		if (output->cursor_view == view)
+			output->cursor_view = NULL;
+
 	free(view);
 }
 
@@ -1976,14 +2056,24 @@ weston_output_damage(struct weston_output *output)
 static void
 surface_flush_damage(struct weston_surface *surface)
 {
+	struct weston_client_timer timer;
+
 	if (surface->buffer_ref.buffer &&
-	    wl_shm_buffer_get(surface->buffer_ref.buffer->resource))
+	    wl_shm_buffer_get(surface->buffer_ref.buffer->resource)) {
+		weston_client_timer_start(&timer, surface->compositor,
+					  surface->resource);
 		surface->compositor->renderer->flush_damage(surface);
+		weston_client_timer_stop(&timer, WESTON_CLIENT_COST_RENDER);
+	}
 
 	if (weston_timeline_enabled_ &&
 	    pixman_region32_not_empty(&surface->damage))
 		TL_POINT("core_flush_damage", TLP_SURFACE(surface),
 			 TLP_OUTPUT(surface->output), TLP_END);
+	WESTON_PROBE(flush_damage, surface,
+		     surface->output ? (int) surface->output->id : -1,
+		     surface->damage.extents.x1, surface->damage.extents.y1,
+		     surface->damage.extents.x2, surface->damage.extents.y2);
 
 	pixman_region32_clear(&surface->damage);
 }
@@ -2173,6 +2263,7 @@ weston_compositor_build_view_list(struct weston_compositor *compositor)
 {
 	struct weston_view *view;
 	struct weston_layer *layer;
+	uint32_t hash = 2166136261u;
 
 	wl_list_for_each(layer, &compositor->layer_list, link)
 		wl_list_for_each(view, &layer->view_list.link, layer_link.link)
@@ -2188,6 +2279,16 @@ weston_compositor_build_view_list(struct weston_compositor *compositor)
 	wl_list_for_each(layer, &compositor->layer_list, link)
 		wl_list_for_each(view, &layer->view_list.link, layer_link.link)
 			surface_free_unused_subsurface_views(view->surface);
+
+	/* Views mapped, unmapped or restacked change what is on top
+	 * anywhere, so any such change makes every seat repick. */
+	wl_list_for_each(view, &compositor->view_list, link)
+		hash = (hash ^ (uint32_t) (uintptr_t) view) * 16777619u;
+
+	if (hash != compositor->view_list_hash) {
+		compositor->view_list_hash = hash;
+		compositor->pick_damage_all = true;
+	}
 }
 
 static void
@@ -2215,27 +2316,364 @@ weston_output_take_feedback_list(struct weston_output *output,
 	wl_list_init(&surface->feedback_list);
 }
 
+/* Times the work of the compositor on CLOCK_MONOTONIC, which keeps
+ * going while a virtual presentation clock stands still. */
+struct output_stats_timer {
+	struct timespec start;
+	struct timespec now;
+};
+
+static uint32_t
+elapsed_usec(const struct timespec *end, const struct timespec *start)
+{
+	struct timespec d;
+	int64_t usec;
+
+	timespec_sub(&d, end, start);
+	usec = timespec_to_nsec(&d) / 1000;
+	if (usec < 0)
+		return 0;
+	if (usec > UINT32_MAX)
+		return UINT32_MAX;
+
+	return usec;
+}
+
+static bool
+timespec_is_set(const struct timespec *ts)
+{
+	return ts->tv_sec != 0 || ts->tv_nsec != 0;
+}
+
+static void
+output_stats_timer_start(struct output_stats_timer *timer)
+{
+	clock_gettime(CLOCK_MONOTONIC, &timer->start);
+}
+
+static void
+output_stats_timer_stop(struct output_stats_timer *timer,
+			struct weston_histogram *h)
+{
+	clock_gettime(CLOCK_MONOTONIC, &timer->now);
+	weston_histogram_add(h, elapsed_usec(&timer->now, &timer->start));
+}
+
+/** Clear the repaint statistics of an output
+ *
+ * \param output The output.
+ *
+ * Empties all histograms and counters of weston_output::stats. A frame
+ * that is being repainted when this is called is still accounted.
+ */
+WL_EXPORT void
+weston_output_stats_reset(struct weston_output *output)
+{
+	struct weston_output_stats *stats = &output->stats;
+
+	weston_histogram_init(&stats->repaint);
+	weston_histogram_init(&stats->assign_planes);
+	weston_histogram_init(&stats->render);
+	weston_histogram_init(&stats->flip);
+	weston_histogram_init(&stats->damage_to_present);
+	weston_histogram_init(&stats->repaint_lead);
+	weston_histogram_init(&stats->latency_saved);
+	weston_histogram_init(&stats->cursor_repaint);
+	stats->frames_presented = 0;
+	stats->frames_missed = 0;
+	stats->repicks = 0;
+	stats->repicks_skipped = 0;
+}
+
+/* Records how long the repaint took until it was posted, counted from
+ * when it was due if the timer fired late. The repaint began at begin
+ * on the presentation clock, and took usec. */
+static void
+output_repaint_sample(struct weston_output *output,
+		      const struct timespec *begin, uint32_t usec)
+{
+	uint32_t late = 0;
+	uint32_t i;
+
+	if (timespec_is_set(&output->repaint_due))
+		late = elapsed_usec(begin, &output->repaint_due);
+
+	i = output->repaint_sample_count++ % WESTON_REPAINT_SAMPLES;
+	output->repaint_samples[i] = MIN((uint64_t) usec + late, UINT32_MAX);
+
+	output->repaint_due.tv_sec = 0;
+	output->repaint_due.tv_nsec = 0;
+}
+
+/* Whether the adaptive repaint lead is in use: not while there are not
+ * enough samples yet, nor for a while after a missed frame. */
+static bool
+output_repaint_adaptive(struct weston_output *output, int32_t refresh_nsec)
+{
+	return output->compositor->adaptive_repaint && refresh_nsec > 0 &&
+	       output->repaint_fallback == 0 &&
+	       output->repaint_sample_count >= WESTON_REPAINT_SAMPLES;
+}
+
+/* How long before the vblank to start the next repaint. With adaptive
+ * repaint scheduling that is the longest of the recent repaints plus the
+ * margin, otherwise it is the static repaint window. */
+static int64_t
+output_repaint_lead_nsec(struct weston_output *output, int32_t refresh_nsec)
+{
+	struct weston_compositor *compositor = output->compositor;
+	uint32_t longest = 0;
+	int64_t lead;
+	int i;
+
+	if (!output_repaint_adaptive(output, refresh_nsec))
+		return (int64_t) compositor->repaint_msec * 1000000;
+
+	for (i = 0; i < WESTON_REPAINT_SAMPLES; i++)
+		longest = MAX(longest, output->repaint_samples[i]);
+
+	lead = ((int64_t) longest + compositor->repaint_margin_usec) * 1000;
+
+	return MIN(lead, refresh_nsec);
+}
+
+/* Accounts the lead the repaint following a presented frame is
+ * scheduled with. Restarts of the repaint loop, which come with an
+ * invalid timestamp, count neither as a frame on the static window nor
+ * in the statistics. */
+static void
+output_repaint_lead_presented(struct weston_output *output,
+			      int32_t refresh_nsec, int64_t lead_nsec)
+{
+	int64_t static_nsec =
+		(int64_t) output->compositor->repaint_msec * 1000000;
+
+	weston_histogram_add(&output->stats.repaint_lead,
+			     MAX(lead_nsec, 0) / 1000);
+
+	if (output_repaint_adaptive(output, refresh_nsec))
+		weston_histogram_add(&output->stats.latency_saved,
+				     MAX(static_nsec - lead_nsec, 0) / 1000);
+	else if (output->repaint_fallback > 0)
+		output->repaint_fallback--;
+}
+
+/* Called with a valid presentation timestamp of a repainted frame. */
+static void
+output_stats_presented(struct weston_output *output,
+		       const struct timespec *stamp, int64_t refresh_nsec)
+{
+	struct weston_output_stats *stats = &output->stats;
+	struct timespec d;
+	int64_t cycles;
+
+	stats->frames_presented++;
+
+	if (timespec_is_set(&stats->posted))
+		weston_histogram_add(&stats->flip,
+				     elapsed_usec(stamp, &stats->posted));
+
+	if (timespec_is_set(&stats->damage_in_flight))
+		weston_histogram_add(&stats->damage_to_present,
+				     elapsed_usec(stamp,
+						  &stats->damage_in_flight));
+
+	/* The repaint loop keeps running as long as there is damage, so
+	 * any refresh cycle skipped between two presented frames of the
+	 * same loop is a frame that missed its deadline. */
+	if (timespec_is_set(&stats->last_presented) && refresh_nsec > 0) {
+		timespec_sub(&d, stamp, &stats->last_presented);
+		cycles = (timespec_to_nsec(&d) + refresh_nsec / 2) /
+			 refresh_nsec;
+		if (cycles > 1) {
+			stats->frames_missed += cycles - 1;
+
+			/* Something took longer than any recent repaint,
+			 * play safe for a while. */
+			if (output->compositor->adaptive_repaint)
+				output->repaint_fallback =
+					WESTON_REPAINT_SAMPLES;
+		}
+	}
+
+	stats->last_presented = *stamp;
+	stats->posted.tv_sec = 0;
+	stats->posted.tv_nsec = 0;
+	stats->damage_in_flight.tv_sec = 0;
+	stats->damage_in_flight.tv_nsec = 0;
+}
+
+/* The view the renderer may repaint on its own: the topmost view, if
+ * it is in the cursor layer, only translated, not faded and does not
+ * hide any part of the views below it. */
+static struct weston_view *
+output_cursor_view(struct weston_output *output)
+{
+	struct weston_compositor *ec = output->compositor;
+	struct weston_view *view;
+
+	if (!ec->cursor_only_repaint ||
+	    !(ec->capabilities & WESTON_CAP_CURSOR_REPAINT) ||
+	    (output->assign_planes && !output->disable_planes) ||
+	    output->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+	    output->current_scale != 1 || output->zoom.active ||
+	    wl_list_empty(&ec->view_list))
+		return NULL;
+
+	view = container_of(ec->view_list.next, struct weston_view, link);
+	if (view->layer_link.layer != &ec->cursor_layer ||
+	    !(view->output_mask & (1u << output->id)) ||
+	    view->transform.enabled || view->alpha < 1.0 ||
+	    pixman_region32_not_empty(&view->transform.opaque))
+		return NULL;
+
+	return view;
+}
+
+static void
+output_cursor_box(struct weston_output *output, struct weston_view *cursor,
+		  pixman_box32_t *box)
+{
+	pixman_region32_t region;
+
+	pixman_region32_init(&region);
+	pixman_region32_intersect(&region, &cursor->transform.boundingbox,
+				  &output->region);
+	*box = *pixman_region32_extents(&region);
+	pixman_region32_fini(&region);
+}
+
+/* Whether nothing but the tracked cursor changed on the output since its
+ * last repaint: no damage left, no view but the cursor moved or to be
+ * moved and no surface with new content. Checked before the view list is
+ * rebuilt, which turns the moves into damage. A view the shell updated
+ * already may have moved onto the output without damaging it, so any
+ * transform update since the last repaint rules the cursor out too. */
+static bool
+output_only_cursor_dirty(struct weston_output *output)
+{
+	struct weston_compositor *ec = output->compositor;
+	struct weston_view *ev;
+	pixman_region32_t damage;
+	bool damaged;
+
+	if (!output->cursor_view ||
+	    output->cursor_geometry_serial != ec->view_geometry_serial)
+		return false;
+
+	pixman_region32_init(&damage);
+	pixman_region32_intersect(&damage, &ec->primary_plane.damage,
+				  &output->region);
+	damaged = pixman_region32_not_empty(&damage);
+	pixman_region32_fini(&damage);
+	if (damaged)
+		return false;
+
+	wl_list_for_each(ev, &ec->view_list, link) {
+		if ((ev->transform.dirty && ev != output->cursor_view) ||
+		    pixman_region32_not_empty(&ev->surface->damage) ||
+		    (ev->surface->buffer_ref.buffer &&
+		     !ev->surface->keep_buffer))
+			return false;
+	}
+
+	return true;
+}
+
+/** Check whether a repaint only has to move the software cursor
+ *
+ * \param output The output to be repainted.
+ * \param cursor The view returned by output_cursor_view().
+ * \param only_cursor_dirty What output_only_cursor_dirty() returned
+ * before the view list was rebuilt.
+ * \param damage Set to the damage of the repaint if it does.
+ * \return Whether the renderer can repaint the cursor alone.
+ *
+ * That is the case when the cursor was tracked in the previous repaint
+ * already, nothing else changed since and no view was mapped, unmapped
+ * or restacked. The scene below the cursor is then unchanged, so the
+ * renderer puts back the background it kept from under the old cursor
+ * position and draws the cursor again, without walking the views.
+ */
+static bool
+output_cursor_only_damage(struct weston_output *output,
+			  struct weston_view *cursor,
+			  bool only_cursor_dirty,
+			  pixman_region32_t *damage)
+{
+	struct weston_compositor *ec = output->compositor;
+	pixman_box32_t *old = &output->cursor_box;
+	pixman_box32_t box;
+
+	if (!only_cursor_dirty || !cursor || cursor != output->cursor_view ||
+	    output->cursor_view_list_hash != ec->view_list_hash)
+		return false;
+
+	output_cursor_box(output, cursor, &box);
+
+	pixman_region32_intersect(damage, &ec->primary_plane.damage,
+				  &output->region);
+	pixman_region32_union_rect(damage, damage, old->x1, old->y1,
+				   old->x2 - old->x1, old->y2 - old->y1);
+	pixman_region32_union_rect(damage, damage, box.x1, box.y1,
+				   box.x2 - box.x1, box.y2 - box.y1);
+
+	return true;
+}
+
 static int
 weston_output_repaint(struct weston_output *output)
 {
 	struct weston_compositor *ec = output->compositor;
-	struct weston_view *ev;
+	struct weston_view *ev, *cursor;
+	struct weston_seat *seat;
 	struct weston_animation *animation, *next;
 	struct weston_frame_callback *cb, *cnext;
 	struct wl_list frame_callback_list;
 	pixman_region32_t output_damage;
+	struct output_stats_timer timer, step;
+	struct timespec begin = { 0, 0 };
+	struct timespec started;
+	bool only_cursor_dirty;
+	uint32_t usec;
 	int r;
 
 	if (output->destroying)
 		return 0;
 
+	/* Deliver the motion held back since the last frame, so that this
+	 * repaint already shows its effect. */
+	if (ec->motion_coalescing)
+		wl_list_for_each(seat, &ec->seat_list, link)
+			weston_seat_flush_motion(seat);
+
+	if (weston_timeline_enabled_)
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	output_stats_timer_start(&timer);
+	weston_compositor_read_presentation_clock(ec, &started);
+	output->stats.damage_in_flight = output->stats.damage_pending;
+	output->stats.damage_pending.tv_sec = 0;
+	output->stats.damage_pending.tv_nsec = 0;
+
 	TL_POINT("core_repaint_begin", TLP_OUTPUT(output), TLP_END);
+	WESTON_PROBE(repaint_begin, output->id);
+
+	only_cursor_dirty = output_only_cursor_dirty(output);
 
 	/* Rebuild the surface list and update surface transforms up front. */
 	weston_compositor_build_view_list(ec);
 
+	pixman_region32_init(&output_damage);
+	cursor = output_cursor_view(output);
+	output->cursor_only = output_cursor_only_damage(output, cursor,
+							only_cursor_dirty,
+							&output_damage);
+
 	if (output->assign_planes && !output->disable_planes) {
+		output_stats_timer_start(&step);
 		output->assign_planes(output);
+		output_stats_timer_stop(&step, &output->stats.assign_planes);
 	} else {
 		wl_list_for_each(ev, &ec->view_list, link) {
 			weston_view_move_to_plane(ev, &ec->primary_plane);
@@ -2257,27 +2695,51 @@ weston_output_repaint(struct weston_output *output)
 		}
 	}
 
-	compositor_accumulate_damage(ec);
+	if (!output->cursor_only) {
+		compositor_accumulate_damage(ec);
 
-	pixman_region32_init(&output_damage);
-	pixman_region32_intersect(&output_damage,
-				  &ec->primary_plane.damage, &output->region);
-	pixman_region32_subtract(&output_damage,
-				 &output_damage, &ec->primary_plane.clip);
+		pixman_region32_intersect(&output_damage,
+					  &ec->primary_plane.damage,
+					  &output->region);
+		pixman_region32_subtract(&output_damage,
+					 &output_damage,
+					 &ec->primary_plane.clip);
+	}
+
+	/* The renderer keeps the background of the cursor from the
+	 * damaged part of its box, so a newly tracked cursor has its whole
+	 * box repainted once. */
+	if (cursor) {
+		output_cursor_box(output, cursor, &output->cursor_box);
+		if (cursor != output->cursor_view)
+			pixman_region32_union_rect(&output_damage,
+				&output_damage,
+				output->cursor_box.x1, output->cursor_box.y1,
+				output->cursor_box.x2 - output->cursor_box.x1,
+				output->cursor_box.y2 - output->cursor_box.y1);
+	}
+	output->cursor_view = cursor;
+	output->cursor_view_list_hash = ec->view_list_hash;
+	output->cursor_geometry_serial = ec->view_geometry_serial;
 
 	if (output->dirty)
 		weston_output_update_matrix(output);
 
+	output_stats_timer_start(&step);
 	r = output->repaint(output, &output_damage);
+	output_stats_timer_stop(&step, &output->stats.render);
 
 	pixman_region32_fini(&output_damage);
 
 	output->repaint_needed = 0;
 
-	weston_compositor_repick(ec);
+	weston_compositor_repick(ec, output);
 	wl_event_loop_dispatch(ec->input_loop, 0);
 
 	wl_list_for_each_safe(cb, cnext, &frame_callback_list, link) {
+		WESTON_PROBE(frame_done, output->id,
+			     wl_resource_get_id(cb->resource),
+			     output->frame_time);
 		wl_callback_send_done(cb->resource, output->frame_time);
 		wl_resource_destroy(cb->resource);
 	}
@@ -2288,6 +2750,20 @@ weston_output_repaint(struct weston_output *output)
 	}
 
 	TL_POINT("core_repaint_posted", TLP_OUTPUT(output), TLP_END);
+	WESTON_PROBE(repaint_posted, output->id);
+
+	output_stats_timer_stop(&timer, &output->stats.repaint);
+	usec = elapsed_usec(&timer.now, &timer.start);
+	if (output->cursor_only)
+		weston_histogram_add(&output->stats.cursor_repaint, usec);
+	weston_compositor_read_presentation_clock(ec, &output->stats.posted);
+	/* A cursor-only repaint says nothing about how long a full one
+	 * takes, keep it out of the adaptive repaint window. */
+	if (!output->cursor_only)
+		output_repaint_sample(output, &started, usec);
+
+	if (weston_timeline_enabled_)
+		weston_timeline_recorder_check_repaint(output, &begin);
 
 	return r;
 }
@@ -2310,7 +2786,10 @@ weston_output_schedule_repaint_reset(struct weston_output *output)
 	int fd;
 
 	output->repaint_scheduled = 0;
+	output->stats.last_presented.tv_sec = 0;
+	output->stats.last_presented.tv_nsec = 0;
 	TL_POINT("core_repaint_exit_loop", TLP_OUTPUT(output), TLP_END);
+	WESTON_PROBE(repaint_exit_loop, output->id);
 
 	if (compositor->input_loop_source)
 		return;
@@ -2348,10 +2827,17 @@ weston_output_finish_frame(struct weston_output *output,
 	int32_t refresh_nsec;
 	struct timespec now;
 	struct timespec gone;
+	int64_t lead_nsec;
 	int msec;
 
-	TL_POINT("core_repaint_finished", TLP_OUTPUT(output),
-		 TLP_VBLANK(stamp), TLP_END);
+	if (presented_flags == PRESENTATION_FEEDBACK_INVALID)
+		TL_POINT("core_repaint_finished", TLP_OUTPUT(output),
+			 TLP_VBLANK_INVALID(stamp), TLP_END);
+	else
+		TL_POINT("core_repaint_finished", TLP_OUTPUT(output),
+			 TLP_VBLANK(stamp), TLP_END);
+	WESTON_PROBE(repaint_finished, output->id, (int64_t) stamp->tv_sec,
+		     stamp->tv_nsec, presented_flags);
 
 	refresh_nsec = millihz_to_nsec(output->current_mode->refresh);
 	weston_presentation_feedback_present_list(&output->feedback_list,
@@ -2359,12 +2845,20 @@ weston_output_finish_frame(struct weston_output *output,
 						  output->msc,
 						  presented_flags);
 
+	if (presented_flags != PRESENTATION_FEEDBACK_INVALID)
+		output_stats_presented(output, stamp, refresh_nsec);
+
 	output->frame_time = stamp->tv_sec * 1000 + stamp->tv_nsec / 1000000;
 
 	weston_compositor_read_presentation_clock(compositor, &now);
 	timespec_sub(&gone, &now, stamp);
-	msec = (refresh_nsec - timespec_to_nsec(&gone)) / 1000000; /* floor */
-	msec -= compositor->repaint_msec;
+	lead_nsec = output_repaint_lead_nsec(output, refresh_nsec);
+	if (presented_flags != PRESENTATION_FEEDBACK_INVALID)
+		output_repaint_lead_presented(output, refresh_nsec, lead_nsec);
+	/* Truncated towards zero, so a deadline missed by less than a
+	 * millisecond still repaints right away. */
+	msec = (refresh_nsec - timespec_to_nsec(&gone) - lead_nsec) /
+	       1000000;
 
 	if (msec < -1000 || msec > 1000) {
 		static bool warned;
@@ -2384,6 +2878,28 @@ weston_output_finish_frame(struct weston_output *output,
 	if (presented_flags == PRESENTATION_FEEDBACK_INVALID && msec < 0)
 		msec += refresh_nsec / 1000000;
 
+	output->repaint_due = now;
+	if (msec > 0)
+		timespec_add_nsec(&output->repaint_due, &now,
+				  (int64_t) msec * 1000000);
+
+	/* An unthrottled output does not wait for the repaint window of
+	 * the next refresh at all. */
+	if (output->unthrottled) {
+		output_repaint_timer_handler(output);
+		return;
+	}
+
+	/* With a virtual clock there is nothing to wait for: jump straight
+	 * to the repaint deadline. */
+	if (compositor->presentation_clock_virtual) {
+		if (msec > 0)
+			weston_compositor_advance_presentation_clock(compositor,
+						(int64_t) msec * 1000000);
+		output_repaint_timer_handler(output);
+		return;
+	}
+
 	if (msec < 1)
 		output_repaint_timer_handler(output);
 	else
@@ -2457,8 +2973,14 @@ weston_output_schedule_repaint(struct weston_output *output)
 	    compositor->state == WESTON_COMPOSITOR_OFFSCREEN)
 		return;
 
-	if (!output->repaint_needed)
+	if (!output->repaint_needed) {
 		TL_POINT("core_repaint_req", TLP_OUTPUT(output), TLP_END);
+		WESTON_PROBE(repaint_req, output->id);
+	}
+
+	if (!timespec_is_set(&output->stats.damage_pending))
+		weston_compositor_read_presentation_clock(compositor,
+					&output->stats.damage_pending);
 
 	loop = wl_display_get_event_loop(compositor->wl_display);
 	output->repaint_needed = 1;
@@ -2468,6 +2990,7 @@ weston_output_schedule_repaint(struct weston_output *output)
 	wl_event_loop_add_idle(loop, idle_repaint, output);
 	output->repaint_scheduled = 1;
 	TL_POINT("core_repaint_enter_loop", TLP_OUTPUT(output), TLP_END);
+	WESTON_PROBE(repaint_enter_loop, output->id);
 
 
 	if (compositor->input_loop_source) {
@@ -2498,6 +3021,10 @@ surface_attach(struct wl_client *client,
 {
 	struct weston_surface *surface = wl_resource_get_user_data(resource);
 	struct weston_buffer *buffer = NULL;
+	struct weston_client_timer timer;
+
+	weston_client_timer_start(&timer, surface->compositor, resource);
+	WESTON_PROBE(surface_attach, surface, buffer_resource, sx, sy);
 
 	if (buffer_resource) {
 		buffer = weston_buffer_from_resource(buffer_resource);
@@ -2514,6 +3041,8 @@ surface_attach(struct wl_client *client,
 	surface->pending.sx = sx;
 	surface->pending.sy = sy;
 	surface->pending.newly_attached = 1;
+
+	weston_client_timer_stop(&timer, WESTON_CLIENT_COST_REQUEST);
 }
 
 static void
@@ -2522,10 +3051,15 @@ surface_damage(struct wl_client *client,
 	       int32_t x, int32_t y, int32_t width, int32_t height)
 {
 	struct weston_surface *surface = wl_resource_get_user_data(resource);
+	struct weston_client_timer timer;
+
+	weston_client_timer_start(&timer, surface->compositor, resource);
 
 	pixman_region32_union_rect(&surface->pending.damage,
 				   &surface->pending.damage,
 				   x, y, width, height);
+
+	weston_client_timer_stop(&timer, WESTON_CLIENT_COST_REQUEST);
 }
 
 static void
@@ -2693,6 +3227,7 @@ weston_surface_commit_state(struct weston_surface *surface,
 {
 	struct weston_view *view;
 	pixman_region32_t opaque;
+	pixman_region32_t input;
 
 	/* wl_surface.set_buffer_transform */
 	/* wl_surface.set_buffer_scale */
@@ -2724,6 +3259,9 @@ weston_surface_commit_state(struct weston_surface *surface,
 	if (weston_timeline_enabled_ &&
 	    pixman_region32_not_empty(&state->damage))
 		TL_POINT("core_commit_damage", TLP_SURFACE(surface), TLP_END);
+	WESTON_PROBE(commit_damage, surface,
+		     state->damage.extents.x1, state->damage.extents.y1,
+		     state->damage.extents.x2, state->damage.extents.y2);
 	pixman_region32_union(&surface->damage, &surface->damage,
 			      &state->damage);
 	pixman_region32_intersect_rect(&surface->damage, &surface->damage,
@@ -2744,9 +3282,18 @@ weston_surface_commit_state(struct weston_surface *surface,
 	pixman_region32_fini(&opaque);
 
 	/* wl_surface.set_input_region */
-	pixman_region32_intersect_rect(&surface->input, &state->input,
+	pixman_region32_init(&input);
+	pixman_region32_intersect_rect(&input, &state->input,
 				       0, 0, surface->width, surface->height);
 
+	if (!pixman_region32_equal(&input, &surface->input)) {
+		pixman_region32_copy(&surface->input, &input);
+		wl_list_for_each(view, &surface->views, surface_link)
+			weston_view_damage_pick(view);
+	}
+
+	pixman_region32_fini(&input);
+
 	/* wl_surface.frame */
 	wl_list_insert_list(&surface->frame_callback_list,
 			    &state->frame_callback_list);
@@ -2761,6 +3308,10 @@ weston_surface_commit_state(struct weston_surface *surface,
 	wl_list_insert_list(&surface->feedback_list,
 			    &state->feedback_list);
 	wl_list_init(&state->feedback_list);
+
+	/* Listeners see the committed buffer and the damage that has
+	 * not yet been flushed to the renderer. */
+	wl_signal_emit(&surface->commit_signal, surface);
 }
 
 static void
@@ -2785,18 +3336,24 @@ surface_commit(struct wl_client *client, struct wl_resource *resource)
 {
 	struct weston_surface *surface = wl_resource_get_user_data(resource);
 	struct weston_subsurface *sub = weston_surface_to_subsurface(surface);
+	struct weston_client_timer timer;
+
+	weston_client_timer_start(&timer, surface->compositor, resource);
+	weston_client_stats_add_commit(surface->compositor, resource);
+	WESTON_PROBE(surface_commit, surface, wl_resource_get_id(resource));
 
 	if (sub) {
 		weston_subsurface_commit(sub);
-		return;
-	}
-
-	weston_surface_commit(surface);
+	} else {
+		weston_surface_commit(surface);
 
-	wl_list_for_each(sub, &surface->subsurface_list, parent_link) {
-		if (sub->surface != surface)
-			weston_subsurface_parent_commit(sub, 0);
+		wl_list_for_each(sub, &surface->subsurface_list, parent_link) {
+			if (sub->surface != surface)
+				weston_subsurface_parent_commit(sub, 0);
+		}
 	}
+
+	weston_client_timer_stop(&timer, WESTON_CLIENT_COST_REQUEST);
 }
 
 static void
@@ -4030,6 +4587,7 @@ weston_output_move(struct weston_output *output, int x, int y)
 	weston_output_init_geometry(output, x, y);
 
 	output->dirty = 1;
+	output->cursor_view = NULL;
 
 	/* Move views on this output. */
 	wl_signal_emit(&output->compositor->output_moved_signal, output);
@@ -4066,6 +4624,9 @@ weston_output_init(struct weston_output *output, struct weston_compositor *c,
 	output->dirty = 1;
 	output->original_scale = scale;
 
+	memset(&output->stats, 0, sizeof output->stats);
+	weston_output_stats_reset(output);
+
 	weston_output_transform_scale_init(output, transform, scale);
 	weston_output_init_zoom(output);
 
@@ -4449,6 +5010,32 @@ timeline_key_binding_handler(struct weston_keyboard *keyboard, uint32_t time,
 		weston_timeline_open(compositor);
 }
 
+static void
+timeline_recorder_binding_handler(struct weston_keyboard *keyboard,
+				  uint32_t time, uint32_t key, void *data)
+{
+	weston_timeline_recorder_dump("debug binding");
+}
+
+static void
+input_recorder_binding_handler(struct weston_keyboard *keyboard,
+			       uint32_t time, uint32_t key, void *data)
+{
+	struct weston_seat *seat = keyboard->seat;
+	struct weston_input_recorder *recorder;
+	static const char filename[] = "input-capture.wir";
+
+	recorder = weston_input_recorder_get(seat);
+	if (recorder) {
+		weston_input_recorder_destroy(recorder);
+		return;
+	}
+
+	weston_log("starting input recorder for seat %s, file %s\n",
+		   seat->seat_name, filename);
+	weston_input_recorder_create(seat, filename);
+}
+
 /** Create the compositor.
  *
  * This functions creates and initializes a compositor instance.
@@ -4489,6 +5076,7 @@ weston_compositor_create(struct wl_display *display, void *user_data)
 
 	ec->output_id_pool = 0;
 	ec->repaint_msec = DEFAULT_REPAINT_WINDOW;
+	ec->repaint_margin_usec = DEFAULT_REPAINT_MARGIN;
 
 	if (!wl_global_create(ec->wl_display, &wl_compositor_interface, 3,
 			      ec, compositor_bind))
@@ -4510,6 +5098,7 @@ weston_compositor_create(struct wl_display *display, void *user_data)
 	wl_list_init(&ec->plane_list);
 	wl_list_init(&ec->layer_list);
 	wl_list_init(&ec->seat_list);
+	wl_list_init(&ec->xkb_info_cache);
 	wl_list_init(&ec->output_list);
 	wl_list_init(&ec->key_binding_list);
 	wl_list_init(&ec->modifier_binding_list);
@@ -4517,8 +5106,13 @@ weston_compositor_create(struct wl_display *display, void *user_data)
 	wl_list_init(&ec->touch_binding_list);
 	wl_list_init(&ec->axis_binding_list);
 	wl_list_init(&ec->debug_binding_list);
+	weston_binding_table_init(&ec->key_binding_table);
+	weston_binding_table_init(&ec->button_binding_table);
+	weston_binding_table_init(&ec->axis_binding_table);
+	weston_binding_table_init(&ec->debug_binding_table);
 
 	weston_plane_init(&ec->primary_plane, ec, 0, 0);
+	pixman_region32_init(&ec->pick_damage);
 	weston_compositor_stack_plane(ec, &ec->primary_plane, NULL);
 
 	wl_data_device_manager_init(ec->wl_display);
@@ -4536,6 +5130,12 @@ weston_compositor_create(struct wl_display *display, void *user_data)
 
 	weston_compositor_add_debug_binding(ec, KEY_T,
 					    timeline_key_binding_handler, ec);
+	weston_compositor_add_debug_binding(ec, KEY_D,
+					    timeline_recorder_binding_handler,
+					    ec);
+	weston_compositor_add_debug_binding(ec, KEY_I,
+					    input_recorder_binding_handler,
+					    ec);
 
 	return ec;
 
@@ -4568,6 +5168,7 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	weston_binding_list_destroy_all(&ec->debug_binding_list);
 
 	weston_plane_release(&ec->primary_plane);
+	pixman_region32_fini(&ec->pick_damage);
 
 	wl_event_loop_destroy(ec->input_loop);
 }
@@ -4607,6 +5208,7 @@ weston_compositor_set_presentation_clock(struct weston_compositor *compositor,
 		return -1;
 
 	compositor->presentation_clock = clk_id;
+	compositor->presentation_clock_virtual = false;
 
 	return 0;
 }
@@ -4659,6 +5261,11 @@ weston_compositor_read_presentation_clock(
 	static bool warned;
 	int ret;
 
+	if (compositor->presentation_clock_virtual) {
+		*ts = compositor->presentation_clock_now;
+		return;
+	}
+
 	ret = clock_gettime(compositor->presentation_clock, ts);
 	if (ret < 0) {
 		ts->tv_sec = 0;
@@ -4672,6 +5279,59 @@ weston_compositor_read_presentation_clock(
 	}
 }
 
+/** Switch to a virtual presentation clock
+ *
+ * \param compositor
+ * \param start The time the clock starts at.
+ * \return 0 on success, -1 on failure.
+ *
+ * The virtual clock does not follow the system time: it stands still
+ * unless advanced with weston_compositor_advance_presentation_clock(),
+ * and weston_output_finish_frame() advances it to the repaint deadline
+ * instead of waiting for it. This makes presentation timestamps
+ * reproducible and lets the repaint loop run as fast as the backend
+ * completes frames.
+ *
+ * Clients are told the presentation clock is CLOCK_MONOTONIC.
+ */
+WL_EXPORT int
+weston_compositor_set_presentation_clock_virtual(
+					struct weston_compositor *compositor,
+					const struct timespec *start)
+{
+	if (weston_compositor_set_presentation_clock(compositor,
+						     CLOCK_MONOTONIC) < 0)
+		return -1;
+
+	compositor->presentation_clock_virtual = true;
+	compositor->presentation_clock_now = *start;
+
+	return 0;
+}
+
+/** Move the virtual presentation clock forward
+ *
+ * \param compositor
+ * \param nsec Nanoseconds to advance by, negative values are ignored.
+ *
+ * Has no effect unless the virtual clock is in use, see
+ * weston_compositor_set_presentation_clock_virtual().
+ */
+WL_EXPORT void
+weston_compositor_advance_presentation_clock(
+					struct weston_compositor *compositor,
+					int64_t nsec)
+{
+	struct timespec *now = &compositor->presentation_clock_now;
+
+	if (!compositor->presentation_clock_virtual || nsec <= 0)
+		return;
+
+	nsec += now->tv_nsec;
+	now->tv_sec += nsec / NSEC_PER_SEC;
+	now->tv_nsec = nsec % NSEC_PER_SEC;
+}
+
 /** Import dmabuf buffer into current renderer
  *
  * \param compositor
@@ -44,6 +44,7 @@ extern "C" {
 #include "config-parser.h"
 #include "zalloc.h"
 #include "timeline-object.h"
+#include "histogram.h"
 
 struct weston_transform {
 	struct weston_matrix matrix;
@@ -169,6 +170,50 @@ enum dpms_enum {
 	WESTON_DPMS_OFF
 };
 
+/** Repaint statistics of an output
+ *
+ * All durations are in microseconds. The time spent in the compositor,
+ * repaint, assign_planes, render and cursor_repaint, is measured on
+ * CLOCK_MONOTONIC, so that it is real even with a virtual presentation
+ * clock. Anything ending at a presentation is measured on the
+ * presentation clock.
+ */
+struct weston_output_stats {
+	/** Whole of weston_output_repaint() */
+	struct weston_histogram repaint;
+	/** weston_output::assign_planes */
+	struct weston_histogram assign_planes;
+	/** weston_output::repaint, including the renderer */
+	struct weston_histogram render;
+	/** From the end of the repaint to the presentation */
+	struct weston_histogram flip;
+	/** From the first damage of a frame to its presentation */
+	struct weston_histogram damage_to_present;
+	/** How long before the vblank the repaint was started */
+	struct weston_histogram repaint_lead;
+	/** How much later the repaint started than with the static repaint
+	 * window, with adaptive repaint scheduling */
+	struct weston_histogram latency_saved;
+	/** Whole of the repaints that only moved the software cursor */
+	struct weston_histogram cursor_repaint;
+
+	uint32_t frames_presented;
+	/** Refresh cycles missed while the repaint loop was running */
+	uint32_t frames_missed;
+	/** Seats repicked after a repaint, and seats whose repick was
+	 * skipped because nothing changed under their pointer */
+	uint32_t repicks;
+	uint32_t repicks_skipped;
+
+	struct timespec damage_pending;
+	struct timespec damage_in_flight;
+	struct timespec posted;
+	struct timespec last_presented;
+};
+
+/* Number of recent repaints the adaptive repaint scheduling looks at */
+#define WESTON_REPAINT_SAMPLES 32
+
 struct weston_output {
 	uint32_t id;
 	char *name;
@@ -240,6 +285,25 @@ struct weston_output {
 			  uint16_t *b);
 
 	struct weston_timeline_object timeline;
+	struct weston_output_stats stats;
+
+	/* Adaptive repaint scheduling, see weston_output_finish_frame() */
+	uint32_t repaint_samples[WESTON_REPAINT_SAMPLES]; /* usec */
+	uint32_t repaint_sample_count;
+	uint32_t repaint_fallback;	/* frames left on the static window */
+	struct timespec repaint_due;
+	/* Set by the backend to repaint as soon as a frame completes,
+	 * regardless of the refresh rate */
+	bool unthrottled;
+
+	/* Software cursor whose background the renderer keeps, and where
+	 * it was last painted, see output_cursor_only_damage() */
+	struct weston_view *cursor_view;
+	pixman_box32_t cursor_box;
+	uint32_t cursor_view_list_hash;
+	uint32_t cursor_geometry_serial;
+	/* This repaint only moves cursor_view */
+	bool cursor_only;
 };
 
 struct weston_pointer_grab;
@@ -314,10 +378,20 @@ struct weston_data_source {
 	void (*cancel)(struct weston_data_source *source);
 };
 
+#define WESTON_RESOURCE_TABLE_SIZE 64 /* power of two */
+
+/* The unfocused wl_pointer, wl_keyboard or wl_touch resources of an input
+ * device, grouped by client and hashed by the client, so that a focus
+ * change only looks at the resources of the clients losing and gaining
+ * the focus. */
+struct weston_resource_table {
+	struct wl_list buckets[WESTON_RESOURCE_TABLE_SIZE];
+};
+
 struct weston_pointer {
 	struct weston_seat *seat;
 
-	struct wl_list resource_list;
+	struct weston_resource_table resource_table;
 	struct wl_list focus_resource_list;
 	struct weston_view *focus;
 	uint32_t focus_serial;
@@ -341,6 +415,12 @@ struct weston_pointer {
 	wl_fixed_t sx, sy;
 	uint32_t button_count;
 
+	/* State at the last repick, see weston_compositor_repick().
+	 * pick_focus is only compared, never dereferenced. */
+	struct weston_view *pick_focus;
+	struct weston_pointer_grab *pick_grab;
+	wl_fixed_t pick_x, pick_y;
+
 	struct wl_listener output_destroy_listener;
 };
 
@@ -348,7 +428,7 @@ struct weston_pointer {
 struct weston_touch {
 	struct weston_seat *seat;
 
-	struct wl_list resource_list;
+	struct weston_resource_table resource_table;
 	struct wl_list focus_resource_list;
 	struct weston_view *focus;
 	struct wl_listener focus_view_listener;
@@ -448,12 +528,17 @@ weston_touch_start_drag(struct weston_touch *touch,
 			struct weston_surface *icon,
 			struct wl_client *client);
 
+/* Compiled keymaps are shared by all the keyboards whose keymap has the
+ * same text, see weston_compositor::xkb_info_cache. keymap_fd is a
+ * sealed, read-only file sent as is to every client. */
 struct weston_xkb_info {
 	struct xkb_keymap *keymap;
 	int keymap_fd;
 	size_t keymap_size;
 	char *keymap_area;
 	int32_t ref_count;
+	uint32_t keymap_hash;
+	struct wl_list link;	/* weston_compositor::xkb_info_cache */
 	xkb_mod_index_t shift_mod;
 	xkb_mod_index_t caps_mod;
 	xkb_mod_index_t ctrl_mod;
@@ -470,7 +555,7 @@ struct weston_xkb_info {
 struct weston_keyboard {
 	struct weston_seat *seat;
 
-	struct wl_list resource_list;
+	struct weston_resource_table resource_table;
 	struct wl_list focus_resource_list;
 	struct weston_surface *focus;
 	struct wl_listener focus_resource_listener;
@@ -503,6 +588,53 @@ struct weston_keyboard {
 	struct xkb_keymap *pending_keymap;
 };
 
+#define WESTON_BINDING_TABLE_SIZE 128 /* power of two */
+
+/* Key, button, axis and debug bindings are also hashed by their code and
+ * modifier mask, so that an input event only looks at the bindings that
+ * can match it. Each bucket keeps the order the bindings were added in. */
+struct weston_binding_table {
+	struct wl_list buckets[WESTON_BINDING_TABLE_SIZE];
+};
+
+/* Motion held back until the next repaint when the compositor coalesces
+ * motion, and the touch events of a touch frame that has not ended yet,
+ * see weston_seat_flush_motion(). */
+struct weston_seat_motion {
+	int pointer_pending;
+	int pointer_absolute;
+	uint32_t pointer_time;
+	wl_fixed_t x, y;		/* if pointer_absolute */
+	wl_fixed_t dx, dy;		/* relative to x, y or the pointer */
+
+	struct wl_array touch;		/* one entry per touch point */
+	int touch_frame;		/* a held back touch frame */
+	struct wl_array touch_batch;	/* events of the current touch frame */
+	struct wl_event_source *touch_idle; /* delivers an unended frame */
+	struct wl_array touch_send;	/* a touch frame sent to the focus */
+};
+
+enum weston_input_event_type {
+	WESTON_INPUT_EVENT_MOTION,
+	WESTON_INPUT_EVENT_MOTION_ABSOLUTE,
+	WESTON_INPUT_EVENT_BUTTON,
+	WESTON_INPUT_EVENT_AXIS,
+	WESTON_INPUT_EVENT_KEY,
+	WESTON_INPUT_EVENT_TOUCH,
+	WESTON_INPUT_EVENT_TOUCH_FRAME,
+};
+
+/* The arguments of a notify_*() call, emitted on weston_seat::input_signal
+ * before the event is processed. */
+struct weston_input_event {
+	struct weston_seat *seat;
+	enum weston_input_event_type type;
+	uint32_t time;
+	int32_t code;		/* button, axis, key or touch id */
+	uint32_t state;		/* button or key state, touch type */
+	wl_fixed_t x, y;	/* motion, position, or axis value in x */
+};
+
 struct weston_seat {
 	struct wl_list base_resource_list;
 
@@ -518,6 +650,7 @@ struct weston_seat {
 
 	struct wl_signal destroy_signal;
 	struct wl_signal updated_caps_signal;
+	struct wl_signal input_signal;
 
 	struct weston_compositor *compositor;
 	struct wl_list link;
@@ -536,6 +669,8 @@ struct weston_seat {
 	uint32_t slot_map;
 	struct input_method *input_method;
 	char *seat_name;
+
+	struct weston_seat_motion motion;
 };
 
 enum {
@@ -610,6 +745,9 @@ enum weston_capability {
 
 	/* renderer supports weston_view_set_mask() clipping */
 	WESTON_CAP_VIEW_CLIP_MASK		= 0x0010,
+
+	/* renderer can repaint weston_output::cursor_view on its own */
+	WESTON_CAP_CURSOR_REPAINT		= 0x0020,
 };
 
 struct weston_backend {
@@ -662,6 +800,10 @@ struct weston_compositor {
 	struct wl_list touch_binding_list;
 	struct wl_list axis_binding_list;
 	struct wl_list debug_binding_list;
+	struct weston_binding_table key_binding_table;
+	struct weston_binding_table button_binding_table;
+	struct weston_binding_table axis_binding_table;
+	struct weston_binding_table debug_binding_table;
 
 	uint32_t state;
 	struct wl_event_source *idle_source;
@@ -672,6 +814,14 @@ struct weston_compositor {
 
 	/* Repaint state. */
 	struct weston_plane primary_plane;
+	/* Global area where views changed since the last repick, and
+	 * whether the stacking order changed so that all seats repick */
+	pixman_region32_t pick_damage;
+	bool pick_damage_all;
+	uint32_t view_list_hash;
+	/* Bumped whenever the transform of a view other than an output's
+	 * cursor_view is updated */
+	uint32_t view_geometry_serial;
 	uint32_t capabilities; /* combination of enum weston_capability */
 
 	struct weston_renderer *renderer;
@@ -687,6 +837,8 @@ struct weston_compositor {
 	struct xkb_rule_names xkb_names;
 	struct xkb_context *xkb_context;
 	struct weston_xkb_info *xkb_info;
+	/* Every weston_xkb_info in use, each with a distinct keymap */
+	struct wl_list xkb_info_cache;
 
 	/* Raw keyboard processing (no libxkbcommon initialization or handling) */
 	int use_xkbcommon;
@@ -695,7 +847,24 @@ struct weston_compositor {
 	int32_t kb_repeat_delay;
 
 	clockid_t presentation_clock;
+	/* When set, the presentation clock is not read from the system
+	 * but only advanced by the compositor and backend. */
+	bool presentation_clock_virtual;
+	struct timespec presentation_clock_now;
 	int32_t repaint_msec;
+	/* Start repaints as late as the measured repaint times allow,
+	 * with this many microseconds to spare */
+	int adaptive_repaint;
+	int32_t repaint_margin_usec;
+
+	/* Deliver pointer and touch motion once per frame */
+	int motion_coalescing;
+	/* Repaint frames that only move the software cursor without
+	 * repainting the scene, with WESTON_CAP_CURSOR_REPAINT */
+	int cursor_only_repaint;
+
+	/* Debugging statistics, only with --debug */
+	struct weston_stats *stats;
 
 	int exit_code;
 
@@ -895,6 +1064,7 @@ struct weston_surface_state {
 struct weston_surface {
 	struct wl_resource *resource;
 	struct wl_signal destroy_signal; /* callback argument: this surface */
+	struct wl_signal commit_signal; /* callback argument: this surface */
 	struct weston_compositor *compositor;
 
 	/** Damage in local coordinates from the client, for tex upload. */
@@ -1094,12 +1264,20 @@ notify_keyboard_focus_in(struct weston_seat *seat, struct wl_array *keys,
 void
 notify_keyboard_focus_out(struct weston_seat *seat);
 
+/* Touch events are held back until the notify_touch_frame() that ends
+ * their frame, so that a frame goes out to each client in one burst.
+ * Backends must end every group of notify_touch() calls with
+ * notify_touch_frame(). Events of a frame that is not ended are
+ * delivered without a frame event once the event loop goes idle. */
 void
 notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
 	     wl_fixed_t x, wl_fixed_t y, int touch_type);
 void
 notify_touch_frame(struct weston_seat *seat);
 
+void
+weston_seat_flush_motion(struct weston_seat *seat);
+
 void
 weston_layer_entry_insert(struct weston_layer_entry *list,
 			  struct weston_layer_entry *entry);
@@ -1136,6 +1314,8 @@ weston_output_finish_frame(struct weston_output *output,
 void
 weston_output_schedule_repaint(struct weston_output *output);
 void
+weston_output_stats_reset(struct weston_output *output);
+void
 weston_output_damage(struct weston_output *output);
 void
 weston_compositor_schedule_repaint(struct weston_compositor *compositor);
@@ -1220,6 +1400,9 @@ weston_install_debug_key_binding(struct weston_compositor *compositor,
 void
 weston_binding_list_destroy_all(struct wl_list *list);
 
+void
+weston_binding_table_init(struct weston_binding_table *table);
+
 void
 weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				  struct weston_keyboard *keyboard,
@@ -1368,6 +1551,14 @@ void
 weston_compositor_read_presentation_clock(
 			const struct weston_compositor *compositor,
 			struct timespec *ts);
+int
+weston_compositor_set_presentation_clock_virtual(
+					struct weston_compositor *compositor,
+					const struct timespec *start);
+void
+weston_compositor_advance_presentation_clock(
+					struct weston_compositor *compositor,
+					int64_t nsec);
 
 bool
 weston_compositor_import_dmabuf(struct weston_compositor *compositor,
@@ -1438,6 +1629,10 @@ weston_log_file_open(const char *filename);
 void
 weston_log_file_close(void);
 int
+weston_log_async_start(void);
+void
+weston_log_flush(void);
+int
 weston_vlog(const char *fmt, va_list ap);
 int
 weston_vlog_continue(const char *fmt, va_list ap);
@@ -1468,6 +1663,37 @@ tty_activate_vt(struct tty *tty, int vt);
 void
 screenshooter_create(struct weston_compositor *ec);
 
+int
+weston_stats_create(struct weston_compositor *compositor);
+
+enum weston_client_cost {
+	WESTON_CLIENT_COST_REQUEST,
+	WESTON_CLIENT_COST_RENDER,
+};
+
+struct weston_client_timer {
+	struct weston_client_stats *stats;
+	struct timespec begin;
+};
+
+void
+weston_client_timer_start(struct weston_client_timer *timer,
+			  struct weston_compositor *compositor,
+			  struct wl_resource *resource);
+void
+weston_client_timer_stop(struct weston_client_timer *timer,
+			 enum weston_client_cost cost);
+void
+weston_client_stats_add_commit(struct weston_compositor *compositor,
+			       struct wl_resource *resource);
+void
+weston_client_stats_add_upload(struct weston_compositor *compositor,
+			       struct wl_resource *resource, uint64_t bytes);
+void
+weston_client_stats_add_pixels(struct weston_compositor *compositor,
+			       struct wl_resource *resource,
+			       pixman_region32_t *region);
+
 enum weston_screenshooter_outcome {
 	WESTON_SCREENSHOOTER_SUCCESS,
 	WESTON_SCREENSHOOTER_NO_MEMORY,
@@ -1479,6 +1705,47 @@ typedef void (*weston_screenshooter_done_func_t)(void *data,
 int
 weston_screenshooter_shoot(struct weston_output *output, struct weston_buffer *buffer,
 			   weston_screenshooter_done_func_t done, void *data);
+int
+weston_screenshooter_shoot_region(struct weston_output *output,
+				  struct weston_buffer *buffer,
+				  int32_t x, int32_t y,
+				  int32_t width, int32_t height,
+				  weston_screenshooter_done_func_t done,
+				  void *data);
+
+struct weston_surface_recorder;
+
+struct weston_surface_recorder *
+weston_surface_recorder_create(struct weston_surface *surface,
+			       const char *filename);
+struct weston_surface_recorder *
+weston_surface_recorder_get(struct weston_surface *surface);
+void
+weston_surface_recorder_destroy(struct weston_surface_recorder *recorder);
+
+struct weston_input_recorder;
+
+/* One event of an input recording, as stored in the file. */
+struct weston_input_record {
+	uint32_t type;		/* enum weston_input_event_type */
+	uint32_t time;
+	uint64_t nsec;		/* since the recording started */
+	int32_t code;
+	uint32_t state;
+	wl_fixed_t x, y;
+};
+
+struct weston_input_recorder *
+weston_input_recorder_create(struct weston_seat *seat, const char *filename);
+struct weston_input_recorder *
+weston_input_recorder_get(struct weston_seat *seat);
+void
+weston_input_recorder_destroy(struct weston_input_recorder *recorder);
+int
+weston_input_recording_load(const char *filename, struct wl_array *records);
+void
+weston_input_record_replay(struct weston_seat *seat,
+			   const struct weston_input_record *record);
 
 struct clipboard *
 clipboard_create(struct weston_seat *seat);
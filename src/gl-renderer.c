@@ -669,6 +669,7 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 	struct weston_compositor *ec = ev->surface->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
 	struct gl_surface_state *gs = get_surface_state(ev->surface);
+	struct weston_client_timer timer;
 	/* repaint bounding region in global coordinates: */
 	pixman_region32_t repaint;
 	/* opaque region in surface coordinates: */
@@ -692,6 +693,9 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 	if (!pixman_region32_not_empty(&repaint))
 		goto out;
 
+	/* Only the CPU side of the drawing is measured. */
+	weston_client_timer_start(&timer, ec, ev->surface->resource);
+
 	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
 	if (gr->fan_debug) {
@@ -761,6 +765,9 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 	pixman_region32_fini(&surface_blend);
 	pixman_region32_fini(&surface_opaque);
 
+	weston_client_timer_stop(&timer, WESTON_CLIENT_COST_RENDER);
+	weston_client_stats_add_pixels(ec, ev->surface->resource, &repaint);
+
 out:
 	pixman_region32_fini(&repaint);
 }
@@ -1174,6 +1181,7 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	struct weston_buffer *buffer = gs->buffer_ref.buffer;
 	struct weston_view *view;
 	int texture_used;
+	uint64_t bytes;
 
 #ifdef GL_EXT_unpack_subimage
 	pixman_box32_t *rectangles;
@@ -1208,7 +1216,12 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 
 	glBindTexture(GL_TEXTURE_2D, gs->textures[0]);
 
+	bytes = (uint64_t) wl_shm_buffer_get_stride(buffer->shm_buffer) *
+		buffer->height;
+
 	if (!gr->has_unpack_subimage) {
+		weston_client_stats_add_upload(surface->compositor,
+					       surface->resource, bytes);
 		wl_shm_buffer_begin_access(buffer->shm_buffer);
 		glTexImage2D(GL_TEXTURE_2D, 0, gs->gl_format,
 			     gs->pitch, buffer->height, 0,
@@ -1224,6 +1237,8 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	data = wl_shm_buffer_get_data(buffer->shm_buffer);
 
 	if (gs->needs_full_upload) {
+		weston_client_stats_add_upload(surface->compositor,
+					       surface->resource, bytes);
 		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
 		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
 		wl_shm_buffer_begin_access(buffer->shm_buffer);
@@ -1235,11 +1250,15 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	}
 
 	rectangles = pixman_region32_rectangles(&gs->texture_damage, &n);
+	bytes = 0;
 	wl_shm_buffer_begin_access(buffer->shm_buffer);
 	for (i = 0; i < n; i++) {
 		pixman_box32_t r;
 
 		r = weston_surface_to_buffer_rect(surface, rectangles[i]);
+		bytes += (uint64_t) (r.x2 - r.x1) * (r.y2 - r.y1) *
+			 wl_shm_buffer_get_stride(buffer->shm_buffer) /
+			 gs->pitch;
 
 		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, r.x1);
 		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, r.y1);
@@ -1248,6 +1267,8 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 				gs->gl_format, gs->gl_pixel_type, data);
 	}
 	wl_shm_buffer_end_access(buffer->shm_buffer);
+	weston_client_stats_add_upload(surface->compositor,
+				       surface->resource, bytes);
 #endif
 
 done:
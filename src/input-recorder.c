@@ -0,0 +1,301 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "compositor.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+/* An input recording is a header followed by fixed size records, in host
+ * byte order. It is meant to be replayed on the machine it was made on. */
+#define INPUT_RECORDING_MAGIC	0x31524957	/* "WIR1" */
+
+struct input_recording_header {
+	uint32_t magic;
+	uint32_t record_size;
+};
+
+struct weston_input_recorder {
+	struct weston_seat *seat;
+	int fd;
+	int failed;
+	struct timespec start;
+	uint32_t count;
+
+	/* Written out when full, not from the input path for every event */
+	struct weston_input_record pending[256];
+	int pending_count;
+
+	struct wl_listener input_listener;
+	struct wl_listener seat_destroy_listener;
+};
+
+static void
+input_recorder_flush(struct weston_input_recorder *recorder)
+{
+	ssize_t size = recorder->pending_count * sizeof recorder->pending[0];
+
+	if (recorder->pending_count == 0 || recorder->failed)
+		return;
+
+	if (write(recorder->fd, recorder->pending, size) != size) {
+		weston_log("input recorder: write failed: %m\n");
+		recorder->failed = 1;
+	}
+
+	recorder->pending_count = 0;
+}
+
+static void
+input_recorder_input_notify(struct wl_listener *listener, void *data)
+{
+	struct weston_input_recorder *recorder =
+		container_of(listener, struct weston_input_recorder,
+			     input_listener);
+	struct weston_input_event *event = data;
+	struct weston_input_record *record;
+	struct timespec now, elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	timespec_sub(&elapsed, &now, &recorder->start);
+
+	record = &recorder->pending[recorder->pending_count++];
+	record->type = event->type;
+	record->time = event->time;
+	record->nsec = timespec_to_nsec(&elapsed);
+	record->code = event->code;
+	record->state = event->state;
+	record->x = event->x;
+	record->y = event->y;
+	recorder->count++;
+
+	if (recorder->pending_count == ARRAY_LENGTH(recorder->pending))
+		input_recorder_flush(recorder);
+}
+
+static void
+input_recorder_seat_destroy_notify(struct wl_listener *listener, void *data)
+{
+	struct weston_input_recorder *recorder =
+		container_of(listener, struct weston_input_recorder,
+			     seat_destroy_listener);
+
+	weston_input_recorder_destroy(recorder);
+}
+
+/** Start recording the input events of a seat
+ *
+ * \param seat The seat to record.
+ * \param filename Path of the recording to write.
+ * \return The recorder, or NULL on failure.
+ *
+ * Every notify_*() call on the seat is written to the file with its
+ * arguments and the time since the recording started, so that it can be
+ * fed back with weston_input_record_replay() at its original pace. The
+ * recorder stops by itself when the seat is destroyed.
+ */
+WL_EXPORT struct weston_input_recorder *
+weston_input_recorder_create(struct weston_seat *seat, const char *filename)
+{
+	struct weston_input_recorder *recorder;
+	struct input_recording_header header;
+
+	if (weston_input_recorder_get(seat))
+		return NULL;
+
+	recorder = zalloc(sizeof *recorder);
+	if (recorder == NULL) {
+		weston_log("%s: out of memory\n", __func__);
+		return NULL;
+	}
+
+	recorder->seat = seat;
+	recorder->fd = open(filename,
+			    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (recorder->fd < 0) {
+		weston_log("problem opening output file %s: %m\n", filename);
+		free(recorder);
+		return NULL;
+	}
+
+	header.magic = INPUT_RECORDING_MAGIC;
+	header.record_size = sizeof(struct weston_input_record);
+	if (write(recorder->fd, &header, sizeof header) != sizeof header) {
+		weston_log("input recorder: write failed: %m\n");
+		close(recorder->fd);
+		free(recorder);
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &recorder->start);
+
+	recorder->input_listener.notify = input_recorder_input_notify;
+	wl_signal_add(&seat->input_signal, &recorder->input_listener);
+	recorder->seat_destroy_listener.notify =
+		input_recorder_seat_destroy_notify;
+	wl_signal_add(&seat->destroy_signal,
+		      &recorder->seat_destroy_listener);
+
+	return recorder;
+}
+
+/** Look up the recorder attached to a seat, if any */
+WL_EXPORT struct weston_input_recorder *
+weston_input_recorder_get(struct weston_seat *seat)
+{
+	struct wl_listener *listener;
+
+	listener = wl_signal_get(&seat->input_signal,
+				 input_recorder_input_notify);
+	if (listener == NULL)
+		return NULL;
+
+	return container_of(listener, struct weston_input_recorder,
+			    input_listener);
+}
+
+WL_EXPORT void
+weston_input_recorder_destroy(struct weston_input_recorder *recorder)
+{
+	input_recorder_flush(recorder);
+
+	weston_log("stopping input recorder, %u events\n", recorder->count);
+
+	wl_list_remove(&recorder->input_listener.link);
+	wl_list_remove(&recorder->seat_destroy_listener.link);
+	close(recorder->fd);
+	free(recorder);
+}
+
+/** Read an input recording
+ *
+ * \param filename Path of the recording.
+ * \param records An initialized array the records are appended to.
+ * \return 0 on success, -1 if the file cannot be read or is not an input
+ * recording of this version.
+ */
+WL_EXPORT int
+weston_input_recording_load(const char *filename, struct wl_array *records)
+{
+	struct input_recording_header header;
+	struct weston_input_record *record;
+	FILE *fp;
+	int ret = -1;
+
+	fp = fopen(filename, "re");
+	if (!fp) {
+		weston_log("input recording: cannot open %s: %m\n", filename);
+		return -1;
+	}
+
+	if (fread(&header, sizeof header, 1, fp) != 1 ||
+	    header.magic != INPUT_RECORDING_MAGIC ||
+	    header.record_size != sizeof *record) {
+		weston_log("input recording: %s is not a recording\n",
+			   filename);
+		goto out;
+	}
+
+	for (;;) {
+		record = wl_array_add(records, sizeof *record);
+		if (!record) {
+			weston_log("%s: out of memory\n", __func__);
+			goto out;
+		}
+
+		if (fread(record, sizeof *record, 1, fp) != 1) {
+			records->size -= sizeof *record;
+			break;
+		}
+	}
+
+	ret = 0;
+out:
+	fclose(fp);
+	return ret;
+}
+
+/** Feed a recorded input event to a seat
+ *
+ * \param seat The seat to replay on.
+ * \param record The recorded event.
+ *
+ * Makes the notify_*() call the event was recorded from. Events for a
+ * device the seat does not have are dropped.
+ */
+WL_EXPORT void
+weston_input_record_replay(struct weston_seat *seat,
+			   const struct weston_input_record *record)
+{
+	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
+	struct weston_keyboard *keyboard = weston_seat_get_keyboard(seat);
+	struct weston_touch *touch = weston_seat_get_touch(seat);
+
+	switch (record->type) {
+	case WESTON_INPUT_EVENT_MOTION:
+		if (pointer)
+			notify_motion(seat, record->time,
+				      record->x, record->y);
+		break;
+	case WESTON_INPUT_EVENT_MOTION_ABSOLUTE:
+		if (pointer)
+			notify_motion_absolute(seat, record->time,
+					       record->x, record->y);
+		break;
+	case WESTON_INPUT_EVENT_BUTTON:
+		if (pointer)
+			notify_button(seat, record->time,
+				      record->code, record->state);
+		break;
+	case WESTON_INPUT_EVENT_AXIS:
+		if (pointer)
+			notify_axis(seat, record->time,
+				    record->code, record->x);
+		break;
+	case WESTON_INPUT_EVENT_KEY:
+		if (keyboard)
+			notify_key(seat, record->time, record->code,
+				   record->state, STATE_UPDATE_AUTOMATIC);
+		break;
+	case WESTON_INPUT_EVENT_TOUCH:
+		if (touch)
+			notify_touch(seat, record->time, record->code,
+				     record->x, record->y, record->state);
+		break;
+	case WESTON_INPUT_EVENT_TOUCH_FRAME:
+		if (touch)
+			notify_touch_frame(seat);
+		break;
+	}
+}
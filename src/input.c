@@ -37,6 +37,7 @@
 #include "shared/helpers.h"
 #include "shared/os-compatibility.h"
 #include "compositor.h"
+#include "probes.h"
 
 static void
 empty_region(pixman_region32_t *region)
@@ -53,12 +54,17 @@ static void unbind_resource(struct wl_resource *resource)
 WL_EXPORT void
 weston_seat_repick(struct weston_seat *seat)
 {
-	const struct weston_pointer *pointer = weston_seat_get_pointer(seat);
+	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
 	if (!pointer)
 		return;
 
 	pointer->grab->interface->focus(pointer->grab);
+
+	pointer->pick_focus = pointer->focus;
+	pointer->pick_grab = pointer->grab;
+	pointer->pick_x = pointer->x;
+	pointer->pick_y = pointer->y;
 }
 
 static void
@@ -132,19 +138,177 @@ move_resources(struct wl_list *destination, struct wl_list *source)
 	wl_list_init(source);
 }
 
+/* Unlink the resources of a list that is going away, so that their
+ * destructors do not touch it. */
+static void
+detach_resources(struct wl_list *list)
+{
+	struct wl_resource *resource, *tmp;
+
+	wl_resource_for_each_safe(resource, tmp, list)
+		wl_list_init(wl_resource_get_link(resource));
+	wl_list_init(list);
+}
+
+struct client_resources {
+	struct wl_list link;		/* in a weston_resource_table bucket */
+	struct wl_client *client;
+	struct wl_list resource_list;
+	struct wl_listener client_destroy_listener;
+};
+
+static void
+client_resources_destroy(struct client_resources *cr)
+{
+	detach_resources(&cr->resource_list);
+	wl_list_remove(&cr->link);
+	wl_list_remove(&cr->client_destroy_listener.link);
+	free(cr);
+}
+
+static void
+client_resources_handle_client_destroy(struct wl_listener *listener,
+				       void *data)
+{
+	struct client_resources *cr =
+		container_of(listener, struct client_resources,
+			     client_destroy_listener);
+
+	client_resources_destroy(cr);
+}
+
+static void
+resource_table_init(struct weston_resource_table *table)
+{
+	int i;
+
+	for (i = 0; i < WESTON_RESOURCE_TABLE_SIZE; i++)
+		wl_list_init(&table->buckets[i]);
+}
+
+static void
+resource_table_release(struct weston_resource_table *table)
+{
+	struct client_resources *cr, *tmp;
+	int i;
+
+	for (i = 0; i < WESTON_RESOURCE_TABLE_SIZE; i++)
+		wl_list_for_each_safe(cr, tmp, &table->buckets[i], link)
+			client_resources_destroy(cr);
+}
+
+static struct wl_list *
+resource_table_bucket(struct weston_resource_table *table,
+		      struct wl_client *client)
+{
+	uint32_t hash = (uint32_t) ((uintptr_t) client >> 4) * 0x9e3779b1;
+
+	hash ^= hash >> 16;
+
+	return &table->buckets[hash & (WESTON_RESOURCE_TABLE_SIZE - 1)];
+}
+
+static struct client_resources *
+resource_table_lookup(struct weston_resource_table *table,
+		      struct wl_client *client)
+{
+	struct client_resources *cr;
+
+	wl_list_for_each(cr, resource_table_bucket(table, client), link)
+		if (cr->client == client)
+			return cr;
+
+	return NULL;
+}
+
+/* The unfocused resources of the client, or NULL if it has none */
+static struct wl_list *
+resource_table_get_list(struct weston_resource_table *table,
+			struct wl_client *client)
+{
+	struct client_resources *cr = resource_table_lookup(table, client);
+
+	if (!cr || wl_list_empty(&cr->resource_list))
+		return NULL;
+
+	return &cr->resource_list;
+}
+
+static int
+resource_table_insert(struct weston_resource_table *table,
+		      struct wl_resource *resource)
+{
+	struct wl_client *client = wl_resource_get_client(resource);
+	struct client_resources *cr;
+
+	cr = resource_table_lookup(table, client);
+	if (!cr) {
+		cr = zalloc(sizeof *cr);
+		if (!cr)
+			return -1;
+
+		cr->client = client;
+		wl_list_init(&cr->resource_list);
+		cr->client_destroy_listener.notify =
+			client_resources_handle_client_destroy;
+		wl_client_add_destroy_listener(client,
+					       &cr->client_destroy_listener);
+		wl_list_insert(resource_table_bucket(table, client),
+			       &cr->link);
+	}
+
+	wl_list_insert(&cr->resource_list, wl_resource_get_link(resource));
+
+	return 0;
+}
+
+/* Put the focused resources, which all belong to one client, back among
+ * the unfocused resources of that client. */
+static void
+resource_table_unfocus(struct weston_resource_table *table,
+		       struct wl_list *focus_resource_list)
+{
+	struct wl_resource *resource;
+	struct client_resources *cr;
+
+	if (wl_list_empty(focus_resource_list))
+		return;
+
+	resource = wl_resource_from_link(focus_resource_list->next);
+	cr = resource_table_lookup(table, wl_resource_get_client(resource));
+
+	/* Every client with resources has an entry until it is destroyed,
+	 * and the resources of a destroyed client go away right after. */
+	if (cr)
+		move_resources(&cr->resource_list, focus_resource_list);
+	else
+		detach_resources(focus_resource_list);
+}
+
 static void
 move_resources_for_client(struct wl_list *destination,
-			  struct wl_list *source,
+			  struct weston_resource_table *table,
 			  struct wl_client *client)
 {
-	struct wl_resource *resource, *tmp;
-	wl_resource_for_each_safe(resource, tmp, source) {
-		if (wl_resource_get_client(resource) == client) {
-			wl_list_remove(wl_resource_get_link(resource));
-			wl_list_insert(destination,
-				       wl_resource_get_link(resource));
-		}
+	struct wl_list *list = resource_table_get_list(table, client);
+
+	if (list)
+		move_resources(destination, list);
+}
+
+/* Add a newly created device resource to the table, destroying it if
+ * that fails. */
+static int
+add_device_resource(struct weston_resource_table *table,
+		    struct wl_client *client, struct wl_resource *resource)
+{
+	if (resource_table_insert(table, resource) < 0) {
+		wl_resource_destroy(resource);
+		wl_client_post_no_memory(client);
+		return -1;
 	}
+
+	return 0;
 }
 
 static void
@@ -353,24 +517,26 @@ send_modifiers_to_resource(struct weston_keyboard *keyboard,
 				   keyboard->modifiers.group);
 }
 
+/* Send the modifiers to the unfocused keyboards of the client */
 static void
-send_modifiers_to_client_in_list(struct wl_client *client,
-				 struct wl_list *list,
-				 uint32_t serial,
-				 struct weston_keyboard *keyboard)
+send_modifiers_to_client(struct wl_client *client,
+			 uint32_t serial,
+			 struct weston_keyboard *keyboard)
 {
 	struct wl_resource *resource;
+	struct wl_list *list;
 
-	wl_resource_for_each(resource, list) {
-		if (wl_resource_get_client(resource) == client)
-			send_modifiers_to_resource(keyboard,
-						   resource,
-						   serial);
-	}
+	list = resource_table_get_list(&keyboard->resource_table, client);
+	if (!list)
+		return;
+
+	wl_resource_for_each(resource, list)
+		send_modifiers_to_resource(keyboard, resource, serial);
 }
 
-static struct wl_resource *
-find_resource_for_surface(struct wl_list *list, struct weston_surface *surface)
+static struct wl_list *
+find_resources_for_surface(struct weston_resource_table *table,
+			   struct weston_surface *surface)
 {
 	if (!surface)
 		return NULL;
@@ -378,16 +544,18 @@ find_resource_for_surface(struct wl_list *list, struct weston_surface *surface)
 	if (!surface->resource)
 		return NULL;
 
-	return wl_resource_find_for_client(list, wl_resource_get_client(surface->resource));
+	return resource_table_get_list(table,
+				       wl_resource_get_client(surface->resource));
 }
 
-static struct wl_resource *
-find_resource_for_view(struct wl_list *list, struct weston_view *view)
+static struct wl_list *
+find_resources_for_view(struct weston_resource_table *table,
+			struct weston_view *view)
 {
 	if (!view)
 		return NULL;
 
-	return find_resource_for_surface(list, view->surface);
+	return find_resources_for_surface(table, view->surface);
 }
 
 static void
@@ -412,10 +580,7 @@ default_grab_keyboard_modifiers(struct weston_keyboard_grab *grab,
 	    pointer->focus->surface != keyboard->focus) {
 		struct wl_client *pointer_client =
 			wl_resource_get_client(pointer->focus->surface->resource);
-		send_modifiers_to_client_in_list(pointer_client,
-						 &keyboard->resource_list,
-						 serial,
-						 keyboard);
+		send_modifiers_to_client(pointer_client, serial, keyboard);
 	}
 }
 
@@ -475,7 +640,7 @@ weston_pointer_create(struct weston_seat *seat)
 	if (pointer == NULL)
 		return NULL;
 
-	wl_list_init(&pointer->resource_list);
+	resource_table_init(&pointer->resource_table);
 	wl_list_init(&pointer->focus_resource_list);
 	weston_pointer_set_default_grab(pointer,
 					seat->compositor->default_pointer_grab);
@@ -510,7 +675,8 @@ weston_pointer_destroy(struct weston_pointer *pointer)
 	if (pointer->sprite)
 		pointer_unmap_sprite(pointer);
 
-	/* XXX: What about pointer->resource_list? */
+	resource_table_release(&pointer->resource_table);
+	detach_resources(&pointer->focus_resource_list);
 
 	wl_list_remove(&pointer->focus_resource_listener.link);
 	wl_list_remove(&pointer->focus_view_listener.link);
@@ -538,7 +704,7 @@ weston_keyboard_create(void)
 	if (keyboard == NULL)
 	    return NULL;
 
-	wl_list_init(&keyboard->resource_list);
+	resource_table_init(&keyboard->resource_table);
 	wl_list_init(&keyboard->focus_resource_list);
 	wl_list_init(&keyboard->focus_resource_listener.link);
 	keyboard->focus_resource_listener.notify = keyboard_focus_resource_destroyed;
@@ -557,7 +723,8 @@ weston_xkb_info_destroy(struct weston_xkb_info *xkb_info);
 WL_EXPORT void
 weston_keyboard_destroy(struct weston_keyboard *keyboard)
 {
-	/* XXX: What about keyboard->resource_list? */
+	resource_table_release(&keyboard->resource_table);
+	detach_resources(&keyboard->focus_resource_list);
 
 #ifdef ENABLE_XKBCOMMON
 	if (keyboard->seat->compositor->use_xkbcommon) {
@@ -588,7 +755,7 @@ weston_touch_create(void)
 	if (touch == NULL)
 		return NULL;
 
-	wl_list_init(&touch->resource_list);
+	resource_table_init(&touch->resource_table);
 	wl_list_init(&touch->focus_resource_list);
 	wl_list_init(&touch->focus_view_listener.link);
 	touch->focus_view_listener.notify = touch_focus_view_destroyed;
@@ -605,7 +772,8 @@ weston_touch_create(void)
 WL_EXPORT void
 weston_touch_destroy(struct weston_touch *touch)
 {
-	/* XXX: What about touch->resource_list? */
+	resource_table_release(&touch->resource_table);
+	detach_resources(&touch->focus_resource_list);
 
 	wl_list_remove(&touch->focus_view_listener.link);
 	wl_list_remove(&touch->focus_resource_listener.link);
@@ -678,23 +846,22 @@ weston_pointer_set_focus(struct weston_pointer *pointer,
 					      pointer->focus->surface->resource);
 		}
 
-		move_resources(&pointer->resource_list, focus_resource_list);
+		resource_table_unfocus(&pointer->resource_table,
+				       focus_resource_list);
 	}
 
-	if (find_resource_for_view(&pointer->resource_list, view) && refocus) {
+	if (find_resources_for_view(&pointer->resource_table, view) &&
+	    refocus) {
 		struct wl_client *surface_client =
 			wl_resource_get_client(view->surface->resource);
 
 		serial = wl_display_next_serial(display);
 
 		if (kbd && kbd->focus != view->surface)
-			send_modifiers_to_client_in_list(surface_client,
-							 &kbd->resource_list,
-							 serial,
-							 kbd);
+			send_modifiers_to_client(surface_client, serial, kbd);
 
 		move_resources_for_client(focus_resource_list,
-					  &pointer->resource_list,
+					  &pointer->resource_table,
 					  surface_client);
 
 		wl_resource_for_each(resource, focus_resource_list) {
@@ -761,10 +928,11 @@ weston_keyboard_set_focus(struct weston_keyboard *keyboard,
 			wl_keyboard_send_leave(resource, serial,
 					keyboard->focus->resource);
 		}
-		move_resources(&keyboard->resource_list, focus_resource_list);
+		resource_table_unfocus(&keyboard->resource_table,
+				       focus_resource_list);
 	}
 
-	if (find_resource_for_surface(&keyboard->resource_list, surface) &&
+	if (find_resources_for_surface(&keyboard->resource_table, surface) &&
 	    keyboard->focus != surface) {
 		struct wl_client *surface_client =
 			wl_resource_get_client(surface->resource);
@@ -772,7 +940,7 @@ weston_keyboard_set_focus(struct weston_keyboard *keyboard,
 		serial = wl_display_next_serial(display);
 
 		move_resources_for_client(focus_resource_list,
-					  &keyboard->resource_list,
+					  &keyboard->resource_table,
 					  surface_client);
 		send_enter_to_resource_list(focus_resource_list,
 					    keyboard,
@@ -974,6 +1142,144 @@ weston_pointer_handle_output_destroy(struct wl_listener *listener, void *data)
 	weston_pointer_move(pointer, fx, fy);
 }
 
+struct touch_event {
+	int touch_id;
+	int touch_type;
+	uint32_t time;
+	wl_fixed_t x, y;
+};
+
+static int
+seat_motion_pending(struct weston_seat *seat)
+{
+	return seat->motion.pointer_pending || seat->motion.touch.size > 0;
+}
+
+/* Motion is held back until the next repaint, which is scheduled when
+ * the first event is held back. */
+static void
+coalesce_pointer_motion(struct weston_seat *seat, uint32_t time)
+{
+	struct weston_seat_motion *motion = &seat->motion;
+
+	if (!seat_motion_pending(seat))
+		weston_compositor_schedule_repaint(seat->compositor);
+
+	if (!motion->pointer_pending) {
+		motion->pointer_pending = 1;
+		motion->pointer_absolute = 0;
+		motion->dx = 0;
+		motion->dy = 0;
+	}
+
+	motion->pointer_time = time;
+}
+
+static void
+coalesce_touch_motion(struct weston_seat *seat, uint32_t time,
+		      int touch_id, wl_fixed_t x, wl_fixed_t y)
+{
+	struct touch_event *tm;
+
+	if (!seat_motion_pending(seat))
+		weston_compositor_schedule_repaint(seat->compositor);
+
+	wl_array_for_each(tm, &seat->motion.touch) {
+		if (tm->touch_id == touch_id)
+			goto update;
+	}
+
+	tm = wl_array_add(&seat->motion.touch, sizeof *tm);
+	if (!tm)
+		return;
+	tm->touch_id = touch_id;
+	tm->touch_type = WL_TOUCH_MOTION;
+
+update:
+	tm->time = time;
+	tm->x = x;
+	tm->y = y;
+}
+
+static void
+deliver_touch_batch(struct weston_seat *seat, struct wl_array *events,
+		    int frame);
+
+static void
+flush_coalesced_motion(struct weston_seat *seat)
+{
+	struct weston_seat_motion *motion = &seat->motion;
+	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
+	wl_fixed_t x, y;
+	int frame;
+
+	if (motion->pointer_pending) {
+		motion->pointer_pending = 0;
+
+		if (pointer) {
+			x = motion->pointer_absolute ? motion->x : pointer->x;
+			y = motion->pointer_absolute ? motion->y : pointer->y;
+			pointer->grab->interface->motion(pointer->grab,
+							 motion->pointer_time,
+							 x + motion->dx,
+							 y + motion->dy);
+		}
+	}
+
+	if (motion->touch.size > 0 || motion->touch_frame) {
+		frame = motion->touch_frame;
+		motion->touch_frame = 0;
+		deliver_touch_batch(seat, &motion->touch, frame);
+	}
+}
+
+/** Deliver the motion held back on a seat
+ *
+ * \param seat The seat
+ *
+ * With motion coalescing enabled, pointer motion and touch motion are
+ * accumulated and delivered once per frame, just before the compositor
+ * repaints. Relative pointer motion is summed up, absolute pointer and
+ * touch positions replace the previous ones, and a touch frame that only
+ * follows motion is held back with it. Any other input event on the seat
+ * delivers the held back motion first, so the order of events as seen by
+ * clients and bindings does not change.
+ *
+ * Touch events are also collected until the end of the touch frame they
+ * belong to, whether motion is coalesced or not. The events of a frame
+ * that has not ended yet are delivered here, without a frame event.
+ */
+WL_EXPORT void
+weston_seat_flush_motion(struct weston_seat *seat)
+{
+	flush_coalesced_motion(seat);
+
+	if (seat->motion.touch_batch.size > 0)
+		deliver_touch_batch(seat, &seat->motion.touch_batch, 0);
+}
+
+/* Skips filling in the event when nobody listens, which is the common
+ * case. */
+static void
+emit_input_event(struct weston_seat *seat, enum weston_input_event_type type,
+		 uint32_t time, int32_t code, uint32_t state,
+		 wl_fixed_t x, wl_fixed_t y)
+{
+	struct weston_input_event event;
+
+	if (wl_list_empty(&seat->input_signal.listener_list))
+		return;
+
+	event.seat = seat;
+	event.type = type;
+	event.time = time;
+	event.code = code;
+	event.state = state;
+	event.x = x;
+	event.y = y;
+	wl_signal_emit(&seat->input_signal, &event);
+}
+
 WL_EXPORT void
 notify_motion(struct weston_seat *seat,
 	      uint32_t time, wl_fixed_t dx, wl_fixed_t dy)
@@ -981,7 +1287,18 @@ notify_motion(struct weston_seat *seat,
 	struct weston_compositor *ec = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	WESTON_PROBE(notify_motion, seat, time, dx, dy);
+	emit_input_event(seat, WESTON_INPUT_EVENT_MOTION, time, 0, 0, dx, dy);
+
 	weston_compositor_wake(ec);
+
+	if (ec->motion_coalescing) {
+		coalesce_pointer_motion(seat, time);
+		seat->motion.dx += dx;
+		seat->motion.dy += dy;
+		return;
+	}
+
 	pointer->grab->interface->motion(pointer->grab, time, pointer->x + dx, pointer->y + dy);
 }
 
@@ -1028,7 +1345,24 @@ notify_motion_absolute(struct weston_seat *seat,
 	struct weston_compositor *ec = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	WESTON_PROBE(notify_motion_absolute, seat, time, x, y);
+	emit_input_event(seat, WESTON_INPUT_EVENT_MOTION_ABSOLUTE, time,
+			 0, 0, x, y);
+
 	weston_compositor_wake(ec);
+
+	if (ec->motion_coalescing) {
+		/* An absolute position replaces any relative motion
+		 * held back so far. */
+		coalesce_pointer_motion(seat, time);
+		seat->motion.pointer_absolute = 1;
+		seat->motion.x = x;
+		seat->motion.y = y;
+		seat->motion.dx = 0;
+		seat->motion.dy = 0;
+		return;
+	}
+
 	pointer->grab->interface->motion(pointer->grab, time, x, y);
 }
 
@@ -1054,6 +1388,12 @@ notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	WESTON_PROBE(notify_button, seat, time, button, state);
+	emit_input_event(seat, WESTON_INPUT_EVENT_BUTTON, time,
+			 button, state, 0, 0);
+
+	weston_seat_flush_motion(seat);
+
 	if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
 		if (pointer->button_count == 0) {
@@ -1087,6 +1427,12 @@ notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
 	struct wl_resource *resource;
 	struct wl_list *resource_list;
 
+	WESTON_PROBE(notify_axis, seat, time, axis, value);
+	emit_input_event(seat, WESTON_INPUT_EVENT_AXIS, time,
+			 axis, 0, value, 0);
+
+	weston_seat_flush_motion(seat);
+
 	weston_compositor_wake(compositor);
 
 	if (!value)
@@ -1269,19 +1615,24 @@ send_modifiers(struct wl_resource *resource, uint32_t serial, struct weston_keyb
 }
 
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap);
+weston_xkb_info_create(struct weston_compositor *ec,
+		       struct xkb_keymap *keymap);
 
 static void
 update_keymap(struct weston_seat *seat)
 {
 	struct weston_keyboard *keyboard = weston_seat_get_keyboard(seat);
+	struct wl_list *buckets = keyboard->resource_table.buckets;
+	struct client_resources *cr;
 	struct wl_resource *resource;
 	struct weston_xkb_info *xkb_info;
 	struct xkb_state *state;
 	xkb_mod_mask_t latched_mods;
 	xkb_mod_mask_t locked_mods;
+	int i;
 
-	xkb_info = weston_xkb_info_create(keyboard->pending_keymap);
+	xkb_info = weston_xkb_info_create(seat->compositor,
+					  keyboard->pending_keymap);
 
 	xkb_keymap_unref(keyboard->pending_keymap);
 	keyboard->pending_keymap = NULL;
@@ -1314,8 +1665,10 @@ update_keymap(struct weston_seat *seat)
 	xkb_state_unref(keyboard->xkb_state.state);
 	keyboard->xkb_state.state = state;
 
-	wl_resource_for_each(resource, &keyboard->resource_list)
-		send_keymap(resource, xkb_info);
+	for (i = 0; i < WESTON_RESOURCE_TABLE_SIZE; i++)
+		wl_list_for_each(cr, &buckets[i], link)
+			wl_resource_for_each(resource, &cr->resource_list)
+				send_keymap(resource, xkb_info);
 	wl_resource_for_each(resource, &keyboard->focus_resource_list)
 		send_keymap(resource, xkb_info);
 
@@ -1324,8 +1677,10 @@ update_keymap(struct weston_seat *seat)
 	if (!latched_mods && !locked_mods)
 		return;
 
-	wl_resource_for_each(resource, &keyboard->resource_list)
-		send_modifiers(resource, wl_display_get_serial(seat->compositor->wl_display), keyboard);
+	for (i = 0; i < WESTON_RESOURCE_TABLE_SIZE; i++)
+		wl_list_for_each(cr, &buckets[i], link)
+			wl_resource_for_each(resource, &cr->resource_list)
+				send_modifiers(resource, wl_display_get_serial(seat->compositor->wl_display), keyboard);
 	wl_resource_for_each(resource, &keyboard->focus_resource_list)
 		send_modifiers(resource, wl_display_get_serial(seat->compositor->wl_display), keyboard);
 }
@@ -1357,6 +1712,12 @@ notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
 	struct weston_keyboard_grab *grab = keyboard->grab;
 	uint32_t *k, *end;
 
+	WESTON_PROBE(notify_key, seat, time, key, state);
+	emit_input_event(seat, WESTON_INPUT_EVENT_KEY, time,
+			 key, state, 0, 0);
+
+	weston_seat_flush_motion(seat);
+
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
 	} else {
@@ -1412,6 +1773,8 @@ notify_pointer_focus(struct weston_seat *seat, struct weston_output *output,
 {
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
+	weston_seat_flush_motion(seat);
+
 	if (output) {
 		weston_pointer_move(pointer, x, y);
 	} else {
@@ -1489,6 +1852,10 @@ notify_keyboard_focus_out(struct weston_seat *seat)
 		weston_pointer_cancel_grab(pointer);
 }
 
+static void
+touch_send_flush(struct weston_touch *touch, struct wl_array *sends,
+		 int frame);
+
 WL_EXPORT void
 weston_touch_set_focus(struct weston_touch *touch, struct weston_view *view)
 {
@@ -1502,15 +1869,16 @@ weston_touch_set_focus(struct weston_touch *touch, struct weston_view *view)
 		return;
 	}
 
+	/* Touch events queued for the old focus go out first. */
+	if (touch->seat->motion.touch_send.size > 0)
+		touch_send_flush(touch, &touch->seat->motion.touch_send, 0);
+
 	wl_list_remove(&touch->focus_resource_listener.link);
 	wl_list_init(&touch->focus_resource_listener.link);
 	wl_list_remove(&touch->focus_view_listener.link);
 	wl_list_init(&touch->focus_view_listener.link);
 
-	if (!wl_list_empty(focus_resource_list)) {
-		move_resources(&touch->resource_list,
-			       focus_resource_list);
-	}
+	resource_table_unfocus(&touch->resource_table, focus_resource_list);
 
 	if (view) {
 		struct wl_client *surface_client;
@@ -1522,7 +1890,7 @@ weston_touch_set_focus(struct weston_touch *touch, struct weston_view *view)
 
 		surface_client = wl_resource_get_client(view->surface->resource);
 		move_resources_for_client(focus_resource_list,
-					  &touch->resource_list,
+					  &touch->resource_table,
 					  surface_client);
 		wl_resource_add_destroy_listener(view->surface->resource,
 						 &touch->focus_resource_listener);
@@ -1539,9 +1907,9 @@ weston_touch_set_focus(struct weston_touch *touch, struct weston_view *view)
  * for sending along such order.
  *
  */
-WL_EXPORT void
-notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
-             wl_fixed_t x, wl_fixed_t y, int touch_type)
+static void
+deliver_touch(struct weston_seat *seat, uint32_t time, int touch_id,
+	      wl_fixed_t x, wl_fixed_t y, int touch_type)
 {
 	struct weston_compositor *ec = seat->compositor;
 	struct weston_touch *touch = weston_seat_get_touch(seat);
@@ -1616,13 +1984,320 @@ notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
 	}
 }
 
+/* An event of a touch frame on its way to the clients of the focus. */
+struct touch_send {
+	int touch_id;
+	int touch_type;
+	uint32_t time;
+	uint32_t serial;
+	wl_fixed_t sx, sy;
+};
+
+/* An untransformed view is only offset from the global coordinates, so
+ * the offset is computed once per view and the points of a frame are
+ * moved by it. */
+struct touch_view_map {
+	struct weston_view *view;
+	wl_fixed_t dx, dy;
+};
+
+static void
+touch_view_map(struct touch_view_map *map, struct weston_view *view,
+	       wl_fixed_t x, wl_fixed_t y, wl_fixed_t *sx, wl_fixed_t *sy)
+{
+	if (view->transform.enabled) {
+		weston_view_from_global_fixed(view, x, y, sx, sy);
+		return;
+	}
+
+	if (map->view != view) {
+		weston_view_from_global_fixed(view, 0, 0, &map->dx, &map->dy);
+		map->view = view;
+	}
+
+	*sx = x + map->dx;
+	*sy = y + map->dy;
+}
+
+static struct touch_send *
+touch_send_add(struct wl_array *sends, const struct touch_event *te)
+{
+	struct touch_send *ts;
+
+	ts = wl_array_add(sends, sizeof *ts);
+	if (!ts)
+		return NULL;
+
+	ts->touch_id = te->touch_id;
+	ts->touch_type = te->touch_type;
+	ts->time = te->time;
+	ts->serial = 0;
+	ts->sx = 0;
+	ts->sy = 0;
+
+	return ts;
+}
+
+/* Sends the queued events, followed by a frame event if frame is set,
+ * to each client resource of the focus in turn. */
+static void
+touch_send_flush(struct weston_touch *touch, struct wl_array *sends,
+		 int frame)
+{
+	struct wl_resource *resource;
+	struct touch_send *ts;
+
+	wl_resource_for_each(resource, &touch->focus_resource_list) {
+		wl_array_for_each(ts, sends) {
+			switch (ts->touch_type) {
+			case WL_TOUCH_DOWN:
+				wl_touch_send_down(resource, ts->serial,
+						   ts->time,
+						   touch->focus->surface->resource,
+						   ts->touch_id, ts->sx, ts->sy);
+				break;
+			case WL_TOUCH_MOTION:
+				wl_touch_send_motion(resource, ts->time,
+						     ts->touch_id,
+						     ts->sx, ts->sy);
+				break;
+			case WL_TOUCH_UP:
+				wl_touch_send_up(resource, ts->serial,
+						 ts->time, ts->touch_id);
+				break;
+			}
+		}
+
+		if (frame)
+			wl_touch_send_frame(resource);
+	}
+
+	sends->size = 0;
+}
+
+/* Delivers the events of a touch frame, and the frame event itself if
+ * frame is set.
+ *
+ * The touch state is updated event by event, as in deliver_touch(). While
+ * the default grab is active the events are not sent right away but
+ * queued with their serials and surface coordinates, and the queue goes
+ * out to each client resource of the focus in one burst when the frame
+ * ends, or earlier when the focus changes, see weston_touch_set_focus(). Other grabs get the events one at a time
+ * through their interface. The array is taken over first, a grab may add
+ * events to it again. */
+static void
+deliver_touch_batch(struct weston_seat *seat, struct wl_array *events,
+		    int frame)
+{
+	struct weston_compositor *ec = seat->compositor;
+	struct weston_touch *touch = weston_seat_get_touch(seat);
+	struct wl_array *sends = &seat->motion.touch_send;
+	struct touch_view_map map = { NULL, 0, 0 };
+	struct wl_array array = *events;
+	struct touch_event *te;
+	struct touch_send *ts;
+	struct weston_view *ev;
+	wl_fixed_t sx, sy;
+
+	wl_array_init(events);
+
+	if (!touch) {
+		wl_array_release(&array);
+		return;
+	}
+
+	wl_array_for_each(te, &array) {
+		if (touch->grab != &touch->default_grab) {
+			touch_send_flush(touch, sends, 0);
+			deliver_touch(seat, te->time, te->touch_id,
+				      te->x, te->y, te->touch_type);
+			continue;
+		}
+
+		if (te->touch_id == touch->grab_touch_id &&
+		    te->touch_type != WL_TOUCH_UP) {
+			touch->grab_x = te->x;
+			touch->grab_y = te->y;
+		}
+
+		switch (te->touch_type) {
+		case WL_TOUCH_DOWN:
+			weston_compositor_idle_inhibit(ec);
+
+			touch->num_tp++;
+
+			if (touch->num_tp == 1) {
+				ev = weston_compositor_pick_view(ec,
+								 te->x, te->y,
+								 &sx, &sy);
+				weston_touch_set_focus(touch, ev);
+			} else if (!touch->focus) {
+				weston_log("touch event received with %d points down"
+					   "but no surface focused\n",
+					   touch->num_tp);
+				continue;
+			}
+
+			weston_compositor_run_touch_binding(ec, touch,
+							    te->time,
+							    te->touch_type);
+
+			/* Like deliver_touch(), the down event goes to the
+			 * grab that was active before the bindings ran. */
+			if (touch->focus &&
+			    !wl_list_empty(&touch->focus_resource_list)) {
+				ts = touch_send_add(sends, te);
+				if (ts) {
+					ts->serial =
+						wl_display_next_serial(ec->wl_display);
+					touch_view_map(&map, touch->focus,
+						       te->x, te->y,
+						       &ts->sx, &ts->sy);
+				}
+			}
+
+			if (touch->num_tp == 1) {
+				touch->grab_serial =
+					wl_display_get_serial(ec->wl_display);
+				touch->grab_touch_id = te->touch_id;
+				touch->grab_time = te->time;
+				touch->grab_x = te->x;
+				touch->grab_y = te->y;
+			}
+			break;
+		case WL_TOUCH_MOTION:
+			if (!touch->focus ||
+			    wl_list_empty(&touch->focus_resource_list))
+				break;
+
+			ts = touch_send_add(sends, te);
+			if (ts)
+				touch_view_map(&map, touch->focus,
+					       te->x, te->y, &ts->sx, &ts->sy);
+			break;
+		case WL_TOUCH_UP:
+			if (touch->num_tp == 0) {
+				weston_log("unmatched touch up event\n");
+				break;
+			}
+			weston_compositor_idle_release(ec);
+			touch->num_tp--;
+
+			if (!wl_list_empty(&touch->focus_resource_list)) {
+				ts = touch_send_add(sends, te);
+				if (ts)
+					ts->serial =
+						wl_display_next_serial(ec->wl_display);
+			}
+
+			if (touch->num_tp == 0)
+				weston_touch_set_focus(touch, NULL);
+			break;
+		}
+	}
+
+	if (touch->grab == &touch->default_grab) {
+		touch_send_flush(touch, sends, frame);
+	} else {
+		touch_send_flush(touch, sends, 0);
+		if (frame)
+			touch->grab->interface->frame(touch->grab);
+	}
+
+	wl_array_release(&array);
+}
+
+/* Delivers a frame that was not ended with notify_touch_frame() by the
+ * time the event loop went idle. */
+static void
+touch_batch_idle(void *data)
+{
+	struct weston_seat *seat = data;
+
+	seat->motion.touch_idle = NULL;
+
+	if (seat->motion.touch_batch.size > 0)
+		deliver_touch_batch(seat, &seat->motion.touch_batch, 0);
+}
+
+/* A motion replaces an earlier motion of the same touch point in the
+ * frame, unless the point went up or down in between. */
+static void
+batch_touch(struct weston_seat *seat, uint32_t time, int touch_id,
+	    wl_fixed_t x, wl_fixed_t y, int touch_type)
+{
+	struct wl_array *batch = &seat->motion.touch_batch;
+	struct wl_event_loop *loop;
+	struct touch_event *te;
+	size_t i = batch->size / sizeof *te;
+
+	if (!seat->motion.touch_idle) {
+		loop = wl_display_get_event_loop(seat->compositor->wl_display);
+		seat->motion.touch_idle =
+			wl_event_loop_add_idle(loop, touch_batch_idle, seat);
+	}
+
+	while (touch_type == WL_TOUCH_MOTION && i-- > 0) {
+		te = (struct touch_event *) batch->data + i;
+		if (te->touch_id != touch_id)
+			continue;
+		if (te->touch_type == WL_TOUCH_MOTION)
+			goto update;
+		break;
+	}
+
+	te = wl_array_add(batch, sizeof *te);
+	if (!te)
+		return;
+	te->touch_id = touch_id;
+	te->touch_type = touch_type;
+
+update:
+	te->time = time;
+	te->x = x;
+	te->y = y;
+}
+
+WL_EXPORT void
+notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
+             wl_fixed_t x, wl_fixed_t y, int touch_type)
+{
+	WESTON_PROBE(notify_touch, seat, time, touch_id, x, y, touch_type);
+	emit_input_event(seat, WESTON_INPUT_EVENT_TOUCH, time,
+			 touch_id, touch_type, x, y);
+
+	/* The events of a touch frame are delivered together when it
+	 * ends. Only a frame of nothing but motion is held back further
+	 * when coalescing motion. */
+	if (seat->compositor->motion_coalescing &&
+	    seat->motion.touch_batch.size == 0) {
+		if (touch_type == WL_TOUCH_MOTION) {
+			coalesce_touch_motion(seat, time, touch_id, x, y);
+			return;
+		}
+
+		weston_seat_flush_motion(seat);
+	}
+
+	batch_touch(seat, time, touch_id, x, y, touch_type);
+}
+
 WL_EXPORT void
 notify_touch_frame(struct weston_seat *seat)
 {
-	struct weston_touch *touch = weston_seat_get_touch(seat);
-	struct weston_touch_grab *grab = touch->grab;
+	WESTON_PROBE(notify_touch_frame, seat);
+	emit_input_event(seat, WESTON_INPUT_EVENT_TOUCH_FRAME, 0, 0, 0, 0, 0);
 
-	grab->interface->frame(grab);
+	/* A frame that only ends motion goes out with it. */
+	if (seat->compositor->motion_coalescing &&
+	    seat->motion.touch_batch.size == 0 &&
+	    seat->motion.touch.size > 0) {
+		seat->motion.touch_frame = 1;
+		return;
+	}
+
+	flush_coalesced_motion(seat);
+	deliver_touch_batch(seat, &seat->motion.touch_batch, 1);
 }
 
 static int
@@ -1760,12 +2435,14 @@ seat_get_pointer(struct wl_client *client, struct wl_resource *resource,
 		return;
 	}
 
+	wl_resource_set_implementation(cr, &pointer_interface, pointer,
+				       unbind_resource);
+
 	/* May be moved to focused list later by either
 	 * weston_pointer_set_focus or directly if this client is already
 	 * focused */
-	wl_list_insert(&pointer->resource_list, wl_resource_get_link(cr));
-	wl_resource_set_implementation(cr, &pointer_interface, pointer,
-				       unbind_resource);
+	if (add_device_resource(&pointer->resource_table, client, cr) < 0)
+		return;
 
 	if (pointer->focus && pointer->focus->surface->resource &&
 	    wl_resource_get_client(pointer->focus->surface->resource) == client) {
@@ -1844,12 +2521,14 @@ seat_get_keyboard(struct wl_client *client, struct wl_resource *resource,
 		return;
 	}
 
+	wl_resource_set_implementation(cr, &keyboard_interface,
+				       seat, unbind_resource);
+
 	/* May be moved to focused list later by either
 	 * weston_keyboard_set_focus or directly if this client is already
 	 * focused */
-	wl_list_insert(&keyboard->resource_list, wl_resource_get_link(cr));
-	wl_resource_set_implementation(cr, &keyboard_interface,
-				       seat, unbind_resource);
+	if (add_device_resource(&keyboard->resource_table, client, cr) < 0)
+		return;
 
 	if (wl_resource_get_version(cr) >= WL_KEYBOARD_REPEAT_INFO_SINCE_VERSION) {
 		wl_keyboard_send_repeat_info(cr,
@@ -1932,16 +2611,18 @@ seat_get_touch(struct wl_client *client, struct wl_resource *resource,
 		return;
 	}
 
-	if (touch->focus &&
+	wl_resource_set_implementation(cr, &touch_interface,
+				       seat, unbind_resource);
+
+	if (add_device_resource(&touch->resource_table, client, cr) < 0)
+		return;
+
+	if (touch->focus && touch->focus->surface->resource &&
 	    wl_resource_get_client(touch->focus->surface->resource) == client) {
-		wl_list_insert(&touch->resource_list,
-			       wl_resource_get_link(cr));
-	} else {
+		wl_list_remove(wl_resource_get_link(cr));
 		wl_list_insert(&touch->focus_resource_list,
 			       wl_resource_get_link(cr));
 	}
-	wl_resource_set_implementation(cr, &touch_interface,
-				       seat, unbind_resource);
 }
 
 static const struct wl_seat_interface seat_interface = {
@@ -2008,6 +2689,7 @@ weston_xkb_info_destroy(struct weston_xkb_info *xkb_info)
 	if (--xkb_info->ref_count > 0)
 		return;
 
+	wl_list_remove(&xkb_info->link);
 	xkb_keymap_unref(xkb_info->keymap);
 
 	if (xkb_info->keymap_area)
@@ -2038,18 +2720,81 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 	xkb_context_unref(ec->xkb_context);
 }
 
+/* FNV-1a, only used to tell most keymaps apart before comparing them */
+static uint32_t
+keymap_hash(const char *str, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		hash = (hash ^ (uint8_t) str[i]) * 16777619u;
+
+	return hash;
+}
+
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap)
+xkb_info_cache_lookup(struct weston_compositor *ec, struct xkb_keymap *keymap,
+		      const char *keymap_str, size_t size, uint32_t hash)
 {
-	struct weston_xkb_info *xkb_info = zalloc(sizeof *xkb_info);
-	if (xkb_info == NULL)
+	struct weston_xkb_info *xkb_info;
+
+	wl_list_for_each(xkb_info, &ec->xkb_info_cache, link) {
+		if (keymap == xkb_info->keymap)
+			return xkb_info;
+
+		if (keymap_str &&
+		    hash == xkb_info->keymap_hash &&
+		    size == xkb_info->keymap_size &&
+		    memcmp(keymap_str, xkb_info->keymap_area, size) == 0)
+			return xkb_info;
+	}
+
+	return NULL;
+}
+
+/* Returns a new reference to the xkb_info of the keymap. Keymaps with
+ * the same text share one xkb_info, and so one keymap file, whichever
+ * seat or device they were compiled for. */
+static struct weston_xkb_info *
+weston_xkb_info_create(struct weston_compositor *ec,
+		       struct xkb_keymap *keymap)
+{
+	struct weston_xkb_info *xkb_info;
+	char *keymap_str;
+	size_t size;
+	uint32_t hash;
+
+	/* The very same keymap is found without serializing it. */
+	xkb_info = xkb_info_cache_lookup(ec, keymap, NULL, 0, 0);
+	if (xkb_info) {
+		xkb_info->ref_count++;
+		return xkb_info;
+	}
+
+	keymap_str = xkb_keymap_get_as_string(keymap,
+					      XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (keymap_str == NULL) {
+		weston_log("failed to get string version of keymap\n");
 		return NULL;
+	}
+	size = strlen(keymap_str) + 1;
+	hash = keymap_hash(keymap_str, size);
+
+	xkb_info = xkb_info_cache_lookup(ec, keymap, keymap_str, size, hash);
+	if (xkb_info) {
+		free(keymap_str);
+		xkb_info->ref_count++;
+		return xkb_info;
+	}
+
+	xkb_info = zalloc(sizeof *xkb_info);
+	if (xkb_info == NULL)
+		goto err_keymap_str;
 
 	xkb_info->keymap = xkb_keymap_ref(keymap);
 	xkb_info->ref_count = 1;
 
-	char *keymap_str;
-
 	xkb_info->shift_mod = xkb_keymap_mod_get_index(xkb_info->keymap,
 						       XKB_MOD_NAME_SHIFT);
 	xkb_info->caps_mod = xkb_keymap_mod_get_index(xkb_info->keymap,
@@ -2074,41 +2819,38 @@ weston_xkb_info_create(struct xkb_keymap *keymap)
 	xkb_info->scroll_led = xkb_keymap_led_get_index(xkb_info->keymap,
 							XKB_LED_NAME_SCROLL);
 
-	keymap_str = xkb_keymap_get_as_string(xkb_info->keymap,
-					      XKB_KEYMAP_FORMAT_TEXT_V1);
-	if (keymap_str == NULL) {
-		weston_log("failed to get string version of keymap\n");
-		goto err_keymap;
-	}
-	xkb_info->keymap_size = strlen(keymap_str) + 1;
+	xkb_info->keymap_size = size;
+	xkb_info->keymap_hash = hash;
 
-	xkb_info->keymap_fd = os_create_anonymous_file(xkb_info->keymap_size);
+	xkb_info->keymap_fd = os_create_sealed_anonymous_file(keymap_str,
+							      size);
 	if (xkb_info->keymap_fd < 0) {
 		weston_log("creating a keymap file for %lu bytes failed: %m\n",
 			(unsigned long) xkb_info->keymap_size);
-		goto err_keymap_str;
+		goto err_keymap;
 	}
 
 	xkb_info->keymap_area = mmap(NULL, xkb_info->keymap_size,
-				     PROT_READ | PROT_WRITE,
-				     MAP_SHARED, xkb_info->keymap_fd, 0);
+				     PROT_READ, MAP_SHARED,
+				     xkb_info->keymap_fd, 0);
 	if (xkb_info->keymap_area == MAP_FAILED) {
 		weston_log("failed to mmap() %lu bytes\n",
 			(unsigned long) xkb_info->keymap_size);
 		goto err_dev_zero;
 	}
-	strcpy(xkb_info->keymap_area, keymap_str);
 	free(keymap_str);
 
+	wl_list_insert(&ec->xkb_info_cache, &xkb_info->link);
+
 	return xkb_info;
 
 err_dev_zero:
 	close(xkb_info->keymap_fd);
-err_keymap_str:
-	free(keymap_str);
 err_keymap:
 	xkb_keymap_unref(xkb_info->keymap);
 	free(xkb_info);
+err_keymap_str:
+	free(keymap_str);
 	return NULL;
 }
 
@@ -2133,7 +2875,7 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 		return -1;
 	}
 
-	ec->xkb_info = weston_xkb_info_create(keymap);
+	ec->xkb_info = weston_xkb_info_create(ec, keymap);
 	xkb_keymap_unref(keymap);
 	if (ec->xkb_info == NULL)
 		return -1;
@@ -2195,7 +2937,9 @@ weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 #ifdef ENABLE_XKBCOMMON
 	if (seat->compositor->use_xkbcommon) {
 		if (keymap != NULL) {
-			keyboard->xkb_info = weston_xkb_info_create(keymap);
+			keyboard->xkb_info =
+				weston_xkb_info_create(seat->compositor,
+						       keymap);
 			if (keyboard->xkb_info == NULL)
 				goto err;
 		} else {
@@ -2360,6 +3104,7 @@ weston_seat_init(struct weston_seat *seat, struct weston_compositor *ec,
 	wl_list_init(&seat->drag_resource_list);
 	wl_signal_init(&seat->destroy_signal);
 	wl_signal_init(&seat->updated_caps_signal);
+	wl_signal_init(&seat->input_signal);
 
 	seat->global = wl_global_create(ec->wl_display, &wl_seat_interface, 4,
 					seat, bind_seat);
@@ -2367,6 +3112,9 @@ weston_seat_init(struct weston_seat *seat, struct weston_compositor *ec,
 	seat->compositor = ec;
 	seat->modifier_state = 0;
 	seat->seat_name = strdup(seat_name);
+	wl_array_init(&seat->motion.touch);
+	wl_array_init(&seat->motion.touch_batch);
+	wl_array_init(&seat->motion.touch_send);
 
 	wl_list_insert(ec->seat_list.prev, &seat->link);
 
@@ -2390,6 +3138,11 @@ weston_seat_release(struct weston_seat *seat)
 	if (seat->touch_state)
 		weston_touch_destroy(seat->touch_state);
 
+	wl_array_release(&seat->motion.touch);
+	wl_array_release(&seat->motion.touch_batch);
+	wl_array_release(&seat->motion.touch_send);
+	if (seat->motion.touch_idle)
+		wl_event_source_remove(seat->motion.touch_idle);
 	free (seat->seat_name);
 
 	wl_global_destroy(seat->global);
@@ -38,13 +38,24 @@
 
 #include "compositor.h"
 #include "libinput-device.h"
+#include "libinput-seat.h"
 #include "shared/helpers.h"
 
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int(10)
 
+/* libinput calls made from the main loop have to be serialized with the
+ * input thread, if there is one. */
+static struct udev_input *
+evdev_device_get_input(struct evdev_device *device)
+{
+	return libinput_get_user_data(
+			libinput_device_get_context(device->device));
+}
+
 void
 evdev_led_update(struct evdev_device *device, enum weston_led weston_leds)
 {
+	struct udev_input *input = evdev_device_get_input(device);
 	enum libinput_led leds = 0;
 
 	if (weston_leds & LED_NUM_LOCK)
@@ -54,15 +65,15 @@ evdev_led_update(struct evdev_device *device, enum weston_led weston_leds)
 	if (weston_leds & LED_SCROLL_LOCK)
 		leds |= LIBINPUT_LED_SCROLL_LOCK;
 
+	udev_input_lock(input);
 	libinput_device_led_update(device->device, leds);
+	udev_input_unlock(input);
 }
 
 static void
-handle_keyboard_key(struct libinput_device *libinput_device,
-		    struct libinput_event_keyboard *keyboard_event)
+prepare_keyboard_key(struct evdev_event *ev,
+		     struct libinput_event_keyboard *keyboard_event)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
 	int key_state =
 		libinput_event_keyboard_get_key_state(keyboard_event);
 	int seat_key_count =
@@ -75,65 +86,38 @@ handle_keyboard_key(struct libinput_device *libinput_device,
 	     seat_key_count != 0))
 		return;
 
-	notify_key(device->seat,
-		   libinput_event_keyboard_get_time(keyboard_event),
-		   libinput_event_keyboard_get_key(keyboard_event),
-		   libinput_event_keyboard_get_key_state(keyboard_event),
-		   STATE_UPDATE_AUTOMATIC);
+	ev->type = EVDEV_EVENT_KEY;
+	ev->time = libinput_event_keyboard_get_time(keyboard_event);
+	ev->code = libinput_event_keyboard_get_key(keyboard_event);
+	ev->state = key_state;
 }
 
 static void
-handle_pointer_motion(struct libinput_device *libinput_device,
-		      struct libinput_event_pointer *pointer_event)
+prepare_pointer_motion(struct evdev_event *ev,
+		       struct libinput_event_pointer *pointer_event)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	wl_fixed_t dx, dy;
-
-	dx = wl_fixed_from_double(libinput_event_pointer_get_dx(pointer_event));
-	dy = wl_fixed_from_double(libinput_event_pointer_get_dy(pointer_event));
-	notify_motion(device->seat,
-		      libinput_event_pointer_get_time(pointer_event),
-		      dx,
-		      dy);
+	ev->type = EVDEV_EVENT_MOTION;
+	ev->time = libinput_event_pointer_get_time(pointer_event);
+	ev->x = libinput_event_pointer_get_dx(pointer_event);
+	ev->y = libinput_event_pointer_get_dy(pointer_event);
 }
 
 static void
-handle_pointer_motion_absolute(
-	struct libinput_device *libinput_device,
-	struct libinput_event_pointer *pointer_event)
+prepare_pointer_motion_absolute(struct evdev_event *ev,
+				struct libinput_event_pointer *pointer_event)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	struct weston_output *output = device->output;
-	uint32_t time;
-	wl_fixed_t x, y;
-	uint32_t width, height;
-
-	if (!output)
-		return;
-
-	time = libinput_event_pointer_get_time(pointer_event);
-	width = device->output->current_mode->width;
-	height = device->output->current_mode->height;
-
-	x = wl_fixed_from_double(
-		libinput_event_pointer_get_absolute_x_transformed(pointer_event,
-								  width));
-	y = wl_fixed_from_double(
-		libinput_event_pointer_get_absolute_y_transformed(pointer_event,
-								  height));
-
-	weston_output_transform_coordinate(device->output, x, y, &x, &y);
-	notify_motion_absolute(device->seat, time, x, y);
+	ev->type = EVDEV_EVENT_MOTION_ABSOLUTE;
+	ev->time = libinput_event_pointer_get_time(pointer_event);
+	ev->x = libinput_event_pointer_get_absolute_x_transformed(
+							pointer_event, 1);
+	ev->y = libinput_event_pointer_get_absolute_y_transformed(
+							pointer_event, 1);
 }
 
 static void
-handle_pointer_button(struct libinput_device *libinput_device,
-		      struct libinput_event_pointer *pointer_event)
+prepare_pointer_button(struct evdev_event *ev,
+		       struct libinput_event_pointer *pointer_event)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
 	int button_state =
 		libinput_event_pointer_get_button_state(pointer_event);
 	int seat_button_count =
@@ -146,10 +130,10 @@ handle_pointer_button(struct libinput_device *libinput_device,
 	     seat_button_count != 0))
 		return;
 
-	notify_button(device->seat,
-		      libinput_event_pointer_get_time(pointer_event),
-		      libinput_event_pointer_get_button(pointer_event),
-		      libinput_event_pointer_get_button_state(pointer_event));
+	ev->type = EVDEV_EVENT_BUTTON;
+	ev->time = libinput_event_pointer_get_time(pointer_event);
+	ev->code = libinput_event_pointer_get_button(pointer_event);
+	ev->state = button_state;
 }
 
 static double
@@ -191,154 +175,205 @@ normalize_scroll(struct libinput_event_pointer *pointer_event,
 }
 
 static void
-handle_pointer_axis(struct libinput_device *libinput_device,
-		    struct libinput_event_pointer *pointer_event)
+prepare_pointer_axis(struct evdev_event *ev,
+		     struct libinput_event_pointer *pointer_event)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	double value;
 	enum libinput_pointer_axis axis;
 
+	ev->type = EVDEV_EVENT_AXIS;
+	ev->time = libinput_event_pointer_get_time(pointer_event);
+
 	axis = LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL;
 	if (libinput_event_pointer_has_axis(pointer_event, axis)) {
-		value = normalize_scroll(pointer_event, axis);
-		notify_axis(device->seat,
-			    libinput_event_pointer_get_time(pointer_event),
-			    WL_POINTER_AXIS_VERTICAL_SCROLL,
-			    wl_fixed_from_double(value));
+		ev->axes |= EVDEV_AXIS_VERTICAL;
+		ev->y = normalize_scroll(pointer_event, axis);
 	}
 
 	axis = LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL;
 	if (libinput_event_pointer_has_axis(pointer_event, axis)) {
-		value = normalize_scroll(pointer_event, axis);
-		notify_axis(device->seat,
-			    libinput_event_pointer_get_time(pointer_event),
-			    WL_POINTER_AXIS_HORIZONTAL_SCROLL,
-			    wl_fixed_from_double(value));
+		ev->axes |= EVDEV_AXIS_HORIZONTAL;
+		ev->x = normalize_scroll(pointer_event, axis);
 	}
 }
 
 static void
-handle_touch_with_coords(struct libinput_device *libinput_device,
-			 struct libinput_event_touch *touch_event,
-			 int touch_type)
+prepare_touch(struct evdev_event *ev,
+	      struct libinput_event_touch *touch_event,
+	      enum evdev_event_type type)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	wl_fixed_t x;
-	wl_fixed_t y;
-	uint32_t width, height;
-	uint32_t time;
-	int32_t slot;
+	ev->type = type;
+	ev->time = libinput_event_touch_get_time(touch_event);
 
-	if (!device->output)
+	if (type == EVDEV_EVENT_TOUCH_FRAME)
 		return;
 
-	time = libinput_event_touch_get_time(touch_event);
-	slot = libinput_event_touch_get_seat_slot(touch_event);
-
-	width = device->output->current_mode->width;
-	height = device->output->current_mode->height;
-	x = wl_fixed_from_double(
-		libinput_event_touch_get_x_transformed(touch_event, width));
-	y = wl_fixed_from_double(
-		libinput_event_touch_get_y_transformed(touch_event, height));
+	ev->slot = libinput_event_touch_get_seat_slot(touch_event);
 
-	weston_output_transform_coordinate(device->output,
-					   x, y, &x, &y);
-
-	notify_touch(device->seat, time, slot, x, y, touch_type);
-}
-
-static void
-handle_touch_down(struct libinput_device *device,
-		  struct libinput_event_touch *touch_event)
-{
-	handle_touch_with_coords(device, touch_event, WL_TOUCH_DOWN);
-}
-
-static void
-handle_touch_motion(struct libinput_device *device,
-		    struct libinput_event_touch *touch_event)
-{
-	handle_touch_with_coords(device, touch_event, WL_TOUCH_MOTION);
-}
-
-static void
-handle_touch_up(struct libinput_device *libinput_device,
-		struct libinput_event_touch *touch_event)
-{
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	uint32_t time = libinput_event_touch_get_time(touch_event);
-	int32_t slot = libinput_event_touch_get_seat_slot(touch_event);
-
-	notify_touch(device->seat, time, slot, 0, 0, WL_TOUCH_UP);
-}
-
-static void
-handle_touch_frame(struct libinput_device *libinput_device,
-		   struct libinput_event_touch *touch_event)
-{
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	struct weston_seat *seat = device->seat;
+	if (type == EVDEV_EVENT_TOUCH_UP)
+		return;
 
-	notify_touch_frame(seat);
+	ev->x = libinput_event_touch_get_x_transformed(touch_event, 1);
+	ev->y = libinput_event_touch_get_y_transformed(touch_event, 1);
 }
 
+/** Read an input event out of a libinput event
+ *
+ * \param ev The event to fill in
+ * \param event The libinput event
+ * \return 1 if this is an input event, 0 if it has to be handled by
+ * the seat
+ *
+ * This only touches the libinput event and may be called from the input
+ * thread. Input events that do not change seat state, such as a key
+ * press on a second keyboard while the key is already down, come out
+ * as EVDEV_EVENT_NONE.
+ */
 int
-evdev_device_process_event(struct libinput_event *event)
+evdev_event_prepare(struct evdev_event *ev, struct libinput_event *event)
 {
-	struct libinput_device *libinput_device =
-		libinput_event_get_device(event);
-	int handled = 1;
+	memset(ev, 0, sizeof *ev);
+	ev->device = libinput_event_get_device(event);
 
 	switch (libinput_event_get_type(event)) {
 	case LIBINPUT_EVENT_KEYBOARD_KEY:
-		handle_keyboard_key(libinput_device,
-				    libinput_event_get_keyboard_event(event));
+		prepare_keyboard_key(ev,
+				     libinput_event_get_keyboard_event(event));
 		break;
 	case LIBINPUT_EVENT_POINTER_MOTION:
-		handle_pointer_motion(libinput_device,
-				      libinput_event_get_pointer_event(event));
+		prepare_pointer_motion(ev,
+				       libinput_event_get_pointer_event(event));
 		break;
 	case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
-		handle_pointer_motion_absolute(
-			libinput_device,
-			libinput_event_get_pointer_event(event));
+		prepare_pointer_motion_absolute(
+			ev, libinput_event_get_pointer_event(event));
 		break;
 	case LIBINPUT_EVENT_POINTER_BUTTON:
-		handle_pointer_button(libinput_device,
-				      libinput_event_get_pointer_event(event));
+		prepare_pointer_button(ev,
+				       libinput_event_get_pointer_event(event));
 		break;
 	case LIBINPUT_EVENT_POINTER_AXIS:
-		handle_pointer_axis(libinput_device,
-				    libinput_event_get_pointer_event(event));
+		prepare_pointer_axis(ev,
+				     libinput_event_get_pointer_event(event));
 		break;
 	case LIBINPUT_EVENT_TOUCH_DOWN:
-		handle_touch_down(libinput_device,
-				  libinput_event_get_touch_event(event));
+		prepare_touch(ev, libinput_event_get_touch_event(event),
+			      EVDEV_EVENT_TOUCH_DOWN);
 		break;
 	case LIBINPUT_EVENT_TOUCH_MOTION:
-		handle_touch_motion(libinput_device,
-				    libinput_event_get_touch_event(event));
+		prepare_touch(ev, libinput_event_get_touch_event(event),
+			      EVDEV_EVENT_TOUCH_MOTION);
 		break;
 	case LIBINPUT_EVENT_TOUCH_UP:
-		handle_touch_up(libinput_device,
-				libinput_event_get_touch_event(event));
+		prepare_touch(ev, libinput_event_get_touch_event(event),
+			      EVDEV_EVENT_TOUCH_UP);
 		break;
 	case LIBINPUT_EVENT_TOUCH_FRAME:
-		handle_touch_frame(libinput_device,
-				   libinput_event_get_touch_event(event));
+		prepare_touch(ev, libinput_event_get_touch_event(event),
+			      EVDEV_EVENT_TOUCH_FRAME);
 		break;
 	default:
-		handled = 0;
+		return 0;
+	}
+
+	return 1;
+}
+
+static int
+process_output_coordinate(struct evdev_device *device,
+			  const struct evdev_event *ev,
+			  wl_fixed_t *x, wl_fixed_t *y)
+{
+	struct weston_output *output = device->output;
+
+	if (!output)
+		return 0;
+
+	*x = wl_fixed_from_double(ev->x * output->current_mode->width);
+	*y = wl_fixed_from_double(ev->y * output->current_mode->height);
+	weston_output_transform_coordinate(output, *x, *y, x, y);
+
+	return 1;
+}
+
+/** Deliver an input event to the seat of its device
+ *
+ * \param ev An event filled in by evdev_event_prepare()
+ */
+void
+evdev_event_process(const struct evdev_event *ev)
+{
+	struct evdev_device *device =
+		libinput_device_get_user_data(ev->device);
+	struct weston_seat *seat;
+	wl_fixed_t x, y;
+
+	if (!device)
+		return;
+
+	seat = device->seat;
+
+	switch (ev->type) {
+	case EVDEV_EVENT_NONE:
+		break;
+	case EVDEV_EVENT_KEY:
+		notify_key(seat, ev->time, ev->code, ev->state,
+			   STATE_UPDATE_AUTOMATIC);
+		break;
+	case EVDEV_EVENT_MOTION:
+		notify_motion(seat, ev->time,
+			      wl_fixed_from_double(ev->x),
+			      wl_fixed_from_double(ev->y));
+		break;
+	case EVDEV_EVENT_MOTION_ABSOLUTE:
+		if (process_output_coordinate(device, ev, &x, &y))
+			notify_motion_absolute(seat, ev->time, x, y);
+		break;
+	case EVDEV_EVENT_BUTTON:
+		notify_button(seat, ev->time, ev->code, ev->state);
+		break;
+	case EVDEV_EVENT_AXIS:
+		if (ev->axes & EVDEV_AXIS_VERTICAL)
+			notify_axis(seat, ev->time,
+				    WL_POINTER_AXIS_VERTICAL_SCROLL,
+				    wl_fixed_from_double(ev->y));
+		if (ev->axes & EVDEV_AXIS_HORIZONTAL)
+			notify_axis(seat, ev->time,
+				    WL_POINTER_AXIS_HORIZONTAL_SCROLL,
+				    wl_fixed_from_double(ev->x));
+		break;
+	case EVDEV_EVENT_TOUCH_DOWN:
+		if (process_output_coordinate(device, ev, &x, &y))
+			notify_touch(seat, ev->time, ev->slot, x, y,
+				     WL_TOUCH_DOWN);
+		break;
+	case EVDEV_EVENT_TOUCH_MOTION:
+		if (process_output_coordinate(device, ev, &x, &y))
+			notify_touch(seat, ev->time, ev->slot, x, y,
+				     WL_TOUCH_MOTION);
+		break;
+	case EVDEV_EVENT_TOUCH_UP:
+		notify_touch(seat, ev->time, ev->slot, 0, 0, WL_TOUCH_UP);
+		break;
+	case EVDEV_EVENT_TOUCH_FRAME:
+		notify_touch_frame(seat);
+		break;
+	}
+}
+
+int
+evdev_device_process_event(struct libinput_event *event)
+{
+	struct evdev_event ev;
+
+	if (!evdev_event_prepare(&ev, event)) {
 		weston_log("unknown libinput event %d\n",
 			   libinput_event_get_type(event));
+		return 0;
 	}
 
-	return handled;
+	evdev_event_process(&ev);
+
+	return 1;
 }
 
 static void
@@ -447,6 +482,8 @@ void
 evdev_device_set_output(struct evdev_device *device,
 			struct weston_output *output)
 {
+	struct udev_input *input = evdev_device_get_input(device);
+
 	if (device->output_destroy_listener.notify) {
 		wl_list_remove(&device->output_destroy_listener.link);
 		device->output_destroy_listener.notify = NULL;
@@ -456,7 +493,10 @@ evdev_device_set_output(struct evdev_device *device,
 	device->output_destroy_listener.notify = notify_output_destroy;
 	wl_signal_add(&output->destroy_signal,
 		      &device->output_destroy_listener);
+
+	udev_input_lock(input);
 	evdev_device_set_calibration(device);
+	udev_input_unlock(input);
 }
 
 static void
@@ -40,6 +40,37 @@ enum evdev_device_seat_capability {
 	EVDEV_SEAT_TOUCH = (1 << 2)
 };
 
+enum evdev_event_type {
+	EVDEV_EVENT_NONE,
+	EVDEV_EVENT_KEY,
+	EVDEV_EVENT_MOTION,
+	EVDEV_EVENT_MOTION_ABSOLUTE,
+	EVDEV_EVENT_BUTTON,
+	EVDEV_EVENT_AXIS,
+	EVDEV_EVENT_TOUCH_DOWN,
+	EVDEV_EVENT_TOUCH_MOTION,
+	EVDEV_EVENT_TOUCH_UP,
+	EVDEV_EVENT_TOUCH_FRAME,
+};
+
+#define EVDEV_AXIS_VERTICAL	(1 << 0)
+#define EVDEV_AXIS_HORIZONTAL	(1 << 1)
+
+/* An input event with everything that does not depend on compositor
+ * state already read out of the libinput event. Absolute positions are
+ * normalized to [0, 1) and only scaled to the output when processed. */
+struct evdev_event {
+	enum evdev_event_type type;
+	struct libinput_device *device;
+	uint32_t time;
+	uint32_t code;		/* key or button */
+	uint32_t state;
+	uint32_t axes;		/* EVDEV_AXIS_* */
+	int32_t slot;
+	double x;		/* dx, absolute x or horizontal scroll */
+	double y;		/* dy, absolute y or vertical scroll */
+};
+
 struct evdev_device {
 	struct weston_seat *seat;
 	enum evdev_device_seat_capability seat_caps;
@@ -59,6 +90,12 @@ struct evdev_device *
 evdev_device_create(struct libinput_device *libinput_device,
 		    struct weston_seat *seat);
 
+int
+evdev_event_prepare(struct evdev_event *ev, struct libinput_event *event);
+
+void
+evdev_event_process(const struct evdev_event *ev);
+
 int
 evdev_device_process_event(struct libinput_event *event);
 
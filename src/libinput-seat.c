@@ -26,10 +26,16 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
 #include <libinput.h>
 #include <libudev.h>
 
@@ -48,6 +54,8 @@ static struct udev_seat *
 udev_seat_create(struct udev_input *input, const char *seat_name);
 static void
 udev_seat_destroy(struct udev_seat *seat);
+static void
+input_thread_stop(struct udev_input_thread *thread);
 
 static void
 device_added(struct udev_input *input, struct libinput_device *libinput_device)
@@ -125,6 +133,9 @@ udev_input_disable(struct udev_input *input)
 	if (input->suspended)
 		return;
 
+	if (input->thread)
+		input_thread_stop(input->thread);
+
 	libinput_suspend(input->libinput);
 	process_events(input);
 	input->suspended = 1;
@@ -192,6 +203,304 @@ libinput_source_dispatch(int fd, uint32_t mask, void *data)
 	return udev_input_dispatch(input) != 0;
 }
 
+/*
+ * Input thread, enabled with input_thread=true in the [libinput] section.
+ *
+ * The thread dispatches libinput as soon as its fd becomes readable, so
+ * events are read from the kernel even while the main loop is busy
+ * repainting. It reads the input events out of the libinput events with
+ * evdev_event_prepare() and hands them to the main loop through a
+ * single-producer single-consumer ring, waking it up with an eventfd.
+ * Device added and removed events are passed along unprepared and are
+ * handled on the main loop as before.
+ *
+ * libinput is not thread safe, so every libinput call is made with the
+ * input lock held. The main loop only takes it for hotplug, LED and
+ * calibration updates and once per batch to destroy the events it has
+ * consumed. When the ring is full the thread stops pulling events out of
+ * libinput until the main loop has drained it.
+ */
+
+#define INPUT_QUEUE_SIZE 1024 /* power of two */
+
+struct input_queue_entry {
+	struct libinput_event *event;
+	int prepared;
+	struct evdev_event ev;
+};
+
+struct udev_input_thread {
+	struct input_queue_entry queue[INPUT_QUEUE_SIZE];
+	uint64_t head;		/* advanced by the input thread */
+	uint64_t tail;		/* advanced by the main loop */
+	int waiting;		/* the input thread waits for the ring to drain */
+	int quit;
+
+	struct udev_input *input;
+	/* Recursive, hotplug handling already holds it when it gets to
+	 * calibration or LED updates. */
+	pthread_mutex_t lock;
+	pthread_t thread;
+	int running;
+	int wakeup_fd;		/* input thread -> main loop */
+	int drained_fd;		/* main loop -> input thread */
+	struct wl_event_source *source;
+};
+
+void
+udev_input_lock(struct udev_input *input)
+{
+	if (input->thread)
+		pthread_mutex_lock(&input->thread->lock);
+}
+
+void
+udev_input_unlock(struct udev_input *input)
+{
+	if (input->thread)
+		pthread_mutex_unlock(&input->thread->lock);
+}
+
+static int
+input_queue_full(struct udev_input_thread *thread, uint64_t head)
+{
+	return head - __atomic_load_n(&thread->tail, __ATOMIC_ACQUIRE) ==
+		INPUT_QUEUE_SIZE;
+}
+
+/* Moves events from libinput to the ring, returns 1 if the ring filled
+ * up before libinput ran out of events. */
+static int
+input_thread_read(struct udev_input_thread *thread)
+{
+	struct libinput *libinput = thread->input->libinput;
+	struct input_queue_entry *entry;
+	struct libinput_event *event;
+	uint64_t head = thread->head;
+	uint64_t one = 1;
+	int full;
+
+	pthread_mutex_lock(&thread->lock);
+
+	if (libinput_dispatch(libinput) != 0)
+		weston_log("libinput: Failed to dispatch libinput\n");
+
+	while (!(full = input_queue_full(thread, head)) &&
+	       (event = libinput_get_event(libinput))) {
+		entry = &thread->queue[head & (INPUT_QUEUE_SIZE - 1)];
+		entry->event = event;
+		entry->prepared = evdev_event_prepare(&entry->ev, event);
+		head++;
+	}
+
+	pthread_mutex_unlock(&thread->lock);
+
+	if (head != thread->head) {
+		__atomic_store_n(&thread->head, head, __ATOMIC_RELEASE);
+		if (write(thread->wakeup_fd, &one, sizeof one) < 0)
+			weston_log("libinput: failed to wake up main loop\n");
+	}
+
+	return full;
+}
+
+static void *
+input_thread_func(void *data)
+{
+	struct udev_input_thread *thread = data;
+	struct pollfd fds[2];
+	uint64_t count;
+	int full;
+
+	fds[0].fd = libinput_get_fd(thread->input->libinput);
+	fds[1].fd = thread->drained_fd;
+	fds[1].events = POLLIN;
+
+	while (!__atomic_load_n(&thread->quit, __ATOMIC_ACQUIRE)) {
+		full = input_thread_read(thread);
+
+		if (full) {
+			__atomic_store_n(&thread->waiting, 1, __ATOMIC_SEQ_CST);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			if (!input_queue_full(thread, thread->head)) {
+				__atomic_store_n(&thread->waiting, 0,
+						 __ATOMIC_SEQ_CST);
+				continue;
+			}
+		}
+
+		/* With a full ring only wait for the main loop. */
+		fds[0].events = full ? 0 : POLLIN;
+		if (poll(fds, ARRAY_LENGTH(fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			weston_log("libinput: input thread poll failed: %m\n");
+			break;
+		}
+
+		if ((fds[1].revents & POLLIN) &&
+		    read(thread->drained_fd, &count, sizeof count) < 0 &&
+		    errno != EAGAIN)
+			break;
+	}
+
+	return NULL;
+}
+
+static void
+input_thread_drain(struct udev_input_thread *thread)
+{
+	struct input_queue_entry *entry;
+	uint64_t tail = thread->tail;
+	uint64_t head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+	uint64_t one = 1;
+	uint64_t i;
+
+	if (head == tail)
+		return;
+
+	for (i = tail; i != head; i++) {
+		entry = &thread->queue[i & (INPUT_QUEUE_SIZE - 1)];
+
+		if (entry->prepared) {
+			evdev_event_process(&entry->ev);
+		} else {
+			pthread_mutex_lock(&thread->lock);
+			process_event(entry->event);
+			pthread_mutex_unlock(&thread->lock);
+		}
+	}
+
+	pthread_mutex_lock(&thread->lock);
+	for (i = tail; i != head; i++) {
+		entry = &thread->queue[i & (INPUT_QUEUE_SIZE - 1)];
+		libinput_event_destroy(entry->event);
+	}
+	pthread_mutex_unlock(&thread->lock);
+
+	__atomic_store_n(&thread->tail, head, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_exchange_n(&thread->waiting, 0, __ATOMIC_SEQ_CST) &&
+	    write(thread->drained_fd, &one, sizeof one) < 0)
+		weston_log("libinput: failed to wake up input thread\n");
+}
+
+static int
+input_thread_source_dispatch(int fd, uint32_t mask, void *data)
+{
+	struct udev_input_thread *thread = data;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+		return 0;
+
+	input_thread_drain(thread);
+
+	return 0;
+}
+
+static int
+input_thread_start(struct udev_input_thread *thread)
+{
+	struct weston_compositor *c = thread->input->compositor;
+	struct wl_event_loop *loop = wl_display_get_event_loop(c->wl_display);
+	sigset_t mask, old_mask;
+	int ret;
+
+	if (thread->running)
+		return 0;
+
+	thread->source = wl_event_loop_add_fd(loop, thread->wakeup_fd,
+					      WL_EVENT_READABLE,
+					      input_thread_source_dispatch,
+					      thread);
+	if (!thread->source)
+		return -1;
+
+	thread->quit = 0;
+
+	/* The input thread must not take the compositor's signals. */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	ret = pthread_create(&thread->thread, NULL, input_thread_func, thread);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	if (ret != 0) {
+		wl_event_source_remove(thread->source);
+		thread->source = NULL;
+		return -1;
+	}
+
+	thread->running = 1;
+
+	return 0;
+}
+
+static void
+input_thread_stop(struct udev_input_thread *thread)
+{
+	uint64_t one = 1;
+
+	if (!thread->running)
+		return;
+
+	__atomic_store_n(&thread->quit, 1, __ATOMIC_RELEASE);
+	if (write(thread->drained_fd, &one, sizeof one) < 0)
+		weston_log("libinput: failed to wake up input thread\n");
+	pthread_join(thread->thread, NULL);
+	thread->running = 0;
+
+	/* Deliver what the thread read last, as the main loop would have. */
+	input_thread_drain(thread);
+
+	wl_event_source_remove(thread->source);
+	thread->source = NULL;
+}
+
+static struct udev_input_thread *
+input_thread_create(struct udev_input *input)
+{
+	struct udev_input_thread *thread;
+	pthread_mutexattr_t attr;
+
+	thread = zalloc(sizeof *thread);
+	if (!thread)
+		return NULL;
+
+	thread->input = input;
+
+	thread->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->wakeup_fd < 0)
+		goto err_free;
+
+	thread->drained_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->drained_fd < 0)
+		goto err_wakeup;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&thread->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return thread;
+
+err_wakeup:
+	close(thread->wakeup_fd);
+err_free:
+	free(thread);
+	return NULL;
+}
+
+static void
+input_thread_destroy(struct udev_input_thread *thread)
+{
+	input_thread_stop(thread);
+	pthread_mutex_destroy(&thread->lock);
+	close(thread->drained_fd);
+	close(thread->wakeup_fd);
+	free(thread);
+}
+
 static int
 open_restricted(const char *path, int flags, void *user_data)
 {
@@ -224,18 +533,21 @@ udev_input_enable(struct udev_input *input)
 	struct udev_seat *seat;
 	int devices_found = 0;
 
-	loop = wl_display_get_event_loop(c->wl_display);
-	fd = libinput_get_fd(input->libinput);
-	input->libinput_source =
-		wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
-				     libinput_source_dispatch, input);
-	if (!input->libinput_source) {
-		return -1;
+	if (!input->thread) {
+		loop = wl_display_get_event_loop(c->wl_display);
+		fd = libinput_get_fd(input->libinput);
+		input->libinput_source =
+			wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
+					     libinput_source_dispatch, input);
+		if (!input->libinput_source) {
+			return -1;
+		}
 	}
 
 	if (input->suspended) {
 		if (libinput_resume(input->libinput) != 0) {
-			wl_event_source_remove(input->libinput_source);
+			if (input->libinput_source)
+				wl_event_source_remove(input->libinput_source);
 			input->libinput_source = NULL;
 			return -1;
 		}
@@ -243,6 +555,12 @@ udev_input_enable(struct udev_input *input)
 		process_events(input);
 	}
 
+	/* Started last, libinput is only used from the main loop before. */
+	if (input->thread && input_thread_start(input->thread) < 0) {
+		weston_log("libinput: failed to start the input thread\n");
+		return -1;
+	}
+
 	wl_list_for_each(seat, &input->compositor->seat_list, base.link) {
 		evdev_notify_keyboard_focus(&seat->base, &seat->devices_list);
 
@@ -278,6 +596,8 @@ udev_input_init(struct udev_input *input, struct weston_compositor *c,
 {
 	enum libinput_log_priority priority = LIBINPUT_LOG_PRIORITY_INFO;
 	const char *log_priority = NULL;
+	struct weston_config_section *s;
+	int input_thread;
 
 	memset(input, 0, sizeof *input);
 
@@ -305,7 +625,18 @@ udev_input_init(struct udev_input *input, struct weston_compositor *c,
 
 	libinput_log_set_priority(input->libinput, priority);
 
+	s = weston_config_get_section(c->config, "libinput", NULL, NULL);
+	weston_config_section_get_bool(s, "input_thread", &input_thread, 0);
+	if (input_thread) {
+		input->thread = input_thread_create(input);
+		if (!input->thread)
+			weston_log("libinput: failed to create the input "
+				   "thread, dispatching on the main loop\n");
+	}
+
 	if (libinput_udev_assign_seat(input->libinput, seat_id) != 0) {
+		if (input->thread)
+			input_thread_destroy(input->thread);
 		libinput_unref(input->libinput);
 		return -1;
 	}
@@ -320,7 +651,10 @@ udev_input_destroy(struct udev_input *input)
 {
 	struct udev_seat *seat, *next;
 
-	wl_event_source_remove(input->libinput_source);
+	if (input->thread)
+		input_thread_destroy(input->thread);
+	if (input->libinput_source)
+		wl_event_source_remove(input->libinput_source);
 	wl_list_for_each_safe(seat, next, &input->compositor->seat_list, base.link)
 		udev_seat_destroy(seat);
 	libinput_unref(input->libinput);
@@ -39,11 +39,14 @@ struct udev_seat {
 	struct wl_listener output_create_listener;
 };
 
+struct udev_input_thread;
+
 struct udev_input {
 	struct libinput *libinput;
 	struct wl_event_source *libinput_source;
 	struct weston_compositor *compositor;
 	int suspended;
+	struct udev_input_thread *thread;
 };
 
 int
@@ -58,6 +61,11 @@ udev_input_init(struct udev_input *input,
 void
 udev_input_destroy(struct udev_input *input);
 
+void
+udev_input_lock(struct udev_input *input);
+void
+udev_input_unlock(struct udev_input *input);
+
 struct udev_seat *
 udev_seat_get_named(struct udev_input *u,
 		    const char *seat_name);
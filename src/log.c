@@ -28,7 +28,14 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -42,36 +49,281 @@ static FILE *weston_logfile = NULL;
 
 static int cached_tm_mday = -1;
 
-static int weston_log_timestamp(void)
+/*
+ * Asynchronous mode: any thread formats its messages into a ring of
+ * fixed-size slots and a background thread writes them to the file.
+ *
+ * Writers reserve consecutive slots by advancing the head with a
+ * compare-and-swap, fill them and publish each one by storing its
+ * position + 1 in its sequence number. The log thread consumes
+ * published slots in order and only then advances the tail, which frees
+ * them. A message that does not fit is dropped and counted, the log
+ * thread reports the count. Nothing ever blocks the writers.
+ */
+
+#define LOG_RING_SLOTS 8192 /* power of two */
+#define LOG_SLOT_DATA 54
+#define LOG_MESSAGE_MAX_SLOTS (LOG_RING_SLOTS / 8)
+
+struct log_slot {
+	uint64_t seq;
+	uint16_t len;
+	char data[LOG_SLOT_DATA];
+};
+
+struct log_ring {
+	struct log_slot slots[LOG_RING_SLOTS];
+
+	uint64_t head;
+	uint64_t tail;
+	uint32_t dropped;
+	int sleeping;
+	char drain_lock;
+
+	int wakeup_fd;
+	bool quit;
+	bool running;
+	pthread_t thread;
+};
+
+/* Other threads read log_async and then write to log_ring without any
+ * lock, so log_async is only accessed atomically and the ring, once
+ * allocated, stays until exit: a writer that saw log_async set just
+ * before the log went synchronous still writes into valid memory. */
+static struct log_ring *log_ring;
+static bool log_async;
+
+static uint64_t
+log_ring_available(struct log_ring *ring, uint64_t head)
+{
+	return LOG_RING_SLOTS -
+		(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+}
+
+static void
+log_ring_wake(struct log_ring *ring)
+{
+	uint64_t one = 1;
+
+	if (!__atomic_exchange_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST))
+		return;
+
+	if (write(ring->wakeup_fd, &one, sizeof one) < 0)
+		return;
+}
+
+static int
+log_ring_write(struct log_ring *ring, const char *buf, size_t len)
+{
+	struct log_slot *slot;
+	uint64_t head, i;
+	size_t n, chunk;
+
+	n = (len + LOG_SLOT_DATA - 1) / LOG_SLOT_DATA;
+	if (n > LOG_MESSAGE_MAX_SLOTS) {
+		n = LOG_MESSAGE_MAX_SLOTS;
+		len = n * LOG_SLOT_DATA;
+	}
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	do {
+		if (log_ring_available(ring, head) < n) {
+			__atomic_add_fetch(&ring->dropped, 1,
+					   __ATOMIC_RELAXED);
+			return 0;
+		}
+	} while (!__atomic_compare_exchange_n(&ring->head, &head, head + n,
+					      true, __ATOMIC_ACQUIRE,
+					      __ATOMIC_RELAXED));
+
+	for (i = 0; i < n; i++) {
+		slot = &ring->slots[(head + i) & (LOG_RING_SLOTS - 1)];
+		chunk = len > LOG_SLOT_DATA ? LOG_SLOT_DATA : len;
+		memcpy(slot->data, buf, chunk);
+		slot->len = chunk;
+		buf += chunk;
+		len -= chunk;
+
+		__atomic_store_n(&slot->seq, head + i + 1, __ATOMIC_RELEASE);
+	}
+
+	/* Pairs with the sleeping flag set by the log thread. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	log_ring_wake(ring);
+
+	return 0;
+}
+
+static bool
+log_ring_pending(struct log_ring *ring)
+{
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	struct log_slot *slot = &ring->slots[tail & (LOG_RING_SLOTS - 1)];
+
+	return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == tail + 1;
+}
+
+/* Write out every published slot. Returns false if another thread is
+ * already draining. */
+static bool
+log_ring_drain(struct log_ring *ring)
+{
+	char buf[4096];
+	struct log_slot *slot;
+	uint64_t tail;
+	uint32_t dropped;
+	size_t len = 0;
+
+	if (__atomic_test_and_set(&ring->drain_lock, __ATOMIC_ACQUIRE))
+		return false;
+
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &ring->slots[tail & (LOG_RING_SLOTS - 1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1)
+			break;
+
+		if (len + slot->len > sizeof buf) {
+			fwrite(buf, 1, len, weston_logfile);
+			len = 0;
+		}
+		memcpy(buf + len, slot->data, slot->len);
+		len += slot->len;
+		tail++;
+
+		/* Free the slots in batches, not one by one. */
+		if ((tail & 63) == 0)
+			__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+	if (len > 0)
+		fwrite(buf, 1, len, weston_logfile);
+
+	dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+	if (dropped > 0)
+		fprintf(weston_logfile,
+			"[weston_log: %u messages dropped, log ring full]\n",
+			dropped);
+
+	fflush(weston_logfile);
+
+	__atomic_clear(&ring->drain_lock, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+static void *
+log_ring_thread(void *data)
+{
+	struct log_ring *ring = data;
+	uint64_t count;
+
+	while (!__atomic_load_n(&ring->quit, __ATOMIC_ACQUIRE)) {
+		log_ring_drain(ring);
+
+		__atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+		if (log_ring_pending(ring) ||
+		    __atomic_load_n(&ring->quit, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		if (read(ring->wakeup_fd, &count, sizeof count) < 0 &&
+		    errno != EINTR)
+			break;
+	}
+
+	log_ring_drain(ring);
+
+	return NULL;
+}
+
+/* Log a prefix and a message, as one ring entry in asynchronous mode
+ * so that messages from different threads do not interleave. */
+static int
+log_vprintf(const char *prefix, const char *fmt, va_list ap)
+{
+	char stack_buf[512];
+	char *buf = stack_buf;
+	size_t prefix_len = strlen(prefix);
+	va_list ap_copy;
+	int len;
+
+	if (!__atomic_load_n(&log_async, __ATOMIC_ACQUIRE))
+		return fprintf(weston_logfile, "%s", prefix) +
+			vfprintf(weston_logfile, fmt, ap);
+
+	if (prefix_len >= sizeof stack_buf)
+		prefix_len = sizeof stack_buf - 1;
+	memcpy(stack_buf, prefix, prefix_len);
+
+	va_copy(ap_copy, ap);
+	len = vsnprintf(stack_buf + prefix_len, sizeof stack_buf - prefix_len,
+			fmt, ap_copy);
+	va_end(ap_copy);
+	if (len < 0)
+		return len;
+
+	if (prefix_len + len >= sizeof stack_buf) {
+		buf = malloc(prefix_len + len + 1);
+		if (!buf) {
+			__atomic_add_fetch(&log_ring->dropped, 1,
+					   __ATOMIC_RELAXED);
+			return 0;
+		}
+		memcpy(buf, prefix, prefix_len);
+		vsnprintf(buf + prefix_len, len + 1, fmt, ap);
+	}
+
+	len += prefix_len;
+	log_ring_write(log_ring, buf, len);
+
+	if (buf != stack_buf)
+		free(buf);
+
+	return len;
+}
+
+/* Called from any thread that logs: the day change is claimed with an
+ * atomic exchange, so exactly one message carries the new date. */
+static int
+weston_log_timestamp(char *buf, size_t size)
 {
 	struct timeval tv;
-	struct tm *brokendown_time;
+	struct tm brokendown_time;
 	char string[128];
+	int len = 0;
 
 	gettimeofday(&tv, NULL);
 
-	brokendown_time = localtime(&tv.tv_sec);
-	if (brokendown_time == NULL)
-		return fprintf(weston_logfile, "[(NULL)localtime] ");
-
-	if (brokendown_time->tm_mday != cached_tm_mday) {
-		strftime(string, sizeof string, "%Y-%m-%d %Z", brokendown_time);
-		fprintf(weston_logfile, "Date: %s\n", string);
+	if (localtime_r(&tv.tv_sec, &brokendown_time) == NULL)
+		return snprintf(buf, size, "[(NULL)localtime] ");
 
-		cached_tm_mday = brokendown_time->tm_mday;
+	if (__atomic_load_n(&cached_tm_mday, __ATOMIC_RELAXED) !=
+	    brokendown_time.tm_mday &&
+	    __atomic_exchange_n(&cached_tm_mday, brokendown_time.tm_mday,
+				__ATOMIC_RELAXED) != brokendown_time.tm_mday) {
+		strftime(string, sizeof string, "%Y-%m-%d %Z",
+			 &brokendown_time);
+		len = snprintf(buf, size, "Date: %s\n", string);
 	}
 
-	strftime(string, sizeof string, "%H:%M:%S", brokendown_time);
+	strftime(string, sizeof string, "%H:%M:%S", &brokendown_time);
 
-	return fprintf(weston_logfile, "[%s.%03li] ", string, tv.tv_usec/1000);
+	return len + snprintf(buf + len, size - len, "[%s.%03li] ",
+			      string, tv.tv_usec/1000);
 }
 
 static void
 custom_handler(const char *fmt, va_list arg)
 {
-	weston_log_timestamp();
-	fprintf(weston_logfile, "libwayland: ");
-	vfprintf(weston_logfile, fmt, arg);
+	char prefix[256];
+	size_t len;
+
+	len = weston_log_timestamp(prefix, sizeof prefix);
+	snprintf(prefix + len, sizeof prefix - len, "libwayland: ");
+	log_vprintf(prefix, fmt, arg);
 }
 
 void
@@ -91,23 +343,133 @@ weston_log_file_open(const char *filename)
 		setvbuf(weston_logfile, NULL, _IOLBF, 256);
 }
 
+/* Writes out the ring and stops the log thread. The ring itself is
+ * kept for writers on other threads, see log_ring. */
+static void
+weston_log_async_stop(void)
+{
+	struct log_ring *ring = log_ring;
+	uint64_t one = 1;
+
+	if (!ring || !ring->running)
+		return;
+
+	__atomic_store_n(&log_async, false, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->quit, true, __ATOMIC_RELEASE);
+	if (write(ring->wakeup_fd, &one, sizeof one) < 0)
+		weston_log("failed to wake the log thread: %m\n");
+	pthread_join(ring->thread, NULL);
+	ring->running = false;
+
+	/* Whatever was written while the thread was quitting */
+	log_ring_drain(ring);
+}
+
 void
 weston_log_file_close()
 {
+	weston_log_async_stop();
+
 	if ((weston_logfile != stderr) && (weston_logfile != NULL))
 		fclose(weston_logfile);
 	weston_logfile = stderr;
 }
 
+static void
+weston_log_atexit(void)
+{
+	weston_log_flush();
+}
+
+/** Write the log from a background thread
+ *
+ * \return 0 on success, -1 if the log stays synchronous.
+ *
+ * From now on weston_log() and friends only format the message into a
+ * ring buffer, which a background thread writes to the log file, so
+ * slow storage cannot stall the compositor. When the ring is full,
+ * messages are dropped and their number is logged. The ring is written
+ * out by weston_log_file_close(), weston_log_flush() and at exit().
+ */
+int
+weston_log_async_start(void)
+{
+	static bool atexit_registered;
+	struct log_ring *ring = log_ring;
+	sigset_t mask, old_mask;
+	int ret;
+
+	if (ring && ring->running)
+		return 0;
+
+	if (!ring) {
+		ring = zalloc(sizeof *ring);
+		if (!ring)
+			return -1;
+
+		ring->wakeup_fd = eventfd(0, EFD_CLOEXEC);
+		if (ring->wakeup_fd < 0) {
+			free(ring);
+			return -1;
+		}
+
+		log_ring = ring;
+	}
+
+	ring->quit = false;
+
+	/* The log thread must not take the compositor's signals. */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	ret = pthread_create(&ring->thread, NULL, log_ring_thread, ring);
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+	if (ret != 0)
+		return -1;
+	ring->running = true;
+
+	if (!atexit_registered) {
+		atexit(weston_log_atexit);
+		atexit_registered = true;
+	}
+
+	fflush(weston_logfile);
+	__atomic_store_n(&log_async, true, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/** Write out the asynchronous log and go synchronous
+ *
+ * To be used when the process is about to die, e.g. from the crash
+ * handler: everything logged so far is written from the calling thread,
+ * and so is everything logged afterwards. The log thread keeps running
+ * but finds nothing more to write.
+ */
+void
+weston_log_flush(void)
+{
+	struct log_ring *ring = log_ring;
+	int tries;
+
+	if (!ring || !__atomic_exchange_n(&log_async, false, __ATOMIC_ACQ_REL))
+		return;
+
+	/* The log thread may be draining right now, let it finish. */
+	for (tries = 0; tries < 1000; tries++) {
+		if (log_ring_drain(ring))
+			break;
+		usleep(1000);
+	}
+}
+
 WL_EXPORT int
 weston_vlog(const char *fmt, va_list ap)
 {
-	int l;
+	char timestamp[256];
 
-	l = weston_log_timestamp();
-	l += vfprintf(weston_logfile, fmt, ap);
+	weston_log_timestamp(timestamp, sizeof timestamp);
 
-	return l;
+	return log_vprintf(timestamp, fmt, ap);
 }
 
 WL_EXPORT int
@@ -126,7 +488,7 @@ weston_log(const char *fmt, ...)
 WL_EXPORT int
 weston_vlog_continue(const char *fmt, va_list argp)
 {
-	return vfprintf(weston_logfile, fmt, argp);
+	return log_vprintf("", fmt, argp);
 }
 
 WL_EXPORT int
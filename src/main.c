@@ -45,6 +45,7 @@
 #include "../shared/os-compatibility.h"
 #include "../shared/helpers.h"
 #include "git-version.h"
+#include "timeline.h"
 #include "version.h"
 
 static struct wl_list child_process_list;
@@ -255,8 +256,10 @@ usage(int error_code)
 		"  -i, --idle-time=SECS\tIdle time in seconds\n"
 		"  --modules\t\tLoad the comma-separated list of modules\n"
 		"  --log=FILE\t\tLog to the given file\n"
+		"  --log-async\t\tWrite the log from a background thread\n"
 		"  -c, --config=FILE\tConfig file to load, defaults to weston.ini\n"
 		"  --no-config\t\tDo not read weston.ini\n"
+		"  --debug\t\tEnable debugging interfaces for all clients\n"
 		"  -h, --help\t\tThis help message\n\n");
 
 #if defined(BUILD_DRM_COMPOSITOR)
@@ -284,7 +287,11 @@ usage(int error_code)
 		"  --height=HEIGHT\tHeight of memory surface\n"
 		"  --transform=TR\tThe output transformation, TR is one of:\n"
 		"\tnormal 90 180 270 flipped flipped-90 flipped-180 flipped-270\n"
-		"  --use-pixman\t\tUse the pixman (CPU) renderer (default: no rendering)\n\n");
+		"  --use-pixman\t\tUse the pixman (CPU) renderer (default: no rendering)\n"
+		"  --refresh-rate=MHZ\tThe output refresh rate, in mHz (default: 60000)\n"
+		"  --unthrottled\t\tComplete frames as soon as they are repainted,\n"
+		"\t\t\tand repaint without waiting for the refresh rate\n"
+		"  --virtual-clock\tUse a deterministic virtual presentation clock\n\n");
 #endif
 
 #if defined(BUILD_RDP_COMPOSITOR)
@@ -296,6 +303,8 @@ usage(int error_code)
 		"  --address=ADDR\tThe address to bind\n"
 		"  --port=PORT\t\tThe port to listen on\n"
 		"  --no-clients-resize\tThe RDP peers will be forced to the size of the desktop\n"
+		"  --encoder-threads=N\tNumber of threads encoding RemoteFX/NSCodec\n"
+		"\t\t\tupdates, 0 to use one per CPU (default)\n"
 		"  --rdp4-key=FILE\tThe file containing the key for RDP4 encryption\n"
 		"  --rdp-tls-cert=FILE\tThe file containing the certificate for TLS encryption\n"
 		"  --rdp-tls-key=FILE\tThe file containing the private key for TLS encryption\n"
@@ -363,6 +372,7 @@ on_caught_signal(int s, siginfo_t *siginfo, void *context)
 	 * will allow weston to switch back to gdb on crash and then
 	 * gdb will catch the crash with SIGTRAP.*/
 
+	weston_log_flush();
 	weston_log("caught signal: %d\n", s);
 
 	print_backtrace();
@@ -496,7 +506,8 @@ weston_compositor_init_config(struct weston_compositor *ec,
 {
 	struct xkb_rule_names xkb_names;
 	struct weston_config_section *s;
-	int repaint_msec;
+	int repaint_msec, repaint_margin_usec;
+	int recorder_sec, recorder_deadline;
 
 	s = weston_config_get_section(config, "keyboard", NULL, NULL);
 	weston_config_section_get_string(s, "keymap_rules",
@@ -530,6 +541,35 @@ weston_compositor_init_config(struct weston_compositor *ec,
 	weston_log("Output repaint window is %d ms maximum.\n",
 		   ec->repaint_msec);
 
+	weston_config_section_get_bool(s, "adaptive-repaint",
+				       &ec->adaptive_repaint, 0);
+	weston_config_section_get_int(s, "adaptive-repaint-margin",
+				      &repaint_margin_usec,
+				      ec->repaint_margin_usec);
+	if (repaint_margin_usec < 0 || repaint_margin_usec > 1000000) {
+		weston_log("Invalid adaptive-repaint-margin value in "
+			   "config: %d\n", repaint_margin_usec);
+	} else {
+		ec->repaint_margin_usec = repaint_margin_usec;
+	}
+	if (ec->adaptive_repaint)
+		weston_log("Adaptive repaint scheduling, %d us margin.\n",
+			   ec->repaint_margin_usec);
+
+	weston_config_section_get_bool(s, "motion-coalescing",
+				       &ec->motion_coalescing, 0);
+	weston_config_section_get_bool(s, "cursor-only-repaint",
+				       &ec->cursor_only_repaint, 1);
+
+	weston_config_section_get_int(s, "timeline-recorder",
+				      &recorder_sec, 0);
+	weston_config_section_get_int(s, "timeline-recorder-deadline",
+				      &recorder_deadline, 0);
+	if (recorder_sec > 0 &&
+	    weston_timeline_recorder_start(ec, recorder_sec,
+					   MAX(recorder_deadline, 0)) < 0)
+		weston_log("Failed to start the timeline recorder.\n");
+
 	return 0;
 }
 
@@ -645,12 +685,14 @@ int main(int argc, char *argv[])
 	char *modules = NULL;
 	char *option_modules = NULL;
 	char *log = NULL;
+	int32_t log_async = 0;
 	char *server_socket = NULL, *end;
 	int32_t idle_time = -1;
 	int32_t help = 0;
 	char *socket_name = NULL;
 	int32_t version = 0;
 	int32_t noconfig = 0;
+	int32_t debug = 0;
 	int32_t numlock_on;
 	char *config_file = NULL;
 	struct weston_config *config = NULL;
@@ -666,10 +708,12 @@ int main(int argc, char *argv[])
 		{ WESTON_OPTION_INTEGER, "idle-time", 'i', &idle_time },
 		{ WESTON_OPTION_STRING, "modules", 0, &option_modules },
 		{ WESTON_OPTION_STRING, "log", 0, &log },
+		{ WESTON_OPTION_BOOLEAN, "log-async", 0, &log_async },
 		{ WESTON_OPTION_BOOLEAN, "help", 'h', &help },
 		{ WESTON_OPTION_BOOLEAN, "version", 0, &version },
 		{ WESTON_OPTION_BOOLEAN, "no-config", 0, &noconfig },
 		{ WESTON_OPTION_STRING, "config", 'c', &config_file },
+		{ WESTON_OPTION_BOOLEAN, "debug", 0, &debug },
 	};
 
 	parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
@@ -683,6 +727,9 @@ int main(int argc, char *argv[])
 	}
 
 	weston_log_file_open(log);
+	if (log_async && weston_log_async_start() < 0)
+		weston_log("failed to start the log thread, "
+			   "logging synchronously\n");
 
 	weston_log("%s\n"
 		   STAMP_SPACE "%s\n"
@@ -756,6 +803,13 @@ int main(int argc, char *argv[])
 
 	weston_compositor_log_capabilities(ec);
 
+	if (debug) {
+		weston_log("Debugging interfaces enabled, "
+			   "any client may use them\n");
+		if (weston_stats_create(ec) < 0)
+			goto out;
+	}
+
 	server_socket = getenv("WAYLAND_SERVER_SOCKET");
 	if (server_socket) {
 		weston_log("Running with single client\n");
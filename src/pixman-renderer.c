@@ -40,6 +40,11 @@ struct pixman_output_state {
 	void *shadow_buffer;
 	pixman_image_t *shadow_image;
 	pixman_image_t *hw_buffer;
+
+	/* The scene under weston_output::cursor_view, and its box in
+	 * output coordinates */
+	pixman_image_t *cursor_background;
+	pixman_box32_t cursor_box;
 };
 
 struct pixman_surface_state {
@@ -472,6 +477,7 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 {
 	static int zoom_logged = 0;
 	struct pixman_surface_state *ps = get_surface_state(ev->surface);
+	struct weston_client_timer timer;
 	/* repaint bounding region in global coordinates: */
 	pixman_region32_t repaint;
 
@@ -487,6 +493,9 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 	if (!pixman_region32_not_empty(&repaint))
 		goto out;
 
+	weston_client_timer_start(&timer, ev->surface->compositor,
+				  ev->surface->resource);
+
 	if (output->zoom.active && !zoom_logged) {
 		weston_log("pixman renderer does not support zoom\n");
 		zoom_logged = 1;
@@ -512,18 +521,119 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 		draw_view_source_clipped(ev, output, &repaint);
 	}
 
+	weston_client_timer_stop(&timer, WESTON_CLIENT_COST_RENDER);
+	weston_client_stats_add_pixels(ev->surface->compositor,
+				       ev->surface->resource, &repaint);
+
 out:
 	pixman_region32_fini(&repaint);
 }
+
+/** Keep what is under the cursor before it is painted
+ *
+ * \param output The output being painted.
+ * \param cursor The cursor view, about to be drawn.
+ * \param damage The region being painted in global coordinates.
+ *
+ * Only the damaged part of the cursor box is copied from the shadow
+ * image. The rest still holds the scene from an earlier repaint, because
+ * the core damages the whole box whenever the cursor starts being
+ * tracked, moves or changes size.
+ */
+static void
+save_cursor_background(struct weston_output *output,
+		       struct weston_view *cursor,
+		       pixman_region32_t *damage)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	pixman_region32_t box_region, clip;
+	pixman_box32_t box;
+	int width, height;
+
+	pixman_region32_init(&box_region);
+	pixman_region32_intersect(&box_region, &cursor->transform.boundingbox,
+				  &output->region);
+	region_global_to_output(output, &box_region);
+	box = *pixman_region32_extents(&box_region);
+	width = box.x2 - box.x1;
+	height = box.y2 - box.y1;
+
+	if (po->cursor_background &&
+	    (pixman_image_get_width(po->cursor_background) != width ||
+	     pixman_image_get_height(po->cursor_background) != height)) {
+		pixman_image_unref(po->cursor_background);
+		po->cursor_background = NULL;
+	}
+
+	if (!po->cursor_background && width > 0 && height > 0)
+		po->cursor_background =
+			pixman_image_create_bits(
+				pixman_image_get_format(po->shadow_image),
+				width, height, NULL, 0);
+
+	po->cursor_box = box;
+
+	if (po->cursor_background) {
+		pixman_region32_init(&clip);
+		pixman_region32_copy(&clip, damage);
+		region_global_to_output(output, &clip);
+		pixman_region32_intersect(&clip, &clip, &box_region);
+		pixman_region32_translate(&clip, -box.x1, -box.y1);
+		pixman_image_set_clip_region32(po->cursor_background, &clip);
+		pixman_region32_fini(&clip);
+
+		pixman_image_composite32(PIXMAN_OP_SRC,
+					 po->shadow_image, /* src */
+					 NULL /* mask */,
+					 po->cursor_background, /* dest */
+					 box.x1, box.y1, /* src_x, src_y */
+					 0, 0, /* mask_x, mask_y */
+					 0, 0, /* dest_x, dest_y */
+					 width, height);
+
+		pixman_image_set_clip_region32(po->cursor_background, NULL);
+	}
+
+	pixman_region32_fini(&box_region);
+}
+
 static void
 repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
 {
 	struct weston_compositor *compositor = output->compositor;
 	struct weston_view *view;
 
-	wl_list_for_each_reverse(view, &compositor->view_list, link)
-		if (view->plane == &compositor->primary_plane)
-			draw_view(view, output, damage);
+	wl_list_for_each_reverse(view, &compositor->view_list, link) {
+		if (view->plane != &compositor->primary_plane)
+			continue;
+
+		if (view == output->cursor_view)
+			save_cursor_background(output, view, damage);
+		draw_view(view, output, damage);
+	}
+}
+
+/* Everything but the cursor is as it was painted last time, so put back
+ * what the cursor covered and draw it at its new position, without
+ * going through the other views. */
+static void
+repaint_cursor(struct weston_output *output, pixman_region32_t *damage)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	pixman_box32_t *box = &po->cursor_box;
+
+	pixman_image_composite32(PIXMAN_OP_SRC,
+				 po->cursor_background, /* src */
+				 NULL /* mask */,
+				 po->shadow_image, /* dest */
+				 0, 0, /* src_x, src_y */
+				 0, 0, /* mask_x, mask_y */
+				 box->x1, box->y1, /* dest_x, dest_y */
+				 box->x2 - box->x1, /* width */
+				 box->y2 - box->y1 /* height */);
+
+	save_cursor_background(output, output->cursor_view, damage);
+	draw_view(output->cursor_view, output, damage);
 }
 
 static void
@@ -562,7 +672,15 @@ pixman_renderer_repaint_output(struct weston_output *output,
 	if (!po->hw_buffer)
 		return;
 
-	repaint_surfaces(output, output_damage);
+	if (!output->cursor_view && po->cursor_background) {
+		pixman_image_unref(po->cursor_background);
+		po->cursor_background = NULL;
+	}
+
+	if (output->cursor_only && po->cursor_background)
+		repaint_cursor(output, output_damage);
+	else
+		repaint_surfaces(output, output_damage);
 	copy_to_hw_buffer(output, output_damage);
 
 	pixman_region32_copy(&output->previous_damage, output_damage);
@@ -849,6 +967,7 @@ pixman_renderer_init(struct weston_compositor *ec)
 	ec->capabilities |= WESTON_CAP_ROTATION_ANY;
 	ec->capabilities |= WESTON_CAP_CAPTURE_YFLIP;
 	ec->capabilities |= WESTON_CAP_VIEW_CLIP_MASK;
+	ec->capabilities |= WESTON_CAP_CURSOR_REPAINT;
 
 	renderer->debug_binding =
 		weston_compositor_add_debug_binding(ec, KEY_R,
@@ -922,6 +1041,9 @@ pixman_renderer_output_destroy(struct weston_output *output)
 	if (po->hw_buffer)
 		pixman_image_unref(po->hw_buffer);
 
+	if (po->cursor_background)
+		pixman_image_unref(po->cursor_background);
+
 	free(po->shadow_buffer);
 
 	po->shadow_buffer = NULL;
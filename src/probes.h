@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_PROBES_H
+#define WESTON_PROBES_H
+
+/*
+ * Static tracepoints for external tracers such as perf, bpftrace or
+ * SystemTap, built with --enable-usdt-probes. Without the configure
+ * switch probes compile to nothing and their arguments are not
+ * evaluated, so never put side effects in them. With it, a probe no
+ * tracer is attached to is a single nop, but its arguments are still
+ * evaluated at the call site. Keep them to values at hand, such as
+ * fields and cheap accessors; anything costlier needs a semaphore check.
+ *
+ * All probes belong to the "weston" provider. Outputs are identified
+ * by weston_output::id and surfaces by the address of their
+ * weston_surface, which is unique while the surface lives. Times are
+ * in milliseconds like the input events, except the presentation
+ * timestamp of repaint_finished.
+ *
+ *  repaint_req(output)                first repaint request of a frame
+ *  repaint_enter_loop(output)         the output starts repainting
+ *  repaint_begin(output)              weston_output_repaint() starts
+ *  repaint_posted(output)             the frame was handed to the backend
+ *  repaint_finished(output, sec, nsec, flags)
+ *                                     presentation feedback from backend
+ *  repaint_exit_loop(output)          the output went idle
+ *  repaint_deadline_missed(output)    flight recorder detected a miss
+ *  frame_done(output, callback, time) one wl_surface.frame callback
+ *  surface_attach(surface, buffer, sx, sy)
+ *                                     buffer is the wl_buffer resource
+ *  surface_commit(surface, id)        id is the wl_surface protocol id
+ *  commit_damage(surface, x1, y1, x2, y2)
+ *                                     extents of the committed damage
+ *  flush_damage(surface, output, x1, y1, x2, y2)
+ *                                     extents of the damage uploaded
+ *  notify_motion(seat, time, dx, dy)  dx and dy in wl_fixed_t
+ *  notify_motion_absolute(seat, time, x, y)
+ *  notify_button(seat, time, button, state)
+ *  notify_axis(seat, time, axis, value)
+ *  notify_key(seat, time, key, state)
+ *  notify_touch(seat, time, touch_id, x, y, type)
+ *  notify_touch_frame(seat)
+ *
+ * Seats are identified by the address of their weston_seat.
+ */
+
+#ifdef ENABLE_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define WESTON_PROBE(name, ...) STAP_PROBEV(weston, name, ##__VA_ARGS__)
+
+#else
+
+#define WESTON_PROBE(name, ...) do { } while (0)
+
+#endif
+
+#endif /* WESTON_PROBES_H */
@@ -44,6 +44,10 @@
 #include "shared/os-compatibility.h"
 #include "fullscreen-shell-client-protocol.h"
 
+/* Upper bound on buffers in flight to the parent before frames get
+ * dropped instead of allocating more. */
+#define SHARED_OUTPUT_MAX_BUFFERS 3
+
 struct shared_output {
 	struct weston_output *output;
 	struct wl_listener output_destroyed;
@@ -76,6 +80,12 @@ struct shared_output {
 	pixman_image_t *cache_image;
 	uint32_t *tmp_data;
 	size_t tmp_data_size;
+
+	struct {
+		uint64_t bytes_copied;
+		uint32_t frames_sent;
+		uint32_t frames_dropped;
+	} stats;
 };
 
 struct ss_seat {
@@ -381,15 +391,27 @@ ss_shm_buffer_destroy(struct ss_shm_buffer *buffer)
 	free(buffer);
 }
 
+static int
+shared_output_can_read_direct(struct shared_output *so);
+
 static void
 buffer_release(void *data, struct wl_buffer *buffer)
 {
 	struct ss_shm_buffer *sb = data;
+	struct shared_output *so = sb->output;
 
-	if (sb->output) {
-		wl_list_insert(&sb->output->shm.free_buffers, &sb->free_link);
-	} else {
+	if (!so) {
 		ss_shm_buffer_destroy(sb);
+		return;
+	}
+
+	wl_list_insert(&so->shm.free_buffers, &sb->free_link);
+
+	/* A frame was dropped for lack of a buffer, catch up now. */
+	if (so->cache_dirty && !so->parent.frame_cb &&
+	    shared_output_can_read_direct(so)) {
+		so->cache_dirty = 0;
+		weston_output_schedule_repaint(so->output);
 	}
 }
 
@@ -593,6 +615,16 @@ shared_output_frame_callback(void *data, struct wl_callback *cb, uint32_t time)
 	wl_callback_destroy(cb);
 	so->parent.frame_cb = NULL;
 
+	/* In direct mode the damage is still accumulated in the buffers,
+	 * but the pixels can only be read back right after a repaint. */
+	if (shared_output_can_read_direct(so)) {
+		if (so->cache_dirty) {
+			so->cache_dirty = 0;
+			weston_output_schedule_repaint(so->output);
+		}
+		return;
+	}
+
 	shared_output_update(so);
 }
 
@@ -601,11 +633,37 @@ static const struct wl_callback_listener shared_output_frame_listener = {
 };
 
 static void
-shared_output_update(struct shared_output *so)
+shared_output_submit(struct shared_output *so, struct ss_shm_buffer *sb)
 {
-	struct ss_shm_buffer *sb;
 	pixman_box32_t *r;
 	int i, nrects;
+
+	r = pixman_region32_rectangles(&sb->damage, &nrects);
+	for (i = 0; i < nrects; ++i)
+		wl_surface_damage(so->parent.surface, r[i].x1, r[i].y1,
+				  r[i].x2 - r[i].x1, r[i].y2 - r[i].y1);
+
+	wl_surface_attach(so->parent.surface, sb->buffer, 0, 0);
+
+	so->parent.frame_cb = wl_surface_frame(so->parent.surface);
+	wl_callback_add_listener(so->parent.frame_cb,
+				 &shared_output_frame_listener, so);
+
+	wl_surface_commit(so->parent.surface);
+	wl_callback_destroy(wl_display_sync(so->parent.display));
+	wl_display_flush(so->parent.display);
+
+	/* Clear the buffer damage */
+	pixman_region32_fini(&sb->damage);
+	pixman_region32_init(&sb->damage);
+
+	so->stats.frames_sent++;
+}
+
+static void
+shared_output_update(struct shared_output *so)
+{
+	struct ss_shm_buffer *sb;
 	pixman_transform_t transform;
 
 	/* Only update if we need to */
@@ -644,24 +702,107 @@ shared_output_update(struct shared_output *so)
 	pixman_image_set_transform(sb->pm_image, NULL);
 	pixman_image_set_clip_region32(sb->pm_image, NULL);
 
+	so->cache_dirty = 0;
+
+	shared_output_submit(so, sb);
+}
+
+/* Without an output transform or scale, the framebuffer has the same
+ * layout as the shm buffers sent to the parent, so the pixels can be
+ * read back straight into them, skipping the cache image. */
+static int
+shared_output_can_read_direct(struct shared_output *so)
+{
+	return so->output->transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+	       so->output->current_scale == 1;
+}
+
+static void
+flip_rows(uint32_t *data, int stride, int height)
+{
+	uint32_t *top, *bottom, tmp;
+	int i, k;
+
+	for (i = 0; i < height / 2; i++) {
+		top = data + i * stride;
+		bottom = data + (height - 1 - i) * stride;
+		for (k = 0; k < stride; k++) {
+			tmp = top[k];
+			top[k] = bottom[k];
+			bottom[k] = tmp;
+		}
+	}
+}
+
+static void
+shared_output_read_damage(struct shared_output *so, struct ss_shm_buffer *sb)
+{
+	struct weston_output *output = so->output;
+	struct weston_renderer *renderer = output->compositor->renderer;
+	pixman_box32_t *r;
+	int32_t y1, y2, width, stride;
+	int i, nrects, do_yflip;
+	uint32_t *dst;
+
+	do_yflip = !!(output->compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
+	width = output->current_mode->width;
+	stride = width;
+
+	/* read_pixels() writes tightly packed rows, which only matches the
+	 * buffer layout for full-width spans. Pixman regions are made of
+	 * y-bands, so read each band of the damage as one span. */
 	r = pixman_region32_rectangles(&sb->damage, &nrects);
-	for (i = 0; i < nrects; ++i)
-		wl_surface_damage(so->parent.surface, r[i].x1, r[i].y1,
-				  r[i].x2 - r[i].x1, r[i].y2 - r[i].y1);
+	for (i = 0; i < nrects; ) {
+		y1 = r[i].y1;
+		y2 = r[i].y2;
+		while (i < nrects && r[i].y1 == y1)
+			i++;
 
-	wl_surface_attach(so->parent.surface, sb->buffer, 0, 0);
+		dst = (uint32_t *) sb->data + y1 * stride;
+		if (do_yflip) {
+			renderer->read_pixels(output, PIXMAN_a8r8g8b8, dst,
+					      0, output->current_mode->height - y2,
+					      width, y2 - y1);
+			flip_rows(dst, stride, y2 - y1);
+		} else {
+			renderer->read_pixels(output, PIXMAN_a8r8g8b8, dst,
+					      0, y1, width, y2 - y1);
+		}
 
-	so->parent.frame_cb = wl_surface_frame(so->parent.surface);
-	wl_callback_add_listener(so->parent.frame_cb,
-				 &shared_output_frame_listener, so);
+		so->stats.bytes_copied += (uint64_t) 4 * width * (y2 - y1);
+	}
+}
 
-	wl_surface_commit(so->parent.surface);
-	wl_callback_destroy(wl_display_sync(so->parent.display));
-	wl_display_flush(so->parent.display);
+static void
+shared_output_repainted_direct(struct shared_output *so)
+{
+	struct ss_shm_buffer *sb;
 
-	/* Clear the buffer damage */
-	pixman_region32_fini(&sb->damage);
-	pixman_region32_init(&sb->damage);
+	/* The parent lags behind: skip this frame. The damage stays
+	 * accumulated in every buffer and is read back on a later
+	 * repaint, once the parent has caught up. */
+	if (so->parent.frame_cb ||
+	    (wl_list_empty(&so->shm.free_buffers) &&
+	     wl_list_length(&so->shm.buffers) >= SHARED_OUTPUT_MAX_BUFFERS)) {
+		so->stats.frames_dropped++;
+		so->cache_dirty = 1;
+		return;
+	}
+
+	sb = shared_output_get_shm_buffer(so);
+	if (sb == NULL) {
+		shared_output_destroy(so);
+		return;
+	}
+
+	so->cache_dirty = 0;
+
+	if (pixman_region32_not_empty(&sb->damage)) {
+		shared_output_read_damage(so, sb);
+		shared_output_submit(so, sb);
+	} else {
+		wl_list_insert(&so->shm.free_buffers, &sb->free_link);
+	}
 }
 
 static void
@@ -796,6 +937,12 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 	wl_list_for_each(sb, &so->shm.buffers, link)
 		pixman_region32_union(&sb->damage, &sb->damage, &damage);
 
+	if (shared_output_can_read_direct(so)) {
+		pixman_region32_fini(&damage);
+		shared_output_repainted_direct(so);
+		return;
+	}
+
 	/* Transform to buffer coordinates */
 	weston_transformed_region(so->output->width, so->output->height,
 				  so->output->transform,
@@ -840,6 +987,8 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 		width = r[i].x2 - r[i].x1;
 		height = r[i].y2 - r[i].y1;
 
+		so->stats.bytes_copied += (uint64_t) 4 * width * height;
+
 		if (do_yflip) {
 			so->output->compositor->renderer->read_pixels(
 				so->output, PIXMAN_a8r8g8b8, so->tmp_data,
@@ -860,6 +1009,9 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 
 	pixman_region32_fini(&damage);
 
+	if (so->cache_dirty && so->parent.frame_cb)
+		so->stats.frames_dropped++;
+
 	so->cache_dirty = 1;
 
 	shared_output_update(so);
@@ -973,6 +1125,11 @@ shared_output_destroy(struct shared_output *so)
 {
 	struct ss_shm_buffer *buffer, *bnext;
 
+	weston_log("screen-share: %u frames sent, %u dropped, "
+		   "%llu kB read back\n",
+		   so->stats.frames_sent, so->stats.frames_dropped,
+		   (unsigned long long) so->stats.bytes_copied / 1024);
+
 	so->output->disable_planes--;
 
 	wl_list_for_each_safe(buffer, bnext, &so->shm.buffers, link)
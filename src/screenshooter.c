@@ -50,70 +50,76 @@ struct screenshooter {
 struct screenshooter_frame_listener {
 	struct wl_listener listener;
 	struct weston_buffer *buffer;
+	int32_t x, y, width, height;
 	weston_screenshooter_done_func_t done;
 	void *data;
 };
 
-static void
-copy_bgra_yflip(uint8_t *dst, uint8_t *src, int height, int stride)
+static inline uint32_t
+swap_RB(uint32_t v)
 {
-	uint8_t *end;
+	/*                A R G B */
+	uint32_t tmp = v & 0xff00ff00;
+	tmp |= (v >> 16) & 0x000000ff;
+	tmp |= (v << 16) & 0x00ff0000;
 
-	end = dst + height * stride;
-	while (dst < end) {
-		memcpy(dst, src, stride);
-		dst += stride;
-		src -= stride;
-	}
+	return tmp;
 }
 
+/* read_pixels() packs rows at width * 4 bytes. Spread them out to the
+ * destination stride, starting from the last row so that no row gets
+ * overwritten before it has been moved. */
 static void
-copy_bgra(uint8_t *dst, uint8_t *src, int height, int stride)
+spread_rows(uint8_t *pixels, int height, int packed_stride, int stride)
 {
-	/* TODO: optimize this out */
-	memcpy(dst, src, height * stride);
-}
+	int i;
 
-static void
-copy_row_swap_RB(void *vdst, void *vsrc, int bytes)
-{
-	uint32_t *dst = vdst;
-	uint32_t *src = vsrc;
-	uint32_t *end = dst + bytes / 4;
-
-	while (dst < end) {
-		uint32_t v = *src++;
-		/*                    A R G B */
-		uint32_t tmp = v & 0xff00ff00;
-		tmp |= (v >> 16) & 0x000000ff;
-		tmp |= (v << 16) & 0x00ff0000;
-		*dst++ = tmp;
-	}
+	if (packed_stride == stride)
+		return;
+
+	for (i = height - 1; i > 0; i--)
+		memmove(pixels + i * stride, pixels + i * packed_stride,
+			packed_stride);
 }
 
+/* Fix up the read-back image in place: undo the y-flip by swapping row
+ * pairs and convert RGBA to BGRA if needed, in a single pass. */
 static void
-copy_rgba_yflip(uint8_t *dst, uint8_t *src, int height, int stride)
+fixup_rows(uint8_t *pixels, int height, int stride, int width,
+	   int yflip, int swap)
 {
-	uint8_t *end;
+	uint32_t *top, *bottom, a, b;
+	int i, k;
 
-	end = dst + height * stride;
-	while (dst < end) {
-		copy_row_swap_RB(dst, src, stride);
-		dst += stride;
-		src -= stride;
+	if (!yflip) {
+		if (!swap)
+			return;
+
+		for (i = 0; i < height; i++) {
+			top = (uint32_t *) (pixels + i * stride);
+			for (k = 0; k < width; k++)
+				top[k] = swap_RB(top[k]);
+		}
+
+		return;
 	}
-}
 
-static void
-copy_rgba(uint8_t *dst, uint8_t *src, int height, int stride)
-{
-	uint8_t *end;
+	for (i = 0; i < height / 2; i++) {
+		top = (uint32_t *) (pixels + i * stride);
+		bottom = (uint32_t *) (pixels + (height - 1 - i) * stride);
 
-	end = dst + height * stride;
-	while (dst < end) {
-		copy_row_swap_RB(dst, src, stride);
-		dst += stride;
-		src += stride;
+		for (k = 0; k < width; k++) {
+			a = top[k];
+			b = bottom[k];
+			top[k] = swap ? swap_RB(b) : b;
+			bottom[k] = swap ? swap_RB(a) : a;
+		}
+	}
+
+	if (swap && (height & 1)) {
+		top = (uint32_t *) (pixels + (height / 2) * stride);
+		for (k = 0; k < width; k++)
+			top[k] = swap_RB(top[k]);
 	}
 }
 
@@ -125,62 +131,82 @@ screenshooter_frame_notify(struct wl_listener *listener, void *data)
 			     struct screenshooter_frame_listener, listener);
 	struct weston_output *output = data;
 	struct weston_compositor *compositor = output->compositor;
-	int32_t stride;
-	uint8_t *pixels, *d, *s;
+	struct wl_shm_buffer *shm_buffer = l->buffer->shm_buffer;
+	int32_t stride, y;
+	int yflip, swap;
+	uint8_t *d;
 
 	output->disable_planes--;
 	wl_list_remove(&listener->link);
-	stride = l->buffer->width * (PIXMAN_FORMAT_BPP(compositor->read_format) / 8);
-	pixels = malloc(stride * l->buffer->height);
-
-	if (pixels == NULL) {
-		l->done(l->data, WESTON_SCREENSHOOTER_NO_MEMORY);
-		free(l);
-		return;
-	}
-
-	compositor->renderer->read_pixels(output,
-			     compositor->read_format, pixels,
-			     0, 0, output->current_mode->width,
-			     output->current_mode->height);
-
-	stride = wl_shm_buffer_get_stride(l->buffer->shm_buffer);
-
-	d = wl_shm_buffer_get_data(l->buffer->shm_buffer);
-	s = pixels + stride * (l->buffer->height - 1);
-
-	wl_shm_buffer_begin_access(l->buffer->shm_buffer);
 
 	switch (compositor->read_format) {
 	case PIXMAN_a8r8g8b8:
 	case PIXMAN_x8r8g8b8:
-		if (compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP)
-			copy_bgra_yflip(d, s, output->current_mode->height, stride);
-		else
-			copy_bgra(d, pixels, output->current_mode->height, stride);
+		swap = 0;
 		break;
 	case PIXMAN_x8b8g8r8:
 	case PIXMAN_a8b8g8r8:
-		if (compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP)
-			copy_rgba_yflip(d, s, output->current_mode->height, stride);
-		else
-			copy_rgba(d, pixels, output->current_mode->height, stride);
+		swap = 1;
 		break;
 	default:
-		break;
+		l->done(l->data, WESTON_SCREENSHOOTER_BAD_BUFFER);
+		free(l);
+		return;
+	}
+
+	yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
+	if (yflip)
+		y = output->current_mode->height - l->y - l->height;
+	else
+		y = l->y;
+
+	stride = wl_shm_buffer_get_stride(shm_buffer);
+	d = wl_shm_buffer_get_data(shm_buffer);
+
+	/* Read straight into the client buffer, then fix up the layout
+	 * in place, instead of going through a temporary copy. */
+	wl_shm_buffer_begin_access(shm_buffer);
+
+	if (compositor->renderer->read_pixels(output,
+				compositor->read_format, d,
+				l->x, y, l->width, l->height) < 0) {
+		wl_shm_buffer_end_access(shm_buffer);
+		l->done(l->data, WESTON_SCREENSHOOTER_NO_MEMORY);
+		free(l);
+		return;
 	}
 
-	wl_shm_buffer_end_access(l->buffer->shm_buffer);
+	spread_rows(d, l->height, l->width * 4, stride);
+	fixup_rows(d, l->height, stride, l->width, yflip, swap);
+
+	wl_shm_buffer_end_access(shm_buffer);
 
 	l->done(l->data, WESTON_SCREENSHOOTER_SUCCESS);
-	free(pixels);
 	free(l);
 }
 
+/** Capture a rectangle of an output into a shm buffer
+ *
+ * \param output The output to capture from.
+ * \param buffer A 32-bit shm buffer at least as large as the rectangle.
+ * \param x Left edge of the rectangle, in output framebuffer pixels.
+ * \param y Top edge of the rectangle, in output framebuffer pixels.
+ * \param width Width of the rectangle.
+ * \param height Height of the rectangle.
+ * \param done Called with the outcome once the capture is finished.
+ * \param data User data for \c done.
+ * \return 0 if the capture was scheduled, -1 otherwise.
+ *
+ * The pixels are read back after the next repaint of the output,
+ * directly into the buffer, top row first.
+ */
 WL_EXPORT int
-weston_screenshooter_shoot(struct weston_output *output,
-			   struct weston_buffer *buffer,
-			   weston_screenshooter_done_func_t done, void *data)
+weston_screenshooter_shoot_region(struct weston_output *output,
+				  struct weston_buffer *buffer,
+				  int32_t x, int32_t y,
+				  int32_t width, int32_t height,
+				  weston_screenshooter_done_func_t done,
+				  void *data)
 {
 	struct screenshooter_frame_listener *l;
 
@@ -193,8 +219,11 @@ weston_screenshooter_shoot(struct weston_output *output,
 	buffer->width = wl_shm_buffer_get_width(buffer->shm_buffer);
 	buffer->height = wl_shm_buffer_get_height(buffer->shm_buffer);
 
-	if (buffer->width < output->current_mode->width ||
-	    buffer->height < output->current_mode->height) {
+	if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+	    x + width > output->current_mode->width ||
+	    y + height > output->current_mode->height ||
+	    buffer->width < width || buffer->height < height ||
+	    wl_shm_buffer_get_stride(buffer->shm_buffer) < width * 4) {
 		done(data, WESTON_SCREENSHOOTER_BAD_BUFFER);
 		return -1;
 	}
@@ -206,6 +235,10 @@ weston_screenshooter_shoot(struct weston_output *output,
 	}
 
 	l->buffer = buffer;
+	l->x = x;
+	l->y = y;
+	l->width = width;
+	l->height = height;
 	l->done = done;
 	l->data = data;
 	l->listener.notify = screenshooter_frame_notify;
@@ -216,6 +249,17 @@ weston_screenshooter_shoot(struct weston_output *output,
 	return 0;
 }
 
+WL_EXPORT int
+weston_screenshooter_shoot(struct weston_output *output,
+			   struct weston_buffer *buffer,
+			   weston_screenshooter_done_func_t done, void *data)
+{
+	return weston_screenshooter_shoot_region(output, buffer, 0, 0,
+						 output->current_mode->width,
+						 output->current_mode->height,
+						 done, data);
+}
+
 static void
 screenshooter_done(void *data, enum weston_screenshooter_outcome outcome)
 {
@@ -252,8 +296,40 @@ screenshooter_shoot(struct wl_client *client,
 	weston_screenshooter_shoot(output, buffer, screenshooter_done, resource);
 }
 
+static void
+screenshooter_shoot_region(struct wl_client *client,
+			   struct wl_resource *resource,
+			   struct wl_resource *output_resource,
+			   struct wl_resource *buffer_resource,
+			   int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct weston_output *output =
+		wl_resource_get_user_data(output_resource);
+	struct weston_buffer *buffer =
+		weston_buffer_from_resource(buffer_resource);
+
+	if (buffer == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
+	if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+	    x > output->current_mode->width - width ||
+	    y > output->current_mode->height - height) {
+		wl_resource_post_error(resource,
+				       SCREENSHOOTER_ERROR_INVALID_REGION,
+				       "region %dx%d+%d+%d is not inside "
+				       "the output", width, height, x, y);
+		return;
+	}
+
+	weston_screenshooter_shoot_region(output, buffer, x, y, width, height,
+					  screenshooter_done, resource);
+}
+
 struct screenshooter_interface screenshooter_implementation = {
-	screenshooter_shoot
+	screenshooter_shoot,
+	screenshooter_shoot_region
 };
 
 static void
@@ -263,8 +339,8 @@ bind_shooter(struct wl_client *client,
 	struct screenshooter *shooter = data;
 	struct wl_resource *resource;
 
-	resource = wl_resource_create(client,
-				      &screenshooter_interface, 1, id);
+	resource = wl_resource_create(client, &screenshooter_interface,
+				      MIN(version, 2), id);
 
 	if (client != shooter->client) {
 		wl_resource_post_error(resource, WL_DISPLAY_ERROR_INVALID_OBJECT,
@@ -413,9 +489,26 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 		else
 			y_orig = r[i].y1;
 
-		compositor->renderer->read_pixels(output,
+		/* The header already announced the rectangle, so encode
+		 * it as unchanged if it cannot be read back and stop the
+		 * recording after this frame. */
+		if (compositor->renderer->read_pixels(output,
 				compositor->read_format, recorder->rect,
-				r[i].x1, y_orig, width, height);
+				r[i].x1, y_orig, width, height) < 0) {
+			if (!recorder->destroying)
+				weston_log("recorder: failed to read back "
+					   "the output, stopping\n");
+			recorder->destroying = 1;
+			for (j = 0; j < height; j++) {
+				if (do_yflip)
+					y_orig = r[i].y2 - j - 1;
+				else
+					y_orig = r[i].y1 + j;
+				memcpy(recorder->rect + j * width,
+				       recorder->frame + stride * y_orig +
+				       r[i].x1, width * 4);
+			}
+		}
 
 		s = recorder->rect;
 		p = outbuf;
@@ -599,6 +692,280 @@ recorder_binding(struct weston_keyboard *keyboard, uint32_t time,
 	}
 }
 
+struct weston_surface_recorder {
+	struct weston_surface *surface;
+	uint32_t *frame, *outbuf;
+	int32_t width, height;
+	uint32_t total;
+	int fd;
+	int count, full_frame;
+	struct wl_listener commit_listener;
+	struct wl_listener destroy_listener;
+};
+
+static void
+weston_surface_recorder_commit_notify(struct wl_listener *listener,
+				      void *data)
+{
+	struct weston_surface_recorder *recorder =
+		container_of(listener, struct weston_surface_recorder,
+			     commit_listener);
+	struct weston_surface *surface = data;
+	struct weston_buffer *buffer = surface->buffer_ref.buffer;
+	struct wl_shm_buffer *shm_buffer;
+	pixman_box32_t *r;
+	pixman_region32_t damage;
+	int i, j, k, n, width, run, stride;
+	uint32_t delta, prev, *d, *s, *p, *pixels, next;
+	struct {
+		uint32_t msecs;
+		uint32_t nrects;
+	} header;
+	struct iovec v[2];
+
+	if (buffer == NULL)
+		return;
+
+	shm_buffer = wl_shm_buffer_get(buffer->resource);
+	if (shm_buffer == NULL)
+		return;
+
+	switch (wl_shm_buffer_get_format(shm_buffer)) {
+	case WL_SHM_FORMAT_ARGB8888:
+	case WL_SHM_FORMAT_XRGB8888:
+		break;
+	default:
+		return;
+	}
+
+	pixman_region32_init(&damage);
+	if (recorder->full_frame)
+		pixman_region32_init_rect(&damage, 0, 0,
+					  recorder->width, recorder->height);
+	else
+		weston_surface_to_buffer_region(surface, &surface->damage,
+						&damage);
+
+	/* The wcap frame size is fixed by the header, so clip to it. */
+	pixman_region32_intersect_rect(&damage, &damage, 0, 0,
+				       MIN(recorder->width,
+					   wl_shm_buffer_get_width(shm_buffer)),
+				       MIN(recorder->height,
+					   wl_shm_buffer_get_height(shm_buffer)));
+
+	r = pixman_region32_rectangles(&damage, &n);
+	if (n == 0) {
+		pixman_region32_fini(&damage);
+		return;
+	}
+
+	header.msecs = weston_compositor_get_time();
+	header.nrects = n;
+	v[0].iov_base = &header;
+	v[0].iov_len = sizeof header;
+	v[1].iov_base = r;
+	v[1].iov_len = n * sizeof *r;
+	recorder->total += writev(recorder->fd, v, 2);
+
+	stride = wl_shm_buffer_get_stride(shm_buffer) / 4;
+
+	wl_shm_buffer_begin_access(shm_buffer);
+	pixels = wl_shm_buffer_get_data(shm_buffer);
+
+	for (i = 0; i < n; i++) {
+		width = r[i].x2 - r[i].x1;
+
+		/* wcap rectangles are stored bottom-up. */
+		p = recorder->outbuf;
+		run = prev = 0; /* quiet gcc */
+		for (j = r[i].y2 - 1; j >= r[i].y1; j--) {
+			s = pixels + stride * j + r[i].x1;
+			d = recorder->frame + recorder->width * j + r[i].x1;
+
+			for (k = 0; k < width; k++) {
+				next = *s++;
+				delta = component_delta(next, *d);
+				*d++ = next;
+				if (run == 0 || delta == prev) {
+					run++;
+				} else {
+					p = output_run(p, prev, run);
+					run = 1;
+				}
+				prev = delta;
+			}
+		}
+
+		p = output_run(p, prev, run);
+
+		recorder->total += write(recorder->fd,
+					 recorder->outbuf,
+					 (p - recorder->outbuf) * 4);
+	}
+
+	wl_shm_buffer_end_access(shm_buffer);
+
+	pixman_region32_fini(&damage);
+	recorder->full_frame = 0;
+	recorder->count++;
+}
+
+static void
+weston_surface_recorder_destroy_notify(struct wl_listener *listener,
+				       void *data)
+{
+	struct weston_surface_recorder *recorder =
+		container_of(listener, struct weston_surface_recorder,
+			     destroy_listener);
+
+	weston_surface_recorder_destroy(recorder);
+}
+
+static void
+weston_surface_recorder_free(struct weston_surface_recorder *recorder)
+{
+	if (recorder == NULL)
+		return;
+
+	free(recorder->outbuf);
+	free(recorder->frame);
+	free(recorder);
+}
+
+/** Start recording the committed shm buffers of a surface
+ *
+ * \param surface The surface to record.
+ * \param filename Path of the wcap file to write.
+ * \return The recorder, or NULL on failure.
+ *
+ * Every commit that attaches a 32-bit shm buffer writes a wcap frame
+ * with the damaged rectangles of that buffer, straight from client
+ * memory.  Nothing is read back from the renderer, so the recording
+ * only contains the surface itself, at its own buffer size.  The
+ * first frame written is always the full buffer.
+ *
+ * The recorder stops by itself when the surface is destroyed.
+ */
+WL_EXPORT struct weston_surface_recorder *
+weston_surface_recorder_create(struct weston_surface *surface,
+			       const char *filename)
+{
+	struct weston_surface_recorder *recorder;
+	struct { uint32_t magic, format, width, height; } header;
+	int size;
+
+	if (weston_surface_recorder_get(surface))
+		return NULL;
+
+	if (surface->width_from_buffer <= 0 ||
+	    surface->height_from_buffer <= 0) {
+		weston_log("surface recorder: surface %p has no content\n",
+			   surface);
+		return NULL;
+	}
+
+	recorder = zalloc(sizeof *recorder);
+	if (recorder == NULL) {
+		weston_log("%s: out of memory\n", __func__);
+		return NULL;
+	}
+
+	recorder->surface = surface;
+	recorder->width = surface->width_from_buffer;
+	recorder->height = surface->height_from_buffer;
+	recorder->full_frame = 1;
+
+	size = recorder->width * 4 * recorder->height;
+	recorder->frame = zalloc(size);
+	recorder->outbuf = malloc(size);
+
+	if ((recorder->frame == NULL) || (recorder->outbuf == NULL)) {
+		weston_log("%s: out of memory\n", __func__);
+		goto err_recorder;
+	}
+
+	recorder->fd = open(filename,
+			    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (recorder->fd < 0) {
+		weston_log("problem opening output file %s: %m\n", filename);
+		goto err_recorder;
+	}
+
+	header.magic = WCAP_HEADER_MAGIC;
+	header.format = WCAP_FORMAT_XRGB8888;
+	header.width = recorder->width;
+	header.height = recorder->height;
+	recorder->total += write(recorder->fd, &header, sizeof header);
+
+	recorder->commit_listener.notify =
+		weston_surface_recorder_commit_notify;
+	wl_signal_add(&surface->commit_signal, &recorder->commit_listener);
+	recorder->destroy_listener.notify =
+		weston_surface_recorder_destroy_notify;
+	wl_signal_add(&surface->destroy_signal, &recorder->destroy_listener);
+
+	return recorder;
+
+err_recorder:
+	weston_surface_recorder_free(recorder);
+	return NULL;
+}
+
+/** Look up the recorder attached to a surface, if any */
+WL_EXPORT struct weston_surface_recorder *
+weston_surface_recorder_get(struct weston_surface *surface)
+{
+	struct wl_listener *listener;
+
+	listener = wl_signal_get(&surface->commit_signal,
+				 weston_surface_recorder_commit_notify);
+	if (listener == NULL)
+		return NULL;
+
+	return container_of(listener, struct weston_surface_recorder,
+			    commit_listener);
+}
+
+WL_EXPORT void
+weston_surface_recorder_destroy(struct weston_surface_recorder *recorder)
+{
+	weston_log("stopping surface recorder, total file size %dK, "
+		   "%d frames\n", recorder->total / 1024, recorder->count);
+
+	wl_list_remove(&recorder->commit_listener.link);
+	wl_list_remove(&recorder->destroy_listener.link);
+	close(recorder->fd);
+	weston_surface_recorder_free(recorder);
+}
+
+static void
+surface_recorder_binding(struct weston_keyboard *keyboard, uint32_t time,
+			 uint32_t key, void *data)
+{
+	struct weston_pointer *pointer = weston_seat_get_pointer(keyboard->seat);
+	struct weston_surface_recorder *recorder;
+	struct weston_surface *surface;
+	static const char filename[] = "surface-capture.wcap";
+
+	if (keyboard->focus)
+		surface = keyboard->focus;
+	else if (pointer && pointer->focus)
+		surface = pointer->focus->surface;
+	else
+		return;
+
+	recorder = weston_surface_recorder_get(surface);
+	if (recorder) {
+		weston_surface_recorder_destroy(recorder);
+		return;
+	}
+
+	weston_log("starting surface recorder for %p, file %s\n",
+		   surface, filename);
+	weston_surface_recorder_create(surface, filename);
+}
+
 static void
 screenshooter_destroy(struct wl_listener *listener, void *data)
 {
@@ -622,12 +989,14 @@ screenshooter_create(struct weston_compositor *ec)
 	shooter->client = NULL;
 
 	shooter->global = wl_global_create(ec->wl_display,
-					   &screenshooter_interface, 1,
+					   &screenshooter_interface, 2,
 					   shooter, bind_shooter);
 	weston_compositor_add_key_binding(ec, KEY_S, MODIFIER_SUPER,
 					  screenshooter_binding, shooter);
 	weston_compositor_add_key_binding(ec, KEY_R, MODIFIER_SUPER,
 					  recorder_binding, shooter);
+	weston_compositor_add_debug_binding(ec, KEY_E,
+					    surface_recorder_binding, shooter);
 
 	shooter->destroy_listener.notify = screenshooter_destroy;
 	wl_signal_add(&ec->destroy_signal, &shooter->destroy_listener);
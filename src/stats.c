@@ -0,0 +1,633 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <linux/input.h>
+
+#include "compositor.h"
+#include "weston-stats-server-protocol.h"
+#include "shared/helpers.h"
+
+#define CLIENT_STATS_LOG_MAX 10
+#define CLIENT_STATS_HASH_SIZE 64	/* power of two */
+
+struct weston_stats {
+	struct weston_compositor *compositor;
+	struct wl_list client_list;
+	/* The same client statistics, by wl_client */
+	struct wl_list client_hash[CLIENT_STATS_HASH_SIZE];
+	struct wl_event_source *tick;
+	struct wl_listener compositor_destroy_listener;
+};
+
+struct client_costs {
+	uint64_t request_nsec;
+	uint64_t render_nsec;
+	uint64_t bytes_uploaded;
+	uint64_t pixels_composited;
+	uint32_t commits;
+};
+
+struct weston_client_stats {
+	struct wl_listener destroy_listener;
+	struct wl_list link;
+	struct wl_client *client;
+	struct wl_list hash_link;
+	pid_t pid;
+	char name[16];
+
+	/* Since the client connected */
+	struct client_costs total;
+	/* Totals at the last tick, and the difference to the tick before */
+	struct client_costs previous;
+	struct client_costs rate;
+};
+
+struct output_stats {
+	struct wl_resource *resource;
+	struct weston_output *output;
+	struct wl_listener output_destroy_listener;
+};
+
+static void
+client_stats_handle_client_destroy(struct wl_listener *listener, void *data)
+{
+	struct weston_client_stats *cs =
+		container_of(listener, struct weston_client_stats,
+			     destroy_listener);
+
+	wl_list_remove(&cs->link);
+	wl_list_remove(&cs->hash_link);
+	free(cs);
+}
+
+static struct wl_list *
+client_stats_bucket(struct weston_stats *stats, struct wl_client *client)
+{
+	uintptr_t key = (uintptr_t) client;
+
+	/* Fibonacci hashing, the low bits of a pointer are mostly the
+	 * same */
+	key = (key >> 4) * 2654435761u;
+
+	return &stats->client_hash[(key >> 8) & (CLIENT_STATS_HASH_SIZE - 1)];
+}
+
+static void
+client_stats_read_name(struct weston_client_stats *cs)
+{
+	char path[64];
+	FILE *fp;
+	size_t len;
+
+	snprintf(path, sizeof path, "/proc/%d/comm", (int) cs->pid);
+	fp = fopen(path, "r");
+	if (!fp) {
+		snprintf(cs->name, sizeof cs->name, "?");
+		return;
+	}
+
+	len = fread(cs->name, 1, sizeof cs->name - 1, fp);
+	fclose(fp);
+
+	cs->name[len] = '\0';
+	if (len > 0 && cs->name[len - 1] == '\n')
+		cs->name[len - 1] = '\0';
+}
+
+/* Find the statistics of the client owning the resource, creating them
+ * on first use. Returns NULL if accounting is disabled. This runs for
+ * every accounted request, so it looks the client up in a hash table
+ * rather than walking its destroy listeners. */
+static struct weston_client_stats *
+client_stats_get(struct weston_compositor *compositor,
+		 struct wl_resource *resource)
+{
+	struct weston_stats *stats = compositor->stats;
+	struct weston_client_stats *cs;
+	struct wl_client *client;
+	struct wl_list *bucket;
+	uid_t uid;
+	gid_t gid;
+
+	if (!stats || !resource)
+		return NULL;
+
+	client = wl_resource_get_client(resource);
+	bucket = client_stats_bucket(stats, client);
+	wl_list_for_each(cs, bucket, hash_link)
+		if (cs->client == client)
+			return cs;
+
+	cs = zalloc(sizeof *cs);
+	if (!cs)
+		return NULL;
+
+	cs->client = client;
+	wl_client_get_credentials(client, &cs->pid, &uid, &gid);
+	client_stats_read_name(cs);
+
+	cs->destroy_listener.notify = client_stats_handle_client_destroy;
+	wl_client_add_destroy_listener(client, &cs->destroy_listener);
+	wl_list_insert(&stats->client_list, &cs->link);
+	wl_list_insert(bucket, &cs->hash_link);
+
+	return cs;
+}
+
+/** Start timing work done on behalf of a client
+ *
+ * \param timer The timer to start.
+ * \param compositor The compositor.
+ * \param resource A resource of the client, may be NULL for surfaces
+ * created by the compositor itself.
+ *
+ * Does nothing unless per-client accounting is enabled, which is the
+ * case when weston runs with --debug.
+ */
+WL_EXPORT void
+weston_client_timer_start(struct weston_client_timer *timer,
+			  struct weston_compositor *compositor,
+			  struct wl_resource *resource)
+{
+	timer->stats = client_stats_get(compositor, resource);
+	if (timer->stats)
+		clock_gettime(CLOCK_MONOTONIC, &timer->begin);
+}
+
+/** Charge the time elapsed since weston_client_timer_start()
+ *
+ * \param timer The timer.
+ * \param cost Whether the time was spent in a request handler or in
+ * the renderer.
+ */
+WL_EXPORT void
+weston_client_timer_stop(struct weston_client_timer *timer,
+			 enum weston_client_cost cost)
+{
+	struct timespec end;
+	int64_t nsec;
+
+	if (!timer->stats)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	nsec = (int64_t) (end.tv_sec - timer->begin.tv_sec) * 1000000000 +
+	       end.tv_nsec - timer->begin.tv_nsec;
+
+	switch (cost) {
+	case WESTON_CLIENT_COST_REQUEST:
+		timer->stats->total.request_nsec += nsec;
+		break;
+	case WESTON_CLIENT_COST_RENDER:
+		timer->stats->total.render_nsec += nsec;
+		break;
+	}
+}
+
+/** Account a surface commit */
+WL_EXPORT void
+weston_client_stats_add_commit(struct weston_compositor *compositor,
+			       struct wl_resource *resource)
+{
+	struct weston_client_stats *cs = client_stats_get(compositor, resource);
+
+	if (cs)
+		cs->total.commits++;
+}
+
+/** Account bytes the renderer copied out of a client buffer */
+WL_EXPORT void
+weston_client_stats_add_upload(struct weston_compositor *compositor,
+			       struct wl_resource *resource, uint64_t bytes)
+{
+	struct weston_client_stats *cs = client_stats_get(compositor, resource);
+
+	if (cs)
+		cs->total.bytes_uploaded += bytes;
+}
+
+/** Account the area of a client surface the renderer composited
+ *
+ * \param compositor The compositor.
+ * \param resource The surface resource.
+ * \param region The repainted region, in any coordinate space.
+ */
+WL_EXPORT void
+weston_client_stats_add_pixels(struct weston_compositor *compositor,
+			       struct wl_resource *resource,
+			       pixman_region32_t *region)
+{
+	struct weston_client_stats *cs = client_stats_get(compositor, resource);
+	pixman_box32_t *rects;
+	uint64_t area = 0;
+	int i, n;
+
+	if (!cs)
+		return;
+
+	rects = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++)
+		area += (uint64_t) (rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+
+	cs->total.pixels_composited += area;
+}
+
+static void
+client_costs_sub(struct client_costs *r, const struct client_costs *a,
+		 const struct client_costs *b)
+{
+	r->request_nsec = a->request_nsec - b->request_nsec;
+	r->render_nsec = a->render_nsec - b->render_nsec;
+	r->bytes_uploaded = a->bytes_uploaded - b->bytes_uploaded;
+	r->pixels_composited = a->pixels_composited - b->pixels_composited;
+	r->commits = a->commits - b->commits;
+}
+
+static int
+client_stats_tick(void *data)
+{
+	struct weston_stats *stats = data;
+	struct weston_client_stats *cs;
+
+	wl_list_for_each(cs, &stats->client_list, link) {
+		client_costs_sub(&cs->rate, &cs->total, &cs->previous);
+		cs->previous = cs->total;
+	}
+
+	wl_event_source_timer_update(stats->tick, 1000);
+
+	return 0;
+}
+
+static int
+compare_client_cost(const void *a, const void *b)
+{
+	const struct weston_client_stats *ca =
+		*(const struct weston_client_stats * const *) a;
+	const struct weston_client_stats *cb =
+		*(const struct weston_client_stats * const *) b;
+	uint64_t cost_a = ca->rate.request_nsec + ca->rate.render_nsec;
+	uint64_t cost_b = cb->rate.request_nsec + cb->rate.render_nsec;
+
+	if (cost_a != cost_b)
+		return cost_a < cost_b ? 1 : -1;
+
+	return 0;
+}
+
+/* Returns the clients sorted by the time they cost in the last second,
+ * the most expensive first. The caller frees the array. */
+static struct weston_client_stats **
+client_stats_sorted(struct weston_stats *stats, int *count)
+{
+	struct weston_client_stats **array, *cs;
+	int n = 0;
+
+	*count = wl_list_length(&stats->client_list);
+	if (*count == 0)
+		return NULL;
+
+	array = malloc(*count * sizeof *array);
+	if (!array) {
+		*count = 0;
+		return NULL;
+	}
+
+	wl_list_for_each(cs, &stats->client_list, link)
+		array[n++] = cs;
+
+	qsort(array, n, sizeof *array, compare_client_cost);
+
+	return array;
+}
+
+static void
+client_stats_log(struct weston_stats *stats)
+{
+	struct weston_client_stats **array, *cs;
+	int i, n;
+
+	array = client_stats_sorted(stats, &n);
+
+	weston_log("Client costs over the last second, most expensive first:\n");
+	weston_log_continue(STAMP_SPACE "%8s %-16s %8s %10s %10s %10s %12s\n",
+			    "pid", "name", "commits", "req usec",
+			    "render usec", "upload KiB", "pixels");
+
+	for (i = 0; i < n && i < CLIENT_STATS_LOG_MAX; i++) {
+		cs = array[i];
+		weston_log_continue(STAMP_SPACE
+				    "%8d %-16s %8u %10llu %10llu %10llu %12llu\n",
+				    (int) cs->pid, cs->name, cs->rate.commits,
+				    (unsigned long long)
+					(cs->rate.request_nsec / 1000),
+				    (unsigned long long)
+					(cs->rate.render_nsec / 1000),
+				    (unsigned long long)
+					(cs->rate.bytes_uploaded / 1024),
+				    (unsigned long long)
+					cs->rate.pixels_composited);
+	}
+
+	free(array);
+}
+
+static void
+client_stats_binding(struct weston_keyboard *keyboard, uint32_t time,
+		     uint32_t key, void *data)
+{
+	client_stats_log(data);
+}
+
+static uint32_t
+clamp_u32(uint64_t value)
+{
+	return value > UINT32_MAX ? UINT32_MAX : value;
+}
+
+static void
+send_histogram(struct wl_resource *resource, const char *name,
+	       const struct weston_histogram *h)
+{
+	weston_output_stats_send_histogram(resource, name,
+				h->count,
+				h->count ? h->min : 0,
+				weston_histogram_mean(h),
+				weston_histogram_percentile(h, 50),
+				weston_histogram_percentile(h, 99),
+				h->max);
+}
+
+static void
+output_stats_send(struct output_stats *os)
+{
+	struct wl_resource *resource = os->resource;
+	struct weston_output_stats *stats;
+
+	if (os->output) {
+		stats = &os->output->stats;
+
+		send_histogram(resource, "repaint", &stats->repaint);
+		send_histogram(resource, "assign_planes",
+			       &stats->assign_planes);
+		send_histogram(resource, "render", &stats->render);
+		send_histogram(resource, "flip", &stats->flip);
+		send_histogram(resource, "damage_to_present",
+			       &stats->damage_to_present);
+		send_histogram(resource, "repaint_lead",
+			       &stats->repaint_lead);
+		send_histogram(resource, "latency_saved",
+			       &stats->latency_saved);
+		send_histogram(resource, "cursor_repaint",
+			       &stats->cursor_repaint);
+		weston_output_stats_send_frames(resource,
+						stats->frames_presented,
+						stats->frames_missed);
+		if (wl_resource_get_version(resource) >= 3)
+			weston_output_stats_send_repicks(resource,
+							 stats->repicks,
+							 stats->repicks_skipped);
+	}
+
+	weston_output_stats_send_done(resource);
+}
+
+static void
+output_stats_handle_output_destroy(struct wl_listener *listener, void *data)
+{
+	struct output_stats *os =
+		container_of(listener, struct output_stats,
+			     output_destroy_listener);
+
+	wl_list_remove(&os->output_destroy_listener.link);
+	wl_list_init(&os->output_destroy_listener.link);
+	os->output = NULL;
+}
+
+static void
+output_stats_destroy_resource(struct wl_resource *resource)
+{
+	struct output_stats *os = wl_resource_get_user_data(resource);
+
+	wl_list_remove(&os->output_destroy_listener.link);
+	free(os);
+}
+
+static void
+output_stats_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+output_stats_update(struct wl_client *client, struct wl_resource *resource)
+{
+	output_stats_send(wl_resource_get_user_data(resource));
+}
+
+static void
+output_stats_reset(struct wl_client *client, struct wl_resource *resource)
+{
+	struct output_stats *os = wl_resource_get_user_data(resource);
+
+	if (os->output)
+		weston_output_stats_reset(os->output);
+}
+
+static const struct weston_output_stats_interface output_stats_implementation = {
+	output_stats_destroy,
+	output_stats_update,
+	output_stats_reset,
+};
+
+static void
+stats_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+stats_get_output_stats(struct wl_client *client, struct wl_resource *resource,
+		       uint32_t id, struct wl_resource *output_resource)
+{
+	struct output_stats *os;
+
+	os = zalloc(sizeof *os);
+	if (os == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	os->resource = wl_resource_create(client,
+					  &weston_output_stats_interface,
+					  wl_resource_get_version(resource),
+					  id);
+	if (os->resource == NULL) {
+		free(os);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(os->resource,
+				       &output_stats_implementation,
+				       os, output_stats_destroy_resource);
+
+	os->output = wl_resource_get_user_data(output_resource);
+	os->output_destroy_listener.notify =
+		output_stats_handle_output_destroy;
+	wl_signal_add(&os->output->destroy_signal,
+		      &os->output_destroy_listener);
+
+	output_stats_send(os);
+}
+
+static void
+stats_list_clients(struct wl_client *client, struct wl_resource *resource)
+{
+	struct weston_stats *stats = wl_resource_get_user_data(resource);
+	struct weston_client_stats **array, *cs;
+	int i, n;
+
+	array = client_stats_sorted(stats, &n);
+
+	for (i = 0; i < n; i++) {
+		cs = array[i];
+		weston_stats_send_client(resource, cs->pid, cs->name,
+				cs->rate.commits,
+				clamp_u32(cs->rate.request_nsec / 1000),
+				clamp_u32(cs->rate.render_nsec / 1000),
+				clamp_u32(cs->rate.bytes_uploaded),
+				clamp_u32(cs->rate.pixels_composited));
+	}
+
+	weston_stats_send_clients_done(resource);
+
+	free(array);
+}
+
+static const struct weston_stats_interface stats_implementation = {
+	stats_destroy,
+	stats_get_output_stats,
+	stats_list_clients,
+};
+
+static void
+bind_stats(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource;
+
+	resource = wl_resource_create(client, &weston_stats_interface,
+				      MIN(version, 3), id);
+	if (resource == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(resource, &stats_implementation,
+				       data, NULL);
+}
+
+static void
+stats_handle_compositor_destroy(struct wl_listener *listener, void *data)
+{
+	struct weston_stats *stats =
+		container_of(listener, struct weston_stats,
+			     compositor_destroy_listener);
+	struct weston_client_stats *cs, *tmp;
+
+	wl_list_for_each_safe(cs, tmp, &stats->client_list, link) {
+		wl_list_remove(&cs->destroy_listener.link);
+		wl_list_remove(&cs->link);
+		free(cs);
+	}
+
+	wl_event_source_remove(stats->tick);
+	stats->compositor->stats = NULL;
+	free(stats);
+}
+
+/** Advertise the weston_stats debugging interface
+ *
+ * \param compositor The compositor.
+ * \return 0 on success, -1 on failure.
+ *
+ * This also turns on the per-client accounting. The interface gives any
+ * client access to the performance counters of the compositor and of
+ * all other clients, so this is only called when weston runs with
+ * --debug. The most expensive clients are logged with the debug binding
+ * mod-shift-space P.
+ */
+WL_EXPORT int
+weston_stats_create(struct weston_compositor *compositor)
+{
+	struct weston_stats *stats;
+	struct wl_event_loop *loop;
+	int i;
+
+	stats = zalloc(sizeof *stats);
+	if (!stats)
+		return -1;
+
+	stats->compositor = compositor;
+	wl_list_init(&stats->client_list);
+	for (i = 0; i < CLIENT_STATS_HASH_SIZE; i++)
+		wl_list_init(&stats->client_hash[i]);
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	stats->tick = wl_event_loop_add_timer(loop, client_stats_tick, stats);
+	if (!stats->tick) {
+		free(stats);
+		return -1;
+	}
+	wl_event_source_timer_update(stats->tick, 1000);
+
+	if (!wl_global_create(compositor->wl_display,
+			      &weston_stats_interface, 3,
+			      stats, bind_stats)) {
+		wl_event_source_remove(stats->tick);
+		free(stats);
+		return -1;
+	}
+
+	stats->compositor_destroy_listener.notify =
+		stats_handle_compositor_destroy;
+	wl_signal_add(&compositor->destroy_signal,
+		      &stats->compositor_destroy_listener);
+
+	weston_compositor_add_debug_binding(compositor, KEY_P,
+					    client_stats_binding, stats);
+
+	compositor->stats = stats;
+
+	return 0;
+}
@@ -27,20 +27,70 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <signal.h>
 #include <time.h>
 #include <assert.h>
 
 #include "timeline.h"
+#include "probes.h"
 #include "compositor.h"
 #include "file-util.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "shared/timeline-format.h"
+
+/* Number of records in the ring, a power of two */
+#define TIMELINE_RING_SIZE (1 << 16)
+/* Flush once the ring is this full, or after TIMELINE_FLUSH_MSEC */
+#define TIMELINE_FLUSH_THRESHOLD (TIMELINE_RING_SIZE / 4)
+#define TIMELINE_FLUSH_MSEC 1000
+/* Definitions kept by the flight recorder before it starts over */
+#define TIMELINE_RECORDER_MAX_DEFS (1 << 16)
+
+#define RECORD_SIZE sizeof(struct weston_timeline_record)
+
+struct timeline_name {
+	const char *name;
+	uint32_t id;
+};
 
 struct timeline_log {
 	clock_t clk_id;
 	FILE *file;
 	unsigned series;
 	struct wl_listener compositor_destroy_listener;
+
+	struct wl_event_loop *loop;
+	struct wl_event_source *flush_idle;
+	struct wl_event_source *flush_timer;
+
+	/* Free-running indices: head is the next record to fill, tail the
+	 * next one to write out. */
+	struct weston_timeline_record *ring;
+	uint32_t head;
+	uint32_t tail;
+	unsigned sync_flushes;
+
+	/* Point names interned by address, open addressing */
+	struct timeline_name *names;
+	uint32_t names_size;
+	uint32_t names_count;
+
+	/* Flight recorder: the ring only holds points and wraps around,
+	 * definitions are kept aside until dumped. */
+	int recording;
+	uint64_t window_nsec;
+	uint64_t deadline_nsec;
+	uint64_t last_auto_dump;
+	struct weston_timeline_record *defs;
+	uint32_t defs_count;
+	uint32_t defs_size;
+	struct wl_event_source *dump_idle;
+	struct wl_event_source *dump_signal;
+	const char *dump_reason;
 };
 
 WL_EXPORT int weston_timeline_enabled_;
@@ -50,8 +100,9 @@ static int
 weston_timeline_do_open(void)
 {
 	const char *prefix = "weston-timeline-";
-	const char *suffix = ".log";
+	const char *suffix = ".wtl";
 	char fname[1000];
+	struct weston_timeline_header header;
 
 	timeline_.file = file_create_dated(prefix, suffix,
 					   fname, sizeof(fname));
@@ -71,11 +122,211 @@ weston_timeline_do_open(void)
 		return -1;
 	}
 
+	header.magic = WESTON_TIMELINE_MAGIC;
+	header.version = WESTON_TIMELINE_VERSION;
+	header.record_size = RECORD_SIZE;
+	header.clock_id = timeline_.clk_id;
+
+	if (fwrite(&header, sizeof header, 1, timeline_.file) != 1) {
+		weston_log("Cannot write timeline header to '%s': %m\n",
+			   fname);
+		fclose(timeline_.file);
+		timeline_.file = NULL;
+		return -1;
+	}
+
 	weston_log("Opened timeline file '%s'\n", fname);
 
 	return 0;
 }
 
+/* Write out everything in the ring. Normally called from the event
+ * loop, outside of any repaint. */
+static void
+timeline_flush(void)
+{
+	uint32_t start, count;
+
+	while (timeline_.tail != timeline_.head) {
+		start = timeline_.tail & (TIMELINE_RING_SIZE - 1);
+		count = MIN(timeline_.head - timeline_.tail,
+			    TIMELINE_RING_SIZE - start);
+
+		if (fwrite(&timeline_.ring[start], RECORD_SIZE, count,
+			   timeline_.file) != count)
+			weston_log("Timeline write error: %m\n");
+
+		timeline_.tail += count;
+	}
+
+	fflush(timeline_.file);
+}
+
+static void
+timeline_flush_idle(void *data)
+{
+	timeline_.flush_idle = NULL;
+	timeline_flush();
+}
+
+static int
+timeline_flush_timer(void *data)
+{
+	timeline_flush();
+	wl_event_source_timer_update(timeline_.flush_timer,
+				     TIMELINE_FLUSH_MSEC);
+
+	return 0;
+}
+
+static struct weston_timeline_record *
+timeline_reserve(uint32_t n)
+{
+	struct weston_timeline_record *rec;
+	uint32_t used = timeline_.head - timeline_.tail;
+
+	/* The flight recorder forgets the oldest points. Otherwise the
+	 * idle flush did not get a chance to run, e.g. during a long
+	 * burst of points; write out synchronously. */
+	if (used + n > TIMELINE_RING_SIZE) {
+		if (timeline_.recording) {
+			timeline_.tail = timeline_.head + n - TIMELINE_RING_SIZE;
+		} else {
+			timeline_.sync_flushes++;
+			timeline_flush();
+		}
+	}
+
+	rec = &timeline_.ring[timeline_.head & (TIMELINE_RING_SIZE - 1)];
+	timeline_.head += n;
+
+	return rec;
+}
+
+static void
+timeline_commit(void)
+{
+	if (timeline_.recording)
+		return;
+
+	if (timeline_.head - timeline_.tail >= TIMELINE_FLUSH_THRESHOLD &&
+	    !timeline_.flush_idle)
+		timeline_.flush_idle =
+			wl_event_loop_add_idle(timeline_.loop,
+					       timeline_flush_idle, NULL);
+}
+
+static struct weston_timeline_record *
+timeline_reserve_definition(void)
+{
+	struct weston_timeline_record *defs;
+	uint32_t size;
+
+	if (!timeline_.recording)
+		return timeline_reserve(1);
+
+	if (timeline_.defs_count == timeline_.defs_size) {
+		size = timeline_.defs_size ? timeline_.defs_size * 2 : 256;
+		defs = realloc(timeline_.defs, size * RECORD_SIZE);
+		if (!defs)
+			return NULL;
+
+		timeline_.defs = defs;
+		timeline_.defs_size = size;
+	}
+
+	return &timeline_.defs[timeline_.defs_count++];
+}
+
+static void
+timeline_emit_definition(uint16_t type, uint32_t id, uint32_t extra,
+			 const char *text)
+{
+	struct weston_timeline_record *rec;
+	size_t len = text ? strnlen(text, UINT16_MAX) : 0;
+	size_t off;
+
+	rec = timeline_reserve_definition();
+	if (!rec)
+		return;
+	memset(rec, 0, RECORD_SIZE);
+	rec->type = type;
+	rec->aux = len;
+	rec->id = id;
+	rec->output = extra;
+
+	/* The text is reserved one record at a time, as it may wrap
+	 * around the end of the ring. */
+	for (off = 0; off < len; off += RECORD_SIZE) {
+		rec = timeline_reserve_definition();
+		if (!rec)
+			return;
+		memset(rec, 0, RECORD_SIZE);
+		memcpy(rec, text + off, MIN(RECORD_SIZE, len - off));
+	}
+}
+
+static void
+timeline_names_insert(struct timeline_name *table, uint32_t size,
+		      const char *name, uint32_t id)
+{
+	uint32_t i = ((uintptr_t)name >> 3) & (size - 1);
+
+	while (table[i].name)
+		i = (i + 1) & (size - 1);
+
+	table[i].name = name;
+	table[i].id = id;
+}
+
+static uint32_t
+timeline_intern_name(const char *name)
+{
+	struct timeline_name *table;
+	uint32_t i, size, id;
+
+	if (timeline_.names_size) {
+		i = ((uintptr_t)name >> 3) & (timeline_.names_size - 1);
+		while (timeline_.names[i].name) {
+			if (timeline_.names[i].name == name)
+				return timeline_.names[i].id;
+			i = (i + 1) & (timeline_.names_size - 1);
+		}
+	}
+
+	if ((timeline_.names_count + 1) * 2 > timeline_.names_size) {
+		size = timeline_.names_size ? timeline_.names_size * 2 : 64;
+		table = calloc(size, sizeof *table);
+		if (!table)
+			return 0;
+
+		for (i = 0; i < timeline_.names_size; i++)
+			if (timeline_.names[i].name)
+				timeline_names_insert(table, size,
+						      timeline_.names[i].name,
+						      timeline_.names[i].id);
+
+		free(timeline_.names);
+		timeline_.names = table;
+		timeline_.names_size = size;
+	}
+
+	id = ++timeline_.names_count;
+	timeline_names_insert(timeline_.names, timeline_.names_size, name, id);
+	timeline_emit_definition(WESTON_TIMELINE_RECORD_NAME, id, 0, name);
+
+	return id;
+}
+
+static void
+timeline_reset_names(void)
+{
+	free(timeline_.names);
+	timeline_.names = NULL;
+	timeline_.names_size = 0;
+	timeline_.names_count = 0;
+}
+
 static void
 timeline_notify_destroy(struct wl_listener *listener, void *data)
 {
@@ -85,11 +336,37 @@ timeline_notify_destroy(struct wl_listener *listener, void *data)
 void
 weston_timeline_open(struct weston_compositor *compositor)
 {
+	if (timeline_.recording) {
+		weston_log("Timeline flight recorder is running, "
+			   "not opening a timeline log.\n");
+		return;
+	}
+
 	if (weston_timeline_enabled_)
 		return;
 
-	if (weston_timeline_do_open() < 0)
+	timeline_.ring = calloc(TIMELINE_RING_SIZE, RECORD_SIZE);
+	if (!timeline_.ring) {
+		weston_log("Cannot allocate the timeline buffer.\n");
+		return;
+	}
+
+	if (weston_timeline_do_open() < 0) {
+		free(timeline_.ring);
+		timeline_.ring = NULL;
 		return;
+	}
+
+	timeline_.head = 0;
+	timeline_.tail = 0;
+	timeline_.sync_flushes = 0;
+
+	timeline_.loop = wl_display_get_event_loop(compositor->wl_display);
+	timeline_.flush_timer =
+		wl_event_loop_add_timer(timeline_.loop,
+					timeline_flush_timer, NULL);
+	wl_event_source_timer_update(timeline_.flush_timer,
+				     TIMELINE_FLUSH_MSEC);
 
 	timeline_.compositor_destroy_listener.notify = timeline_notify_destroy;
 	wl_signal_add(&compositor->destroy_signal,
@@ -104,141 +381,322 @@ weston_timeline_open(struct weston_compositor *compositor)
 void
 weston_timeline_close(void)
 {
-	if (!weston_timeline_enabled_)
+	if (!weston_timeline_enabled_ || timeline_.recording)
 		return;
 
 	weston_timeline_enabled_ = 0;
 
 	wl_list_remove(&timeline_.compositor_destroy_listener.link);
 
+	if (timeline_.flush_idle)
+		wl_event_source_remove(timeline_.flush_idle);
+	timeline_.flush_idle = NULL;
+	wl_event_source_remove(timeline_.flush_timer);
+	timeline_.flush_timer = NULL;
+
+	timeline_flush();
+
+	if (timeline_.sync_flushes)
+		weston_log("Timeline buffer overran %u times.\n",
+			   timeline_.sync_flushes);
+
+	free(timeline_.ring);
+	timeline_.ring = NULL;
+	timeline_reset_names();
+
 	fclose(timeline_.file);
 	timeline_.file = NULL;
 	weston_log("Timeline log file closed.\n");
 }
 
-struct timeline_emit_context {
-	FILE *cur;
-	FILE *out;
-	unsigned series;
-};
-
-static unsigned
-timeline_new_id(void)
+static void
+timeline_recorder_dump_now(void)
 {
-	static unsigned idc;
+	const char *prefix = "weston-timeline-recorder-";
+	const char *suffix = ".wtl";
+	char fname[1000];
+	struct weston_timeline_header header;
+	struct weston_timeline_record *rec;
+	struct timespec now;
+	uint64_t since;
+	uint32_t i, count = 0;
+	FILE *fp;
+
+	fp = file_create_dated(prefix, suffix, fname, sizeof(fname));
+	if (!fp) {
+		weston_log("Cannot open '%s*%s' for writing: %m\n",
+			   prefix, suffix);
+		return;
+	}
 
-	if (++idc == 0)
-		++idc;
+	clock_gettime(timeline_.clk_id, &now);
+	since = timespec_to_nsec(&now);
+	since = since > timeline_.window_nsec ? since - timeline_.window_nsec : 0;
 
-	return idc;
-}
+	header.magic = WESTON_TIMELINE_MAGIC;
+	header.version = WESTON_TIMELINE_VERSION;
+	header.record_size = RECORD_SIZE;
+	header.clock_id = timeline_.clk_id;
 
-static int
-check_series(struct timeline_emit_context *ctx,
-	     struct weston_timeline_object *to)
-{
-	if (to->series == 0 || to->series != ctx->series) {
-		to->series = ctx->series;
-		to->id = timeline_new_id();
-		return 1;
-	}
+	fwrite(&header, sizeof header, 1, fp);
+	fwrite(timeline_.defs, RECORD_SIZE, timeline_.defs_count, fp);
 
-	if (to->force_refresh) {
-		to->force_refresh = 0;
-		return 1;
+	for (i = timeline_.tail; i != timeline_.head; i++) {
+		rec = &timeline_.ring[i & (TIMELINE_RING_SIZE - 1)];
+		if (rec->time < since)
+			continue;
+
+		fwrite(rec, RECORD_SIZE, 1, fp);
+		count++;
 	}
 
-	return 0;
+	if (ferror(fp))
+		weston_log("Error writing timeline recorder dump '%s'\n",
+			   fname);
+	fclose(fp);
+
+	weston_log("Timeline flight recorder: dumped %u points to '%s' (%s)\n",
+		   count, fname, timeline_.dump_reason);
 }
 
 static void
-fprint_quoted_string(FILE *fp, const char *str)
+timeline_recorder_dump_idle(void *data)
 {
-	if (!str) {
-		fprintf(fp, "null");
+	timeline_.dump_idle = NULL;
+	timeline_recorder_dump_now();
+}
+
+/** Dump the flight recorder to a file
+ *
+ * \param reason Why the dump was requested, for the log. Must stay
+ * valid until the dump happens.
+ *
+ * The points of the recorder window are written as a binary timeline
+ * log named weston-timeline-recorder-<date>.wtl. Writing is deferred to
+ * an idle callback, so this is safe to call from the repaint path.
+ * Does nothing if the recorder is not running.
+ */
+void
+weston_timeline_recorder_dump(const char *reason)
+{
+	if (!timeline_.recording || timeline_.dump_idle)
 		return;
-	}
 
-	fprintf(fp, "\"%s\"", str);
+	timeline_.dump_reason = reason;
+	timeline_.dump_idle = wl_event_loop_add_idle(timeline_.loop,
+						     timeline_recorder_dump_idle,
+						     NULL);
 }
 
-static int
-emit_weston_output(struct timeline_emit_context *ctx, void *obj)
+/** Dump the flight recorder if a repaint took too long
+ *
+ * \param output The output repainted.
+ * \param begin When the repaint started, on CLOCK_MONOTONIC.
+ *
+ * Automatic dumps are rate limited to one per recorder window, the
+ * window of the first one already covering the following stalls.
+ */
+void
+weston_timeline_recorder_check_repaint(struct weston_output *output,
+				       const struct timespec *begin)
 {
-	struct weston_output *o = obj;
-
-	if (check_series(ctx, &o->timeline)) {
-		fprintf(ctx->out, "{ \"id\":%u, "
-			"\"type\":\"weston_output\", \"name\":",
-			o->timeline.id);
-		fprint_quoted_string(ctx->out, o->name);
-		fprintf(ctx->out, " }\n");
-	}
+	struct timespec now;
+	uint64_t end;
+
+	if (!timeline_.recording || !timeline_.deadline_nsec)
+		return;
 
-	fprintf(ctx->cur, "\"wo\":%u", o->timeline.id);
+	clock_gettime(timeline_.clk_id, &now);
+	end = timespec_to_nsec(&now);
+	if (end - timespec_to_nsec(begin) <= timeline_.deadline_nsec)
+		return;
+
+	TL_POINT("core_repaint_deadline_missed", TLP_OUTPUT(output), TLP_END);
+	WESTON_PROBE(repaint_deadline_missed, output->id);
+
+	if (timeline_.last_auto_dump &&
+	    end - timeline_.last_auto_dump < timeline_.window_nsec)
+		return;
+
+	timeline_.last_auto_dump = end;
+	weston_timeline_recorder_dump("repaint deadline exceeded");
+}
+
+static int
+timeline_recorder_signal(int signal_number, void *data)
+{
+	weston_timeline_recorder_dump("signal");
 
 	return 1;
 }
 
 static void
-check_weston_surface_description(struct timeline_emit_context *ctx,
-				 struct weston_surface *s)
+timeline_recorder_notify_destroy(struct wl_listener *listener, void *data)
 {
-	struct weston_surface *mains;
-	char d[512];
-	char mainstr[32];
+	weston_timeline_recorder_stop();
+}
+
+/** Start the always-on timeline flight recorder
+ *
+ * \param compositor The compositor.
+ * \param seconds How far back a dump goes.
+ * \param deadline_msec Dump automatically when a repaint takes longer
+ * than this, 0 to disable.
+ * \return 0 on success, -1 on failure.
+ *
+ * The recorder keeps the most recent timeline points in memory, in a
+ * fixed-size ring, so a dump holds at most the last \p seconds worth of
+ * points that fit in it. Dumps are requested with
+ * weston_timeline_recorder_dump() or the SIGUSR2 signal. The timeline
+ * log cannot be opened while the recorder runs.
+ */
+int
+weston_timeline_recorder_start(struct weston_compositor *compositor,
+			       int32_t seconds, int32_t deadline_msec)
+{
+	if (weston_timeline_enabled_)
+		weston_timeline_close();
+
+	timeline_.ring = calloc(TIMELINE_RING_SIZE, RECORD_SIZE);
+	if (!timeline_.ring)
+		return -1;
+
+	timeline_.head = 0;
+	timeline_.tail = 0;
+	timeline_.window_nsec = (uint64_t)seconds * NSEC_PER_SEC;
+	timeline_.deadline_nsec = (uint64_t)deadline_msec * 1000000;
+	timeline_.last_auto_dump = 0;
+
+	timeline_.loop = wl_display_get_event_loop(compositor->wl_display);
+	/* Dump on SIGUSR2, the launchers take SIGRTMIN for VT switching */
+	timeline_.dump_signal =
+		wl_event_loop_add_signal(timeline_.loop, SIGUSR2,
+					 timeline_recorder_signal, NULL);
+
+	timeline_.compositor_destroy_listener.notify =
+		timeline_recorder_notify_destroy;
+	wl_signal_add(&compositor->destroy_signal,
+		      &timeline_.compositor_destroy_listener);
+
+	if (++timeline_.series == 0)
+		++timeline_.series;
+
+	timeline_.recording = 1;
+	weston_timeline_enabled_ = 1;
+
+	weston_log("Timeline flight recorder keeping the last %d s", seconds);
+	if (deadline_msec)
+		weston_log_continue(", dumping on repaints over %d ms",
+				    deadline_msec);
+	weston_log_continue(".\n");
+
+	return 0;
+}
 
-	if (!check_series(ctx, &s->timeline))
+void
+weston_timeline_recorder_stop(void)
+{
+	if (!timeline_.recording)
 		return;
 
-	mains = weston_surface_get_main_surface(s);
-	if (mains != s) {
-		check_weston_surface_description(ctx, mains);
-		if (snprintf(mainstr, sizeof(mainstr),
-			     ", \"main_surface\":%u", mains->timeline.id) < 0)
-			mainstr[0] = '\0';
-	} else {
-		mainstr[0] = '\0';
-	}
+	weston_timeline_enabled_ = 0;
+	timeline_.recording = 0;
 
-	if (!s->get_label || s->get_label(s, d, sizeof(d)) < 0)
-		d[0] = '\0';
+	wl_list_remove(&timeline_.compositor_destroy_listener.link);
 
-	fprintf(ctx->out, "{ \"id\":%u, "
-		"\"type\":\"weston_surface\", \"desc\":", s->timeline.id);
-	fprint_quoted_string(ctx->out, d[0] ? d : NULL);
-	fprintf(ctx->out, "%s }\n", mainstr);
+	if (timeline_.dump_idle)
+		wl_event_source_remove(timeline_.dump_idle);
+	timeline_.dump_idle = NULL;
+	if (timeline_.dump_signal)
+		wl_event_source_remove(timeline_.dump_signal);
+	timeline_.dump_signal = NULL;
+
+	free(timeline_.ring);
+	timeline_.ring = NULL;
+	free(timeline_.defs);
+	timeline_.defs = NULL;
+	timeline_.defs_count = 0;
+	timeline_.defs_size = 0;
+	timeline_reset_names();
 }
 
-static int
-emit_weston_surface(struct timeline_emit_context *ctx, void *obj)
+/* Objects seen by a long running recorder pile up definitions. Past a
+ * limit, start a new series: everything gets defined again on next use,
+ * at the cost of the points recorded so far. */
+static void
+timeline_recorder_check_defs(void)
 {
-	struct weston_surface *s = obj;
+	if (timeline_.defs_count < TIMELINE_RECORDER_MAX_DEFS)
+		return;
 
-	check_weston_surface_description(ctx, s);
-	fprintf(ctx->cur, "\"ws\":%u", s->timeline.id);
+	if (++timeline_.series == 0)
+		++timeline_.series;
 
-	return 1;
+	timeline_.defs_count = 0;
+	timeline_.tail = timeline_.head;
+	timeline_reset_names();
+}
+
+static unsigned
+timeline_new_id(void)
+{
+	static unsigned idc;
+
+	if (++idc == 0)
+		++idc;
+
+	return idc;
 }
 
 static int
-emit_vblank_timestamp(struct timeline_emit_context *ctx, void *obj)
+check_series(struct weston_timeline_object *to)
 {
-	struct timespec *ts = obj;
+	if (to->series == 0 || to->series != timeline_.series) {
+		to->series = timeline_.series;
+		to->id = timeline_new_id();
+		return 1;
+	}
 
-	fprintf(ctx->cur, "\"vblank\":[%" PRId64 ", %ld]",
-		(int64_t)ts->tv_sec, ts->tv_nsec);
+	if (to->force_refresh) {
+		to->force_refresh = 0;
+		return 1;
+	}
 
-	return 1;
+	return 0;
 }
 
-typedef int (*type_func)(struct timeline_emit_context *ctx, void *obj);
+static uint32_t
+emit_weston_output(struct weston_output *o)
+{
+	if (check_series(&o->timeline))
+		timeline_emit_definition(WESTON_TIMELINE_RECORD_OUTPUT,
+					 o->timeline.id, 0, o->name);
 
-static const type_func type_dispatch[] = {
-	[TLT_OUTPUT] = emit_weston_output,
-	[TLT_SURFACE] = emit_weston_surface,
-	[TLT_VBLANK] = emit_vblank_timestamp,
-};
+	return o->timeline.id;
+}
+
+static uint32_t
+emit_weston_surface(struct weston_surface *s)
+{
+	struct weston_surface *mains;
+	uint32_t main_id = 0;
+	char d[512];
+
+	if (!check_series(&s->timeline))
+		return s->timeline.id;
+
+	mains = weston_surface_get_main_surface(s);
+	if (mains != s)
+		main_id = emit_weston_surface(mains);
+
+	if (!s->get_label || s->get_label(s, d, sizeof(d)) < 0)
+		d[0] = '\0';
+
+	timeline_emit_definition(WESTON_TIMELINE_RECORD_SURFACE,
+				 s->timeline.id, main_id, d);
+
+	return s->timeline.id;
+}
 
 WL_EXPORT void
 weston_timeline_point(const char *name, ...)
@@ -247,23 +705,18 @@ weston_timeline_point(const char *name, ...)
 	struct timespec ts;
 	enum timeline_type otype;
 	void *obj;
-	char buf[512];
-	struct timeline_emit_context ctx;
+	struct weston_timeline_record *rec;
+	uint32_t name_id, output = 0, surface = 0;
+	uint64_t vblank = 0;
+	uint16_t flags = 0;
 
 	clock_gettime(timeline_.clk_id, &ts);
 
-	ctx.out = timeline_.file;
-	ctx.cur = fmemopen(buf, sizeof(buf), "w");
-	ctx.series = timeline_.series;
+	if (timeline_.recording)
+		timeline_recorder_check_defs();
 
-	if (!ctx.cur) {
-		weston_log("Timeline error in fmemopen, closing.\n");
-		weston_timeline_close();
-		return;
-	}
-
-	fprintf(ctx.cur, "{ \"T\":[%" PRId64 ", %ld], \"N\":\"%s\"",
-		(int64_t)ts.tv_sec, ts.tv_nsec, name);
+	/* Definitions go into the ring before the point itself. */
+	name_id = timeline_intern_name(name);
 
 	va_start(argp, name);
 	while (1) {
@@ -272,21 +725,36 @@ weston_timeline_point(const char *name, ...)
 			break;
 
 		obj = va_arg(argp, void *);
-		if (type_dispatch[otype]) {
-			fprintf(ctx.cur, ", ");
-			type_dispatch[otype](&ctx, obj);
+		switch (otype) {
+		case TLT_OUTPUT:
+			output = emit_weston_output(obj);
+			break;
+		case TLT_SURFACE:
+			surface = emit_weston_surface(obj);
+			break;
+		case TLT_VBLANK:
+			vblank = timespec_to_nsec(obj);
+			flags |= WESTON_TIMELINE_POINT_VBLANK;
+			break;
+		case TLT_VBLANK_INVALID:
+			vblank = timespec_to_nsec(obj);
+			flags |= WESTON_TIMELINE_POINT_VBLANK |
+				 WESTON_TIMELINE_POINT_VBLANK_INVALID;
+			break;
+		default:
+			break;
 		}
 	}
 	va_end(argp);
 
-	fprintf(ctx.cur, " }\n");
-	fflush(ctx.cur);
-	if (ferror(ctx.cur)) {
-		weston_log("Timeline error in constructing entry, closing.\n");
-		weston_timeline_close();
-	} else {
-		fprintf(ctx.out, "%s", buf);
-	}
+	rec = timeline_reserve(1);
+	rec->type = WESTON_TIMELINE_RECORD_POINT;
+	rec->aux = flags;
+	rec->id = name_id;
+	rec->time = timespec_to_nsec(&ts);
+	rec->output = output;
+	rec->surface = surface;
+	rec->vblank = vblank;
 
-	fclose(ctx.cur);
+	timeline_commit();
 }
@@ -27,6 +27,8 @@
 #ifndef WESTON_TIMELINE_H
 #define WESTON_TIMELINE_H
 
+#include <stdint.h>
+
 extern int weston_timeline_enabled_;
 
 struct weston_compositor;
@@ -37,11 +39,29 @@ weston_timeline_open(struct weston_compositor *compositor);
 void
 weston_timeline_close(void);
 
+struct weston_output;
+struct timespec;
+
+int
+weston_timeline_recorder_start(struct weston_compositor *compositor,
+			       int32_t seconds, int32_t deadline_msec);
+
+void
+weston_timeline_recorder_stop(void);
+
+void
+weston_timeline_recorder_dump(const char *reason);
+
+void
+weston_timeline_recorder_check_repaint(struct weston_output *output,
+				       const struct timespec *begin);
+
 enum timeline_type {
 	TLT_END = 0,
 	TLT_OUTPUT,
 	TLT_SURFACE,
 	TLT_VBLANK,
+	TLT_VBLANK_INVALID,
 };
 
 #define TYPEVERIFY(type, arg) ({			\
@@ -53,6 +73,8 @@ enum timeline_type {
 #define TLP_OUTPUT(o) TLT_OUTPUT, TYPEVERIFY(struct weston_output *, (o))
 #define TLP_SURFACE(s) TLT_SURFACE, TYPEVERIFY(struct weston_surface *, (s))
 #define TLP_VBLANK(t) TLT_VBLANK, TYPEVERIFY(const struct timespec *, (t))
+#define TLP_VBLANK_INVALID(t) \
+	TLT_VBLANK_INVALID, TYPEVERIFY(const struct timespec *, (t))
 
 #define TL_POINT(...) do { \
 	if (weston_timeline_enabled_) \
@@ -0,0 +1,352 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Runs with adaptive-repaint=true, see adaptive-repaint.ini, on the
+ * virtual presentation clock, which only moves when the test says so.
+ * Repaints are timed on CLOCK_MONOTONIC, and weston-test makes them take
+ * longer on request, so the adaptive lead can be checked against a known
+ * repaint cost. That needs the pixman renderer, which emits the frame
+ * signal weston-test waits in.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "weston-test-client-helper.h"
+#include "presentation_timing-client-protocol.h"
+#include "weston-stats-client-protocol.h"
+
+char *server_parameters = "--use-pixman --virtual-clock --debug";
+
+/* As set in adaptive-repaint.ini */
+#define REPAINT_WINDOW_USEC 7000
+#define REPAINT_MARGIN_USEC 3000
+
+/* WESTON_REPAINT_SAMPLES */
+#define REPAINT_SAMPLES 32
+
+/* Added to each repaint while checking that the lead follows it. Well
+ * above what repainting the test surface takes, and the lead it gives
+ * stays below the 60 Hz refresh period the lead is capped at. */
+#define REPAINT_COST_USEC 8000
+
+struct lead {
+	struct weston_output_stats *output_stats;
+	int done;
+	uint32_t count;		/* of the repaint_lead histogram */
+	uint32_t min;
+	uint32_t max;
+	uint32_t missed;
+};
+
+struct frame {
+	struct wl_callback *callback;
+	int repainted;
+	struct presentation_feedback *feedback;
+	int presented;
+	uint32_t refresh_nsec;
+};
+
+static void
+stats_histogram(void *data, struct weston_output_stats *output_stats,
+		const char *name, uint32_t count, uint32_t min, uint32_t avg,
+		uint32_t p50, uint32_t p99, uint32_t max)
+{
+	struct lead *lead = data;
+
+	if (strcmp(name, "repaint_lead") != 0)
+		return;
+
+	lead->count = count;
+	lead->min = min;
+	lead->max = max;
+}
+
+static void
+stats_frames(void *data, struct weston_output_stats *output_stats,
+	     uint32_t presented, uint32_t missed)
+{
+	struct lead *lead = data;
+
+	lead->missed = missed;
+}
+
+static void
+stats_done(void *data, struct weston_output_stats *output_stats)
+{
+	struct lead *lead = data;
+
+	lead->done = 1;
+}
+
+static void
+stats_repicks(void *data, struct weston_output_stats *output_stats,
+	      uint32_t repicked, uint32_t skipped)
+{
+}
+
+static const struct weston_output_stats_listener stats_listener = {
+	stats_histogram,
+	stats_frames,
+	stats_done,
+	stats_repicks,
+};
+
+static void
+lead_init(struct lead *lead, struct client *client)
+{
+	struct weston_stats *stats = NULL;
+	struct global *g;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, "weston_stats") == 0)
+			stats = wl_registry_bind(client->wl_registry, g->name,
+						 &weston_stats_interface, 1);
+	}
+	assert(stats);
+
+	memset(lead, 0, sizeof *lead);
+	lead->output_stats =
+		weston_stats_get_output_stats(stats,
+					      client->output->wl_output);
+	weston_output_stats_add_listener(lead->output_stats,
+					 &stats_listener, lead);
+	weston_stats_destroy(stats);
+	client_roundtrip(client);
+}
+
+static void
+lead_reset(struct lead *lead, struct client *client)
+{
+	weston_output_stats_reset(lead->output_stats);
+	client_roundtrip(client);
+}
+
+static void
+lead_update(struct lead *lead, struct client *client)
+{
+	lead->done = 0;
+	weston_output_stats_update(lead->output_stats);
+	while (!lead->done)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+}
+
+static void
+frame_callback_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+	struct frame *frame = data;
+
+	wl_callback_destroy(callback);
+	frame->callback = NULL;
+	frame->repainted = 1;
+}
+
+static const struct wl_callback_listener frame_listener = {
+	frame_callback_done
+};
+
+static void
+feedback_sync_output(void *data,
+		     struct presentation_feedback *presentation_feedback,
+		     struct wl_output *output)
+{
+}
+
+static void
+feedback_presented(void *data,
+		   struct presentation_feedback *presentation_feedback,
+		   uint32_t tv_sec_hi,
+		   uint32_t tv_sec_lo,
+		   uint32_t tv_nsec,
+		   uint32_t refresh_nsec,
+		   uint32_t seq_hi,
+		   uint32_t seq_lo,
+		   uint32_t flags)
+{
+	struct frame *frame = data;
+
+	presentation_feedback_destroy(presentation_feedback);
+	frame->presented = 1;
+	frame->refresh_nsec = refresh_nsec;
+}
+
+static void
+feedback_discarded(void *data,
+		   struct presentation_feedback *presentation_feedback)
+{
+	assert(0 && "feedback discarded");
+}
+
+static const struct presentation_feedback_listener feedback_listener = {
+	feedback_sync_output,
+	feedback_presented,
+	feedback_discarded
+};
+
+static void
+commit_frame(struct client *client, struct presentation *pres,
+	     struct frame *frame)
+{
+	struct surface *surface = client->surface;
+
+	memset(frame, 0, sizeof *frame);
+	frame->callback = wl_surface_frame(surface->wl_surface);
+	wl_callback_add_listener(frame->callback, &frame_listener, frame);
+	frame->feedback = presentation_feedback(pres, surface->wl_surface);
+	presentation_feedback_add_listener(frame->feedback,
+					   &feedback_listener, frame);
+
+	wl_surface_attach(surface->wl_surface, surface->wl_buffer, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, 0,
+			  surface->width, surface->height);
+	wl_surface_commit(surface->wl_surface);
+}
+
+static void
+wait_repainted(struct client *client, struct frame *frame)
+{
+	while (!frame->repainted)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+}
+
+static void
+wait_presented(struct client *client, struct frame *frame)
+{
+	while (!frame->presented)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+}
+
+/* Each frame restarts the repaint loop, which is not a presented frame
+ * and must not be accounted. */
+static void
+present_frames(struct client *client, struct presentation *pres, int n)
+{
+	struct frame frame;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		commit_frame(client, pres, &frame);
+		wait_presented(client, &frame);
+	}
+}
+
+/* The lead the repaint after a single presented frame is scheduled
+ * with. */
+static uint32_t
+lead_of_one_frame(struct lead *lead, struct client *client,
+		  struct presentation *pres)
+{
+	lead_reset(lead, client);
+	present_frames(client, pres, 1);
+	lead_update(lead, client);
+
+	fprintf(stderr, "repaint lead: count %u, min %u, max %u usec\n",
+		lead->count, lead->min, lead->max);
+	assert(lead->count == 1);
+	assert(lead->min == lead->max);
+
+	return lead->min;
+}
+
+static void
+set_repaint_cost(struct client *client, uint32_t usec)
+{
+	weston_test_set_repaint_cost(client->test->weston_test, usec);
+	client_roundtrip(client);
+}
+
+TEST(adaptive_lead_follows_repaint_cost_and_falls_back)
+{
+	struct client *client;
+	struct presentation *pres = NULL;
+	struct lead lead;
+	struct frame a, b;
+	struct global *g;
+	uint32_t usec;
+
+	client = create_client_and_test_surface(100, 50, 100, 100);
+	assert(client);
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, "presentation") == 0)
+			pres = wl_registry_bind(client->wl_registry, g->name,
+						&presentation_interface, 1);
+	}
+	assert(pres);
+	lead_init(&lead, client);
+
+	/* Enough samples: the lead is the longest repaint plus the
+	 * margin, and repainting the test surface is cheap. */
+	present_frames(client, pres, REPAINT_SAMPLES);
+	usec = lead_of_one_frame(&lead, client, pres);
+	assert(usec >= REPAINT_MARGIN_USEC);
+	assert(usec < REPAINT_MARGIN_USEC + REPAINT_COST_USEC);
+
+	/* Costlier repaints make the lead grow by at least as much. */
+	set_repaint_cost(client, REPAINT_COST_USEC);
+	present_frames(client, pres, REPAINT_SAMPLES);
+	usec = lead_of_one_frame(&lead, client, pres);
+	assert(usec >= REPAINT_MARGIN_USEC + REPAINT_COST_USEC);
+
+	/* And it shrinks again once the costly repaints have left the
+	 * samples. */
+	set_repaint_cost(client, 0);
+	present_frames(client, pres, REPAINT_SAMPLES + 1);
+	usec = lead_of_one_frame(&lead, client, pres);
+	assert(usec >= REPAINT_MARGIN_USEC);
+	assert(usec < REPAINT_MARGIN_USEC + REPAINT_COST_USEC);
+
+	/* Keep the repaint loop running with b queued behind a, and let
+	 * time pass while b is in flight, so that it misses vblanks. */
+	lead_reset(&lead, client);
+	commit_frame(client, pres, &a);
+	wait_repainted(client, &a);
+	commit_frame(client, pres, &b);
+	wait_repainted(client, &b);
+	assert(a.presented);
+	weston_test_advance_presentation_clock(client->test->weston_test,
+					       3 * a.refresh_nsec / 1000);
+	wait_presented(client, &b);
+	lead_update(&lead, client);
+
+	fprintf(stderr, "missed %u, repaint lead min %u, max %u usec\n",
+		lead.missed, lead.min, lead.max);
+	assert(lead.missed > 0);
+	assert(lead.max >= REPAINT_WINDOW_USEC);
+
+	/* The static window for as many frames as there are samples. */
+	assert(lead_of_one_frame(&lead, client, pres) == REPAINT_WINDOW_USEC);
+	present_frames(client, pres, REPAINT_SAMPLES);
+	usec = lead_of_one_frame(&lead, client, pres);
+	assert(usec >= REPAINT_MARGIN_USEC);
+	assert(usec < REPAINT_MARGIN_USEC + REPAINT_COST_USEC);
+
+	weston_output_stats_destroy(lead.output_stats);
+	presentation_destroy(pres);
+}
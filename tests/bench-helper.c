@@ -0,0 +1,259 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/socket.h>
+
+#include "shared/timespec-util.h"
+#include "bench-helper.h"
+
+void *
+bench_bind_global(struct client *client, const char *interface,
+		  const struct wl_interface *wl_interface)
+{
+	struct global *g;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, interface) == 0)
+			return wl_registry_bind(client->wl_registry, g->name,
+						wl_interface, 1);
+	}
+
+	assert(0 && "global not found");
+	return NULL;
+}
+
+static void
+presentation_clock_id(void *data, struct presentation *presentation,
+		      uint32_t clk_id)
+{
+	clockid_t *clock_id = data;
+
+	*clock_id = clk_id;
+}
+
+static const struct presentation_listener presentation_listener = {
+	presentation_clock_id
+};
+
+/** Bind the presentation global and wait for its clock
+ *
+ * \param client The client.
+ * \param clock_id Set to the presentation clock, which must outlive
+ * the returned object.
+ * \return The bound presentation object.
+ */
+struct presentation *
+bench_bind_presentation(struct client *client, clockid_t *clock_id)
+{
+	struct presentation *presentation;
+
+	*clock_id = CLOCK_MONOTONIC;
+	presentation = bench_bind_global(client, "presentation",
+					 &presentation_interface);
+	presentation_add_listener(presentation, &presentation_listener,
+				  clock_id);
+	client_roundtrip(client);
+
+	return presentation;
+}
+
+static void
+feedback_sync_output(void *data,
+		     struct presentation_feedback *presentation_feedback,
+		     struct wl_output *output)
+{
+}
+
+static void
+feedback_done(struct bench_feedback *fb)
+{
+	presentation_feedback_destroy(fb->feedback);
+	fb->feedback = NULL;
+	fb->done = 1;
+}
+
+static void
+feedback_presented(void *data,
+		   struct presentation_feedback *presentation_feedback,
+		   uint32_t tv_sec_hi,
+		   uint32_t tv_sec_lo,
+		   uint32_t tv_nsec,
+		   uint32_t refresh_nsec,
+		   uint32_t seq_hi,
+		   uint32_t seq_lo,
+		   uint32_t flags)
+{
+	struct bench_feedback *fb = data;
+
+	fb->presented.tv_sec = ((uint64_t)tv_sec_hi << 32) + tv_sec_lo;
+	fb->presented.tv_nsec = tv_nsec;
+	fb->refresh_nsec = refresh_nsec;
+	fb->seq = ((uint64_t)seq_hi << 32) | seq_lo;
+	feedback_done(fb);
+}
+
+static void
+feedback_discarded(void *data,
+		   struct presentation_feedback *presentation_feedback)
+{
+	struct bench_feedback *fb = data;
+
+	fb->discarded = 1;
+	feedback_done(fb);
+}
+
+static const struct presentation_feedback_listener feedback_listener = {
+	feedback_sync_output,
+	feedback_presented,
+	feedback_discarded
+};
+
+/** Ask for presentation feedback on the next commit of a surface
+ *
+ * \param fb Where the feedback is stored, reset here.
+ * \param presentation The presentation object.
+ * \param surface The surface about to be committed.
+ */
+void
+bench_feedback_request(struct bench_feedback *fb,
+		       struct presentation *presentation,
+		       struct wl_surface *surface)
+{
+	memset(fb, 0, sizeof *fb);
+	fb->feedback = presentation_feedback(presentation, surface);
+	presentation_feedback_add_listener(fb->feedback,
+					   &feedback_listener, fb);
+}
+
+void
+bench_feedback_wait(struct client *client, struct bench_feedback *fb)
+{
+	while (!fb->done)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+}
+
+/** Get the CPU-time clock of the compositor
+ *
+ * \param client The client.
+ * \param clock Set to the clock on success.
+ * \return 0 on success, -1 if the clock is not available.
+ *
+ * The test client is not a direct child of the compositor, so ask the
+ * socket who is on the other end.
+ */
+int
+bench_compositor_cpu_clock(struct client *client, clockid_t *clock)
+{
+	struct ucred ucred;
+	socklen_t len = sizeof ucred;
+	int fd = wl_display_get_fd(client->wl_display);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) < 0)
+		return -1;
+
+	if (clock_getcpuclockid(ucred.pid, clock) != 0)
+		return -1;
+
+	return 0;
+}
+
+double
+bench_elapsed_usec(const struct timespec *begin, const struct timespec *end)
+{
+	struct timespec d;
+
+	timespec_sub(&d, end, begin);
+
+	return timespec_to_nsec(&d) / 1000.0;
+}
+
+/** Read a positive count from the environment
+ *
+ * \param name The environment variable.
+ * \param fallback Returned when the variable is not set.
+ * \return The count.
+ */
+unsigned
+bench_env_count(const char *name, unsigned fallback)
+{
+	const char *env = getenv(name);
+	char *end;
+	long count;
+
+	if (!env)
+		return fallback;
+
+	count = strtol(env, &end, 10);
+	assert(*end == '\0' && count > 0);
+
+	return count;
+}
+
+/** Open the results stream
+ *
+ * \return The file named by WESTON_BENCH_RESULTS opened for appending,
+ * or stdout when that is not set. Close it with bench_results_close().
+ */
+FILE *
+bench_results_open(void)
+{
+	const char *path = getenv("WESTON_BENCH_RESULTS");
+	FILE *fp;
+
+	if (!path)
+		return stdout;
+
+	fp = fopen(path, "a");
+	assert(fp);
+
+	return fp;
+}
+
+void
+bench_results_close(FILE *fp)
+{
+	if (fp != stdout)
+		fclose(fp);
+}
+
+/** Print a histogram as a JSON member, without a trailing separator */
+void
+bench_print_histogram(FILE *fp, const char *name,
+		      const struct weston_histogram *h)
+{
+	fprintf(fp, "\"%s\":{\"min\":%u,\"avg\":%u,\"p50\":%u,"
+		"\"p90\":%u,\"p99\":%u,\"max\":%u}",
+		name, h->count ? h->min : 0,
+		weston_histogram_mean(h),
+		weston_histogram_percentile(h, 50),
+		weston_histogram_percentile(h, 90),
+		weston_histogram_percentile(h, 99),
+		h->max);
+}
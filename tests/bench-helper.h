@@ -0,0 +1,85 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _WESTON_BENCH_HELPER_H_
+#define _WESTON_BENCH_HELPER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "shared/histogram.h"
+#include "weston-test-client-helper.h"
+#include "presentation_timing-client-protocol.h"
+
+/*
+ * Helpers shared by the benchmark clients, see 'make bench'.
+ */
+
+/* Presentation feedback of one commit, filled in as it arrives. */
+struct bench_feedback {
+	struct presentation_feedback *feedback;
+	int done;
+	int discarded;
+	struct timespec presented;
+	uint32_t refresh_nsec;
+	uint64_t seq;
+};
+
+void *
+bench_bind_global(struct client *client, const char *interface,
+		  const struct wl_interface *wl_interface);
+
+struct presentation *
+bench_bind_presentation(struct client *client, clockid_t *clock_id);
+
+void
+bench_feedback_request(struct bench_feedback *fb,
+		       struct presentation *presentation,
+		       struct wl_surface *surface);
+
+void
+bench_feedback_wait(struct client *client, struct bench_feedback *fb);
+
+int
+bench_compositor_cpu_clock(struct client *client, clockid_t *clock);
+
+double
+bench_elapsed_usec(const struct timespec *begin, const struct timespec *end);
+
+unsigned
+bench_env_count(const char *name, unsigned fallback);
+
+FILE *
+bench_results_open(void);
+
+void
+bench_results_close(FILE *fp);
+
+void
+bench_print_histogram(FILE *fp, const char *name,
+		      const struct weston_histogram *h);
+
+#endif
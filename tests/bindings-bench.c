@@ -0,0 +1,190 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Key binding dispatch cost as the number of bindings grows.
+ *
+ * Runs inside the compositor and calls weston_compositor_run_key_binding()
+ * directly on a seat of its own, for a key nothing is bound to and for a
+ * key bound last. Appends one JSON object per binding count to the file
+ * named by WESTON_BENCH_RESULTS, or writes it to stdout.
+ *
+ * This is not part of 'make check'; run it with 'make bench'.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <linux/input.h>
+
+#include "src/compositor.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+#define BENCH_ITERATIONS 100000
+#define BENCH_MISS_KEY KEY_F24
+#define BENCH_HIT_KEY KEY_F23
+
+static const int binding_counts[] = { 0, 16, 64, 256, 1024 };
+
+static void
+noop_binding(struct weston_keyboard *keyboard, uint32_t time,
+	     uint32_t key, void *data)
+{
+}
+
+static void
+hit_binding(struct weston_keyboard *keyboard, uint32_t time,
+	    uint32_t key, void *data)
+{
+	int *hits = data;
+
+	(*hits)++;
+}
+
+static double
+elapsed_nsec(const struct timespec *begin, const struct timespec *end)
+{
+	struct timespec d;
+
+	timespec_sub(&d, end, begin);
+
+	return timespec_to_nsec(&d);
+}
+
+static double
+bench_dispatch(struct weston_compositor *compositor,
+	       struct weston_keyboard *keyboard, uint32_t key)
+{
+	struct timespec begin, end;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		weston_compositor_run_key_binding(compositor, keyboard, i,
+						  key,
+						  WL_KEYBOARD_KEY_STATE_PRESSED);
+
+		/* A binding that ran swallows the key until it is
+		 * released, with a grab of its own. */
+		if (keyboard->grab != &keyboard->default_grab)
+			keyboard->grab->interface->key(keyboard->grab, i, key,
+					WL_KEYBOARD_KEY_STATE_RELEASED);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed_nsec(&begin, &end) / BENCH_ITERATIONS;
+}
+
+static void
+bench_report(int count, double miss_ns, double hit_ns)
+{
+	const char *path = getenv("WESTON_BENCH_RESULTS");
+	FILE *fp = stdout;
+
+	if (path) {
+		fp = fopen(path, "a");
+		assert(fp);
+	}
+
+	fprintf(fp, "{\"benchmark\":\"key-bindings\",\"bindings\":%d,"
+		"\"miss_ns\":%.1f,\"hit_ns\":%.1f}\n",
+		count, miss_ns, hit_ns);
+
+	if (fp != stdout)
+		fclose(fp);
+}
+
+static void
+bindings_bench(void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct weston_binding **bindings;
+	struct weston_binding *hit;
+	struct weston_keyboard *keyboard;
+	struct weston_seat *seat;
+	double miss_ns, hit_ns;
+	int hits;
+	unsigned c;
+	int i;
+
+	seat = zalloc(sizeof *seat);
+	assert(seat);
+	weston_seat_init(seat, compositor, "bindings-bench");
+	assert(weston_seat_init_keyboard(seat, NULL) == 0);
+	keyboard = weston_seat_get_keyboard(seat);
+
+	for (c = 0; c < ARRAY_LENGTH(binding_counts); c++) {
+		bindings = zalloc(binding_counts[c] * sizeof *bindings);
+		assert(bindings || binding_counts[c] == 0);
+
+		/* Spread over the main block of keys and every
+		 * non-empty modifier mask. */
+		for (i = 0; i < binding_counts[c]; i++)
+			bindings[i] = weston_compositor_add_key_binding(
+				compositor,
+				KEY_ESC + i % (KEY_KPDOT - KEY_ESC + 1),
+				1 + i / (KEY_KPDOT - KEY_ESC + 1) % 15,
+				noop_binding, NULL);
+
+		hits = 0;
+		hit = weston_compositor_add_key_binding(compositor,
+							BENCH_HIT_KEY, 0,
+							hit_binding, &hits);
+
+		miss_ns = bench_dispatch(compositor, keyboard, BENCH_MISS_KEY);
+		hit_ns = bench_dispatch(compositor, keyboard, BENCH_HIT_KEY);
+		assert(hits == BENCH_ITERATIONS);
+
+		bench_report(binding_counts[c], miss_ns, hit_ns);
+
+		weston_binding_destroy(hit);
+		for (i = 0; i < binding_counts[c]; i++)
+			weston_binding_destroy(bindings[i]);
+		free(bindings);
+	}
+
+	weston_seat_release(seat);
+	free(seat);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, bindings_bench, compositor);
+
+	return 0;
+}
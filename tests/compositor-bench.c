@@ -0,0 +1,374 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compositor macro-benchmarks.
+ *
+ * Each scenario drives the headless backend with the pixman renderer as
+ * fast as it will go and appends one JSON object per line to the file
+ * named by WESTON_BENCH_RESULTS, or to stdout when that is not set.
+ * WESTON_BENCH_FRAMES overrides the number of measured frames.
+ *
+ * The output refreshes at only 10 Hz. Unthrottled, a frame takes far
+ * less than that, so a benchmark that is held to the refresh rate again
+ * fails instead of reporting the refresh rate as throughput.
+ *
+ * These are not part of 'make check'; run them with 'make bench'.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "bench-helper.h"
+
+char *server_parameters = "--use-pixman --unthrottled --refresh-rate=10000";
+
+#define BENCH_DEFAULT_FRAMES 300
+#define BENCH_WARMUP_FRAMES 10
+#define BENCH_SMALL_DAMAGE 32
+
+enum bench_damage {
+	BENCH_DAMAGE_FULL,
+	BENCH_DAMAGE_SMALL,
+};
+
+struct bench_scenario {
+	const char *name;
+	int windows;
+	int width;	/* 0 means the output size */
+	int height;
+	int subsurfaces;
+	enum bench_damage damage;
+	int alpha;
+};
+
+static const struct bench_scenario scenarios[] = {
+	{ "fullscreen-opaque",     1,   0,   0, 0, BENCH_DAMAGE_FULL,  0 },
+	{ "fullscreen-alpha",      1,   0,   0, 0, BENCH_DAMAGE_FULL,  1 },
+	{ "fullscreen-small",      1,   0,   0, 0, BENCH_DAMAGE_SMALL, 0 },
+	{ "windows16-opaque",     16, 256, 192, 0, BENCH_DAMAGE_FULL,  0 },
+	{ "windows16-alpha",      16, 256, 192, 0, BENCH_DAMAGE_FULL,  1 },
+	{ "windows64-small",      64, 128,  96, 0, BENCH_DAMAGE_SMALL, 1 },
+	{ "subsurfaces4x8-alpha",  4, 400, 300, 8, BENCH_DAMAGE_SMALL, 1 },
+	{ "subsurfaces4x8-full",   4, 400, 300, 8, BENCH_DAMAGE_FULL,  0 },
+};
+
+struct bench_surface {
+	struct wl_surface *wl_surface;
+	struct wl_subsurface *wl_subsurface;
+	struct wl_buffer *wl_buffer;
+	uint32_t *pixels;
+	int width;
+	int height;
+};
+
+struct bench;
+
+struct bench_window {
+	struct bench *bench;
+	/* surfaces[0] is the main surface, the rest are nested
+	 * synchronized sub-surfaces, each a child of the previous one */
+	struct bench_surface *surfaces;
+	int n_surfaces;
+	struct bench_feedback feedback;
+	struct timespec commit_time;
+};
+
+struct bench {
+	const struct bench_scenario *scenario;
+	struct client *client;
+	struct presentation *presentation;
+	struct wl_subcompositor *subcompositor;
+	clockid_t clock_id;
+
+	struct bench_window *windows;
+
+	uint64_t last_seq;
+	uint32_t refresh_nsec;
+	unsigned output_frames;
+	unsigned discarded;
+	struct weston_histogram latency;
+};
+
+static void
+bench_surface_init(struct bench *bench, struct bench_surface *surface,
+		   int width, int height)
+{
+	struct client *client = bench->client;
+	struct wl_region *region;
+
+	surface->width = width;
+	surface->height = height;
+	surface->wl_surface =
+		wl_compositor_create_surface(client->wl_compositor);
+	surface->wl_buffer = create_shm_buffer(client, width, height,
+					       (void **)&surface->pixels);
+
+	if (!bench->scenario->alpha) {
+		region = wl_compositor_create_region(client->wl_compositor);
+		wl_region_add(region, 0, 0, width, height);
+		wl_surface_set_opaque_region(surface->wl_surface, region);
+		wl_region_destroy(region);
+	}
+}
+
+static uint32_t
+bench_color(const struct bench_scenario *scenario, unsigned frame)
+{
+	uint32_t rgb = frame * 0x030507;
+
+	/* premultiplied, so the colour channels must not exceed alpha */
+	if (scenario->alpha)
+		return 0x80000000 | (rgb & 0x7f7f7f);
+
+	return 0xff000000 | (rgb & 0xffffff);
+}
+
+static void
+bench_surface_paint(struct bench *bench, struct bench_surface *surface,
+		    unsigned frame)
+{
+	const struct bench_scenario *scenario = bench->scenario;
+	uint32_t color = bench_color(scenario, frame);
+	int x = 0, y = 0;
+	int width = surface->width;
+	int height = surface->height;
+	int i, j;
+
+	if (scenario->damage == BENCH_DAMAGE_SMALL) {
+		width = MIN(width, BENCH_SMALL_DAMAGE);
+		height = MIN(height, BENCH_SMALL_DAMAGE);
+		x = (frame * 7) % (surface->width - width + 1);
+		y = (frame * 3) % (surface->height - height + 1);
+	}
+
+	for (j = y; j < y + height; j++)
+		for (i = x; i < x + width; i++)
+			surface->pixels[j * surface->width + i] = color;
+
+	wl_surface_attach(surface->wl_surface, surface->wl_buffer, 0, 0);
+	wl_surface_damage(surface->wl_surface, x, y, width, height);
+}
+
+static void
+bench_window_init(struct bench *bench, struct bench_window *window,
+		  int index)
+{
+	const struct bench_scenario *scenario = bench->scenario;
+	struct output *output = bench->client->output;
+	struct bench_surface *parent, *surface;
+	int width = scenario->width ? scenario->width : output->width;
+	int height = scenario->height ? scenario->height : output->height;
+	int x, y, i;
+
+	window->bench = bench;
+	window->n_surfaces = 1 + scenario->subsurfaces;
+	window->surfaces = xzalloc(window->n_surfaces *
+				   sizeof window->surfaces[0]);
+
+	/* Scatter the windows so that they partially overlap. */
+	x = (index * 97) % MAX(output->width - width + 1, 1);
+	y = (index * 61) % MAX(output->height - height + 1, 1);
+
+	bench_surface_init(bench, &window->surfaces[0], width, height);
+	weston_test_move_surface(bench->client->test->weston_test,
+				 window->surfaces[0].wl_surface, x, y);
+
+	for (i = 1; i < window->n_surfaces; i++) {
+		parent = &window->surfaces[i - 1];
+		surface = &window->surfaces[i];
+
+		bench_surface_init(bench, surface,
+				   MAX(parent->width - 16, 16),
+				   MAX(parent->height - 16, 16));
+		surface->wl_subsurface =
+			wl_subcompositor_get_subsurface(bench->subcompositor,
+							surface->wl_surface,
+							parent->wl_surface);
+		wl_subsurface_set_position(surface->wl_subsurface, 8, 8);
+	}
+}
+
+static void
+bench_window_commit(struct bench_window *window, unsigned frame)
+{
+	struct bench *bench = window->bench;
+	struct wl_surface *main_surface = window->surfaces[0].wl_surface;
+	int i;
+
+	/* Sub-surfaces are synchronized, so their state is applied by
+	 * the main surface commit that comes last. */
+	for (i = window->n_surfaces - 1; i >= 0; i--) {
+		bench_surface_paint(bench, &window->surfaces[i], frame);
+		if (i > 0)
+			wl_surface_commit(window->surfaces[i].wl_surface);
+	}
+
+	bench_feedback_request(&window->feedback, bench->presentation,
+			       main_surface);
+
+	clock_gettime(bench->clock_id, &window->commit_time);
+	wl_surface_commit(main_surface);
+}
+
+static void
+bench_window_presented(struct bench_window *window)
+{
+	struct bench *bench = window->bench;
+	struct bench_feedback *fb = &window->feedback;
+	struct timespec latency;
+
+	bench_feedback_wait(bench->client, fb);
+
+	if (fb->discarded) {
+		bench->discarded++;
+		return;
+	}
+
+	bench->refresh_nsec = fb->refresh_nsec;
+	timespec_sub(&latency, &fb->presented, &window->commit_time);
+	weston_histogram_add(&bench->latency,
+			     timespec_to_nsec(&latency) / 1000);
+
+	/* All windows committed in one iteration normally land in the
+	 * same output frame; count how many it really took. */
+	if (fb->seq != bench->last_seq) {
+		bench->last_seq = fb->seq;
+		bench->output_frames++;
+	}
+}
+
+static void
+bench_frame(struct bench *bench, unsigned frame)
+{
+	int i;
+
+	for (i = 0; i < bench->scenario->windows; i++)
+		bench_window_commit(&bench->windows[i], frame);
+
+	for (i = 0; i < bench->scenario->windows; i++)
+		bench_window_presented(&bench->windows[i]);
+}
+
+static void
+bench_report(struct bench *bench, unsigned frames, double wall_usec,
+	     double client_cpu_usec, double compositor_cpu_usec)
+{
+	const struct bench_scenario *scenario = bench->scenario;
+	const struct bench_surface *surface = &bench->windows[0].surfaces[0];
+	FILE *fp = bench_results_open();
+	char compositor_cpu[32] = "null";
+
+	if (compositor_cpu_usec >= 0)
+		snprintf(compositor_cpu, sizeof compositor_cpu, "%.1f",
+			 compositor_cpu_usec / frames);
+
+	fprintf(fp, "{\"benchmark\":\"%s\",\"windows\":%d,"
+		"\"width\":%d,\"height\":%d,\"subsurfaces\":%d,"
+		"\"damage\":\"%s\",\"alpha\":%s,"
+		"\"frames\":%u,\"output_frames\":%u,\"discarded\":%u,"
+		"\"fps\":%.1f,"
+		"\"compositor_cpu_usec_per_frame\":%s,"
+		"\"client_cpu_usec_per_frame\":%.1f,",
+		scenario->name, scenario->windows,
+		surface->width, surface->height, scenario->subsurfaces,
+		scenario->damage == BENCH_DAMAGE_FULL ? "full" : "small",
+		scenario->alpha ? "true" : "false",
+		frames, bench->output_frames, bench->discarded,
+		frames * 1000000.0 / wall_usec,
+		compositor_cpu,
+		client_cpu_usec / frames);
+	bench_print_histogram(fp, "latency_usec", &bench->latency);
+	fputs("}\n", fp);
+
+	bench_results_close(fp);
+}
+
+TEST_P(compositor_bench, scenarios)
+{
+	struct bench bench = { 0 };
+	struct timespec wall[2], client_cpu[2], compositor_cpu[2];
+	double wall_usec;
+	clockid_t compositor_clock;
+	int have_compositor_clock;
+	unsigned frames = bench_env_count("WESTON_BENCH_FRAMES",
+					  BENCH_DEFAULT_FRAMES);
+	unsigned i;
+	int w;
+
+	bench.scenario = data;
+	bench.client = create_client();
+	bench.presentation = bench_bind_presentation(bench.client,
+						     &bench.clock_id);
+	bench.subcompositor =
+		bench_bind_global(bench.client, "wl_subcompositor",
+				  &wl_subcompositor_interface);
+	weston_histogram_init(&bench.latency);
+	have_compositor_clock =
+		bench_compositor_cpu_clock(bench.client, &compositor_clock) == 0;
+
+	bench.windows = xzalloc(bench.scenario->windows *
+				sizeof bench.windows[0]);
+	for (w = 0; w < bench.scenario->windows; w++)
+		bench_window_init(&bench, &bench.windows[w], w);
+
+	for (i = 0; i < BENCH_WARMUP_FRAMES; i++)
+		bench_frame(&bench, i);
+
+	weston_histogram_init(&bench.latency);
+	bench.output_frames = 0;
+	bench.discarded = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &wall[0]);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &client_cpu[0]);
+	if (have_compositor_clock)
+		clock_gettime(compositor_clock, &compositor_cpu[0]);
+
+	for (i = 0; i < frames; i++)
+		bench_frame(&bench, BENCH_WARMUP_FRAMES + i);
+
+	clock_gettime(CLOCK_MONOTONIC, &wall[1]);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &client_cpu[1]);
+	if (have_compositor_clock)
+		clock_gettime(compositor_clock, &compositor_cpu[1]);
+
+	wall_usec = bench_elapsed_usec(&wall[0], &wall[1]);
+	bench_report(&bench, frames, wall_usec,
+		     bench_elapsed_usec(&client_cpu[0], &client_cpu[1]),
+		     have_compositor_clock ?
+			bench_elapsed_usec(&compositor_cpu[0],
+					   &compositor_cpu[1]) : -1.0);
+
+	assert(bench.discarded == 0);
+	assert(bench.refresh_nsec > 0);
+	assert(wall_usec / frames < bench.refresh_nsec / 1000.0 / 4);
+}
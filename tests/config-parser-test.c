@@ -457,3 +457,48 @@ ZUC_TEST(config_test, section_from_null)
 	section = weston_config_get_section(NULL, "bucket", NULL, NULL);
 	ZUC_ASSERT_NULL(section);
 }
+
+ZUC_BENCH(config_bench, parse)
+{
+	struct weston_config *config = NULL;
+	const char *text = config_test_t1.data;
+	char file[] = "/tmp/weston-config-parser-bench-XXXXXX";
+	int len;
+	int fd;
+
+	fd = mkstemp(file);
+	ZUC_ASSERT_NE(-1, fd);
+	len = write(fd, text, strlen(text));
+	close(fd);
+	ZUC_ASSERTG_EQ((int)strlen(text), len, out);
+
+	ZUC_BENCH_LOOP {
+		config = weston_config_parse(file);
+		weston_config_destroy(config);
+	}
+
+	config = weston_config_parse(file);
+	ZUC_ASSERTG_NOT_NULL(config, out);
+	weston_config_destroy(config);
+
+out:
+	unlink(file);
+}
+
+ZUC_BENCH(config_bench, lookup)
+{
+	struct weston_config *config = load_config(config_test_t1.data);
+	struct weston_config_section *section;
+	int32_t n = 0;
+
+	ZUC_ASSERT_NOT_NULL(config);
+
+	ZUC_BENCH_LOOP {
+		section = weston_config_get_section(config, "bar", NULL, NULL);
+		weston_config_section_get_int(section, "number", &n, 600);
+		ZUC_BENCH_KEEP(&n);
+	}
+
+	weston_config_destroy(config);
+	ZUC_ASSERT_EQ(5252, n);
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "weston-test-client-helper.h"
+#include "weston-stats-client-protocol.h"
+
+char *server_parameters = "--use-pixman --width=320 --height=240 --debug";
+
+#define SURFACE_X 100
+#define SURFACE_Y 100
+#define SURFACE_SIZE 100
+#define SURFACE_COLOR 0xff2050a0
+#define CURSOR_SIZE 16
+#define CURSOR_COLOR 0xff00ff00
+
+struct cursor_repaints {
+	struct weston_output_stats *output_stats;
+	int done;
+	uint32_t count;		/* of the cursor_repaint histogram */
+};
+
+static void
+stats_histogram(void *data, struct weston_output_stats *output_stats,
+		const char *name, uint32_t count, uint32_t min, uint32_t avg,
+		uint32_t p50, uint32_t p99, uint32_t max)
+{
+	struct cursor_repaints *repaints = data;
+
+	if (strcmp(name, "cursor_repaint") == 0)
+		repaints->count = count;
+}
+
+static void
+stats_frames(void *data, struct weston_output_stats *output_stats,
+	     uint32_t presented, uint32_t missed)
+{
+}
+
+static void
+stats_done(void *data, struct weston_output_stats *output_stats)
+{
+	struct cursor_repaints *repaints = data;
+
+	repaints->done = 1;
+}
+
+static void
+stats_repicks(void *data, struct weston_output_stats *output_stats,
+	      uint32_t repicked, uint32_t skipped)
+{
+}
+
+static const struct weston_output_stats_listener stats_listener = {
+	stats_histogram,
+	stats_frames,
+	stats_done,
+	stats_repicks,
+};
+
+static void
+cursor_repaints_init(struct cursor_repaints *repaints, struct client *client)
+{
+	struct weston_stats *stats = NULL;
+	struct global *g;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, "weston_stats") == 0)
+			stats = wl_registry_bind(client->wl_registry, g->name,
+						 &weston_stats_interface, 1);
+	}
+	assert(stats);
+
+	memset(repaints, 0, sizeof *repaints);
+	repaints->output_stats =
+		weston_stats_get_output_stats(stats,
+					      client->output->wl_output);
+	weston_output_stats_add_listener(repaints->output_stats,
+					 &stats_listener, repaints);
+	weston_stats_destroy(stats);
+	client_roundtrip(client);
+}
+
+static void
+cursor_repaints_update(struct cursor_repaints *repaints,
+		       struct client *client)
+{
+	repaints->done = 0;
+	weston_output_stats_update(repaints->output_stats);
+	while (!repaints->done)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+}
+
+/* Waits for the frame that shows the cursor at (x, y). The commit carries
+ * nothing new, so the frame only moves the cursor. */
+static void
+move_cursor(struct client *client, struct surface *cursor, int x, int y)
+{
+	int done;
+
+	weston_test_move_pointer(client->test->weston_test, x, y);
+	while (client->input->pointer->x != x - SURFACE_X ||
+	       client->input->pointer->y != y - SURFACE_Y)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+
+	frame_callback_set(cursor->wl_surface, &done);
+	wl_surface_commit(cursor->wl_surface);
+	frame_callback_wait(client, &done);
+}
+
+static uint32_t
+pixel_at(struct surface *screenshot, int x, int y)
+{
+	uint32_t *pixels = screenshot->data;
+
+	return pixels[y * screenshot->width + x] & 0xffffff;
+}
+
+TEST(cursor_moves_leave_no_trail)
+{
+	static const int path[][2] = {
+		{ 110, 110 }, { 118, 114 }, { 130, 120 }, { 131, 121 },
+		{ 150, 150 }, { 140, 160 }, { 170, 130 },
+	};
+	struct client *client;
+	struct cursor_repaints repaints;
+	struct surface *cursor;
+	struct surface *screenshot;
+	unsigned i;
+	int x, y;
+
+	client = create_client_and_test_surface(SURFACE_X, SURFACE_Y,
+						SURFACE_SIZE, SURFACE_SIZE);
+	cursor_repaints_init(&repaints, client);
+	fill_pixels(client->surface->data, SURFACE_SIZE * SURFACE_SIZE,
+		    SURFACE_COLOR);
+	wl_surface_attach(client->surface->wl_surface,
+			  client->surface->wl_buffer, 0, 0);
+	wl_surface_damage(client->surface->wl_surface, 0, 0,
+			  SURFACE_SIZE, SURFACE_SIZE);
+	wl_surface_commit(client->surface->wl_surface);
+
+	weston_test_move_pointer(client->test->weston_test,
+				 path[0][0], path[0][1]);
+	while (client->input->pointer->focus != client->surface)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+	cursor = set_cursor(client, CURSOR_SIZE, CURSOR_SIZE, CURSOR_COLOR);
+
+	/* The first frame starts tracking the cursor, the later ones only
+	 * move it. */
+	move_cursor(client, cursor, path[0][0], path[0][1]);
+	cursor_repaints_update(&repaints, client);
+	weston_output_stats_reset(repaints.output_stats);
+
+	for (i = 1; i < ARRAY_LENGTH(path); i++)
+		move_cursor(client, cursor, path[i][0], path[i][1]);
+
+	/* The renderer repainted the cursor alone for every move... */
+	cursor_repaints_update(&repaints, client);
+	assert(repaints.count >= ARRAY_LENGTH(path) - 1);
+
+	screenshot = capture_screenshot_of_output(client);
+
+	/* ...the cursor is where the pointer is... */
+	x = path[ARRAY_LENGTH(path) - 1][0];
+	y = path[ARRAY_LENGTH(path) - 1][1];
+	assert(pixel_at(screenshot, x, y) == (CURSOR_COLOR & 0xffffff));
+	assert(pixel_at(screenshot, x + CURSOR_SIZE - 1,
+			y + CURSOR_SIZE - 1) == (CURSOR_COLOR & 0xffffff));
+
+	/* ...and the surface shows again wherever it was before. */
+	for (i = 0; i < ARRAY_LENGTH(path) - 1; i++) {
+		assert(pixel_at(screenshot, path[i][0], path[i][1]) ==
+		       (SURFACE_COLOR & 0xffffff));
+		assert(pixel_at(screenshot, path[i][0] + CURSOR_SIZE - 1,
+				path[i][1]) == (SURFACE_COLOR & 0xffffff));
+	}
+
+	shm_surface_destroy(screenshot);
+	shm_surface_destroy(cursor);
+	weston_output_stats_destroy(repaints.output_stats);
+}
@@ -284,6 +284,42 @@ TEST(test_pointer_surface_move)
 	check_pointer(client, 50, 50);
 }
 
+TEST(test_pointer_input_region_change)
+{
+	struct client *client;
+	struct surface *surface;
+	struct wl_region *region;
+	int done;
+
+	client = create_client_and_test_surface(100, 100, 100, 100);
+	assert(client);
+	surface = client->surface;
+
+	check_pointer_move(client, 150, 150);
+
+	/* shrink the input region away from the pointer, which does not
+	 * move, and check that the surface loses the focus */
+	region = wl_compositor_create_region(client->wl_compositor);
+	wl_region_add(region, 0, 0, 10, 10);
+	wl_surface_set_input_region(surface->wl_surface, region);
+	wl_region_destroy(region);
+	wl_surface_damage(surface->wl_surface, 0, 0, 1, 1);
+	frame_callback_set(surface->wl_surface, &done);
+	wl_surface_commit(surface->wl_surface);
+	frame_callback_wait(client, &done);
+
+	assert(client->input->pointer->focus == NULL);
+
+	/* and back */
+	wl_surface_set_input_region(surface->wl_surface, NULL);
+	wl_surface_damage(surface->wl_surface, 0, 0, 1, 1);
+	frame_callback_set(surface->wl_surface, &done);
+	wl_surface_commit(surface->wl_surface);
+	frame_callback_wait(client, &done);
+
+	check_pointer(client, 150, 150);
+}
+
 static int
 output_contains_client(struct client *client)
 {
@@ -0,0 +1,98 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+
+#include "shared/histogram.h"
+#include "zunitc/zunitc.h"
+
+ZUC_TEST(histogram_test, empty)
+{
+	struct weston_histogram h;
+
+	weston_histogram_init(&h);
+
+	ZUC_ASSERT_EQ(0, h.count);
+	ZUC_ASSERT_EQ(0, weston_histogram_mean(&h));
+	ZUC_ASSERT_EQ(0, weston_histogram_percentile(&h, 50));
+	ZUC_ASSERT_EQ(0, weston_histogram_percentile(&h, 99));
+}
+
+ZUC_TEST(histogram_test, small_values_exact)
+{
+	struct weston_histogram h;
+	uint32_t i;
+
+	weston_histogram_init(&h);
+	for (i = 0; i < 10; i++)
+		weston_histogram_add(&h, i);
+
+	ZUC_ASSERT_EQ(10, h.count);
+	ZUC_ASSERT_EQ(0, h.min);
+	ZUC_ASSERT_EQ(9, h.max);
+	ZUC_ASSERT_EQ(4, weston_histogram_mean(&h));
+	ZUC_ASSERT_EQ(4, weston_histogram_percentile(&h, 50));
+	ZUC_ASSERT_EQ(9, weston_histogram_percentile(&h, 99));
+	ZUC_ASSERT_EQ(0, weston_histogram_percentile(&h, 0));
+}
+
+ZUC_TEST(histogram_test, percentile_error_bound)
+{
+	struct weston_histogram h;
+	uint32_t i, p50, p99;
+
+	weston_histogram_init(&h);
+	for (i = 1; i <= 1000; i++)
+		weston_histogram_add(&h, i * 100);
+
+	ZUC_ASSERT_EQ(100, h.min);
+	ZUC_ASSERT_EQ(100000, h.max);
+	ZUC_ASSERT_EQ(50050, weston_histogram_mean(&h));
+
+	/* Buckets are 1/8 of a power of two wide. */
+	p50 = weston_histogram_percentile(&h, 50);
+	ZUC_ASSERT_GE(p50, 50000);
+	ZUC_ASSERT_LE(p50, 50000 + 50000 / 8);
+
+	p99 = weston_histogram_percentile(&h, 99);
+	ZUC_ASSERT_GE(p99, 99000);
+	ZUC_ASSERT_LE(p99, 100000);
+}
+
+ZUC_TEST(histogram_test, extremes)
+{
+	struct weston_histogram h;
+
+	weston_histogram_init(&h);
+	weston_histogram_add(&h, 15);
+	weston_histogram_add(&h, UINT32_MAX);
+
+	ZUC_ASSERT_EQ(15, h.min);
+	ZUC_ASSERT_EQ(UINT32_MAX, h.max);
+	ZUC_ASSERT_EQ(15, weston_histogram_percentile(&h, 50));
+	ZUC_ASSERT_EQ(UINT32_MAX, weston_histogram_percentile(&h, 100));
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Input-to-photon latency.
+ *
+ * The client injects an input event through weston-test, waits for the
+ * compositor to deliver it back, paints a response into its surface and
+ * waits for the presentation feedback of that commit. The injection is
+ * timestamped on the presentation clock just before the request is sent,
+ * so the latencies below are measured against the same clock as the
+ * presented timestamps:
+ *
+ *   input_to_client:  injection until the event is received
+ *   input_to_present: injection until the response is presented
+ *
+ * In the cursor scenario the client sets a cursor and does not paint
+ * anything in response to the motion, so the frames only move the
+ * cursor. input-latency-full-repaint-bench runs the same scenarios with
+ * cursor-only-repaint turned off, for comparison.
+ *
+ * The headless output keeps its normal refresh rate, so input_to_present
+ * includes waiting for the next repaint. Results are appended as one JSON
+ * object per input type to the file named by WESTON_BENCH_RESULTS, or to
+ * stdout when that is not set. WESTON_BENCH_EVENTS overrides the number of
+ * measured events per input type.
+ *
+ * These are not part of 'make check'; run them with 'make bench'.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include <linux/input.h>
+
+#include "bench-helper.h"
+
+char *server_parameters = "--use-pixman";
+
+#define LATENCY_DEFAULT_EVENTS 100
+#define LATENCY_WARMUP_EVENTS 4
+
+#define SURFACE_X 10
+#define SURFACE_Y 10
+#define SURFACE_SIZE 100
+#define CURSOR_SIZE 16
+
+#ifdef LATENCY_FULL_REPAINT
+#define LATENCY_CONFIG "full-repaint"
+#else
+#define LATENCY_CONFIG "default"
+#endif
+
+enum latency_input {
+	LATENCY_INPUT_KEY,
+	LATENCY_INPUT_BUTTON,
+	LATENCY_INPUT_MOTION,
+	LATENCY_INPUT_CURSOR,
+};
+
+struct latency_scenario {
+	const char *name;
+	enum latency_input input;
+};
+
+static const struct latency_scenario scenarios[] = {
+	{ "key",    LATENCY_INPUT_KEY },
+	{ "button", LATENCY_INPUT_BUTTON },
+	{ "motion", LATENCY_INPUT_MOTION },
+	{ "cursor", LATENCY_INPUT_CURSOR },
+};
+
+struct latency {
+	const struct latency_scenario *scenario;
+	struct client *client;
+	struct presentation *presentation;
+	clockid_t clock_id;
+	struct surface *cursor;
+
+	struct bench_feedback feedback;
+	uint32_t refresh_nsec;
+
+	unsigned discarded;
+	struct weston_histogram to_client;
+	struct weston_histogram to_present;
+};
+
+/* Even events press or move right, odd events release or move back. */
+static void
+inject_input(struct latency *lat, unsigned event)
+{
+	struct weston_test *test = lat->client->test->weston_test;
+	uint32_t state = (event & 1) ? WL_KEYBOARD_KEY_STATE_RELEASED :
+				       WL_KEYBOARD_KEY_STATE_PRESSED;
+
+	switch (lat->scenario->input) {
+	case LATENCY_INPUT_KEY:
+		weston_test_send_key(test, KEY_A, state);
+		break;
+	case LATENCY_INPUT_BUTTON:
+		weston_test_send_button(test, BTN_LEFT, state);
+		break;
+	case LATENCY_INPUT_MOTION:
+	case LATENCY_INPUT_CURSOR:
+		weston_test_move_pointer(test,
+					 SURFACE_X + 40 + (event & 1) * 20,
+					 SURFACE_Y + 50);
+		break;
+	}
+}
+
+static int
+input_received(struct latency *lat, unsigned event)
+{
+	struct input *input = lat->client->input;
+	uint32_t state = (event & 1) ? WL_KEYBOARD_KEY_STATE_RELEASED :
+				       WL_KEYBOARD_KEY_STATE_PRESSED;
+
+	switch (lat->scenario->input) {
+	case LATENCY_INPUT_KEY:
+		return input->keyboard->key == KEY_A &&
+		       input->keyboard->state == state;
+	case LATENCY_INPUT_BUTTON:
+		return input->pointer->button == BTN_LEFT &&
+		       input->pointer->state == state;
+	case LATENCY_INPUT_MOTION:
+	case LATENCY_INPUT_CURSOR:
+		return input->pointer->x == 40 + (int)(event & 1) * 20;
+	}
+
+	return 0;
+}
+
+static void
+commit_with_feedback(struct latency *lat, struct wl_surface *wl_surface)
+{
+	bench_feedback_request(&lat->feedback, lat->presentation, wl_surface);
+	wl_surface_commit(wl_surface);
+}
+
+/* The response to an event is a full repaint in a colour derived from it,
+ * with feedback requested for the commit that carries it. A cursor
+ * motion gets no response, only feedback for the frame moving the cursor,
+ * through an empty commit of the cursor surface. */
+static void
+draw_response(struct latency *lat, unsigned event)
+{
+	struct surface *surface = lat->client->surface;
+	uint32_t *pixels = surface->data;
+	uint32_t color = 0xff000000 | ((event * 0x030507) & 0xffffff);
+	int i;
+
+	if (lat->scenario->input == LATENCY_INPUT_CURSOR) {
+		commit_with_feedback(lat, lat->cursor->wl_surface);
+		return;
+	}
+
+	for (i = 0; i < surface->width * surface->height; i++)
+		pixels[i] = color;
+
+	wl_surface_attach(surface->wl_surface, surface->wl_buffer, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, 0,
+			  surface->width, surface->height);
+
+	commit_with_feedback(lat, surface->wl_surface);
+}
+
+static void
+measure_event(struct latency *lat, unsigned event)
+{
+	struct wl_display *display = lat->client->wl_display;
+	struct timespec injected, received;
+
+	clock_gettime(lat->clock_id, &injected);
+	inject_input(lat, event);
+
+	while (!input_received(lat, event))
+		assert(wl_display_dispatch(display) >= 0);
+
+	clock_gettime(lat->clock_id, &received);
+	draw_response(lat, event);
+	bench_feedback_wait(lat->client, &lat->feedback);
+
+	if (lat->feedback.discarded) {
+		lat->discarded++;
+		return;
+	}
+
+	lat->refresh_nsec = lat->feedback.refresh_nsec;
+	weston_histogram_add(&lat->to_client,
+			     bench_elapsed_usec(&injected, &received));
+	weston_histogram_add(&lat->to_present,
+			     bench_elapsed_usec(&injected,
+						&lat->feedback.presented));
+}
+
+static void
+focus_surface(struct latency *lat)
+{
+	struct client *client = lat->client;
+	struct input *input = client->input;
+
+	if (lat->scenario->input == LATENCY_INPUT_KEY) {
+		weston_test_activate_surface(client->test->weston_test,
+					     client->surface->wl_surface);
+		while (input->keyboard->focus != client->surface)
+			assert(wl_display_dispatch(client->wl_display) >= 0);
+	} else {
+		weston_test_move_pointer(client->test->weston_test,
+					 SURFACE_X + 50, SURFACE_Y + 50);
+		while (input->pointer->focus != client->surface)
+			assert(wl_display_dispatch(client->wl_display) >= 0);
+	}
+
+	if (lat->scenario->input == LATENCY_INPUT_CURSOR) {
+		lat->cursor = set_cursor(client, CURSOR_SIZE, CURSOR_SIZE,
+					 0x80ffffff);
+		client_roundtrip(client);
+	}
+}
+
+static void
+latency_report(struct latency *lat, unsigned events)
+{
+	FILE *fp = bench_results_open();
+
+	fprintf(fp, "{\"benchmark\":\"input-latency\",\"config\":\"%s\","
+		"\"input\":\"%s\",\"events\":%u,\"discarded\":%u,"
+		"\"refresh_nsec\":%u,",
+		LATENCY_CONFIG, lat->scenario->name, events, lat->discarded,
+		lat->refresh_nsec);
+	bench_print_histogram(fp, "input_to_client_usec", &lat->to_client);
+	fputc(',', fp);
+	bench_print_histogram(fp, "input_to_present_usec", &lat->to_present);
+	fputs("}\n", fp);
+
+	bench_results_close(fp);
+}
+
+TEST_P(input_latency, scenarios)
+{
+	struct latency lat = { 0 };
+	unsigned events = bench_env_count("WESTON_BENCH_EVENTS",
+					  LATENCY_DEFAULT_EVENTS);
+	unsigned i;
+
+	lat.scenario = data;
+	lat.client = create_client_and_test_surface(SURFACE_X, SURFACE_Y,
+						     SURFACE_SIZE,
+						     SURFACE_SIZE);
+	lat.presentation = bench_bind_presentation(lat.client, &lat.clock_id);
+	weston_histogram_init(&lat.to_client);
+	weston_histogram_init(&lat.to_present);
+
+	focus_surface(&lat);
+
+	for (i = 0; i < LATENCY_WARMUP_EVENTS; i++)
+		measure_event(&lat, i);
+
+	weston_histogram_init(&lat.to_client);
+	weston_histogram_init(&lat.to_present);
+	lat.discarded = 0;
+
+	/* Keep the press/release and left/right alternation going. */
+	for (i = 0; i < events; i++)
+		measure_event(&lat, LATENCY_WARMUP_EVENTS + i);
+
+	latency_report(&lat, events);
+	if (lat.cursor)
+		shm_surface_destroy(lat.cursor);
+
+	assert(lat.discarded == 0);
+	assert(lat.to_present.count == events);
+	assert(weston_histogram_percentile(&lat.to_client, 50) <=
+	       weston_histogram_percentile(&lat.to_present, 50));
+}
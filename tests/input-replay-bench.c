@@ -0,0 +1,264 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Input path cost, replayed from a recording.
+ *
+ * The client records a synthetic session of pointer, keyboard and touch
+ * input on the test seat, or uses the recording named by
+ * WESTON_BENCH_INPUT_RECORDING, and has the compositor replay it through
+ * the headless backend, once at the recorded pace and once as fast as
+ * possible. For every replayed event the compositor reports how long it
+ * took to process, and the client measures the delivery latency from the
+ * moment the event was fed to the seat until the first wl_pointer,
+ * wl_keyboard or wl_touch event it caused reached the client, both on
+ * CLOCK_MONOTONIC:
+ *
+ *   processing: notify_*() call of one recorded event
+ *   delivery:   injection until the client received the first event it
+ *               caused, for the recorded events that cause one
+ *
+ * Results are appended as one JSON object per replay speed to the file
+ * named by WESTON_BENCH_RESULTS, or to stdout when that is not set.
+ *
+ * These are not part of 'make check'; run them with 'make bench'.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+#include "shared/timespec-util.h"
+#include "bench-helper.h"
+
+#define SURFACE_X 10
+#define SURFACE_Y 10
+#define SURFACE_SIZE 200
+
+/* Steps of the synthetic session, one every SESSION_STEP_USEC */
+#define SESSION_STEPS 400
+#define SESSION_STEP_USEC 2000
+
+struct replay_speed {
+	const char *name;
+	enum weston_test_replay_speed speed;
+};
+
+static const struct replay_speed speeds[] = {
+	{ "original", WESTON_TEST_REPLAY_SPEED_ORIGINAL },
+	{ "maximum",  WESTON_TEST_REPLAY_SPEED_MAXIMUM },
+};
+
+/* Cycles through pointer motion and clicks, key presses and a two finger
+ * touch gesture, leaving no button, key or touch point down at the end of
+ * a cycle. */
+static void
+session_step(struct client *client, int step)
+{
+	struct weston_test *test = client->test->weston_test;
+	int x = SURFACE_X + 20 + step % 160;
+
+	switch (step % 16) {
+	case 0:
+	case 1:
+	case 2:
+	case 4:
+	case 6:
+		weston_test_move_pointer(test, x, SURFACE_Y + 50);
+		break;
+	case 3:
+		weston_test_send_button(test, BTN_LEFT,
+					WL_POINTER_BUTTON_STATE_PRESSED);
+		break;
+	case 5:
+		weston_test_send_button(test, BTN_LEFT,
+					WL_POINTER_BUTTON_STATE_RELEASED);
+		break;
+	case 7:
+		weston_test_send_key(test, KEY_A,
+				     WL_KEYBOARD_KEY_STATE_PRESSED);
+		break;
+	case 8:
+		weston_test_send_key(test, KEY_A,
+				     WL_KEYBOARD_KEY_STATE_RELEASED);
+		break;
+	case 9:
+		send_touch(client, 0, x, SURFACE_Y + 100, TOUCH_DOWN);
+		send_touch(client, 1, x, SURFACE_Y + 120, TOUCH_DOWN);
+		weston_test_send_touch_frame(test);
+		break;
+	case 10:
+	case 11:
+	case 12:
+	case 13:
+	case 14:
+		send_touch(client, 0, x, SURFACE_Y + 100 - step % 16,
+			   TOUCH_MOTION);
+		send_touch(client, 1, x, SURFACE_Y + 120 + step % 16,
+			   TOUCH_MOTION);
+		weston_test_send_touch_frame(test);
+		break;
+	case 15:
+		send_touch(client, 0, 0, 0, TOUCH_UP);
+		send_touch(client, 1, 0, 0, TOUCH_UP);
+		weston_test_send_touch_frame(test);
+		break;
+	}
+}
+
+static void
+record_session(struct client *client, const char *path)
+{
+	struct weston_test *test = client->test->weston_test;
+	int step;
+
+	weston_test_start_input_recording(test, path);
+
+	for (step = 0; step < SESSION_STEPS; step++) {
+		session_step(client, step);
+		assert(wl_display_flush(client->wl_display) >= 0);
+		usleep(SESSION_STEP_USEC);
+	}
+
+	weston_test_stop_input_recording(test);
+	client_roundtrip(client);
+}
+
+static int
+received_before(struct recorded_event *ev, struct replayed_input *replayed)
+{
+	struct timespec d;
+
+	timespec_sub(&d, &replayed->received, &ev->time);
+
+	return timespec_to_nsec(&d) >= 0;
+}
+
+/* The events a replayed event caused are sent before its input_replayed
+ * event, so they are the ones recorded since the previous one. */
+static void
+replay_report(const struct replay_speed *speed, struct test *test,
+	      struct recorder *recorder, uint32_t duration_usec)
+{
+	struct weston_histogram processing, delivery;
+	struct replayed_input *replayed;
+	int n = 0, count = recorded_count(recorder);
+	FILE *fp;
+
+	weston_histogram_init(&processing);
+	weston_histogram_init(&delivery);
+	wl_array_for_each(replayed, &test->replayed) {
+		weston_histogram_add(&processing, replayed->processing_nsec);
+
+		if (n < count &&
+		    received_before(recorded(recorder, n), replayed))
+			weston_histogram_add(&delivery,
+				bench_elapsed_usec(&replayed->injected,
+						   &recorded(recorder, n)->time));
+
+		while (n < count &&
+		       received_before(recorded(recorder, n), replayed))
+			n++;
+	}
+
+	fp = bench_results_open();
+
+	fprintf(fp, "{\"benchmark\":\"input-replay\",\"speed\":\"%s\","
+		"\"events\":%u,\"delivered\":%u,\"duration_usec\":%u,",
+		speed->name, test->replay_count, (unsigned) delivery.count,
+		duration_usec);
+	bench_print_histogram(fp, "processing_nsec", &processing);
+	fputc(',', fp);
+	bench_print_histogram(fp, "delivery_usec", &delivery);
+	fputs("}\n", fp);
+
+	bench_results_close(fp);
+}
+
+static void
+replay(struct client *client, struct recorder *recorder, const char *path,
+       const struct replay_speed *speed)
+{
+	struct test *test = client->test;
+	struct timespec begin, end;
+
+	test->replayed.size = 0;
+	test->replay_done = 0;
+	recorder->events.size = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	weston_test_replay_input(test->weston_test, path, speed->speed);
+	while (!test->replay_done)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	assert(test->replay_count > 0);
+	assert(test->replayed.size ==
+	       test->replay_count * sizeof(struct replayed_input));
+
+	replay_report(speed, test, recorder,
+		      bench_elapsed_usec(&begin, &end));
+}
+
+TEST(input_replay)
+{
+	const char *recording = getenv("WESTON_BENCH_INPUT_RECORDING");
+	const char *builddir = getenv("abs_builddir");
+	struct client *client;
+	struct recorder recorder;
+	char *path = NULL;
+	unsigned i;
+
+	client = create_client_and_test_surface(SURFACE_X, SURFACE_Y,
+						SURFACE_SIZE, SURFACE_SIZE);
+	assert(client);
+
+	/* Both the pointer and the keyboard go to the surface. */
+	weston_test_activate_surface(client->test->weston_test,
+				     client->surface->wl_surface);
+	weston_test_move_pointer(client->test->weston_test,
+				 SURFACE_X + 20, SURFACE_Y + 50);
+	client_roundtrip(client);
+
+	if (!recording) {
+		assert(asprintf(&path, "%s/logs/input-replay-bench.wir",
+				builddir ? builddir : ".") > 0);
+		record_session(client, path);
+		recording = path;
+	}
+
+	recorder_init(&recorder, client);
+	for (i = 0; i < ARRAY_LENGTH(speeds); i++)
+		replay(client, &recorder, recording, &speeds[i]);
+	recorder_release(&recorder);
+
+	free(path);
+}
@@ -129,67 +129,6 @@ load_surface_from_png(const char *fname)
 	return reference;
 }
 
-/** create_screenshot_surface()
- *
- *  Allocates and initializes a weston test surface for use in
- *  storing a screenshot of the client's output.  Establishes a
- *  shm backed wl_buffer for retrieving screenshot image data
- *  from the server, sized to match the client's output display.
- *
- *  @returns stack allocated surface image, which should be
- *  free'd when done using it.
- */
-static struct surface*
-create_screenshot_surface(struct client *client)
-{
-	struct surface* screenshot;
-	screenshot = xzalloc(sizeof *screenshot);
-	if (screenshot == NULL)
-		return NULL;
-	screenshot->wl_buffer = create_shm_buffer(client,
-						  client->output->width,
-						  client->output->height,
-						  &screenshot->data);
-	screenshot->height = client->output->height;
-	screenshot->width = client->output->width;
-
-	return screenshot;
-}
-
-/** capture_screenshot_of_output()
- *
- * Requests a screenshot from the server of the output that the
- * client appears on.  The image data returned from the server
- * can be accessed from the screenshot surface's data member.
- *
- * @returns a new surface object, which should be free'd when no
- * longer needed.
- */
-static struct surface *
-capture_screenshot_of_output(struct client *client)
-{
-	struct surface *screenshot;
-
-	/* Create a surface to hold the screenshot */
-	screenshot = create_screenshot_surface(client);
-
-	client->test->buffer_copy_done = 0;
-	weston_test_capture_screenshot(client->test->weston_test,
-				       client->output->wl_output,
-				       screenshot->wl_buffer);
-	while (client->test->buffer_copy_done == 0)
-		if (wl_display_dispatch(client->wl_display) < 0)
-			break;
-
-	/* FIXME: Document somewhere the orientation the screenshot is taken
-	 * and how the clip coords are interpreted, in case of scaling/transform.
-	 * If we're using read_pixels() just make sure it is documented somewhere.
-	 * Protocol docs in the XML, comparison function docs in Doxygen style.
-	 */
-
-	return screenshot;
-}
-
 static void
 draw_stuff(void *pixels, int w, int h)
 {
@@ -280,7 +219,7 @@ TEST(internal_screenshot)
 		write_surface_as_png(screenshot, fname);
 	}
 
-	free(screenshot);
+	shm_surface_destroy(screenshot);
 
 	printf("Test complete\n");
 	assert(match);
@@ -0,0 +1,218 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+#include <pixman.h>
+
+#include "shared/helpers.h"
+#include "shared/matrix.h"
+#include "src/vertex-clipping.h"
+#include "zunitc/zunitc.h"
+
+/*
+ * Microbenchmarks for code on the repaint path. Run them with
+ * --zuc-bench; without it each one runs once as a plain test.
+ */
+
+static void
+rotated_matrix(struct weston_matrix *m)
+{
+	weston_matrix_init(m);
+	weston_matrix_translate(m, -320.0f, -240.0f, 0.0f);
+	weston_matrix_rotate_xy(m, cosf(0.3f), sinf(0.3f));
+	weston_matrix_scale(m, 1.5f, 1.5f, 1.0f);
+	weston_matrix_translate(m, 400.0f, 300.0f, 0.0f);
+}
+
+ZUC_BENCH(matrix_bench, multiply)
+{
+	struct weston_matrix m, n;
+
+	rotated_matrix(&n);
+
+	ZUC_BENCH_LOOP {
+		weston_matrix_init(&m);
+		weston_matrix_multiply(&m, &n);
+		ZUC_BENCH_KEEP(&m);
+	}
+
+	ZUC_ASSERT_EQ(0, memcmp(m.d, n.d, sizeof m.d));
+}
+
+ZUC_BENCH(matrix_bench, transform)
+{
+	struct weston_matrix m;
+	struct weston_vector v;
+
+	rotated_matrix(&m);
+
+	ZUC_BENCH_LOOP {
+		v.f[0] = 100.0f;
+		v.f[1] = 200.0f;
+		v.f[2] = 0.0f;
+		v.f[3] = 1.0f;
+		weston_matrix_transform(&m, &v);
+		ZUC_BENCH_KEEP(&v);
+	}
+
+	ZUC_ASSERT_EQ(1, (int)v.f[3]);
+}
+
+ZUC_BENCH(matrix_bench, invert)
+{
+	struct weston_matrix m, inverse;
+	int ret = 0;
+
+	rotated_matrix(&m);
+
+	ZUC_BENCH_LOOP {
+		ret |= weston_matrix_invert(&inverse, &m);
+		ZUC_BENCH_KEEP(&inverse);
+	}
+
+	ZUC_ASSERT_EQ(0, ret);
+}
+
+static void
+clip_context_init(struct clip_context *ctx)
+{
+	ctx->clip.x1 = 50.0f;
+	ctx->clip.y1 = 50.0f;
+	ctx->clip.x2 = 250.0f;
+	ctx->clip.y2 = 200.0f;
+}
+
+ZUC_BENCH(vertex_clip_bench, simple)
+{
+	struct clip_context ctx;
+	struct polygon8 quad = {
+		{ 0.0f, 150.0f, 150.0f, 0.0f },
+		{ 0.0f, 0.0f, 120.0f, 120.0f },
+		4
+	};
+	float x[8], y[8];
+	int n = 0;
+
+	ZUC_BENCH_LOOP {
+		clip_context_init(&ctx);
+		n = clip_simple(&ctx, &quad, x, y);
+		ZUC_BENCH_KEEP(x);
+		ZUC_BENCH_KEEP(y);
+	}
+
+	ZUC_ASSERT_EQ(4, n);
+}
+
+ZUC_BENCH(vertex_clip_bench, transformed)
+{
+	struct clip_context ctx;
+	/* a rotated square crossing all four clip edges */
+	struct polygon8 quad = {
+		{ 150.0f, 300.0f, 150.0f, 0.0f },
+		{ 0.0f, 125.0f, 250.0f, 125.0f },
+		4
+	};
+	float x[8], y[8];
+	int n = 0;
+
+	ZUC_BENCH_LOOP {
+		clip_context_init(&ctx);
+		n = clip_transformed(&ctx, &quad, x, y);
+		ZUC_BENCH_KEEP(x);
+		ZUC_BENCH_KEEP(y);
+	}
+
+	ZUC_ASSERT_EQ(8, n);
+}
+
+/* A staircase of overlapping rectangles, like the damage of a few
+ * windows moving diagonally. */
+static void
+staircase_region(pixman_region32_t *region, int count, int offset)
+{
+	int i;
+
+	pixman_region32_init(region);
+	for (i = 0; i < count; i++)
+		pixman_region32_union_rect(region, region,
+					   offset + i * 13, i * 11, 64, 48);
+}
+
+ZUC_BENCH(region_bench, union_rects)
+{
+	pixman_region32_t region;
+	int n = 0;
+
+	ZUC_BENCH_LOOP {
+		staircase_region(&region, 32, 0);
+		n = pixman_region32_n_rects(&region);
+		pixman_region32_fini(&region);
+	}
+
+	ZUC_ASSERT_GT(n, 1);
+}
+
+ZUC_BENCH(region_bench, intersect)
+{
+	pixman_region32_t a, b, result;
+	int n = 0;
+
+	staircase_region(&a, 32, 0);
+	staircase_region(&b, 32, 40);
+	pixman_region32_init(&result);
+
+	ZUC_BENCH_LOOP {
+		pixman_region32_intersect(&result, &a, &b);
+		n = pixman_region32_n_rects(&result);
+	}
+
+	pixman_region32_fini(&result);
+	pixman_region32_fini(&b);
+	pixman_region32_fini(&a);
+	ZUC_ASSERT_GT(n, 1);
+}
+
+ZUC_BENCH(region_bench, subtract)
+{
+	pixman_region32_t a, b, result;
+	int n = 0;
+
+	staircase_region(&a, 32, 0);
+	staircase_region(&b, 32, 40);
+	pixman_region32_init(&result);
+
+	ZUC_BENCH_LOOP {
+		pixman_region32_subtract(&result, &a, &b);
+		n = pixman_region32_n_rects(&result);
+	}
+
+	pixman_region32_fini(&result);
+	pixman_region32_fini(&b);
+	pixman_region32_fini(&a);
+	ZUC_ASSERT_GT(n, 1);
+}
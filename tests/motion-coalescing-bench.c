@@ -0,0 +1,179 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * CPU cost of a burst of pointer motion.
+ *
+ * The client sends bursts of weston_test.move_pointer requests over its
+ * test surface and waits for a frame after each burst, so that held back
+ * motion is delivered. It counts the wl_pointer.motion events it gets and
+ * measures the CPU time both processes spent on the bursts:
+ *
+ *   client_cpu:     getrusage() of the client, dispatching the events
+ *   compositor_cpu: CPU-time clock of the compositor, running the grabs,
+ *                   picking and sending the events
+ *
+ * motion-coalescing-bench runs with motion-coalescing turned on, see its
+ * .ini, and motion-uncoalesced-bench runs the same bursts without it, for
+ * comparison. Results are appended as one JSON object to the file named
+ * by WESTON_BENCH_RESULTS, or to stdout when that is not set.
+ * WESTON_BENCH_FRAMES overrides the number of measured bursts.
+ *
+ * These are not part of 'make check'; run them with 'make bench'.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "bench-helper.h"
+
+#define MOTION_DEFAULT_BURSTS 200
+#define MOTION_WARMUP_BURSTS 4
+#define MOTION_BURST 32
+
+#define SURFACE_X 10
+#define SURFACE_Y 10
+#define SURFACE_SIZE 200
+
+#ifdef MOTION_UNCOALESCED
+#define MOTION_CONFIG "uncoalesced"
+#else
+#define MOTION_CONFIG "coalesced"
+#endif
+
+static void
+wait_frame(struct client *client)
+{
+	struct surface *surface = client->surface;
+	int done;
+
+	frame_callback_set(surface->wl_surface, &done);
+	wl_surface_attach(surface->wl_surface, surface->wl_buffer, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, 0, 1, 1);
+	wl_surface_commit(surface->wl_surface);
+	frame_callback_wait(client, &done);
+}
+
+/* Moves along a diagonal and back, staying on the surface. */
+static void
+motion_burst(struct client *client, unsigned burst)
+{
+	struct weston_test *test = client->test->weston_test;
+	int i, d;
+
+	for (i = 0; i < MOTION_BURST; i++) {
+		d = (burst & 1) ? MOTION_BURST - i : 20 + i;
+		weston_test_move_pointer(test, SURFACE_X + d, SURFACE_Y + d);
+	}
+
+	wait_frame(client);
+}
+
+static double
+rusage_usec(void)
+{
+	struct rusage usage;
+
+	assert(getrusage(RUSAGE_SELF, &usage) == 0);
+
+	return usage.ru_utime.tv_sec * 1000000.0 + usage.ru_utime.tv_usec +
+	       usage.ru_stime.tv_sec * 1000000.0 + usage.ru_stime.tv_usec;
+}
+
+TEST(motion_burst)
+{
+	struct client *client;
+	struct recorder recorder;
+	struct timespec wall[2], compositor_cpu[2];
+	clockid_t compositor_clock;
+	int have_compositor_clock;
+	unsigned bursts = bench_env_count("WESTON_BENCH_FRAMES",
+					  MOTION_DEFAULT_BURSTS);
+	unsigned motions;
+	double client_cpu[2];
+	char compositor_cpu_usec[32] = "null";
+	unsigned i;
+	FILE *fp;
+
+	client = create_client_and_test_surface(SURFACE_X, SURFACE_Y,
+						SURFACE_SIZE, SURFACE_SIZE);
+	assert(client);
+	have_compositor_clock =
+		bench_compositor_cpu_clock(client, &compositor_clock) == 0;
+
+	weston_test_move_pointer(client->test->weston_test,
+				 SURFACE_X + 5, SURFACE_Y + 5);
+	wait_frame(client);
+	assert(client->input->pointer->focus == client->surface);
+
+	recorder_init(&recorder, client);
+
+	for (i = 0; i < MOTION_WARMUP_BURSTS; i++)
+		motion_burst(client, i);
+	recorder.events.size = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &wall[0]);
+	client_cpu[0] = rusage_usec();
+	if (have_compositor_clock)
+		clock_gettime(compositor_clock, &compositor_cpu[0]);
+
+	for (i = 0; i < bursts; i++)
+		motion_burst(client, MOTION_WARMUP_BURSTS + i);
+
+	clock_gettime(CLOCK_MONOTONIC, &wall[1]);
+	client_cpu[1] = rusage_usec();
+	if (have_compositor_clock)
+		clock_gettime(compositor_clock, &compositor_cpu[1]);
+
+	motions = recorded_count(&recorder);
+	recorder_release(&recorder);
+
+	if (have_compositor_clock)
+		snprintf(compositor_cpu_usec, sizeof compositor_cpu_usec,
+			 "%.1f", bench_elapsed_usec(&compositor_cpu[0],
+						    &compositor_cpu[1]) /
+			 bursts);
+
+	fp = bench_results_open();
+	fprintf(fp, "{\"benchmark\":\"motion-burst\",\"config\":\"%s\","
+		"\"bursts\":%u,\"burst_size\":%d,\"motion_events\":%u,"
+		"\"wall_usec_per_burst\":%.1f,"
+		"\"compositor_cpu_usec_per_burst\":%s,"
+		"\"client_cpu_usec_per_burst\":%.1f}\n",
+		MOTION_CONFIG, bursts, MOTION_BURST, motions,
+		bench_elapsed_usec(&wall[0], &wall[1]) / bursts,
+		compositor_cpu_usec,
+		(client_cpu[1] - client_cpu[0]) / bursts);
+	bench_results_close(fp);
+
+	assert(motions >= bursts);
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Runs with motion-coalescing=true, see motion-coalescing.ini.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <linux/input.h>
+
+#include "weston-test-client-helper.h"
+
+#define SURFACE_X 10
+#define SURFACE_Y 10
+
+static void
+wait_frame(struct client *client)
+{
+	struct surface *surface = client->surface;
+	int done;
+
+	frame_callback_set(surface->wl_surface, &done);
+	wl_surface_attach(surface->wl_surface, surface->wl_buffer, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, 0,
+			  surface->width, surface->height);
+	wl_surface_commit(surface->wl_surface);
+	frame_callback_wait(client, &done);
+}
+
+/* Puts the pointer over a new test surface and starts recording. */
+static struct client *
+setup(struct recorder *recorder)
+{
+	struct client *client;
+
+	client = create_client_and_test_surface(SURFACE_X, SURFACE_Y,
+						100, 100);
+	assert(client);
+
+	weston_test_move_pointer(client->test->weston_test,
+				 SURFACE_X + 5, SURFACE_Y + 5);
+	wait_frame(client);
+	assert(client->input->pointer->focus == client->surface);
+
+	recorder_init(recorder, client);
+
+	return client;
+}
+
+TEST(motion_coalesced_per_frame)
+{
+	struct recorder recorder;
+	struct client *client = setup(&recorder);
+	const int injected = 32;
+	int i;
+
+	for (i = 0; i < injected; i++)
+		weston_test_move_pointer(client->test->weston_test,
+					 SURFACE_X + 20 + i,
+					 SURFACE_Y + 30 + i);
+	wait_frame(client);
+
+	fprintf(stderr, "injected %d motion events, received %d\n",
+		injected, recorded_count(&recorder));
+
+	/* All requests are read in one go, before the next repaint. */
+	assert(recorded_count(&recorder) == 1);
+	assert_recorded(recorded(&recorder, 0), RECORDED_POINTER_MOTION, -1,
+			20 + injected - 1, 30 + injected - 1);
+
+	recorder_release(&recorder);
+}
+
+TEST(buttons_keep_their_order)
+{
+	struct recorder recorder;
+	struct client *client = setup(&recorder);
+	struct weston_test *test = client->test->weston_test;
+
+	weston_test_move_pointer(test, SURFACE_X + 30, SURFACE_Y + 30);
+	weston_test_move_pointer(test, SURFACE_X + 40, SURFACE_Y + 40);
+	weston_test_send_button(test, BTN_LEFT,
+				WL_POINTER_BUTTON_STATE_PRESSED);
+	weston_test_move_pointer(test, SURFACE_X + 45, SURFACE_Y + 45);
+	weston_test_move_pointer(test, SURFACE_X + 50, SURFACE_Y + 50);
+	weston_test_send_button(test, BTN_LEFT,
+				WL_POINTER_BUTTON_STATE_RELEASED);
+	wait_frame(client);
+
+	/* Motion before a button is delivered right before it. */
+	assert(recorded_count(&recorder) == 4);
+	assert_recorded(recorded(&recorder, 0), RECORDED_POINTER_MOTION, -1,
+			40, 40);
+	assert_recorded_button(recorded(&recorder, 1), BTN_LEFT,
+			       WL_POINTER_BUTTON_STATE_PRESSED);
+	assert_recorded(recorded(&recorder, 2), RECORDED_POINTER_MOTION, -1,
+			50, 50);
+	assert_recorded_button(recorded(&recorder, 3), BTN_LEFT,
+			       WL_POINTER_BUTTON_STATE_RELEASED);
+
+	recorder_release(&recorder);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "shared/os-compatibility.h"
+#include "zunitc/zunitc.h"
+
+static const char data[] = "xkb_keymap { xkb_keycodes { }; };";
+
+#ifdef HAVE_MEMFD_CREATE
+/* When set, memfd_create() fails with this error. The shared code is
+ * linked statically into this test, so this replaces the C library's
+ * memfd_create() for it. */
+static int memfd_create_errno;
+
+int
+memfd_create(const char *name, unsigned int flags)
+{
+	if (memfd_create_errno) {
+		errno = memfd_create_errno;
+		return -1;
+	}
+
+	return syscall(SYS_memfd_create, name, flags);
+}
+#endif
+
+ZUC_TEST(os_compatibility_test, sealed_file_contents)
+{
+	char buf[sizeof data];
+	struct stat st;
+	int fd;
+
+	fd = os_create_sealed_anonymous_file(data, sizeof data);
+	ZUC_ASSERT_GE(fd, 0);
+
+	ZUC_ASSERT_EQ(0, fstat(fd, &st));
+	ZUC_ASSERT_EQ(sizeof data, st.st_size);
+	ZUC_ASSERT_TRUE(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+
+	ZUC_ASSERT_EQ(sizeof data, pread(fd, buf, sizeof buf, 0));
+	ZUC_ASSERT_EQ(0, memcmp(data, buf, sizeof data));
+
+	close(fd);
+}
+
+ZUC_TEST(os_compatibility_test, sealed_file_read_only)
+{
+	void *map;
+	int fd;
+
+	fd = os_create_sealed_anonymous_file(data, sizeof data);
+	ZUC_ASSERT_GE(fd, 0);
+
+#ifdef F_GET_SEALS
+	/* Only when the file really is sealed */
+	if (fcntl(fd, F_GET_SEALS) >= 0) {
+		ZUC_ASSERT_EQ(-1, pwrite(fd, "x", 1, 0));
+		ZUC_ASSERT_EQ(-1, ftruncate(fd, 0));
+
+		map = mmap(NULL, sizeof data, PROT_READ | PROT_WRITE,
+			   MAP_SHARED, fd, 0);
+		ZUC_ASSERT_TRUE(map == MAP_FAILED);
+	}
+#endif
+
+	/* Reading through a mapping, as clients do, always works */
+	map = mmap(NULL, sizeof data, PROT_READ, MAP_SHARED, fd, 0);
+	ZUC_ASSERT_TRUE(map != MAP_FAILED);
+	ZUC_ASSERT_EQ(0, memcmp(data, map, sizeof data));
+	munmap(map, sizeof data);
+
+	close(fd);
+}
+
+ZUC_TEST(os_compatibility_test, sealed_file_fallback)
+{
+#ifdef HAVE_MEMFD_CREATE
+	char buf[sizeof data];
+	int fd;
+
+	/* Where os_create_anonymous_file() creates its files */
+	if (!getenv("XDG_RUNTIME_DIR"))
+		setenv("XDG_RUNTIME_DIR", "/tmp", 1);
+
+	/* Not ENOSYS, as when a seccomp filter denies the call */
+	memfd_create_errno = EPERM;
+	fd = os_create_sealed_anonymous_file(data, sizeof data);
+	memfd_create_errno = 0;
+
+	ZUC_ASSERT_GE(fd, 0);
+	ZUC_ASSERT_TRUE(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+
+	ZUC_ASSERT_EQ(sizeof data, pread(fd, buf, sizeof buf, 0));
+	ZUC_ASSERT_EQ(0, memcmp(data, buf, sizeof data));
+
+	close(fd);
+#endif
+}
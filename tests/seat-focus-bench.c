@@ -0,0 +1,434 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Focus change cost with many seats and many clients.
+ *
+ * Runs inside the compositor. Creates seats of its own with a pointer and
+ * a keyboard, and connects clients over socket pairs from inside the
+ * compositor. Every client binds the pointer and the keyboard of every
+ * seat and creates a surface. The pointer and keyboard focus of every
+ * seat then cycle through the surfaces of all clients. Appends one JSON
+ * object per seat and client count to the file named by
+ * WESTON_BENCH_RESULTS, or writes it to stdout.
+ *
+ * This is not part of 'make check'; run it with 'make bench'.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <wayland-client.h>
+
+#include "src/compositor.h"
+#include "shared/helpers.h"
+#include "shared/os-compatibility.h"
+#include "shared/timespec-util.h"
+
+#define BENCH_ROUNDS 20
+
+static const int seat_counts[] = { 1, 4, 16 };
+static const int client_counts[] = { 16, 64, 256 };
+
+struct bench_client {
+	struct bench *bench;
+
+	/* Client side */
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_compositor *compositor;
+	struct wl_surface *surface;
+
+	/* Compositor side */
+	struct wl_client *client;
+	struct weston_surface *wsurface;
+	struct weston_view *view;
+};
+
+struct bench {
+	struct weston_compositor *compositor;
+	struct wl_event_loop *loop;
+	struct wl_event_source *timer;
+	struct weston_seat **seats;
+	int seat_count;
+};
+
+static void
+sync_handle_done(void *data, struct wl_callback *callback, uint32_t serial)
+{
+	int *done = data;
+
+	*done = 1;
+	wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener sync_listener = {
+	sync_handle_done
+};
+
+static void
+keyboard_handle_keymap(void *data, struct wl_keyboard *keyboard,
+		       uint32_t format, int32_t fd, uint32_t size)
+{
+	close(fd);
+}
+
+static void
+keyboard_handle_enter(void *data, struct wl_keyboard *keyboard,
+		      uint32_t serial, struct wl_surface *surface,
+		      struct wl_array *keys)
+{
+}
+
+static void
+keyboard_handle_leave(void *data, struct wl_keyboard *keyboard,
+		      uint32_t serial, struct wl_surface *surface)
+{
+}
+
+static void
+keyboard_handle_key(void *data, struct wl_keyboard *keyboard,
+		    uint32_t serial, uint32_t time, uint32_t key,
+		    uint32_t state)
+{
+}
+
+static void
+keyboard_handle_modifiers(void *data, struct wl_keyboard *keyboard,
+			  uint32_t serial, uint32_t mods_depressed,
+			  uint32_t mods_latched, uint32_t mods_locked,
+			  uint32_t group)
+{
+}
+
+/* Only the keymap matters, its fd has to be closed. */
+static const struct wl_keyboard_listener keyboard_listener = {
+	keyboard_handle_keymap,
+	keyboard_handle_enter,
+	keyboard_handle_leave,
+	keyboard_handle_key,
+	keyboard_handle_modifiers,
+};
+
+static void
+registry_handle_global(void *data, struct wl_registry *registry,
+		       uint32_t name, const char *interface, uint32_t version)
+{
+	struct bench_client *c = data;
+	struct wl_keyboard *keyboard;
+	struct wl_seat *seat;
+
+	if (strcmp(interface, "wl_compositor") == 0) {
+		c->compositor = wl_registry_bind(registry, name,
+						 &wl_compositor_interface, 1);
+	} else if (strcmp(interface, "wl_seat") == 0) {
+		seat = wl_registry_bind(registry, name,
+					&wl_seat_interface, 1);
+		wl_seat_get_pointer(seat);
+		keyboard = wl_seat_get_keyboard(seat);
+		wl_keyboard_add_listener(keyboard, &keyboard_listener, c);
+	}
+}
+
+static void
+registry_handle_global_remove(void *data, struct wl_registry *registry,
+			      uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_handle_global,
+	registry_handle_global_remove
+};
+
+/* Read and dispatch whatever the compositor sent to the client, without
+ * blocking. */
+static void
+client_read(struct bench_client *c)
+{
+	struct pollfd pfd;
+
+	while (wl_display_prepare_read(c->display) != 0)
+		wl_display_dispatch_pending(c->display);
+
+	pfd.fd = wl_display_get_fd(c->display);
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 0) > 0)
+		assert(wl_display_read_events(c->display) == 0);
+	else
+		wl_display_cancel_read(c->display);
+
+	wl_display_dispatch_pending(c->display);
+}
+
+/* Both ends live in this thread, so run the compositor in between. */
+static void
+client_roundtrip(struct bench_client *c)
+{
+	struct wl_callback *callback;
+	int done = 0;
+
+	callback = wl_display_sync(c->display);
+	wl_callback_add_listener(callback, &sync_listener, &done);
+
+	while (!done) {
+		assert(wl_display_flush(c->display) >= 0);
+		wl_event_loop_dispatch(c->bench->loop, 0);
+		wl_display_flush_clients(c->bench->compositor->wl_display);
+		client_read(c);
+	}
+}
+
+static void
+client_connect(struct bench *bench, struct bench_client *c)
+{
+	struct wl_resource *resource;
+	int sv[2];
+
+	c->bench = bench;
+
+	assert(os_socketpair_cloexec(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	c->client = wl_client_create(bench->compositor->wl_display, sv[0]);
+	assert(c->client);
+	c->display = wl_display_connect_to_fd(sv[1]);
+	assert(c->display);
+
+	c->registry = wl_display_get_registry(c->display);
+	wl_registry_add_listener(c->registry, &registry_listener, c);
+	client_roundtrip(c);
+	assert(c->compositor);
+
+	c->surface = wl_compositor_create_surface(c->compositor);
+	client_roundtrip(c);
+
+	resource = wl_client_get_object(c->client,
+					wl_proxy_get_id((struct wl_proxy *)
+							c->surface));
+	assert(resource);
+	c->wsurface = wl_resource_get_user_data(resource);
+	c->view = weston_view_create(c->wsurface);
+	assert(c->view);
+}
+
+static void
+client_disconnect(struct bench_client *c)
+{
+	wl_client_destroy(c->client);
+	wl_display_disconnect(c->display);
+}
+
+static void
+flush_clients(struct bench *bench, struct bench_client *clients, int count)
+{
+	int i;
+
+	wl_display_flush_clients(bench->compositor->wl_display);
+	for (i = 0; i < count; i++)
+		client_read(&clients[i]);
+}
+
+static double
+elapsed_nsec(const struct timespec *begin, const struct timespec *end)
+{
+	struct timespec d;
+
+	timespec_sub(&d, end, begin);
+
+	return timespec_to_nsec(&d);
+}
+
+static void
+check_keyboard_focus(struct weston_keyboard *keyboard,
+		     struct bench_client *c)
+{
+	struct wl_resource *resource;
+
+	assert(keyboard->focus == c->wsurface);
+	assert(wl_list_length(&keyboard->focus_resource_list) == 1);
+	resource = wl_resource_from_link(keyboard->focus_resource_list.next);
+	assert(wl_resource_get_client(resource) == c->client);
+}
+
+/* Move the keyboard or pointer focus of every seat through all clients,
+ * returning the time per focus change. */
+static double
+bench_focus(struct bench *bench, struct bench_client *clients, int count,
+	    bool keyboard)
+{
+	struct timespec begin, end;
+	struct weston_seat *seat;
+	double total = 0;
+	int round, i, s;
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+
+		for (i = 0; i < count; i++) {
+			for (s = 0; s < bench->seat_count; s++) {
+				seat = bench->seats[s];
+				if (keyboard)
+					weston_keyboard_set_focus(
+						weston_seat_get_keyboard(seat),
+						clients[i].wsurface);
+				else
+					weston_pointer_set_focus(
+						weston_seat_get_pointer(seat),
+						clients[i].view, 0, 0);
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		total += elapsed_nsec(&begin, &end);
+
+		if (keyboard)
+			check_keyboard_focus(
+				weston_seat_get_keyboard(bench->seats[0]),
+				&clients[count - 1]);
+
+		/* Keep the socket buffers from filling up */
+		flush_clients(bench, clients, count);
+	}
+
+	return total / ((double) BENCH_ROUNDS * count * bench->seat_count);
+}
+
+static void
+bench_report(int seats, int clients, double keyboard_ns, double pointer_ns)
+{
+	const char *path = getenv("WESTON_BENCH_RESULTS");
+	FILE *fp = stdout;
+
+	if (path) {
+		fp = fopen(path, "a");
+		assert(fp);
+	}
+
+	fprintf(fp, "{\"benchmark\":\"seat-focus\",\"seats\":%d,"
+		"\"clients\":%d,\"keyboard_focus_ns\":%.1f,"
+		"\"pointer_focus_ns\":%.1f}\n",
+		seats, clients, keyboard_ns, pointer_ns);
+
+	if (fp != stdout)
+		fclose(fp);
+}
+
+static void
+bench_run(struct bench *bench, int seat_count, int client_count)
+{
+	struct bench_client *clients;
+	struct weston_seat *seat;
+	double keyboard_ns, pointer_ns;
+	char name[32];
+	int i;
+
+	bench->seat_count = seat_count;
+	bench->seats = zalloc(seat_count * sizeof *bench->seats);
+	assert(bench->seats);
+
+	for (i = 0; i < seat_count; i++) {
+		seat = zalloc(sizeof *seat);
+		assert(seat);
+		snprintf(name, sizeof name, "seat-focus-bench-%d", i);
+		weston_seat_init(seat, bench->compositor, name);
+		weston_seat_init_pointer(seat);
+		assert(weston_seat_init_keyboard(seat, NULL) == 0);
+		bench->seats[i] = seat;
+	}
+
+	clients = zalloc(client_count * sizeof *clients);
+	assert(clients);
+	for (i = 0; i < client_count; i++)
+		client_connect(bench, &clients[i]);
+
+	keyboard_ns = bench_focus(bench, clients, client_count, true);
+	pointer_ns = bench_focus(bench, clients, client_count, false);
+
+	bench_report(seat_count, client_count, keyboard_ns, pointer_ns);
+
+	for (i = 0; i < seat_count; i++) {
+		seat = bench->seats[i];
+		weston_keyboard_set_focus(weston_seat_get_keyboard(seat), NULL);
+		weston_pointer_clear_focus(weston_seat_get_pointer(seat));
+	}
+
+	for (i = 0; i < client_count; i++)
+		client_disconnect(&clients[i]);
+	free(clients);
+
+	for (i = 0; i < seat_count; i++) {
+		weston_seat_release(bench->seats[i]);
+		free(bench->seats[i]);
+	}
+	free(bench->seats);
+}
+
+/* Runs from a timer rather than an idle callback, because the clients
+ * need the event loop to be dispatched from within. */
+static int
+seat_focus_bench(void *data)
+{
+	struct bench *bench = data;
+	unsigned s, c;
+
+	for (s = 0; s < ARRAY_LENGTH(seat_counts); s++)
+		for (c = 0; c < ARRAY_LENGTH(client_counts); c++)
+			bench_run(bench, seat_counts[s], client_counts[c]);
+
+	wl_event_source_remove(bench->timer);
+	wl_display_terminate(bench->compositor->wl_display);
+	free(bench);
+
+	return 0;
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct bench *bench;
+
+	bench = zalloc(sizeof *bench);
+	if (!bench)
+		return -1;
+
+	bench->compositor = compositor;
+	bench->loop = wl_display_get_event_loop(compositor->wl_display);
+	bench->timer = wl_event_loop_add_timer(bench->loop,
+					       seat_focus_bench, bench);
+	if (!bench->timer) {
+		free(bench);
+		return -1;
+	}
+	wl_event_source_timer_update(bench->timer, 1);
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright © 2015 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "weston-test-client-helper.h"
+#include "wcap/wcap-decode.h"
+
+static const char recording_name[] = "surface-recorder-test.wcap";
+
+static void
+draw_pattern(uint32_t *pixels, int width, int height, uint32_t seed)
+{
+	int x, y;
+
+	for (y = 0; y < height; y++)
+		for (x = 0; x < width; x++)
+			pixels[y * width + x] = 0xff000000 |
+				((x * seed) & 0xff) << 16 |
+				((y * seed) & 0xff) << 8 |
+				((x + y) & 0xff);
+}
+
+static void
+commit_buffer(struct client *client, struct wl_buffer *buffer,
+	      int x, int y, int width, int height)
+{
+	struct wl_surface *surface = client->surface->wl_surface;
+	int done;
+
+	wl_surface_attach(surface, buffer, 0, 0);
+	wl_surface_damage(surface, x, y, width, height);
+	frame_callback_set(surface, &done);
+	wl_surface_commit(surface);
+	frame_callback_wait(client, &done);
+}
+
+/* Replays a wcap stream the same way wcap-decode does, and returns the
+ * number of frames found. */
+static int
+decode_recording(uint32_t *p, uint32_t *end, uint32_t *frame, int stride)
+{
+	struct wcap_frame_header *header;
+	struct wcap_rectangle *rects;
+	uint32_t i, v, *d;
+	int count = 0, x, j, k, l, n, width, height;
+
+	while (p < end) {
+		header = (struct wcap_frame_header *) p;
+		rects = (struct wcap_rectangle *) (header + 1);
+		p = (uint32_t *) (rects + header->nrects);
+
+		for (i = 0; i < header->nrects; i++) {
+			width = rects[i].x2 - rects[i].x1;
+			height = rects[i].y2 - rects[i].y1;
+			d = frame + (rects[i].y2 - 1) * stride;
+			x = rects[i].x1;
+
+			for (n = 0; n < width * height; n += j) {
+				assert(p < end);
+				v = *p++;
+				l = v >> 24;
+				j = l < 0xe0 ? l + 1 : 1 << (l - 0xe0 + 7);
+
+				for (k = 0; k < j; k++) {
+					d[x] = 0xff000000 |
+						((((d[x] >> 16) + (v >> 16)) & 0xff) << 16) |
+						((((d[x] >> 8) + (v >> 8)) & 0xff) << 8) |
+						(((d[x] + v) & 0xff));
+					if (++x == rects[i].x2) {
+						x = rects[i].x1;
+						d -= stride;
+					}
+				}
+			}
+			assert(n == width * height);
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+TEST(surface_recorder_replays_committed_buffers)
+{
+	struct client *client;
+	struct wl_buffer *first, *second;
+	struct wcap_header header;
+	uint32_t *first_pixels, *second_pixels, *data, *frame;
+	const int width = 100, height = 100;
+	FILE *fp;
+	long size;
+
+	client = create_client_and_test_surface(100, 100, width, height);
+	assert(client);
+
+	weston_test_start_surface_recording(client->test->weston_test,
+					    client->surface->wl_surface,
+					    recording_name);
+	client_roundtrip(client);
+
+	first = create_shm_buffer(client, width, height,
+				  (void **) &first_pixels);
+	draw_pattern(first_pixels, width, height, 3);
+	commit_buffer(client, first, 0, 0, width, height);
+
+	/* Only the damaged part of the second buffer must be recorded. */
+	second = create_shm_buffer(client, width, height,
+				   (void **) &second_pixels);
+	memcpy(second_pixels, first_pixels, width * height * 4);
+	draw_pattern(second_pixels + 10 * width, width, 20, 7);
+	commit_buffer(client, second, 0, 10, width, 20);
+
+	weston_test_stop_surface_recording(client->test->weston_test,
+					   client->surface->wl_surface);
+	client_roundtrip(client);
+
+	fp = fopen(recording_name, "r");
+	assert(fp);
+	assert(fread(&header, sizeof header, 1, fp) == 1);
+	assert(header.magic == WCAP_HEADER_MAGIC);
+	assert(header.format == WCAP_FORMAT_XRGB8888);
+	assert(header.width == (uint32_t) width);
+	assert(header.height == (uint32_t) height);
+
+	assert(fseek(fp, 0, SEEK_END) == 0);
+	size = ftell(fp) - sizeof header;
+	assert(size > 0 && size % 4 == 0);
+	assert(fseek(fp, sizeof header, SEEK_SET) == 0);
+	data = xmalloc(size);
+	assert(fread(data, size, 1, fp) == 1);
+	fclose(fp);
+	unlink(recording_name);
+
+	frame = xzalloc(width * height * 4);
+	assert(decode_recording(data, data + size / 4, frame, width) == 2);
+	assert(memcmp(frame, second_pixels, width * height * 4) == 0);
+
+	free(frame);
+	free(data);
+	wl_buffer_destroy(first);
+	wl_buffer_destroy(second);
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include "weston-test-client-helper.h"
+
+#define SURFACE_X 10
+#define SURFACE_Y 10
+#define POINTS 10
+
+static struct client *
+setup(struct recorder *recorder)
+{
+	struct client *client;
+
+	client = create_client_and_test_surface(SURFACE_X, SURFACE_Y,
+						100, 100);
+	assert(client);
+	assert(client->input->touch);
+	recorder_init(recorder, client);
+
+	return client;
+}
+
+TEST(touch_updates_wait_for_frame)
+{
+	struct recorder recorder;
+	struct client *client = setup(&recorder);
+
+	send_touch(client, 0, SURFACE_X + 5, SURFACE_Y + 5, TOUCH_DOWN);
+	send_touch(client, 0, SURFACE_X + 6, SURFACE_Y + 6, TOUCH_MOTION);
+	client_roundtrip(client);
+	assert(recorded_count(&recorder) == 0);
+
+	weston_test_send_touch_frame(client->test->weston_test);
+	client_roundtrip(client);
+
+	/* The motion following a down is not merged into it. */
+	assert(recorded_count(&recorder) == 3);
+	assert_recorded(recorded(&recorder, 0), RECORDED_TOUCH_DOWN, 0, 5, 5);
+	assert_recorded(recorded(&recorder, 1), RECORDED_TOUCH_MOTION, 0, 6, 6);
+	assert_recorded(recorded(&recorder, 2), RECORDED_TOUCH_FRAME,
+			-1, 0, 0);
+
+	send_touch(client, 0, 0, 0, TOUCH_UP);
+	weston_test_send_touch_frame(client->test->weston_test);
+	client_roundtrip(client);
+	assert(recorded_count(&recorder) == 5);
+	assert_recorded(recorded(&recorder, 3), RECORDED_TOUCH_UP, 0, 0, 0);
+	assert_recorded(recorded(&recorder, 4), RECORDED_TOUCH_FRAME,
+			-1, 0, 0);
+
+	recorder_release(&recorder);
+}
+
+/* Moves all points a few times per frame, as a multi-touch screen
+ * reporting faster than the frames are read would. */
+TEST(multitouch_frames_batched)
+{
+	struct recorder recorder;
+	struct client *client = setup(&recorder);
+	struct weston_test *test = client->test->weston_test;
+	const int frames = 20;
+	const int updates = 3;
+	int f, u, i, n;
+
+	for (i = 0; i < POINTS; i++)
+		send_touch(client, i, SURFACE_X + 5 + i * 5, SURFACE_Y + 5,
+			   TOUCH_DOWN);
+	weston_test_send_touch_frame(test);
+
+	for (f = 0; f < frames; f++) {
+		for (u = 0; u < updates; u++)
+			for (i = 0; i < POINTS; i++)
+				send_touch(client, i,
+					   SURFACE_X + 5 + i * 5 + u,
+					   SURFACE_Y + 10 + f,
+					   TOUCH_MOTION);
+		weston_test_send_touch_frame(test);
+	}
+
+	for (i = 0; i < POINTS; i++)
+		send_touch(client, i, 0, 0, TOUCH_UP);
+	weston_test_send_touch_frame(test);
+	client_roundtrip(client);
+
+	fprintf(stderr, "injected %d touch updates in %d frames, "
+		"received %d events\n",
+		POINTS * (frames * updates + 2), frames + 2,
+		recorded_count(&recorder));
+
+	/* One event per point and a single frame event per frame. */
+	assert(recorded_count(&recorder) == (POINTS + 1) * (frames + 2));
+
+	n = 0;
+	for (i = 0; i < POINTS; i++)
+		assert_recorded(recorded(&recorder, n++),
+				RECORDED_TOUCH_DOWN, i, 5 + i * 5, 5);
+	assert_recorded(recorded(&recorder, n++), RECORDED_TOUCH_FRAME,
+			-1, 0, 0);
+
+	for (f = 0; f < frames; f++) {
+		for (i = 0; i < POINTS; i++)
+			assert_recorded(recorded(&recorder, n++),
+					RECORDED_TOUCH_MOTION, i,
+					5 + i * 5 + updates - 1, 10 + f);
+		assert_recorded(recorded(&recorder, n++),
+				RECORDED_TOUCH_FRAME, -1, 0, 0);
+	}
+
+	for (i = 0; i < POINTS; i++)
+		assert_recorded(recorded(&recorder, n++),
+				RECORDED_TOUCH_UP, i, 0, 0);
+	assert_recorded(recorded(&recorder, n++), RECORDED_TOUCH_FRAME,
+			-1, 0, 0);
+
+	recorder_release(&recorder);
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "weston-test-client-helper.h"
+#include "presentation_timing-client-protocol.h"
+
+char *server_parameters = "--unthrottled --virtual-clock";
+
+struct feedback {
+	int presented;
+	struct timespec time;
+	uint32_t refresh_nsec;
+};
+
+static struct presentation *
+get_presentation(struct client *client)
+{
+	struct global *g;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, "presentation") == 0)
+			return wl_registry_bind(client->wl_registry, g->name,
+						&presentation_interface, 1);
+	}
+
+	assert(0 && "no presentation found");
+	return NULL;
+}
+
+static void
+feedback_sync_output(void *data,
+		     struct presentation_feedback *presentation_feedback,
+		     struct wl_output *output)
+{
+}
+
+static void
+feedback_presented(void *data,
+		   struct presentation_feedback *presentation_feedback,
+		   uint32_t tv_sec_hi,
+		   uint32_t tv_sec_lo,
+		   uint32_t tv_nsec,
+		   uint32_t refresh_nsec,
+		   uint32_t seq_hi,
+		   uint32_t seq_lo,
+		   uint32_t flags)
+{
+	struct feedback *fb = data;
+
+	fb->presented = 1;
+	fb->time.tv_sec = ((uint64_t)tv_sec_hi << 32) + tv_sec_lo;
+	fb->time.tv_nsec = tv_nsec;
+	fb->refresh_nsec = refresh_nsec;
+}
+
+static void
+feedback_discarded(void *data,
+		   struct presentation_feedback *presentation_feedback)
+{
+	assert(0 && "feedback discarded");
+}
+
+static const struct presentation_feedback_listener feedback_listener = {
+	feedback_sync_output,
+	feedback_presented,
+	feedback_discarded
+};
+
+static void
+present_frame(struct client *client, struct presentation *pres,
+	      struct feedback *fb)
+{
+	struct wl_surface *surface = client->surface->wl_surface;
+	struct presentation_feedback *obj;
+
+	memset(fb, 0, sizeof *fb);
+	obj = presentation_feedback(pres, surface);
+	presentation_feedback_add_listener(obj, &feedback_listener, fb);
+
+	wl_surface_attach(surface, client->surface->wl_buffer, 0, 0);
+	wl_surface_damage(surface, 0, 0, 100, 100);
+	wl_surface_commit(surface);
+
+	while (!fb->presented)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+
+	presentation_feedback_destroy(obj);
+}
+
+TEST(virtual_clock_presents_on_refresh_boundaries)
+{
+	struct client *client;
+	struct presentation *pres;
+	struct feedback fb[5];
+	int64_t t, prev = 0;
+	unsigned i;
+
+	client = create_client_and_test_surface(100, 50, 123, 77);
+	assert(client);
+	pres = get_presentation(client);
+
+	for (i = 0; i < ARRAY_LENGTH(fb); i++) {
+		present_frame(client, pres, &fb[i]);
+
+		t = timespec_to_nsec(&fb[i].time);
+		printf("frame %u presented at %lld ns\n", i, (long long)t);
+
+		/* The virtual clock only ever stops on whole refresh
+		 * periods, starting from zero. */
+		assert(fb[i].refresh_nsec > 0);
+		assert(t % fb[i].refresh_nsec == 0);
+		assert(i == 0 || t > prev);
+
+		prev = t;
+	}
+
+	presentation_destroy(pres);
+}
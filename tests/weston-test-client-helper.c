@@ -30,6 +30,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/mman.h>
 
 #include "shared/os-compatibility.h"
@@ -122,6 +123,268 @@ move_client(struct client *client, int x, int y)
 	frame_callback_wait(client, &done);
 }
 
+void
+send_touch(struct client *client, int id, int x, int y, uint32_t type)
+{
+	weston_test_send_touch(client->test->weston_test, id,
+			       wl_fixed_from_int(x), wl_fixed_from_int(y),
+			       type);
+}
+
+static struct recorded_event *
+record(struct recorder *recorder, enum recorded_type type,
+       int id, wl_fixed_t x, wl_fixed_t y)
+{
+	struct recorded_event *ev;
+
+	ev = wl_array_add(&recorder->events, sizeof *ev);
+	assert(ev);
+	memset(ev, 0, sizeof *ev);
+	ev->type = type;
+	ev->id = id;
+	ev->x = wl_fixed_to_int(x);
+	ev->y = wl_fixed_to_int(y);
+	clock_gettime(CLOCK_MONOTONIC, &ev->time);
+
+	return ev;
+}
+
+static void
+recorder_pointer_enter(void *data, struct wl_pointer *wl_pointer,
+		       uint32_t serial, struct wl_surface *wl_surface,
+		       wl_fixed_t x, wl_fixed_t y)
+{
+}
+
+static void
+recorder_pointer_leave(void *data, struct wl_pointer *wl_pointer,
+		       uint32_t serial, struct wl_surface *wl_surface)
+{
+}
+
+static void
+recorder_pointer_motion(void *data, struct wl_pointer *wl_pointer,
+			uint32_t time, wl_fixed_t x, wl_fixed_t y)
+{
+	record(data, RECORDED_POINTER_MOTION, -1, x, y);
+}
+
+static void
+recorder_pointer_button(void *data, struct wl_pointer *wl_pointer,
+			uint32_t serial, uint32_t time, uint32_t button,
+			uint32_t state)
+{
+	struct recorded_event *ev;
+
+	ev = record(data, RECORDED_BUTTON, -1, 0, 0);
+	ev->button = button;
+	ev->state = state;
+}
+
+static void
+recorder_pointer_axis(void *data, struct wl_pointer *wl_pointer,
+		      uint32_t time, uint32_t axis, wl_fixed_t value)
+{
+}
+
+static const struct wl_pointer_listener recorder_pointer_listener = {
+	recorder_pointer_enter,
+	recorder_pointer_leave,
+	recorder_pointer_motion,
+	recorder_pointer_button,
+	recorder_pointer_axis,
+};
+
+static void
+recorder_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard,
+			 uint32_t format, int fd, uint32_t size)
+{
+	close(fd);
+}
+
+static void
+recorder_keyboard_enter(void *data, struct wl_keyboard *wl_keyboard,
+			uint32_t serial, struct wl_surface *wl_surface,
+			struct wl_array *keys)
+{
+}
+
+static void
+recorder_keyboard_leave(void *data, struct wl_keyboard *wl_keyboard,
+			uint32_t serial, struct wl_surface *wl_surface)
+{
+}
+
+static void
+recorder_keyboard_key(void *data, struct wl_keyboard *wl_keyboard,
+		      uint32_t serial, uint32_t time, uint32_t key,
+		      uint32_t state)
+{
+	struct recorded_event *ev;
+
+	ev = record(data, RECORDED_KEY, -1, 0, 0);
+	ev->button = key;
+	ev->state = state;
+}
+
+static void
+recorder_keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard,
+			    uint32_t serial, uint32_t mods_depressed,
+			    uint32_t mods_latched, uint32_t mods_locked,
+			    uint32_t group)
+{
+}
+
+static void
+recorder_keyboard_repeat_info(void *data, struct wl_keyboard *wl_keyboard,
+			      int32_t rate, int32_t delay)
+{
+}
+
+static const struct wl_keyboard_listener recorder_keyboard_listener = {
+	recorder_keyboard_keymap,
+	recorder_keyboard_enter,
+	recorder_keyboard_leave,
+	recorder_keyboard_key,
+	recorder_keyboard_modifiers,
+	recorder_keyboard_repeat_info,
+};
+
+static void
+recorder_touch_down(void *data, struct wl_touch *wl_touch,
+		    uint32_t serial, uint32_t time, struct wl_surface *surface,
+		    int32_t id, wl_fixed_t x, wl_fixed_t y)
+{
+	record(data, RECORDED_TOUCH_DOWN, id, x, y);
+}
+
+static void
+recorder_touch_up(void *data, struct wl_touch *wl_touch,
+		  uint32_t serial, uint32_t time, int32_t id)
+{
+	record(data, RECORDED_TOUCH_UP, id, 0, 0);
+}
+
+static void
+recorder_touch_motion(void *data, struct wl_touch *wl_touch,
+		      uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y)
+{
+	record(data, RECORDED_TOUCH_MOTION, id, x, y);
+}
+
+static void
+recorder_touch_frame(void *data, struct wl_touch *wl_touch)
+{
+	record(data, RECORDED_TOUCH_FRAME, -1, 0, 0);
+}
+
+static void
+recorder_touch_cancel(void *data, struct wl_touch *wl_touch)
+{
+}
+
+static const struct wl_touch_listener recorder_touch_listener = {
+	recorder_touch_down,
+	recorder_touch_up,
+	recorder_touch_motion,
+	recorder_touch_frame,
+	recorder_touch_cancel,
+};
+
+/** Start recording the input events of a client's seat
+ *
+ * \param recorder The recorder to set up.
+ * \param client The client, whose seat is used.
+ *
+ * Only events sent after this returns are recorded.
+ */
+void
+recorder_init(struct recorder *recorder, struct client *client)
+{
+	struct input *input = client->input;
+
+	memset(recorder, 0, sizeof *recorder);
+	wl_array_init(&recorder->events);
+
+	if (input->caps & WL_SEAT_CAPABILITY_POINTER) {
+		recorder->wl_pointer = wl_seat_get_pointer(input->wl_seat);
+		wl_pointer_add_listener(recorder->wl_pointer,
+					&recorder_pointer_listener, recorder);
+	}
+
+	if (input->caps & WL_SEAT_CAPABILITY_KEYBOARD) {
+		recorder->wl_keyboard = wl_seat_get_keyboard(input->wl_seat);
+		wl_keyboard_add_listener(recorder->wl_keyboard,
+					 &recorder_keyboard_listener,
+					 recorder);
+	}
+
+	if (input->caps & WL_SEAT_CAPABILITY_TOUCH) {
+		recorder->wl_touch = wl_seat_get_touch(input->wl_seat);
+		wl_touch_add_listener(recorder->wl_touch,
+				      &recorder_touch_listener, recorder);
+	}
+
+	client_roundtrip(client);
+}
+
+void
+recorder_release(struct recorder *recorder)
+{
+	if (recorder->wl_pointer)
+		wl_pointer_destroy(recorder->wl_pointer);
+	if (recorder->wl_keyboard)
+		wl_keyboard_destroy(recorder->wl_keyboard);
+	if (recorder->wl_touch)
+		wl_touch_destroy(recorder->wl_touch);
+	wl_array_release(&recorder->events);
+}
+
+int
+recorded_count(struct recorder *recorder)
+{
+	return recorder->events.size / sizeof(struct recorded_event);
+}
+
+struct recorded_event *
+recorded(struct recorder *recorder, int i)
+{
+	assert(i < recorded_count(recorder));
+
+	return (struct recorded_event *) recorder->events.data + i;
+}
+
+/** Check a recorded event
+ *
+ * \param ev The event.
+ * \param type Its expected type.
+ * \param id The expected touch point, -1 for pointer and frame events.
+ * \param x The expected surface-local position, checked for pointer
+ * motion, touch down and touch motion only.
+ * \param y See x.
+ */
+void
+assert_recorded(struct recorded_event *ev, enum recorded_type type,
+		int id, int x, int y)
+{
+	assert(ev->type == type);
+	assert(ev->id == id);
+	if (type == RECORDED_POINTER_MOTION ||
+	    type == RECORDED_TOUCH_DOWN || type == RECORDED_TOUCH_MOTION) {
+		assert(ev->x == x);
+		assert(ev->y == y);
+	}
+}
+
+void
+assert_recorded_button(struct recorded_event *ev, uint32_t button,
+		       uint32_t state)
+{
+	assert(ev->type == RECORDED_BUTTON);
+	assert(ev->button == button);
+	assert(ev->state == state);
+}
+
 int
 get_n_egl_buffers(struct client *client)
 {
@@ -141,6 +404,7 @@ pointer_handle_enter(void *data, struct wl_pointer *wl_pointer,
 	struct pointer *pointer = data;
 
 	pointer->focus = wl_surface_get_user_data(wl_surface);
+	pointer->serial = serial;
 	pointer->x = wl_fixed_to_int(x);
 	pointer->y = wl_fixed_to_int(y);
 
@@ -416,6 +680,63 @@ create_shm_buffer(struct client *client, int width, int height, void **pixels)
 	return buffer;
 }
 
+void
+fill_pixels(uint32_t *pixels, int count, uint32_t color)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		pixels[i] = color;
+}
+
+/** set_cursor()
+ *
+ * Sets a cursor of a single color, with its hotspot in the top left
+ * corner, on the pointer of the client. The pointer must have entered
+ * one of the client's surfaces.
+ *
+ * @returns the cursor surface, to be released with shm_surface_destroy().
+ */
+struct surface *
+set_cursor(struct client *client, int width, int height, uint32_t color)
+{
+	struct pointer *pointer = client->input->pointer;
+	struct surface *cursor;
+
+	cursor = xzalloc(sizeof *cursor);
+	cursor->width = width;
+	cursor->height = height;
+	cursor->wl_buffer = create_shm_buffer(client, width, height,
+					      &cursor->data);
+	fill_pixels(cursor->data, width * height, color);
+
+	cursor->wl_surface =
+		wl_compositor_create_surface(client->wl_compositor);
+	wl_pointer_set_cursor(pointer->wl_pointer, pointer->serial,
+			      cursor->wl_surface, 0, 0);
+	wl_surface_attach(cursor->wl_surface, cursor->wl_buffer, 0, 0);
+	wl_surface_damage(cursor->wl_surface, 0, 0, width, height);
+	wl_surface_commit(cursor->wl_surface);
+
+	return cursor;
+}
+
+/** shm_surface_destroy()
+ *
+ * Destroys a surface whose pixels are in a buffer from
+ * create_shm_buffer(), as returned by set_cursor() and
+ * capture_screenshot_of_output().
+ */
+void
+shm_surface_destroy(struct surface *surface)
+{
+	if (surface->wl_surface)
+		wl_surface_destroy(surface->wl_surface);
+	wl_buffer_destroy(surface->wl_buffer);
+	munmap(surface->data, surface->width * surface->height * 4);
+	free(surface);
+}
+
 static void
 shm_format(void *data, struct wl_shm *wl_shm, uint32_t format)
 {
@@ -458,10 +779,40 @@ test_handle_capture_screenshot_done(void *data, struct weston_test *weston_test)
 	test->buffer_copy_done = 1;
 }
 
+static void
+test_handle_input_replayed(void *data, struct weston_test *weston_test,
+			   uint32_t index, uint32_t tv_sec_hi,
+			   uint32_t tv_sec_lo, uint32_t tv_nsec,
+			   uint32_t processing_nsec)
+{
+	struct test *test = data;
+	struct replayed_input *replayed;
+
+	replayed = wl_array_add(&test->replayed, sizeof *replayed);
+	assert(replayed);
+	clock_gettime(CLOCK_MONOTONIC, &replayed->received);
+	replayed->index = index;
+	replayed->injected.tv_sec = ((uint64_t) tv_sec_hi << 32) + tv_sec_lo;
+	replayed->injected.tv_nsec = tv_nsec;
+	replayed->processing_nsec = processing_nsec;
+}
+
+static void
+test_handle_input_replay_done(void *data, struct weston_test *weston_test,
+			      uint32_t count)
+{
+	struct test *test = data;
+
+	test->replay_done = 1;
+	test->replay_count = count;
+}
+
 static const struct weston_test_listener test_listener = {
 	test_handle_pointer_position,
 	test_handle_n_egl_buffers,
 	test_handle_capture_screenshot_done,
+	test_handle_input_replayed,
+	test_handle_input_replay_done,
 };
 
 static void
@@ -651,6 +1002,7 @@ handle_global(void *data, struct wl_registry *registry,
 		client->output = output;
 	} else if (strcmp(interface, "weston_test") == 0) {
 		test = xzalloc(sizeof *test);
+		wl_array_init(&test->replayed);
 		test->weston_test =
 			wl_registry_bind(registry, id,
 					 &weston_test_interface, version);
@@ -841,6 +1193,44 @@ create_client_and_test_surface(int x, int y, int width, int height)
 	return client;
 }
 
+/** capture_screenshot_of_output()
+ *
+ * Requests a screenshot from the server of the output that the
+ * client appears on.  The image data returned from the server
+ * can be accessed from the screenshot surface's data member.
+ *
+ * @returns a new surface object, to be released with
+ * shm_surface_destroy().
+ */
+struct surface *
+capture_screenshot_of_output(struct client *client)
+{
+	struct surface *screenshot;
+
+	screenshot = xzalloc(sizeof *screenshot);
+	screenshot->width = client->output->width;
+	screenshot->height = client->output->height;
+	screenshot->wl_buffer = create_shm_buffer(client,
+						  screenshot->width,
+						  screenshot->height,
+						  &screenshot->data);
+
+	client->test->buffer_copy_done = 0;
+	weston_test_capture_screenshot(client->test->weston_test,
+				       client->output->wl_output,
+				       screenshot->wl_buffer);
+	while (client->test->buffer_copy_done == 0)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+
+	/* FIXME: Document somewhere the orientation the screenshot is taken
+	 * and how the clip coords are interpreted, in case of scaling/transform.
+	 * If we're using read_pixels() just make sure it is documented somewhere.
+	 * Protocol docs in the XML, comparison function docs in Doxygen style.
+	 */
+
+	return screenshot;
+}
+
 static const char*
 output_path(void)
 {
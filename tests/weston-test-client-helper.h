@@ -30,6 +30,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include <wayland-client-protocol.h>
 #include "weston-test-runner.h"
@@ -63,12 +64,23 @@ struct global {
 	struct wl_list link;
 };
 
+/* An input_replayed event, with the time it was received at. */
+struct replayed_input {
+	uint32_t index;
+	struct timespec injected;
+	struct timespec received;
+	uint32_t processing_nsec;
+};
+
 struct test {
 	struct weston_test *weston_test;
 	int pointer_x;
 	int pointer_y;
 	uint32_t n_egl_buffers;
 	int buffer_copy_done;
+	struct wl_array replayed;	/* struct replayed_input */
+	int replay_done;
+	uint32_t replay_count;
 };
 
 struct input {
@@ -84,6 +96,7 @@ struct input {
 struct pointer {
 	struct wl_pointer *wl_pointer;
 	struct surface *focus;
+	uint32_t serial; /* of the last enter, for set_cursor */
 	int x;
 	int y;
 	uint32_t button;
@@ -145,6 +158,35 @@ struct rectangle {
 	int height;
 };
 
+enum recorded_type {
+	RECORDED_POINTER_MOTION,
+	RECORDED_BUTTON,
+	RECORDED_TOUCH_DOWN,
+	RECORDED_TOUCH_UP,
+	RECORDED_TOUCH_MOTION,
+	RECORDED_TOUCH_FRAME,
+	RECORDED_KEY,
+};
+
+struct recorded_event {
+	enum recorded_type type;
+	int id;		/* touch point, -1 for the other events */
+	int x, y;	/* surface-local, of motion and touch down */
+	uint32_t button;	/* or key */
+	uint32_t state;
+	struct timespec time;	/* received at, on CLOCK_MONOTONIC */
+};
+
+/* A second wl_pointer, wl_keyboard and wl_touch next to the helper's
+ * ones, recording motion, button, key and touch events in the order they
+ * arrive. */
+struct recorder {
+	struct wl_pointer *wl_pointer;
+	struct wl_keyboard *wl_keyboard;
+	struct wl_touch *wl_touch;
+	struct wl_array events;		/* struct recorded_event */
+};
+
 void *
 fail_on_null(void *p);
 
@@ -169,12 +211,31 @@ create_client_and_test_surface(int x, int y, int width, int height);
 struct wl_buffer *
 create_shm_buffer(struct client *client, int width, int height, void **pixels);
 
+void
+fill_pixels(uint32_t *pixels, int count, uint32_t color);
+
+struct surface *
+set_cursor(struct client *client, int width, int height, uint32_t color);
+
+void
+shm_surface_destroy(struct surface *surface);
+
 int
 surface_contains(struct surface *surface, int x, int y);
 
 void
 move_client(struct client *client, int x, int y);
 
+/* The wl_touch event opcodes, as taken by weston_test.send_touch. */
+enum {
+	TOUCH_DOWN = 0,
+	TOUCH_UP = 1,
+	TOUCH_MOTION = 2,
+};
+
+void
+send_touch(struct client *client, int id, int x, int y, uint32_t type);
+
 #define client_roundtrip(c) do { \
 	assert(wl_display_roundtrip((c)->wl_display) >= 0); \
 } while (0)
@@ -203,6 +264,29 @@ screenshot_output_filename(const char *basename, uint32_t seq);
 char*
 screenshot_reference_filename(const char *basename, uint32_t seq);
 
+struct surface *
+capture_screenshot_of_output(struct client *client);
+
+void
+recorder_init(struct recorder *recorder, struct client *client);
+
+void
+recorder_release(struct recorder *recorder);
+
+int
+recorded_count(struct recorder *recorder);
+
+struct recorded_event *
+recorded(struct recorder *recorder, int i);
+
+void
+assert_recorded(struct recorded_event *ev, enum recorded_type type,
+		int id, int x, int y);
+
+void
+assert_recorded_button(struct recorded_event *ev, uint32_t button,
+		       uint32_t state);
+
 bool
 check_surfaces_geometry(const struct surface *a, const struct surface *b);
 
@@ -27,9 +27,11 @@
 
 #include <stdlib.h>
 #include <assert.h>
+#include <errno.h>
 #include <signal.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 
 #include "src/compositor.h"
 #include "weston-test-server-protocol.h"
@@ -41,12 +43,41 @@
 #endif /* ENABLE_EGL */
 
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 
 struct weston_test {
 	struct weston_compositor *compositor;
 	struct weston_layer layer;
 	struct weston_process process;
 	struct weston_seat seat;
+	struct test_replay *replay;
+
+	/* owed a pointer_position event once coalesced motion is
+	 * delivered, see move_pointer() */
+	struct wl_resource *position_resource;
+	struct wl_listener pointer_motion_listener;
+
+	/* added to every repaint, see set_repaint_cost() */
+	uint32_t repaint_cost_usec;
+	struct wl_listener output_created_listener;
+};
+
+/* Delays the repaints of one output. */
+struct test_repaint_cost {
+	struct weston_test *test;
+	struct wl_listener frame_listener;
+	struct wl_listener destroy_listener;
+};
+
+/* An input recording being fed back to the test seat, see replay_input. */
+struct test_replay {
+	struct weston_test *test;
+	struct wl_resource *resource;
+	struct wl_array records;
+	unsigned int next;
+	uint32_t speed;
+	struct timespec start;
+	struct wl_event_source *timer;
 };
 
 struct weston_test_surface {
@@ -138,6 +169,20 @@ move_surface(struct wl_client *client, struct wl_resource *resource,
 	test_surface->y = y;
 }
 
+static void
+pointer_motion_notify(struct wl_listener *listener, void *data)
+{
+	struct weston_test *test =
+		container_of(listener, struct weston_test,
+			     pointer_motion_listener);
+
+	wl_list_remove(&listener->link);
+	wl_list_init(&listener->link);
+
+	notify_pointer_position(test, test->position_resource);
+	test->position_resource = NULL;
+}
+
 static void
 move_pointer(struct wl_client *client, struct wl_resource *resource,
 	     int32_t x, int32_t y)
@@ -146,9 +191,20 @@ move_pointer(struct wl_client *client, struct wl_resource *resource,
 	struct weston_seat *seat = get_seat(test);
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
-	notify_motion(seat, 100,
-		      wl_fixed_from_int(x) - pointer->x,
-		      wl_fixed_from_int(y) - pointer->y);
+	/* Absolute, so that it still lands where asked when motion is
+	 * coalesced and the pointer has not moved yet. */
+	notify_motion_absolute(seat, 100,
+			       wl_fixed_from_int(x), wl_fixed_from_int(y));
+
+	/* Coalesced motion only moves the pointer at the next repaint,
+	 * report the position from there rather than the stale one. */
+	if (seat->motion.pointer_pending) {
+		test->position_resource = resource;
+		if (wl_list_empty(&test->pointer_motion_listener.link))
+			wl_signal_add(&pointer->motion_signal,
+				      &test->pointer_motion_listener);
+		return;
+	}
 
 	notify_pointer_position(test, resource);
 }
@@ -196,6 +252,162 @@ send_key(struct wl_client *client, struct wl_resource *resource,
 	notify_key(seat, 100, key, state, STATE_UPDATE_AUTOMATIC);
 }
 
+static void
+send_touch(struct wl_client *client, struct wl_resource *resource,
+	   int32_t touch_id, wl_fixed_t x, wl_fixed_t y, uint32_t touch_type)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+	struct weston_seat *seat = get_seat(test);
+
+	notify_touch(seat, 100, touch_id, x, y, touch_type);
+}
+
+static void
+send_touch_frame(struct wl_client *client, struct wl_resource *resource)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+	struct weston_seat *seat = get_seat(test);
+
+	notify_touch_frame(seat);
+}
+
+static void
+start_input_recording(struct wl_client *client, struct wl_resource *resource,
+		      const char *filename)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+
+	if (!weston_input_recorder_create(get_seat(test), filename))
+		weston_log("test: could not start recording input\n");
+}
+
+static void
+stop_input_recording(struct wl_client *client, struct wl_resource *resource)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+	struct weston_input_recorder *recorder;
+
+	recorder = weston_input_recorder_get(get_seat(test));
+	if (recorder)
+		weston_input_recorder_destroy(recorder);
+}
+
+static void
+test_replay_destroy(struct test_replay *replay)
+{
+	replay->test->replay = NULL;
+	if (replay->timer)
+		wl_event_source_remove(replay->timer);
+	wl_array_release(&replay->records);
+	free(replay);
+}
+
+/* Returns 0 if the replay was destroyed, because flushing found its
+ * client gone. */
+static int
+test_replay_event(struct test_replay *replay, unsigned int index)
+{
+	struct weston_test *test = replay->test;
+	struct weston_input_record *record =
+		(struct weston_input_record *) replay->records.data + index;
+	struct timespec begin, end, d;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	weston_input_record_replay(get_seat(test), record);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	timespec_sub(&d, &end, &begin);
+
+	weston_test_send_input_replayed(replay->resource, index,
+					(uint64_t) begin.tv_sec >> 32,
+					begin.tv_sec & 0xffffffff,
+					begin.tv_nsec,
+					timespec_to_nsec(&d));
+
+	/* Not held back until the replay is done, so that the client sees
+	 * the events as soon as they were processed. */
+	wl_display_flush_clients(test->compositor->wl_display);
+
+	return test->replay != NULL;
+}
+
+static int
+test_replay_timer(void *data)
+{
+	struct test_replay *replay = data;
+	struct weston_input_record *records = replay->records.data;
+	unsigned int count = replay->records.size / sizeof *records;
+	struct timespec now, elapsed;
+	int64_t wait;
+
+	while (replay->next < count) {
+		if (replay->speed == WESTON_TEST_REPLAY_SPEED_ORIGINAL) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			timespec_sub(&elapsed, &now, &replay->start);
+			wait = (int64_t) records[replay->next].nsec -
+			       timespec_to_nsec(&elapsed);
+
+			/* Timers count in milliseconds, rounded up here. */
+			if (wait > 0) {
+				wl_event_source_timer_update(replay->timer,
+					(wait + 999999) / 1000000);
+				return 0;
+			}
+		}
+
+		if (!test_replay_event(replay, replay->next++))
+			return 0;
+	}
+
+	weston_test_send_input_replay_done(replay->resource, count);
+	test_replay_destroy(replay);
+
+	return 0;
+}
+
+static void
+replay_input(struct wl_client *client, struct wl_resource *resource,
+	     const char *filename, uint32_t speed)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+	struct wl_event_loop *loop;
+	struct test_replay *replay;
+
+	if (test->replay) {
+		weston_test_send_input_replay_done(resource, 0);
+		return;
+	}
+
+	replay = zalloc(sizeof *replay);
+	if (!replay) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
+	replay->test = test;
+	replay->resource = resource;
+	replay->speed = speed;
+	wl_array_init(&replay->records);
+	test->replay = replay;
+
+	if (weston_input_recording_load(filename, &replay->records) < 0) {
+		weston_test_send_input_replay_done(resource, 0);
+		test_replay_destroy(replay);
+		return;
+	}
+
+	loop = wl_display_get_event_loop(test->compositor->wl_display);
+	replay->timer = wl_event_loop_add_timer(loop, test_replay_timer,
+						replay);
+	if (!replay->timer) {
+		wl_resource_post_no_memory(resource);
+		test_replay_destroy(replay);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &replay->start);
+	wl_event_source_timer_update(replay->timer, 1);
+}
+
 static void
 device_release(struct wl_client *client,
 	       struct wl_resource *resource, const char *device)
@@ -517,6 +729,121 @@ capture_screenshot(struct wl_client *client,
 				     capture_screenshot_done, resource);
 }
 
+static void
+start_surface_recording(struct wl_client *client,
+			struct wl_resource *resource,
+			struct wl_resource *surface_resource,
+			const char *filename)
+{
+	struct weston_surface *surface =
+		wl_resource_get_user_data(surface_resource);
+
+	if (!weston_surface_recorder_create(surface, filename))
+		weston_log("test: could not start recording surface %p\n",
+			   surface);
+}
+
+static void
+stop_surface_recording(struct wl_client *client,
+		       struct wl_resource *resource,
+		       struct wl_resource *surface_resource)
+{
+	struct weston_surface *surface =
+		wl_resource_get_user_data(surface_resource);
+	struct weston_surface_recorder *recorder;
+
+	recorder = weston_surface_recorder_get(surface);
+	if (recorder)
+		weston_surface_recorder_destroy(recorder);
+}
+
+static void
+advance_presentation_clock(struct wl_client *client,
+			   struct wl_resource *resource, uint32_t usec)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+
+	weston_compositor_advance_presentation_clock(test->compositor,
+						     (int64_t) usec * 1000);
+}
+
+static void
+repaint_cost_frame_notify(struct wl_listener *listener, void *data)
+{
+	struct test_repaint_cost *cost =
+		container_of(listener, struct test_repaint_cost,
+			     frame_listener);
+	struct timespec ts;
+
+	if (cost->test->repaint_cost_usec == 0)
+		return;
+
+	ts.tv_sec = cost->test->repaint_cost_usec / 1000000;
+	ts.tv_nsec = cost->test->repaint_cost_usec % 1000000 * 1000;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+static void
+repaint_cost_destroy_notify(struct wl_listener *listener, void *data)
+{
+	struct test_repaint_cost *cost =
+		container_of(listener, struct test_repaint_cost,
+			     destroy_listener);
+
+	wl_list_remove(&cost->frame_listener.link);
+	wl_list_remove(&cost->destroy_listener.link);
+	free(cost);
+}
+
+static void
+repaint_cost_add_output(struct weston_test *test,
+			struct weston_output *output)
+{
+	struct test_repaint_cost *cost;
+
+	cost = zalloc(sizeof *cost);
+	if (!cost)
+		return;
+
+	cost->test = test;
+	cost->frame_listener.notify = repaint_cost_frame_notify;
+	wl_signal_add(&output->frame_signal, &cost->frame_listener);
+	cost->destroy_listener.notify = repaint_cost_destroy_notify;
+	wl_signal_add(&output->destroy_signal, &cost->destroy_listener);
+}
+
+static void
+output_created_notify(struct wl_listener *listener, void *data)
+{
+	struct weston_test *test =
+		container_of(listener, struct weston_test,
+			     output_created_listener);
+
+	repaint_cost_add_output(test, data);
+}
+
+/* The delay is taken in the frame signal, which the renderer emits while
+ * the repaint is timed, so it counts towards the repaint samples of the
+ * adaptive repaint scheduling. The listeners are added on first use. */
+static void
+set_repaint_cost(struct wl_client *client,
+		 struct wl_resource *resource, uint32_t usec)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+	struct weston_output *output;
+
+	if (wl_list_empty(&test->output_created_listener.link)) {
+		wl_list_for_each(output, &test->compositor->output_list, link)
+			repaint_cost_add_output(test, output);
+		test->output_created_listener.notify = output_created_notify;
+		wl_signal_add(&test->compositor->output_created_signal,
+			      &test->output_created_listener);
+	}
+
+	test->repaint_cost_usec = usec;
+}
+
 static const struct weston_test_interface test_implementation = {
 	move_surface,
 	move_pointer,
@@ -527,8 +854,32 @@ static const struct weston_test_interface test_implementation = {
 	device_add,
 	get_n_buffers,
 	capture_screenshot,
+	start_surface_recording,
+	stop_surface_recording,
+	send_touch,
+	send_touch_frame,
+	start_input_recording,
+	stop_input_recording,
+	replay_input,
+	advance_presentation_clock,
+	set_repaint_cost,
 };
 
+static void
+destroy_test(struct wl_resource *resource)
+{
+	struct weston_test *test = wl_resource_get_user_data(resource);
+
+	if (test->replay && test->replay->resource == resource)
+		test_replay_destroy(test->replay);
+
+	if (test->position_resource == resource) {
+		test->position_resource = NULL;
+		wl_list_remove(&test->pointer_motion_listener.link);
+		wl_list_init(&test->pointer_motion_listener.link);
+	}
+}
+
 static void
 bind_test(struct wl_client *client, void *data, uint32_t version, uint32_t id)
 {
@@ -542,7 +893,8 @@ bind_test(struct wl_client *client, void *data, uint32_t version, uint32_t id)
 	}
 
 	wl_resource_set_implementation(resource,
-				       &test_implementation, test, NULL);
+				       &test_implementation, test,
+				       destroy_test);
 
 	notify_pointer_position(test, resource);
 }
@@ -600,6 +952,10 @@ module_init(struct weston_compositor *ec,
 	weston_seat_init_keyboard(&test->seat, NULL);
 	weston_seat_init_touch(&test->seat);
 
+	test->pointer_motion_listener.notify = pointer_motion_notify;
+	wl_list_init(&test->pointer_motion_listener.link);
+	wl_list_init(&test->output_created_listener.link);
+
 	loop = wl_display_get_event_loop(ec->wl_display);
 	wl_event_loop_add_idle(loop, idle_launch_client, test);
 
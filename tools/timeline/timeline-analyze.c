@@ -0,0 +1,727 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Reads a binary weston timeline log (weston-timeline-*.wtl) and reports
+ * per output the repaint durations, the time from repaint start to
+ * presentation and the missed vblanks, per surface the latency from
+ * commit to presentation, and the slowest frames with the events that
+ * led to them. Limits can be given to make the exit status fail, for
+ * use in automated performance tests.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "shared/config-parser.h"
+#include "shared/helpers.h"
+#include "shared/histogram.h"
+#include "timeline-reader.h"
+
+/* Events shown before the end of each slow frame */
+#define FRAME_CONTEXT_EVENTS 40
+
+struct point {
+	const char *name;
+	uint64_t time;
+	uint64_t vblank;
+	uint32_t output;
+	uint32_t surface;
+	bool has_vblank;
+	bool vblank_invalid;
+};
+
+struct frame {
+	uint32_t output;
+	uint64_t begin;
+	uint64_t posted;
+	uint64_t present;
+	/* Indices in the point array */
+	size_t first_point;
+	size_t last_point;
+};
+
+struct pending_commit {
+	uint32_t surface;
+	uint64_t time;
+	uint64_t flush_time;
+};
+
+struct output_info {
+	bool defined;
+	char *name;
+
+	struct weston_histogram repaint;
+	struct weston_histogram begin_to_present;
+	uint32_t deadline_missed;
+
+	/* Frame being repainted, -1 if none */
+	long current_frame;
+	/* Where the previous frame of this output ended */
+	size_t context_start;
+
+	/* Presentation times, 0 marks the start of a repaint loop */
+	uint64_t *vblanks;
+	size_t vblanks_count, vblanks_alloc;
+
+	/* Surfaces flushed to this output and not presented yet */
+	struct pending_commit *commits;
+	size_t commits_count, commits_alloc;
+};
+
+struct surface_info {
+	bool defined;
+	char *label;
+	uint32_t main_surface;
+
+	/* First commit with damage not yet flushed, 0 if none */
+	uint64_t commit_time;
+	struct weston_histogram commit_to_present;
+};
+
+struct analysis {
+	char **names;
+	size_t names_count, names_alloc;
+
+	struct point *points;
+	size_t points_count, points_alloc;
+
+	struct frame *frames;
+	size_t frames_count, frames_alloc;
+
+	struct output_info *outputs;
+	uint32_t outputs_size;
+
+	struct surface_info *surfaces;
+	uint32_t surfaces_size;
+
+	struct weston_histogram all_commit_to_present;
+	uint32_t total_missed;
+};
+
+static void *
+grow(void *array, size_t *alloc, size_t count, size_t elem_size)
+{
+	void *p;
+	size_t size;
+
+	if (count < *alloc)
+		return array;
+
+	size = *alloc ? *alloc * 2 : 64;
+	p = realloc(array, size * elem_size);
+	if (!p) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	*alloc = size;
+
+	return p;
+}
+
+#define APPEND(array, count, alloc) \
+	(array = grow(array, &(alloc), count, sizeof *(array)), \
+	 &(array)[(count)++])
+
+static const char *
+intern_name(struct analysis *an, const char *name)
+{
+	char **slot;
+	size_t i;
+
+	for (i = 0; i < an->names_count; i++)
+		if (strcmp(an->names[i], name) == 0)
+			return an->names[i];
+
+	slot = APPEND(an->names, an->names_count, an->names_alloc);
+	*slot = strdup(name);
+	if (!*slot) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return *slot;
+}
+
+static struct output_info *
+get_output(struct analysis *an, uint32_t id)
+{
+	struct output_info *outputs;
+	uint32_t i, size;
+
+	if (id >= an->outputs_size) {
+		size = an->outputs_size ? an->outputs_size : 8;
+		while (size <= id)
+			size *= 2;
+
+		outputs = realloc(an->outputs, size * sizeof *outputs);
+		if (!outputs) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+
+		memset(outputs + an->outputs_size, 0,
+		       (size - an->outputs_size) * sizeof *outputs);
+		for (i = an->outputs_size; i < size; i++) {
+			weston_histogram_init(&outputs[i].repaint);
+			weston_histogram_init(&outputs[i].begin_to_present);
+			outputs[i].current_frame = -1;
+		}
+
+		an->outputs = outputs;
+		an->outputs_size = size;
+	}
+
+	return &an->outputs[id];
+}
+
+static struct surface_info *
+get_surface(struct analysis *an, uint32_t id)
+{
+	struct surface_info *surfaces;
+	uint32_t i, size;
+
+	if (id >= an->surfaces_size) {
+		size = an->surfaces_size ? an->surfaces_size : 64;
+		while (size <= id)
+			size *= 2;
+
+		surfaces = realloc(an->surfaces, size * sizeof *surfaces);
+		if (!surfaces) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+
+		memset(surfaces + an->surfaces_size, 0,
+		       (size - an->surfaces_size) * sizeof *surfaces);
+		for (i = an->surfaces_size; i < size; i++)
+			weston_histogram_init(&surfaces[i].commit_to_present);
+
+		an->surfaces = surfaces;
+		an->surfaces_size = size;
+	}
+
+	return &an->surfaces[id];
+}
+
+static uint32_t
+nsec_to_usec(uint64_t nsec)
+{
+	return nsec / 1000 > UINT32_MAX ? UINT32_MAX : nsec / 1000;
+}
+
+static void
+handle_repaint_begin(struct analysis *an, const struct point *pt)
+{
+	struct output_info *out = get_output(an, pt->output);
+	struct frame *frame;
+
+	frame = APPEND(an->frames, an->frames_count, an->frames_alloc);
+	memset(frame, 0, sizeof *frame);
+	frame->output = pt->output;
+	frame->begin = pt->time;
+	frame->first_point = out->context_start;
+
+	out->current_frame = an->frames_count - 1;
+}
+
+static void
+handle_repaint_posted(struct analysis *an, const struct point *pt)
+{
+	struct output_info *out = get_output(an, pt->output);
+	struct frame *frame;
+
+	if (out->current_frame < 0)
+		return;
+
+	frame = &an->frames[out->current_frame];
+	frame->posted = pt->time;
+	weston_histogram_add(&out->repaint,
+			     nsec_to_usec(frame->posted - frame->begin));
+}
+
+static void
+handle_repaint_finished(struct analysis *an, const struct point *pt)
+{
+	struct output_info *out = get_output(an, pt->output);
+	struct pending_commit *commit;
+	struct surface_info *surf;
+	struct frame *frame;
+	uint64_t *vblank;
+	uint64_t present;
+	size_t i, kept;
+
+	present = pt->has_vblank ? pt->vblank : pt->time;
+
+	/* Restarting the repaint loop reports a stamp that is not a vblank,
+	 * it would skew the frame intervals. */
+	if (!pt->vblank_invalid) {
+		vblank = APPEND(out->vblanks, out->vblanks_count,
+				out->vblanks_alloc);
+		*vblank = present;
+	}
+
+	out->context_start = an->points_count - 1;
+
+	if (out->current_frame < 0)
+		return;
+
+	frame = &an->frames[out->current_frame];
+	frame->present = present;
+	frame->last_point = an->points_count - 1;
+	out->current_frame = -1;
+
+	if (frame->posted && present >= frame->begin)
+		weston_histogram_add(&out->begin_to_present,
+				     nsec_to_usec(present - frame->begin));
+
+	/* Damage flushed after this frame was posted, while another
+	 * output repainted, goes to the next frame. */
+	for (i = 0, kept = 0; i < out->commits_count; i++) {
+		commit = &out->commits[i];
+		if (!frame->posted || commit->flush_time > frame->posted) {
+			out->commits[kept++] = *commit;
+			continue;
+		}
+
+		if (present < commit->time)
+			continue;
+
+		surf = get_surface(an, commit->surface);
+		weston_histogram_add(&surf->commit_to_present,
+				     nsec_to_usec(present - commit->time));
+		weston_histogram_add(&an->all_commit_to_present,
+				     nsec_to_usec(present - commit->time));
+	}
+	out->commits_count = kept;
+}
+
+static void
+handle_repaint_exit_loop(struct analysis *an, const struct point *pt)
+{
+	struct output_info *out = get_output(an, pt->output);
+	uint64_t *vblank;
+
+	vblank = APPEND(out->vblanks, out->vblanks_count, out->vblanks_alloc);
+	*vblank = 0;
+}
+
+static void
+handle_commit_damage(struct analysis *an, const struct point *pt)
+{
+	struct surface_info *surf = get_surface(an, pt->surface);
+
+	if (surf->commit_time == 0)
+		surf->commit_time = pt->time;
+}
+
+static void
+handle_flush_damage(struct analysis *an, const struct point *pt)
+{
+	struct surface_info *surf = get_surface(an, pt->surface);
+	struct output_info *out;
+	struct pending_commit *commit;
+
+	if (surf->commit_time == 0 || pt->output == 0)
+		return;
+
+	out = get_output(an, pt->output);
+	commit = APPEND(out->commits, out->commits_count, out->commits_alloc);
+	commit->surface = pt->surface;
+	commit->time = surf->commit_time;
+	commit->flush_time = pt->time;
+	surf->commit_time = 0;
+}
+
+static void
+handle_point(struct analysis *an, const struct point *pt)
+{
+	if (strcmp(pt->name, "core_repaint_begin") == 0)
+		handle_repaint_begin(an, pt);
+	else if (strcmp(pt->name, "core_repaint_posted") == 0)
+		handle_repaint_posted(an, pt);
+	else if (strcmp(pt->name, "core_repaint_finished") == 0)
+		handle_repaint_finished(an, pt);
+	else if (strcmp(pt->name, "core_repaint_exit_loop") == 0)
+		handle_repaint_exit_loop(an, pt);
+	else if (strcmp(pt->name, "core_commit_damage") == 0)
+		handle_commit_damage(an, pt);
+	else if (strcmp(pt->name, "core_flush_damage") == 0)
+		handle_flush_damage(an, pt);
+	else if (strcmp(pt->name, "core_repaint_deadline_missed") == 0)
+		get_output(an, pt->output)->deadline_missed++;
+}
+
+static void
+define_object(struct analysis *an, const struct timeline_event *ev)
+{
+	const struct weston_timeline_record *rec = ev->record;
+	struct output_info *out;
+	struct surface_info *surf;
+
+	if (rec->type == WESTON_TIMELINE_RECORD_OUTPUT) {
+		out = get_output(an, rec->id);
+		free(out->name);
+		out->name = strdup(ev->text ? ev->text : "");
+		out->defined = true;
+	} else if (rec->type == WESTON_TIMELINE_RECORD_SURFACE) {
+		surf = get_surface(an, rec->id);
+		free(surf->label);
+		surf->label = strdup(ev->text ? ev->text : "");
+		surf->main_surface = rec->output;
+		surf->defined = true;
+	}
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+	uint64_t ua = *(const uint64_t *) a;
+	uint64_t ub = *(const uint64_t *) b;
+
+	return ua < ub ? -1 : ua > ub;
+}
+
+/* Refresh cycles skipped between presentations of a repaint loop, with
+ * the refresh period estimated as the median interval. */
+static uint32_t
+count_missed_vblanks(struct output_info *out, uint64_t *period)
+{
+	uint64_t *deltas;
+	size_t i, n = 0;
+	uint32_t missed = 0;
+	uint64_t cycles;
+
+	*period = 0;
+
+	deltas = calloc(out->vblanks_count + 1, sizeof *deltas);
+	if (!deltas)
+		return 0;
+
+	for (i = 1; i < out->vblanks_count; i++)
+		if (out->vblanks[i] && out->vblanks[i - 1] &&
+		    out->vblanks[i] > out->vblanks[i - 1])
+			deltas[n++] = out->vblanks[i] - out->vblanks[i - 1];
+
+	if (n == 0)
+		goto out;
+
+	qsort(deltas, n, sizeof *deltas, compare_u64);
+	*period = deltas[n / 2];
+
+	for (i = 0; i < n; i++) {
+		cycles = (deltas[i] + *period / 2) / *period;
+		if (cycles > 1)
+			missed += cycles - 1;
+	}
+
+out:
+	free(deltas);
+	return missed;
+}
+
+static void
+print_histogram(const char *label, const struct weston_histogram *h)
+{
+	if (h->count == 0) {
+		printf("  %-22s no samples\n", label);
+		return;
+	}
+
+	printf("  %-22s %8" PRIu64 " %8u %8u %8u %8u %8u\n", label, h->count,
+	       h->min, weston_histogram_mean(h),
+	       weston_histogram_percentile(h, 50),
+	       weston_histogram_percentile(h, 99), h->max);
+}
+
+static void
+print_histogram_header(void)
+{
+	printf("  %-22s %8s %8s %8s %8s %8s %8s\n", "usec",
+	       "count", "min", "avg", "p50", "p99", "max");
+}
+
+static void
+print_outputs(struct analysis *an)
+{
+	struct output_info *out;
+	uint64_t period;
+	uint32_t id, missed;
+
+	for (id = 1; id < an->outputs_size; id++) {
+		out = &an->outputs[id];
+		if (!out->defined && out->repaint.count == 0)
+			continue;
+
+		missed = count_missed_vblanks(out, &period);
+		an->total_missed += missed;
+
+		printf("output %u '%s':\n", id, out->name ? out->name : "?");
+		print_histogram_header();
+		print_histogram("repaint", &out->repaint);
+		print_histogram("begin_to_present", &out->begin_to_present);
+		printf("  missed vblanks: %u (refresh period %.3f ms), "
+		       "deadline misses recorded: %u\n\n", missed,
+		       period / 1000000.0, out->deadline_missed);
+	}
+}
+
+static void
+print_surfaces(struct analysis *an)
+{
+	struct surface_info *surf;
+	uint32_t id;
+	bool header = false;
+
+	for (id = 1; id < an->surfaces_size; id++) {
+		surf = &an->surfaces[id];
+		if (surf->commit_to_present.count == 0)
+			continue;
+
+		if (!header) {
+			printf("commit to present, per surface:\n");
+			print_histogram_header();
+			header = true;
+		}
+
+		printf("  surface %u '%s'", id,
+		       surf->label ? surf->label : "?");
+		if (surf->main_surface && surf->main_surface != id)
+			printf(", main surface %u", surf->main_surface);
+		printf("\n");
+		print_histogram("", &surf->commit_to_present);
+	}
+
+	if (header)
+		printf("\n");
+}
+
+static int
+compare_frame_duration(const void *a, const void *b)
+{
+	const struct frame *fa = *(const struct frame * const *) a;
+	const struct frame *fb = *(const struct frame * const *) b;
+	uint64_t da = fa->posted - fa->begin;
+	uint64_t db = fb->posted - fb->begin;
+
+	return da < db ? 1 : da > db ? -1 : 0;
+}
+
+static void
+print_point(const struct point *pt, uint64_t origin)
+{
+	printf("    %+10.3f ms %-30s", ((int64_t) (pt->time - origin)) / 1e6,
+	       pt->name);
+	if (pt->output)
+		printf(" output %u", pt->output);
+	if (pt->surface)
+		printf(" surface %u", pt->surface);
+	if (pt->has_vblank)
+		printf(" vblank %+.3f ms",
+		       ((int64_t) (pt->vblank - origin)) / 1e6);
+	printf("\n");
+}
+
+static void
+print_slowest_frames(struct analysis *an, int count)
+{
+	struct frame **sorted;
+	struct frame *frame;
+	size_t i, n = 0, first, p;
+
+	if (count <= 0)
+		return;
+
+	sorted = calloc(an->frames_count + 1, sizeof *sorted);
+	if (!sorted)
+		return;
+
+	for (i = 0; i < an->frames_count; i++)
+		if (an->frames[i].present >= an->frames[i].begin &&
+		    an->frames[i].posted)
+			sorted[n++] = &an->frames[i];
+
+	qsort(sorted, n, sizeof *sorted, compare_frame_duration);
+
+	for (i = 0; i < n && i < (size_t) count; i++) {
+		frame = sorted[i];
+
+		printf("slow frame %zu: output %u, repaint %.3f ms, "
+		       "presented %.3f ms after begin\n", i + 1,
+		       frame->output, (frame->posted - frame->begin) / 1e6,
+		       (frame->present - frame->begin) / 1e6);
+
+		first = frame->first_point;
+		if (frame->last_point - first >= FRAME_CONTEXT_EVENTS)
+			first = frame->last_point - FRAME_CONTEXT_EVENTS + 1;
+
+		for (p = first; p <= frame->last_point; p++)
+			print_point(&an->points[p], frame->begin);
+		printf("\n");
+	}
+
+	free(sorted);
+}
+
+static void
+analysis_release(struct analysis *an)
+{
+	uint32_t i;
+
+	for (i = 0; i < an->outputs_size; i++) {
+		free(an->outputs[i].name);
+		free(an->outputs[i].vblanks);
+		free(an->outputs[i].commits);
+	}
+	for (i = 0; i < an->surfaces_size; i++)
+		free(an->surfaces[i].label);
+	for (i = 0; i < an->names_count; i++)
+		free(an->names[i]);
+
+	free(an->outputs);
+	free(an->surfaces);
+	free(an->names);
+	free(an->points);
+	free(an->frames);
+}
+
+static void
+usage(const char *prog, int exit_code)
+{
+	fprintf(stderr, "usage: %s [options] <timeline.wtl>\n\n"
+		"Analyzes repaint latency in a binary weston timeline log.\n\n"
+		"  --slowest=N\t\t\tshow the N slowest frames, default 5\n"
+		"  --max-repaint-p99=USEC\tfail if the 99th percentile "
+		"repaint of an output is longer\n"
+		"  --max-latency-p99=USEC\tfail if the 99th percentile "
+		"commit to present latency is longer\n"
+		"  --max-missed=N\t\tfail if more than N vblanks were "
+		"missed\n"
+		"  -h, --help\t\t\tthis help message\n", prog);
+
+	exit(exit_code);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timeline_reader reader;
+	struct weston_timeline_record record;
+	struct timeline_event ev;
+	struct analysis an;
+	struct point *pt;
+	int32_t slowest = 5;
+	int32_t max_repaint_p99 = -1;
+	int32_t max_latency_p99 = -1;
+	int32_t max_missed = -1;
+	int32_t help = 0;
+	uint32_t id, p99;
+	bool failed = false;
+	int ret;
+
+	const struct weston_option options[] = {
+		{ WESTON_OPTION_INTEGER, "slowest", 0, &slowest },
+		{ WESTON_OPTION_INTEGER, "max-repaint-p99", 0,
+		  &max_repaint_p99 },
+		{ WESTON_OPTION_INTEGER, "max-latency-p99", 0,
+		  &max_latency_p99 },
+		{ WESTON_OPTION_INTEGER, "max-missed", 0, &max_missed },
+		{ WESTON_OPTION_BOOLEAN, "help", 'h', &help },
+	};
+
+	parse_options(options, ARRAY_LENGTH(options), &argc, argv);
+
+	if (help)
+		usage(argv[0], EXIT_SUCCESS);
+	if (argc != 2)
+		usage(argv[0], EXIT_FAILURE);
+
+	if (timeline_reader_open(&reader, argv[1]) < 0)
+		return EXIT_FAILURE;
+
+	memset(&an, 0, sizeof an);
+	weston_histogram_init(&an.all_commit_to_present);
+
+	while ((ret = timeline_reader_next(&reader, &record, &ev)) > 0) {
+		if (record.type != WESTON_TIMELINE_RECORD_POINT) {
+			define_object(&an, &ev);
+			continue;
+		}
+
+		pt = APPEND(an.points, an.points_count, an.points_alloc);
+		pt->name = intern_name(&an, ev.name);
+		pt->time = record.time;
+		pt->vblank = record.vblank;
+		pt->output = record.output;
+		pt->surface = record.surface;
+		pt->has_vblank = record.aux & WESTON_TIMELINE_POINT_VBLANK;
+		pt->vblank_invalid =
+			record.aux & WESTON_TIMELINE_POINT_VBLANK_INVALID;
+
+		handle_point(&an, pt);
+	}
+
+	if (ret < 0)
+		fprintf(stderr, "%s: truncated or corrupt timeline log, "
+			"analyzing what could be read\n", argv[1]);
+
+	timeline_reader_close(&reader);
+
+	print_outputs(&an);
+	print_surfaces(&an);
+	print_slowest_frames(&an, slowest);
+
+	for (id = 1; id < an.outputs_size; id++) {
+		p99 = weston_histogram_percentile(&an.outputs[id].repaint, 99);
+		if (max_repaint_p99 >= 0 && p99 > (uint32_t) max_repaint_p99) {
+			printf("FAIL: output %u repaint p99 %u usec "
+			       "exceeds %d usec\n", id, p99, max_repaint_p99);
+			failed = true;
+		}
+	}
+
+	p99 = weston_histogram_percentile(&an.all_commit_to_present, 99);
+	if (max_latency_p99 >= 0 && p99 > (uint32_t) max_latency_p99) {
+		printf("FAIL: commit to present p99 %u usec exceeds %d usec\n",
+		       p99, max_latency_p99);
+		failed = true;
+	}
+
+	if (max_missed >= 0 && an.total_missed > (uint32_t) max_missed) {
+		printf("FAIL: %u missed vblanks exceed %d\n",
+		       an.total_missed, max_missed);
+		failed = true;
+	}
+
+	analysis_release(&an);
+
+	return failed || ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Converts a binary weston timeline log (weston-timeline-*.wtl) into the
+ * JSON stream format understood by existing timeline tools, on stdout.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "timeline-reader.h"
+
+static void
+print_quoted_string(FILE *fp, const char *str)
+{
+	if (!str) {
+		fprintf(fp, "null");
+		return;
+	}
+
+	fprintf(fp, "\"%s\"", str);
+}
+
+static void
+print_time(FILE *fp, uint64_t nsec)
+{
+	fprintf(fp, "[%" PRId64 ", %ld]",
+		(int64_t)(nsec / 1000000000), (long)(nsec % 1000000000));
+}
+
+static void
+print_event(FILE *fp, const struct timeline_event *ev)
+{
+	const struct weston_timeline_record *rec = ev->record;
+
+	switch (rec->type) {
+	case WESTON_TIMELINE_RECORD_OUTPUT:
+		fprintf(fp, "{ \"id\":%u, "
+			"\"type\":\"weston_output\", \"name\":", rec->id);
+		print_quoted_string(fp, ev->text);
+		fprintf(fp, " }\n");
+		break;
+	case WESTON_TIMELINE_RECORD_SURFACE:
+		fprintf(fp, "{ \"id\":%u, "
+			"\"type\":\"weston_surface\", \"desc\":", rec->id);
+		print_quoted_string(fp, ev->text);
+		if (rec->output)
+			fprintf(fp, ", \"main_surface\":%u", rec->output);
+		fprintf(fp, " }\n");
+		break;
+	case WESTON_TIMELINE_RECORD_POINT:
+		fprintf(fp, "{ \"T\":");
+		print_time(fp, rec->time);
+		fprintf(fp, ", \"N\":\"%s\"", ev->name);
+		if (rec->surface)
+			fprintf(fp, ", \"ws\":%u", rec->surface);
+		if (rec->output)
+			fprintf(fp, ", \"wo\":%u", rec->output);
+		if (rec->aux & WESTON_TIMELINE_POINT_VBLANK) {
+			fprintf(fp, ", \"vblank\":");
+			print_time(fp, rec->vblank);
+		}
+		fprintf(fp, " }\n");
+		break;
+	default:
+		break;
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timeline_reader reader;
+	struct weston_timeline_record record;
+	struct timeline_event ev;
+	int ret;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <timeline.wtl>\n\n"
+			"Converts a binary weston timeline log to JSON "
+			"on stdout.\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (timeline_reader_open(&reader, argv[1]) < 0)
+		return EXIT_FAILURE;
+
+	while ((ret = timeline_reader_next(&reader, &record, &ev)) > 0)
+		print_event(stdout, &ev);
+
+	if (ret < 0)
+		fprintf(stderr, "%s: truncated or corrupt timeline log\n",
+			argv[1]);
+
+	timeline_reader_close(&reader);
+
+	return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
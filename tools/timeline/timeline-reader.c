@@ -0,0 +1,192 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "timeline-reader.h"
+
+/** Open a binary timeline log
+ *
+ * \param reader The reader to initialize.
+ * \param filename The log to read, or "-" for standard input.
+ * \return 0 on success, -1 with an error printed on failure.
+ */
+int
+timeline_reader_open(struct timeline_reader *reader, const char *filename)
+{
+	memset(reader, 0, sizeof *reader);
+
+	if (strcmp(filename, "-") == 0)
+		reader->file = stdin;
+	else
+		reader->file = fopen(filename, "r");
+
+	if (!reader->file) {
+		fprintf(stderr, "cannot open '%s': %m\n", filename);
+		return -1;
+	}
+
+	if (fread(&reader->header, sizeof reader->header, 1,
+		  reader->file) != 1 ||
+	    reader->header.magic != WESTON_TIMELINE_MAGIC) {
+		fprintf(stderr, "'%s' is not a weston timeline log\n",
+			filename);
+		goto err;
+	}
+
+	if (reader->header.version != WESTON_TIMELINE_VERSION ||
+	    reader->header.record_size != sizeof(struct weston_timeline_record)) {
+		fprintf(stderr, "'%s': unsupported timeline version %u\n",
+			filename, reader->header.version);
+		goto err;
+	}
+
+	return 0;
+
+err:
+	if (reader->file != stdin)
+		fclose(reader->file);
+	reader->file = NULL;
+	return -1;
+}
+
+static int
+read_text(struct timeline_reader *reader, uint16_t len)
+{
+	size_t rsize = sizeof(struct weston_timeline_record);
+	size_t nrecords = (len + rsize - 1) / rsize;
+
+	if (reader->text_size < nrecords * rsize + 1) {
+		free(reader->text);
+		reader->text_size = nrecords * rsize + 1;
+		reader->text = malloc(reader->text_size);
+		if (!reader->text)
+			return -1;
+	}
+
+	if (nrecords && fread(reader->text, rsize, nrecords,
+			      reader->file) != nrecords)
+		return -1;
+
+	reader->text[len] = '\0';
+
+	return 0;
+}
+
+static int
+define_name(struct timeline_reader *reader, uint32_t id, const char *text)
+{
+	char **names;
+	uint32_t size;
+
+	if (id >= reader->names_size) {
+		size = reader->names_size ? reader->names_size : 64;
+		while (size <= id)
+			size *= 2;
+
+		names = realloc(reader->names, size * sizeof *names);
+		if (!names)
+			return -1;
+
+		memset(names + reader->names_size, 0,
+		       (size - reader->names_size) * sizeof *names);
+		reader->names = names;
+		reader->names_size = size;
+	}
+
+	free(reader->names[id]);
+	reader->names[id] = strdup(text ? text : "");
+
+	return reader->names[id] ? 0 : -1;
+}
+
+/** Read the next event from a timeline log
+ *
+ * \param reader The reader.
+ * \param record Storage for the record read.
+ * \param event[out] The event, pointing into record and the reader.
+ * \return 1 when an event was read, 0 at the end of the log, -1 on
+ * error.
+ *
+ * Name definitions are consumed by the reader, but returned like any
+ * other event. The strings in event stay valid until the next call.
+ */
+int
+timeline_reader_next(struct timeline_reader *reader,
+		     struct weston_timeline_record *record,
+		     struct timeline_event *event)
+{
+	if (fread(record, sizeof *record, 1, reader->file) != 1)
+		return ferror(reader->file) ? -1 : 0;
+
+	event->record = record;
+	event->text = NULL;
+	event->name = NULL;
+
+	switch (record->type) {
+	case WESTON_TIMELINE_RECORD_POINT:
+		if (record->id < reader->names_size)
+			event->name = reader->names[record->id];
+		if (!event->name)
+			event->name = "unknown";
+		break;
+	case WESTON_TIMELINE_RECORD_NAME:
+	case WESTON_TIMELINE_RECORD_OUTPUT:
+	case WESTON_TIMELINE_RECORD_SURFACE:
+		if (read_text(reader, record->aux) < 0)
+			return -1;
+		if (record->aux)
+			event->text = reader->text;
+		if (record->type == WESTON_TIMELINE_RECORD_NAME &&
+		    define_name(reader, record->id, event->text) < 0)
+			return -1;
+		break;
+	default:
+		fprintf(stderr, "unknown timeline record type %u\n",
+			record->type);
+		return -1;
+	}
+
+	return 1;
+}
+
+void
+timeline_reader_close(struct timeline_reader *reader)
+{
+	uint32_t i;
+
+	for (i = 0; i < reader->names_size; i++)
+		free(reader->names[i]);
+	free(reader->names);
+	free(reader->text);
+
+	if (reader->file && reader->file != stdin)
+		fclose(reader->file);
+	reader->file = NULL;
+}
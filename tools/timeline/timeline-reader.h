@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_TIMELINE_READER_H
+#define WESTON_TIMELINE_READER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "shared/timeline-format.h"
+
+struct timeline_reader {
+	FILE *file;
+	struct weston_timeline_header header;
+
+	/* Point names by id, index 0 unused */
+	char **names;
+	uint32_t names_size;
+
+	char *text;
+	size_t text_size;
+};
+
+struct timeline_event {
+	const struct weston_timeline_record *record;
+	/* Definitions: the NUL-terminated text, NULL if empty */
+	const char *text;
+	/* Points: the name of the point */
+	const char *name;
+};
+
+int
+timeline_reader_open(struct timeline_reader *reader, const char *filename);
+
+int
+timeline_reader_next(struct timeline_reader *reader,
+		     struct weston_timeline_record *record,
+		     struct timeline_event *event);
+
+void
+timeline_reader_close(struct timeline_reader *reader);
+
+#endif /* WESTON_TIMELINE_READER_H */
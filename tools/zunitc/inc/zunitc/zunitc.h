@@ -257,6 +257,49 @@ zuc_set_spawn(bool spawn);
 void
 zuc_set_output_junit(bool enable);
 
+/**
+ * Enables benchmark mode.
+ * Defaults to false.
+ *
+ * In benchmark mode only tests defined with ZUC_BENCH() are run, and each
+ * of them is calibrated, warmed up and timed over several samples.
+ * Otherwise benchmarks run their loop a single time, like a normal test.
+ *
+ * @param enable true to run benchmarks, false to run tests.
+ * @see zuc_set_bench_samples()
+ * @see zuc_set_bench_time()
+ */
+void
+zuc_set_bench(bool enable);
+
+/**
+ * Sets the number of timed samples taken for each benchmark.
+ * Defaults to 10.
+ *
+ * @param samples the number of samples, must be positive.
+ */
+void
+zuc_set_bench_samples(int samples);
+
+/**
+ * Sets the approximate duration of each benchmark sample. The number of
+ * iterations per sample is scaled until a sample takes about this long.
+ * Defaults to 20 ms.
+ *
+ * @param msec the target sample duration in milliseconds.
+ */
+void
+zuc_set_bench_time(int msec);
+
+/**
+ * Enables output in a JSON format that includes benchmark results.
+ * Defaults to false.
+ *
+ * @param enable true to generate JSON output, false to disable.
+ */
+void
+zuc_set_output_json(bool enable);
+
 /**
  * Defines a test case that can be registered to run.
  */
@@ -292,6 +335,49 @@ zuc_set_output_junit(bool enable);
 	\
 	static void zuctest_##tcase##_##test(void *data)
 
+/**
+ * Defines a benchmark that can be registered to run.
+ *
+ * The body may do any setup it needs and then runs the code to measure
+ * inside ZUC_BENCH_LOOP, which is the only part that is timed. The body is
+ * called several times while the iteration count is calibrated, so any
+ * setup must be repeatable. The usual checks can be used in the body.
+ *
+ * @see zuc_set_bench()
+ */
+#define ZUC_BENCH(tcase, test) \
+	static void zucbench_##tcase##_##test(struct zuc_bench *zuc_bench_); \
+	\
+	const struct zuc_registration zzz_##tcase##_##test \
+	__attribute__ ((section ("zuc_tsect"))) = \
+	{ \
+		#tcase, #test, 0,		\
+		0,				\
+		0,				\
+		zucbench_##tcase##_##test	\
+	}; \
+	\
+	static void zucbench_##tcase##_##test(struct zuc_bench *zuc_bench_)
+
+/**
+ * Runs the following statement as many times as the framework asks for
+ * and times it. Must be used exactly once in the body of a ZUC_BENCH(),
+ * and must not be left with break or goto.
+ */
+#define ZUC_BENCH_LOOP \
+	for (uint64_t zuc_bench_n_ = zucimpl_bench_start(zuc_bench_); \
+	     zuc_bench_n_ > 0 || zucimpl_bench_stop(zuc_bench_); \
+	     zuc_bench_n_--)
+
+/**
+ * Keeps the compiler from optimizing away work in a benchmark loop whose
+ * result would otherwise be unused.
+ *
+ * @param ptr pointer to the result of the work.
+ */
+#define ZUC_BENCH_KEEP(ptr) \
+	__asm__ __volatile__ ("" : : "g" (ptr) : "memory")
+
 
 /**
  * Returns true if the currently executing test has encountered any skips.
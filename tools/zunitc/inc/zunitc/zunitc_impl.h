@@ -66,6 +66,10 @@ typedef void (*zucimpl_test_fn)(void);
 
 typedef void (*zucimpl_test_fn_f)(void *);
 
+struct zuc_bench;
+
+typedef void (*zucimpl_bench_fn)(struct zuc_bench *);
+
 /**
  * Internal use structure for automatic test case registration.
  * Should not be used directly in code.
@@ -77,6 +81,8 @@ struct zuc_registration {
 	zucimpl_test_fn fn;		/**< function implementing base test. */
 	zucimpl_test_fn_f fn_f;	/**< function implementing test with
 					   fixture. */
+	zucimpl_bench_fn bench_fn;	/**< function implementing a
+					   benchmark. */
 } __attribute__ ((aligned (32)));
 
 
@@ -91,6 +97,12 @@ int
 zucimpl_tracepoint(char const *file, int line, const char *fmt, ...)
 	__attribute__ ((format (printf, 3, 4)));
 
+uint64_t
+zucimpl_bench_start(struct zuc_bench *bench);
+
+bool
+zucimpl_bench_stop(struct zuc_bench *bench);
+
 int
 zucimpl_expect_pred2(char const *file, int line,
 		     enum zuc_check_op, enum zuc_check_valtype valtype,
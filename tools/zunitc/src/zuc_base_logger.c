@@ -27,6 +27,7 @@
 
 #include "zuc_base_logger.h"
 
+#include <inttypes.h>
 #include <memory.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -293,6 +294,18 @@ void
 test_ended(void *data, struct zuc_test *test)
 {
 	struct base_data *bdata = data;
+	if (test->bench) {
+		styled_printf(bdata->use_color, STYLE_GOOD, "[    BENCH ]");
+		printf(" %s.%s %.2f ns/iter"
+		       " (min %.2f, mean %.2f, max %.2f, stddev %.2f;"
+		       " %d x %" PRIu64 " iterations)\n",
+		       test->test_case->name, test->name,
+		       test->bench->median_ns, test->bench->min_ns,
+		       test->bench->mean_ns, test->bench->max_ns,
+		       test->bench->stddev_ns, test->bench->samples,
+		       test->bench->iterations);
+	}
+
 	if (test->failed || test->fatal) {
 		styled_printf(bdata->use_color, STYLE_BAD, "[  FAILED  ]");
 		printf(" %s.%s (%ld ms)\n",
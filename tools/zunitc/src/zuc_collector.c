@@ -34,6 +34,7 @@
 
 #include "shared/zalloc.h"
 #include "zuc_event_listener.h"
+#include "zuc_types.h"
 #include "zunitc/zunitc_impl.h"
 
 #include <sys/types.h>
@@ -50,6 +51,12 @@
  * and updating.
  */
 
+/**
+ * Message type for benchmark results. Other messages carry one of the
+ * zuc_event_type values instead.
+ */
+#define MSG_BENCH_RESULT 0x100
+
 /**
  * Internal data struct for processing.
  */
@@ -79,6 +86,17 @@ pack_int32(char *ptr, int32_t val);
 static char *
 pack_intptr_t(char *ptr, intptr_t val);
 
+/**
+ * Stores raw bytes into the given buffer.
+ *
+ * @param ptr the buffer to store to.
+ * @param val pointer to the value to store.
+ * @param size the size of the value.
+ * @return a pointer to the position in the buffer after the stored value.
+ */
+static char *
+pack_raw(char *ptr, const void *val, size_t size);
+
 /**
  * Extracts a int32_t from the given buffer.
  *
@@ -101,6 +119,18 @@ unpack_int32(char const *ptr, int32_t *val);
 static char const *
 unpack_intptr_t(char const *ptr, intptr_t *val);
 
+/**
+ * Extracts raw bytes from the given buffer.
+ *
+ * @param ptr the buffer to extract from.
+ * @param val pointer to the value to set.
+ * @param size the size of the value.
+ * @return a pointer to the position in the buffer after the extracted
+ * value.
+ */
+static char const *
+unpack_raw(char const *ptr, void *val, size_t size);
+
 /**
  * Extracts a length-prefixed string from the given buffer.
  *
@@ -152,6 +182,9 @@ check_triggered(void *data, char const *file, int line,
 static void
 collect_event(void *data, char const *file, int line, const char *expr1);
 
+static void
+bench_result(void *data, struct zuc_test *test);
+
 struct zuc_event_listener *
 zuc_collector_create(int *pipe_fd)
 {
@@ -165,6 +198,7 @@ zuc_collector_create(int *pipe_fd)
 	listener->test_ended = test_ended;
 	listener->check_triggered = check_triggered;
 	listener->collect_event = collect_event;
+	listener->bench_result = bench_result;
 
 	return listener;
 }
@@ -183,6 +217,13 @@ pack_intptr_t(char *ptr, intptr_t val)
 	return ptr + sizeof(val);
 }
 
+char *
+pack_raw(char *ptr, const void *val, size_t size)
+{
+	memcpy(ptr, val, size);
+	return ptr + size;
+}
+
 static char *
 pack_cstr(char *ptr, intptr_t val, int len)
 {
@@ -239,6 +280,40 @@ collect_event(void *data, char const *file, int line, const char *expr1)
 		    0, 0, expr1, "");
 }
 
+void
+bench_result(void *data, struct zuc_test *test)
+{
+	struct collector_data *cdata = data;
+	const struct zuc_bench_result *res = test->bench;
+	char buf[sizeof(int32_t) * 3 + sizeof(int64_t)
+		 + sizeof(double) * 5];
+	char *ptr;
+	int sent;
+	int count;
+
+	/* Results are already attached when running in-process. */
+	if (*cdata->fd == -1)
+		return;
+
+	ptr = pack_int32(buf, sizeof(buf) - 4);
+	ptr = pack_int32(ptr, MSG_BENCH_RESULT);
+	ptr = pack_raw(ptr, &res->iterations, sizeof(res->iterations));
+	ptr = pack_int32(ptr, res->samples);
+	ptr = pack_raw(ptr, &res->min_ns, sizeof(double));
+	ptr = pack_raw(ptr, &res->median_ns, sizeof(double));
+	ptr = pack_raw(ptr, &res->mean_ns, sizeof(double));
+	ptr = pack_raw(ptr, &res->stddev_ns, sizeof(double));
+	ptr = pack_raw(ptr, &res->max_ns, sizeof(double));
+
+	sent = 0;
+	while (sent < (int)sizeof(buf)) {
+		count = write(*cdata->fd, buf + sent, sizeof(buf) - sent);
+		if (count == -1)
+			break;
+		sent += count;
+	}
+}
+
 void
 store_event(struct collector_data *cdata,
 	    enum zuc_event_type event_type, char const *file, int line,
@@ -341,6 +416,13 @@ unpack_intptr_t(char const *ptr, intptr_t *val)
 	return ptr + sizeof(*val);
 }
 
+char const *
+unpack_raw(char const *ptr, void *val, size_t size)
+{
+	memcpy(val, ptr, size);
+	return ptr + size;
+}
+
 char const *
 unpack_string(char const *ptr, char **str)
 {
@@ -369,6 +451,30 @@ unpack_cstr(char const *ptr, char **str)
 	return ptr;
 }
 
+/**
+ * Extracts benchmark results from the given buffer and attaches them to
+ * the test.
+ */
+static void
+unpack_bench_result(char const *ptr, struct zuc_test *test)
+{
+	struct zuc_bench_result *res = zalloc(sizeof(*res));
+
+	if (!res)
+		return;
+
+	ptr = unpack_raw(ptr, &res->iterations, sizeof(res->iterations));
+	ptr = unpack_int32(ptr, &res->samples);
+	ptr = unpack_raw(ptr, &res->min_ns, sizeof(double));
+	ptr = unpack_raw(ptr, &res->median_ns, sizeof(double));
+	ptr = unpack_raw(ptr, &res->mean_ns, sizeof(double));
+	ptr = unpack_raw(ptr, &res->stddev_ns, sizeof(double));
+	ptr = unpack_raw(ptr, &res->max_ns, sizeof(double));
+
+	free(test->bench);
+	test->bench = res;
+}
+
 struct zuc_event *
 unpack_event(char const *ptr, int32_t len)
 {
@@ -417,10 +523,15 @@ zuc_process_message(struct zuc_test *test, int fd)
 		got = read(fd, raw, len);
 
 		tmp = unpack_int32(raw, &val);
-		event_type = val;
+		if (val == MSG_BENCH_RESULT) {
+			unpack_bench_result(tmp, test);
+		} else {
+			event_type = val;
 
-		struct zuc_event *evt = unpack_event(tmp, len - (tmp - raw));
-		zuc_attach_event(test, evt, event_type, true);
+			struct zuc_event *evt =
+				unpack_event(tmp, len - (tmp - raw));
+			zuc_attach_event(test, evt, event_type, true);
+		}
 		free(raw);
 	}
 	return got;
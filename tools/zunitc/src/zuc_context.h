@@ -46,6 +46,10 @@ struct zuc_context {
 	bool break_on_failure;
 	bool output_tap;
 	bool output_junit;
+	bool output_json;
+	bool bench;
+	int bench_samples;
+	int bench_time;
 	int fds[2];
 	char *filter;
 
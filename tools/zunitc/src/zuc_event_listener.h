@@ -162,6 +162,15 @@ struct zuc_event_listener {
 			      char const *file,
 			      int line,
 			      const char *expr1);
+
+	/**
+	 * Handler for the results of a benchmark becoming available.
+	 *
+	 * @param data the user data associated with this instance.
+	 * @param test the benchmark, with its results attached.
+	 */
+	void (*bench_result)(void *data,
+			     struct zuc_test *test);
 };
 
 /**
@@ -0,0 +1,198 @@
+/*
+ * Copyright © 2016 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "zuc_json_reporter.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "zunitc/zunitc.h"
+#include "zuc_event_listener.h"
+#include "zuc_types.h"
+
+#include "shared/zalloc.h"
+
+/**
+ * Hardcoded output name, next to the JUnit one.
+ */
+#define JSON_FNAME "test_detail.json"
+
+#define ISO_8601_FORMAT "%Y-%m-%dT%H:%M:%SZ"
+
+/**
+ * Internal data.
+ */
+struct json_data
+{
+	time_t begin;
+};
+
+/**
+ * Writes a string as a quoted JSON string.
+ *
+ * @param fp the stream to write to.
+ * @param str the string to write.
+ */
+static void
+emit_string(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(fp, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(fp, "\\u%04x", *str);
+		else
+			fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+/**
+ * Returns the status string for the test.
+ *
+ * @param test the test to check status of.
+ * @return the status string.
+ */
+static char const *
+get_test_status(struct zuc_test *test)
+{
+	if (test->disabled)
+		return "disabled";
+	else if (test->failed || test->fatal)
+		return "failed";
+	else if (test->skipped)
+		return "skipped";
+	else
+		return "passed";
+}
+
+/**
+ * Output the given test as a JSON object.
+ *
+ * @param fp the stream to write to.
+ * @param test the test to write out.
+ */
+static void
+emit_test(FILE *fp, struct zuc_test *test)
+{
+	struct zuc_bench_result *bench = test->bench;
+
+	fprintf(fp, "    { \"case\": ");
+	emit_string(fp, test->test_case->name);
+	fprintf(fp, ", \"name\": ");
+	emit_string(fp, test->name);
+	fprintf(fp, ", \"status\": \"%s\", \"time_ms\": %ld",
+		get_test_status(test), test->elapsed);
+
+	if (bench)
+		fprintf(fp, ",\n      \"bench\": { \"iterations\": %" PRIu64
+			", \"samples\": %d, \"min_ns\": %.3f"
+			", \"median_ns\": %.3f, \"mean_ns\": %.3f"
+			", \"stddev_ns\": %.3f, \"max_ns\": %.3f }",
+			bench->iterations, bench->samples, bench->min_ns,
+			bench->median_ns, bench->mean_ns, bench->stddev_ns,
+			bench->max_ns);
+
+	fprintf(fp, " }");
+}
+
+static void
+run_started(void *data, int live_case_count, int live_test_count,
+	    int disabled_count)
+{
+	struct json_data *jdata = data;
+
+	jdata->begin = time(NULL);
+}
+
+static void
+run_ended(void *data, int case_count, struct zuc_case **cases,
+	  int live_case_count, int live_test_count, int total_passed,
+	  int total_failed, int total_disabled, long total_elapsed)
+{
+	struct json_data *jdata = data;
+	const char *program = zuc_get_program_basename();
+	char timestamp[32] = "";
+	struct tm when;
+	bool first = true;
+	FILE *fp;
+	int i;
+	int j;
+
+	fp = fopen(JSON_FNAME, "we");
+	if (!fp) {
+		printf("%s:%d: error: Unable to open %s\n",
+		       __FILE__, __LINE__, JSON_FNAME);
+		return;
+	}
+
+	if (gmtime_r(&jdata->begin, &when))
+		strftime(timestamp, sizeof(timestamp), ISO_8601_FORMAT, &when);
+
+	fprintf(fp, "{\n  \"program\": ");
+	emit_string(fp, program ? program : "");
+	fprintf(fp, ",\n  \"timestamp\": \"%s\",\n", timestamp);
+	fprintf(fp, "  \"passed\": %d, \"failed\": %d, \"disabled\": %d,\n",
+		total_passed, total_failed, total_disabled);
+	fprintf(fp, "  \"tests\": [\n");
+
+	for (i = 0; i < case_count; ++i) {
+		for (j = 0; j < cases[i]->test_count; ++j) {
+			if (!first)
+				fprintf(fp, ",\n");
+			emit_test(fp, cases[i]->tests[j]);
+			first = false;
+		}
+	}
+
+	fprintf(fp, "\n  ]\n}\n");
+	fclose(fp);
+}
+
+static void
+destroy(void *data)
+{
+	free(data);
+}
+
+struct zuc_event_listener *
+zuc_json_reporter_create(void)
+{
+	struct zuc_event_listener *listener =
+		zalloc(sizeof(struct zuc_event_listener));
+
+	listener->data = zalloc(sizeof(struct json_data));
+	listener->destroy = destroy;
+	listener->run_started = run_started;
+	listener->run_ended = run_ended;
+
+	return listener;
+}
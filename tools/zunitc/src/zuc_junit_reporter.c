@@ -30,8 +30,10 @@
 #if ENABLE_JUNIT_XML
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <libxml/parser.h>
 #include <memory.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -254,6 +256,54 @@ get_test_status(struct zuc_test *test)
 		return "run";
 }
 
+static void
+emit_property(xmlNodePtr parent, const char *name, const char *fmt, ...)
+	__attribute__ ((format (printf, 3, 4)));
+
+static void
+emit_property(xmlNodePtr parent, const char *name, const char *fmt, ...)
+{
+	char *value = NULL;
+	va_list argp;
+	xmlNodePtr node;
+
+	va_start(argp, fmt);
+	if (vasprintf(&value, fmt, argp) < 0)
+		value = NULL;
+	va_end(argp);
+
+	if (!value)
+		return;
+
+	node = xmlNewChild(parent, NULL, BAD_CAST "property", NULL);
+	xmlSetProp(node, BAD_CAST "name", BAD_CAST name);
+	xmlSetProp(node, BAD_CAST "value", BAD_CAST value);
+	free(value);
+}
+
+/**
+ * Output the results of a benchmark as test properties, in nanoseconds
+ * per iteration.
+ *
+ * @param parent the parent node to add new content to.
+ * @param bench the benchmark results to write out.
+ */
+static void
+emit_bench(xmlNodePtr parent, struct zuc_bench_result *bench)
+{
+	xmlNodePtr node = xmlNewChild(parent, NULL,
+				      BAD_CAST "properties", NULL);
+
+	emit_property(node, "bench_iterations", "%" PRIu64,
+		      bench->iterations);
+	emit_property(node, "bench_samples", "%d", bench->samples);
+	emit_property(node, "bench_min_ns", "%.3f", bench->min_ns);
+	emit_property(node, "bench_median_ns", "%.3f", bench->median_ns);
+	emit_property(node, "bench_mean_ns", "%.3f", bench->mean_ns);
+	emit_property(node, "bench_stddev_ns", "%.3f", bench->stddev_ns);
+	emit_property(node, "bench_max_ns", "%.3f", bench->max_ns);
+}
+
 /**
  * Output the given test.
  *
@@ -278,6 +328,9 @@ emit_test(xmlNodePtr parent, struct zuc_test *test)
 
 	xmlSetProp(node, BAD_CAST "classname", BAD_CAST test->test_case->name);
 
+	if (test->bench)
+		emit_bench(node, test->bench);
+
 	if ((test->failed || test->fatal || test->skipped) && test->events) {
 		struct zuc_event *evt;
 		for (evt = test->events; evt; evt = evt->next)
@@ -30,6 +30,20 @@
 
 struct zuc_case;
 
+/**
+ * Timing of a benchmark, per iteration of its loop.
+ */
+struct zuc_bench_result
+{
+	uint64_t iterations; /**< iterations timed in each sample. */
+	int32_t samples;
+	double min_ns;
+	double median_ns;
+	double mean_ns;
+	double stddev_ns;
+	double max_ns;
+};
+
 /**
  * Represents a specific test.
  */
@@ -39,6 +53,7 @@ struct zuc_test
 	struct zuc_case *test_case;
 	zucimpl_test_fn fn;
 	zucimpl_test_fn_f fn_f;
+	zucimpl_bench_fn bench_fn;
 	char *name;
 	int disabled;
 	int skipped;
@@ -47,6 +62,7 @@ struct zuc_test
 	long elapsed;
 	struct zuc_event *events;
 	struct zuc_event *deferred;
+	struct zuc_bench_result *bench;
 };
 
 /**
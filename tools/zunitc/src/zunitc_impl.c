@@ -27,6 +27,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -44,6 +45,7 @@
 #include "zuc_collector.h"
 #include "zuc_context.h"
 #include "zuc_event_listener.h"
+#include "zuc_json_reporter.h"
 #include "zuc_junit_reporter.h"
 
 #include "shared/config-parser.h"
@@ -66,6 +68,21 @@ static char const DISABLED_PREFIX[] = "DISABLED_";
 
 #define MS_PER_SEC 1000L
 #define NANO_PER_MS 1000000L
+#define NANO_PER_SEC 1000000000L
+
+/* Upper bound for benchmark calibration, in case the loop is empty. */
+#define MAX_BENCH_ITERATIONS (1ULL << 40)
+
+/**
+ * Internal state of a single run of a benchmark body.
+ */
+struct zuc_bench {
+	uint64_t iterations;
+	bool started;
+	bool stopped;
+	struct timespec begin;
+	int64_t elapsed;
+};
 
 /**
  * Simple single-linked list structure.
@@ -84,6 +101,9 @@ static struct zuc_context g_ctx = {
 	.random = 0,
 	.spawn = true,
 	.break_on_failure = false,
+	.bench = false,
+	.bench_samples = 10,
+	.bench_time = 20,
 	.fds = {-1, -1},
 
 	.listeners = NULL,
@@ -159,6 +179,32 @@ zuc_set_output_junit(bool enable)
 	g_ctx.output_junit = enable;
 }
 
+void
+zuc_set_output_json(bool enable)
+{
+	g_ctx.output_json = enable;
+}
+
+void
+zuc_set_bench(bool enable)
+{
+	g_ctx.bench = enable;
+}
+
+void
+zuc_set_bench_samples(int samples)
+{
+	if (samples > 0)
+		g_ctx.bench_samples = samples;
+}
+
+void
+zuc_set_bench_time(int msec)
+{
+	if (msec > 0)
+		g_ctx.bench_time = msec;
+}
+
 const char *
 zuc_get_program_name(void)
 {
@@ -173,6 +219,7 @@ zuc_get_program_basename(void)
 
 static struct zuc_test *
 create_test(int order, zucimpl_test_fn fn, zucimpl_test_fn_f fn_f,
+	    zucimpl_bench_fn bench_fn,
 	    char const *case_name, char const *test_name,
 	    struct zuc_case *parent)
 {
@@ -181,8 +228,9 @@ create_test(int order, zucimpl_test_fn fn, zucimpl_test_fn_f fn_f,
 	test->order = order;
 	test->fn = fn;
 	test->fn_f = fn_f;
+	test->bench_fn = bench_fn;
 	test->name = strdup(test_name);
-	if ((!fn && !fn_f) ||
+	if ((!fn && !fn_f && !bench_fn) ||
 	    (strncmp(DISABLED_PREFIX,
 		     test_name, sizeof(DISABLED_PREFIX) - 1) == 0))
 		test->disabled = 1;
@@ -285,7 +333,7 @@ register_tests(void)
 		if (order < case_array[case_num]->order)
 			case_array[case_num]->order = order;
 		case_array[case_num]->tests[idx] =
-			create_test(order, reg->fn, reg->fn_f,
+			create_test(order, reg->fn, reg->fn_f, reg->bench_fn,
 				    reg->tcase, reg->test,
 				    case_array[case_num]);
 
@@ -351,6 +399,7 @@ free_test(struct zuc_test *test)
 	free(test->name);
 	free_events(&test->events);
 	free_events(&test->deferred);
+	free(test->bench);
 	free(test);
 }
 
@@ -416,6 +465,35 @@ out:
 	return parts;
 }
 
+static void
+remove_test(struct zuc_case *test_case, int index)
+{
+	int w;
+
+	free_test(test_case->tests[index]);
+	for (w = index + 1; w < test_case->test_count; w++)
+		test_case->tests[w - 1] = test_case->tests[w];
+	test_case->test_count--;
+}
+
+/* Prune any cases with no more tests. */
+static void
+remove_empty_cases(int *count, struct zuc_case **cases)
+{
+	int i;
+	int j;
+
+	for (i = *count - 1; i >= 0; --i) {
+		if (cases[i]->test_count < 1) {
+			free_test_case(cases[i]);
+			for (j = i + 1; j < *count; ++j)
+				cases[j - 1] = cases[j];
+			cases[*count - 1] = NULL;
+			(*count)--;
+		}
+	}
+}
+
 static void
 filter_cases(int *count, struct zuc_case **cases, char const *filter)
 {
@@ -454,14 +532,8 @@ filter_cases(int *count, struct zuc_case **cases, char const *filter)
 				for (x = negative; parts[x] && keep; ++x)
 					keep &= !wildcard_matches(parts[x],
 								  name);
-			if (!keep) {
-				int w;
-				free_test(test);
-				for (w = j + 1; w < cases[i]->test_count; w++)
-					cases[i]->tests[w - 1] =
-						cases[i]->tests[w];
-				cases[i]->test_count--;
-			}
+			if (!keep)
+				remove_test(cases[i], j);
 
 			free(name);
 		}
@@ -471,16 +543,24 @@ filter_cases(int *count, struct zuc_case **cases, char const *filter)
 	free(buf);
 	buf = NULL;
 
-	/* Prune any cases with no more tests. */
-	for (i = *count - 1; i >= 0; --i) {
-		if (cases[i]->test_count < 1) {
-			free_test_case(cases[i]);
-			for (j = i + 1; j < *count; ++j)
-				cases[j - 1] = cases[j];
-			cases[*count - 1] = NULL;
-			(*count)--;
-		}
-	}
+	remove_empty_cases(count, cases);
+}
+
+/**
+ * Removes all tests that are not benchmarks, for benchmark mode.
+ */
+static void
+filter_bench_cases(int *count, struct zuc_case **cases)
+{
+	int i;
+	int j;
+
+	for (i = 0; i < *count; ++i)
+		for (j = cases[i]->test_count - 1; j >= 0; --j)
+			if (!cases[i]->tests[j]->bench_fn)
+				remove_test(cases[i], j);
+
+	remove_empty_cases(count, cases);
 }
 
 static unsigned int
@@ -531,6 +611,10 @@ zuc_initialize(int *argc, char *argv[], bool *help_flagged)
 	int opt_random = 0;
 	int opt_break_on_failure = 0;
 	int opt_junit = 0;
+	int opt_json = 0;
+	int opt_bench = 0;
+	int opt_bench_samples = 0;
+	int opt_bench_time = 0;
 	char *opt_filter = NULL;
 
 	char *help_param = NULL;
@@ -546,7 +630,13 @@ zuc_initialize(int *argc, char *argv[], bool *help_flagged)
 #if ENABLE_JUNIT_XML
 		{ WESTON_OPTION_BOOLEAN, "zuc-output-xml", 0, &opt_junit },
 #endif
+		{ WESTON_OPTION_BOOLEAN, "zuc-output-json", 0, &opt_json },
 		{ WESTON_OPTION_STRING, "zuc-filter", 0, &opt_filter },
+		{ WESTON_OPTION_BOOLEAN, "zuc-bench", 0, &opt_bench },
+		{ WESTON_OPTION_INTEGER, "zuc-bench-samples", 0,
+		  &opt_bench_samples },
+		{ WESTON_OPTION_INTEGER, "zuc-bench-time", 0,
+		  &opt_bench_time },
 	};
 
 	/*
@@ -630,10 +720,14 @@ zuc_initialize(int *argc, char *argv[], bool *help_flagged)
 
 	if (opt_help) {
 		printf("Usage: %s [OPTIONS]\n"
+		       "  --zuc-bench\n"
+		       "  --zuc-bench-samples=N     [default 10]\n"
+		       "  --zuc-bench-time=MS       [per sample, default 20]\n"
 		       "  --zuc-break-on-failure\n"
 		       "  --zuc-filter=FILTER\n"
 		       "  --zuc-list-tests\n"
 		       "  --zuc-nofork\n"
+		       "  --zuc-output-json\n"
 #if ENABLE_JUNIT_XML
 		       "  --zuc-output-xml\n"
 #endif
@@ -653,6 +747,10 @@ zuc_initialize(int *argc, char *argv[], bool *help_flagged)
 		zuc_set_spawn(!opt_nofork);
 		zuc_set_break_on_failure(opt_break_on_failure);
 		zuc_set_output_junit(opt_junit);
+		zuc_set_output_json(opt_json);
+		zuc_set_bench(opt_bench);
+		zuc_set_bench_samples(opt_bench_samples);
+		zuc_set_bench_time(opt_bench_time);
 		rc = EXIT_SUCCESS;
 	}
 
@@ -802,6 +900,17 @@ dispatch_collect_event(struct zuc_context *ctx, char const *file, int line,
 	}
 }
 
+static void
+dispatch_bench_result(struct zuc_context *ctx, struct zuc_test *test)
+{
+	struct zuc_slinked *curr;
+	for (curr = ctx->listeners; curr; curr = curr->next) {
+		struct zuc_event_listener *listener = curr->data;
+		if (listener->bench_result)
+			listener->bench_result(listener->data, test);
+	}
+}
+
 static void
 migrate_deferred_events(struct zuc_test *test, bool transferred)
 {
@@ -1017,13 +1126,165 @@ zuc_list_tests(void)
 	}
 }
 
+uint64_t
+zucimpl_bench_start(struct zuc_bench *bench)
+{
+	bench->started = true;
+	clock_gettime(TARGET_TIMER, &bench->begin);
+
+	return bench->iterations;
+}
+
+bool
+zucimpl_bench_stop(struct zuc_bench *bench)
+{
+	struct timespec end;
+
+	clock_gettime(TARGET_TIMER, &end);
+	bench->elapsed = (end.tv_sec - bench->begin.tv_sec) * NANO_PER_SEC
+		+ (end.tv_nsec - bench->begin.tv_nsec);
+	bench->stopped = true;
+
+	return false;
+}
+
+/**
+ * Runs a benchmark body once with the given number of loop iterations.
+ *
+ * @return the time spent in the loop in nanoseconds, or -1 if the
+ * benchmark failed or was skipped.
+ */
+static int64_t
+run_bench_once(struct zuc_test *test, uint64_t iterations)
+{
+	struct zuc_bench bench;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.iterations = iterations;
+
+	test->bench_fn(&bench);
+
+	if (test_has_failure(test) || test_has_skip(test))
+		return -1;
+
+	if (!bench.started || !bench.stopped) {
+		zucimpl_terminate(__FILE__, __LINE__, true, true,
+				  "Benchmark did not run its ZUC_BENCH_LOOP "
+				  "to completion");
+		return -1;
+	}
+
+	return bench.elapsed;
+}
+
+static int
+compare_double(const void *lhs, const void *rhs)
+{
+	double l = *(const double *)lhs;
+	double r = *(const double *)rhs;
+
+	return (l > r) - (l < r);
+}
+
+static void
+run_bench(struct zuc_test *test)
+{
+	int64_t target = g_ctx.bench_time * NANO_PER_MS;
+	int samples = g_ctx.bench_samples;
+	uint64_t iterations = 1;
+	struct zuc_bench_result *result = NULL;
+	double *per_iteration = NULL;
+	double sum = 0.0;
+	double sq_sum = 0.0;
+	int64_t elapsed;
+	int i;
+
+	if (!g_ctx.bench) {
+		run_bench_once(test, 1);
+		return;
+	}
+
+	/* Scale the iteration count up until a single run takes about the
+	 * target time. These runs also serve as the warm-up. */
+	for (;;) {
+		double scale;
+		uint64_t next;
+
+		elapsed = run_bench_once(test, iterations);
+		if (elapsed < 0)
+			return;
+		if (elapsed >= target || iterations >= MAX_BENCH_ITERATIONS)
+			break;
+
+		/* aim a little past the target, growing at most 100 times */
+		scale = elapsed > 0 ? 1.2 * target / elapsed : 100.0;
+		if (scale > 100.0)
+			scale = 100.0;
+		next = iterations * scale;
+		iterations = next > iterations ? next : iterations + 1;
+	}
+
+	result = zalloc(sizeof(*result));
+	ZUC_ASSERT_NOT_NULL(result);
+	per_iteration = zalloc(samples * sizeof(double));
+	ZUC_ASSERTG_NOT_NULL(per_iteration, out);
+
+	for (i = 0; i < samples; ++i) {
+		elapsed = run_bench_once(test, iterations);
+		if (elapsed < 0)
+			goto out;
+
+		per_iteration[i] = (double)elapsed / iterations;
+		sum += per_iteration[i];
+		sq_sum += per_iteration[i] * per_iteration[i];
+	}
+
+	qsort(per_iteration, samples, sizeof(double), compare_double);
+
+	result->iterations = iterations;
+	result->samples = samples;
+	result->min_ns = per_iteration[0];
+	result->max_ns = per_iteration[samples - 1];
+	result->median_ns = (samples % 2) ? per_iteration[samples / 2] :
+		(per_iteration[samples / 2 - 1] +
+		 per_iteration[samples / 2]) / 2.0;
+	result->mean_ns = sum / samples;
+	if (samples > 1) {
+		double var = (sq_sum - sum * sum / samples) / (samples - 1);
+		result->stddev_ns = var > 0.0 ? sqrt(var) : 0.0;
+	}
+
+	free(test->bench);
+	test->bench = result;
+	result = NULL;
+	dispatch_bench_result(&g_ctx, test);
+
+out:
+	free(per_iteration);
+	free(result);
+}
+
+/**
+ * Calls the function implementing the given test.
+ */
+static void
+invoke_test(struct zuc_test *test, void *test_data)
+{
+	if (test->bench_fn)
+		run_bench(test);
+	else if (test->fn_f)
+		test->fn_f(test_data);
+	else
+		test->fn();
+}
+
 static void
 spawn_test(struct zuc_test *test, void *test_data,
 	   void (*cleanup_fn)(void *data), void *cleanup_data)
 {
 	pid_t pid = -1;
 
-	if (!test || (!test->fn && !test->fn_f))
+	if (!test || (!test->fn && !test->fn_f && !test->bench_fn))
 		return;
 
 	if (pipe2(g_ctx.fds, O_CLOEXEC)) {
@@ -1050,10 +1311,7 @@ spawn_test(struct zuc_test *test, void *test_data,
 		close(g_ctx.fds[0]);
 		g_ctx.fds[0] = -1;
 
-		if (test->fn_f)
-			test->fn_f(test_data);
-		else
-			test->fn();
+		invoke_test(test, test_data);
 
 		if (test_has_failure(test))
 			rc = EXIT_FAILURE;
@@ -1151,10 +1409,7 @@ run_single_test(struct zuc_test *test,const struct zuc_fixture *fxt,
 			spawn_test(test, test_data,
 				   cleanup_fn, cleanup_data);
 		} else {
-			if (test->fn_f)
-				test->fn_f(test_data);
-			else
-				test->fn();
+			invoke_test(test, test_data);
 		}
 	}
 
@@ -1247,6 +1502,8 @@ reset_test_values(struct zuc_case **cases, int case_count)
 			test->failed = 0;
 			test->fatal = 0;
 			test->elapsed = 0;
+			free(test->bench);
+			test->bench = NULL;
 
 			free_events(&test->events);
 			free_events(&test->deferred);
@@ -1318,8 +1575,15 @@ zucimpl_run_tests(void)
 		zuc_add_event_listener(zuc_base_logger_create());
 		if (g_ctx.output_junit)
 			zuc_add_event_listener(zuc_junit_reporter_create());
+		if (g_ctx.output_json)
+			zuc_add_event_listener(zuc_json_reporter_create());
 	}
 
+	/* Options are only parsed after the tests have been registered, so
+	 * benchmark mode is applied here. */
+	if (g_ctx.bench)
+		filter_bench_cases(&g_ctx.case_count, g_ctx.cases);
+
 	if (g_ctx.case_count < 1) {
 		printf("%s:%d: error: Setup error: test tree is empty\n",
 		       __FILE__, __LINE__);
@@ -451,6 +451,39 @@ ZUC_TEST(strings, ne_fail06)
 }
 #endif
 
+ZUC_BENCH(bench_test, loop_runs)
+{
+	int runs = 0;
+
+	ZUC_BENCH_LOOP {
+		runs++;
+		ZUC_BENCH_KEEP(&runs);
+	}
+
+	ZUC_ASSERT_GE(runs, 1);
+}
+
+ZUC_BENCH(bench_test, checks_after_loop)
+{
+	unsigned sum = 0;
+	unsigned i;
+
+	ZUC_BENCH_LOOP {
+		for (i = 0; i < 64; i++)
+			sum += i;
+		ZUC_BENCH_KEEP(&sum);
+	}
+
+	ZUC_ASSERT_EQ(0, sum % 2016);
+}
+
+#ifdef ENABLE_FAIL_TESTS
+ZUC_BENCH(bench_test, loop_missing)
+{
+	/* a benchmark must run its loop, this one does not */
+}
+#endif
+
 ZUC_TEST(base_test, later)
 {
 	/* an additional test for the same case but later in source */